@@ -0,0 +1,201 @@
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "arena.h"
+#include "dberror.h"
+
+/*
+ * Arenas
+ * ---------------------------------------------------------------
+ * An arena was a chain of blocks that allocations were carved from by bumping
+ * an offset. Nothing was freed on its own; resetArena rewound to the first
+ * block in O(1) and kept every block for reuse, so a scan that evaluated the
+ * same expression for every row reached a steady state after the first row
+ * and stopped calling malloc. A request larger than the block size got a
+ * block of its own, linked into the chain like any other.
+ *
+ * Evaluation code did not take an arena argument. It called evalAlloc and
+ * evalFree, which used the arena installed for the calling thread and fell
+ * back to malloc/free otherwise, so callers that never installed one saw the
+ * old behavior.
+ */
+
+#define ARENA_ALIGN 16
+
+typedef struct ArenaBlock {
+    struct ArenaBlock *next;
+    size_t size;
+    size_t used;
+    _Alignas(ARENA_ALIGN) char data[];
+} ArenaBlock;
+
+struct Arena {
+    ArenaBlock *first;
+    ArenaBlock *current;
+    size_t blockSize;
+};
+
+static __thread Arena *evalArena = NULL;
+
+/* --------------------------------------------------------------------------
+   Arena
+   -------------------------------------------------------------------------- */
+
+/*
+ * newBlock
+ * --------
+ * Allocated a block with room for at least size bytes of data.
+ */
+static ArenaBlock *
+newBlock(size_t size)
+{
+    ArenaBlock *block = (ArenaBlock *) malloc(sizeof(ArenaBlock) + size);
+    if (block == NULL)
+        return NULL;
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+/*
+ * createArena
+ * -----------
+ * Created an arena whose blocks held blockSize bytes (ARENA_BLOCK_SIZE when
+ * 0). The first block was allocated up front.
+ */
+RC
+createArena(Arena **arena, size_t blockSize)
+{
+    Arena *a = (Arena *) malloc(sizeof(Arena));
+    if (a == NULL)
+        THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate an arena");
+    a->blockSize = blockSize ? blockSize : ARENA_BLOCK_SIZE;
+    a->first = a->current = newBlock(a->blockSize);
+    if (a->first == NULL)
+    {
+        free(a);
+        THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate an arena block");
+    }
+    *arena = a;
+    return RC_OK;
+}
+
+/*
+ * freeArena
+ * ---------
+ * Released every block and the arena itself. An arena still installed for
+ * evaluation on this thread was uninstalled first.
+ */
+RC
+freeArena(Arena *arena)
+{
+    if (arena == NULL)
+        return RC_OK;
+    if (evalArena == arena)
+        evalArena = NULL;
+    for (ArenaBlock *b = arena->first, *next; b != NULL; b = next)
+    {
+        next = b->next;
+        free(b);
+    }
+    free(arena);
+    return RC_OK;
+}
+
+/*
+ * arenaAlloc
+ * ----------
+ * Returned size bytes aligned to ARENA_ALIGN. The request was served from the
+ * current block, then from the blocks kept by an earlier reset, and only then
+ * from a new block. NULL meant malloc failed.
+ */
+void *
+arenaAlloc(Arena *arena, size_t size)
+{
+    ArenaBlock *b = arena->current;
+    size = (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+
+    while (b->used + size > b->size)
+    {
+        if (b->next == NULL)
+        {
+            ArenaBlock *block = newBlock(size > arena->blockSize ? size : arena->blockSize);
+            if (block == NULL)
+                return NULL;
+            b->next = block;
+        }
+        b = b->next;
+        b->used = 0;
+    }
+    arena->current = b;
+    b->used += size;
+    return b->data + b->used - size;
+}
+
+/*
+ * resetArena
+ * ----------
+ * Released everything allocated since the last reset. Only the first block
+ * was touched; later blocks were rewound when arenaAlloc moved into them.
+ */
+void
+resetArena(Arena *arena)
+{
+    arena->current = arena->first;
+    arena->first->used = 0;
+}
+
+/*
+ * arenaOwns
+ * ---------
+ * Told whether ptr pointed into one of the arena's blocks.
+ */
+bool
+arenaOwns(Arena *arena, void *ptr)
+{
+    uintptr_t p = (uintptr_t) ptr;
+    for (ArenaBlock *b = arena->first; b != NULL; b = b->next)
+        if (p >= (uintptr_t) b->data && p < (uintptr_t) (b->data + b->size))
+            return true;
+    return false;
+}
+
+/* --------------------------------------------------------------------------
+   Evaluation allocator
+   -------------------------------------------------------------------------- */
+
+/*
+ * setEvalArena
+ * ------------
+ * Installed arena (or NULL for malloc) for this thread's evaluation
+ * temporaries and returned the one it replaced, so calls could nest.
+ */
+Arena *
+setEvalArena(Arena *arena)
+{
+    Arena *prev = evalArena;
+    evalArena = arena;
+    return prev;
+}
+
+/*
+ * evalAlloc / evalFree
+ * --------------------
+ * Allocated from the installed arena, or with malloc when there was none.
+ * evalFree ignored memory of the installed arena, which went away with the
+ * next reset, and passed anything else to free.
+ */
+void *
+evalAlloc(size_t size)
+{
+    return evalArena ? arenaAlloc(evalArena, size) : malloc(size);
+}
+
+void
+evalFree(void *ptr)
+{
+    if (ptr == NULL || (evalArena && arenaOwns(evalArena, ptr)))
+        return;
+    free(ptr);
+}
@@ -0,0 +1,29 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+#include "dberror.h"
+#include "dt.h"
+
+// default size of one arena block; larger requests get a block of their own
+#define ARENA_BLOCK_SIZE 4096
+
+// a bump allocator for short-lived temporaries; everything allocated from it
+// is released at once by resetArena or freeArena
+typedef struct Arena Arena;
+
+extern RC createArena (Arena **arena, size_t blockSize);
+extern RC freeArena (Arena *arena);
+extern void *arenaAlloc (Arena *arena, size_t size);
+extern void resetArena (Arena *arena);
+extern bool arenaOwns (Arena *arena, void *ptr);
+
+// evaluation temporaries (result values, attribute copies, string results)
+// come from the arena installed for the calling thread, or from malloc when
+// none is; evalFree leaves arena memory alone and frees everything else
+extern Arena *setEvalArena (Arena *arena);
+extern void *evalAlloc (size_t size);
+extern void evalFree (void *ptr);
+
+#endif // ARENA_H
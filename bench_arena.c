@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "arena.h"
+#include "dberror.h"
+#include "expr.h"
+#include "expr_parser.h"
+#include "record_mgr.h"
+#include "tables.h"
+
+/*
+ * bench_arena
+ * ---------------------------------------------------------------
+ * Evaluated a condition the predicate compiler rejected (a CAST to STRING
+ * compared with a string, OR'ed with a string comparison) over in-memory
+ * records with evalExpr, first with malloc'd temporaries and then with a
+ * bump arena installed and reset between rows, the way a scan's fallback
+ * path ran. The program was linked with --wrap=malloc/calloc/realloc so
+ * every heap allocation was counted; it printed allocations and time per
+ * row for both runs and failed unless the arena run allocated nothing per
+ * row and matched the same rows.
+ *
+ *   usage: bench_arena [numRows]
+ */
+
+#define DEFAULT_ROWS 1000000
+
+static long numAllocs = 0;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *
+__wrap_malloc(size_t size)
+{
+    numAllocs++;
+    return __real_malloc(size);
+}
+
+void *
+__wrap_calloc(size_t n, size_t size)
+{
+    numAllocs++;
+    return __real_calloc(n, size);
+}
+
+void *
+__wrap_realloc(void *ptr, size_t size)
+{
+    numAllocs++;
+    return __real_realloc(ptr, size);
+}
+
+static double
+nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static Schema *
+benchSchema(void)
+{
+    char *names[] = { "a", "b", "c" };
+    DataType dt[] = { DT_INT, DT_STRING, DT_INT };
+    int sizes[] = { 0, 16, 0 };
+    char **cpNames = (char **) malloc(sizeof(char*) * 3);
+    DataType *cpDt = (DataType *) malloc(sizeof(DataType) * 3);
+    int *cpSizes = (int *) malloc(sizeof(int) * 3);
+    int *cpKeys = (int *) malloc(sizeof(int));
+
+    for (int i = 0; i < 3; i++)
+        cpNames[i] = strdup(names[i]);
+    memcpy(cpDt, dt, sizeof(dt));
+    memcpy(cpSizes, sizes, sizeof(sizes));
+    cpKeys[0] = 0;
+    return createSchema(3, cpNames, cpDt, cpSizes, 1, cpKeys);
+}
+
+int
+main(int argc, char **argv)
+{
+    int numRows = (argc > 1) ? atoi(argv[1]) : DEFAULT_ROWS;
+    Schema *schema = benchSchema();
+    int recSize = getRecordSize(schema);
+    char *rows = (char *) malloc((size_t) numRows * recSize);
+    Record rec;
+
+    srand(42);
+    for (int i = 0; i < numRows; i++)
+    {
+        Value *v;
+        char name[20];
+        rec.data = rows + (size_t) i * recSize;
+
+        MAKE_VALUE(v, DT_INT, i);
+        setAttr(&rec, schema, 0, v);
+        freeVal(v);
+
+        sprintf(name, "scustomer-%05d", rand() % 100000);
+        v = stringToValue(name);
+        setAttr(&rec, schema, 1, v);
+        freeVal(v);
+
+        MAKE_VALUE(v, DT_INT, rand() % 100);
+        setAttr(&rec, schema, 2, v);
+        freeVal(v);
+    }
+
+    Expr *cond;
+    if (parseCondition("CAST(c AS STRING) = '7' OR b = 'customer-00042'", schema, &cond) != RC_OK)
+    {
+        printf("failed to parse the benchmark condition\n");
+        return 1;
+    }
+
+    // malloc'd temporaries, freed value by value
+    int mallocHits = 0;
+    long allocs0 = numAllocs;
+    double t0 = nowSeconds();
+    for (int i = 0; i < numRows; i++)
+    {
+        Value *res;
+        rec.data = rows + (size_t) i * recSize;
+        evalExpr(&rec, schema, cond, &res);
+        mallocHits += res->v.boolV;
+        freeVal(res);
+    }
+    double t1 = nowSeconds();
+    long mallocAllocs = numAllocs - allocs0;
+
+    // the same rows with an arena reset between them
+    Arena *arena;
+    int arenaHits = 0;
+    long allocs1 = numAllocs;
+    createArena(&arena, 0);
+    double t2 = nowSeconds();
+    for (int i = 0; i < numRows; i++)
+    {
+        Value *res;
+        rec.data = rows + (size_t) i * recSize;
+        resetArena(arena);
+        Arena *prev = setEvalArena(arena);
+        evalExpr(&rec, schema, cond, &res);
+        arenaHits += res->v.boolV;
+        freeVal(res);
+        setEvalArena(prev);
+    }
+    double t3 = nowSeconds();
+    long arenaAllocs = numAllocs - allocs1;
+
+    printf("rows:    %d (%d matched)\n", numRows, mallocHits);
+    printf("malloc:  %.2f allocations/row, %.2f ns/row\n", (double) mallocAllocs / numRows,
+           (t1 - t0) * 1e9 / numRows);
+    printf("arena:   %.2f allocations/row, %.2f ns/row (%ld allocations in total, %d matched)\n",
+           (double) arenaAllocs / numRows, (t3 - t2) * 1e9 / numRows, arenaAllocs, arenaHits);
+
+    freeArena(arena);
+    freeExpr(cond);
+    freeSchema(schema);
+    free(rows);
+    // only the arena itself and its first block were allocated
+    return (mallocHits == arenaHits && arenaAllocs <= 2) ? 0 : 1;
+}
@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dberror.h"
+#include "expr.h"
+#include "expr_compile.h"
+#include "pred_simd.h"
+#include "record_mgr.h"
+#include "tables.h"
+#include "value_set.h"
+
+/*
+ * bench_predicates
+ * ---------------------------------------------------------------
+ * Evaluated a badly ordered conjunction over skewed in-memory records, once
+ * in the written order (evalPredicate) and once with selectivity-driven
+ * reordering (evalPredicateAdaptive), and printed the time per row. It then
+ * ran the same rows through the selection-bitmap path (evalPredicateBatch)
+ * and filtered a plain INT column with selCompareInt to compare its
+ * throughput against memory bandwidth. Finally it compared a 1,000-value IN
+ * list on c with the equivalent chain of ORs.
+ *
+ *   usage: bench_predicates [numRows]
+ */
+
+#define DEFAULT_ROWS 2000000
+#define COLUMN_VALUES (16 * 1024 * 1024)
+#define IN_VALUES 1000
+
+static double
+nowSeconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static Schema *
+benchSchema(void)
+{
+    char *names[] = { "a", "b", "c" };
+    DataType dt[] = { DT_INT, DT_STRING, DT_INT };
+    int sizes[] = { 0, 16, 0 };
+    char **cpNames = (char **) malloc(sizeof(char*) * 3);
+    DataType *cpDt = (DataType *) malloc(sizeof(DataType) * 3);
+    int *cpSizes = (int *) malloc(sizeof(int) * 3);
+    int *cpKeys = (int *) malloc(sizeof(int));
+
+    for (int i = 0; i < 3; i++)
+        cpNames[i] = strdup(names[i]);
+    memcpy(cpDt, dt, sizeof(dt));
+    memcpy(cpSizes, sizes, sizeof(sizes));
+    cpKeys[0] = 0;
+    return createSchema(3, cpNames, cpDt, cpSizes, 1, cpKeys);
+}
+
+/*
+ * skewedValue
+ * -----------
+ * Drew a value in [0, 1000) where small values were far more frequent:
+ * roughly half of all rows had c = 0 and c = 7 appeared in well under 1%.
+ */
+static int
+skewedValue(void)
+{
+    double u = (double) rand() / RAND_MAX;
+    return (int) (1000 * u * u * u * u);
+}
+
+int
+main(int argc, char **argv)
+{
+    int numRows = (argc > 1) ? atoi(argv[1]) : DEFAULT_ROWS;
+    Schema *schema = benchSchema();
+    int recSize = getRecordSize(schema);
+    char *rows = (char *) malloc((size_t) numRows * recSize);
+    Record rec;
+
+    srand(42);
+    for (int i = 0; i < numRows; i++)
+    {
+        Value *v;
+        char name[20];
+        rec.data = rows + (size_t) i * recSize;
+
+        MAKE_VALUE(v, DT_INT, i);
+        setAttr(&rec, schema, 0, v);
+        freeVal(v);
+
+        sprintf(name, "scustomer-%05d", rand() % 100000);
+        v = stringToValue(name);
+        setAttr(&rec, schema, 1, v);
+        freeVal(v);
+
+        MAKE_VALUE(v, DT_INT, skewedValue());
+        setAttr(&rec, schema, 2, v);
+        freeVal(v);
+    }
+
+    // b < 'customer-99999' AND NOT (a < 0) AND c = 7, most selective term last
+    Expr *terms[3], *attr, *cons, *cmp, *cond;
+    MAKE_ATTRREF(attr, 1);
+    MAKE_CONS(cons, stringToValue("scustomer-99999"));
+    MAKE_BINOP_EXPR(terms[0], attr, cons, OP_COMP_SMALLER);
+    MAKE_ATTRREF(attr, 0);
+    MAKE_CONS(cons, stringToValue("i0"));
+    MAKE_BINOP_EXPR(cmp, attr, cons, OP_COMP_SMALLER);
+    MAKE_UNOP_EXPR(terms[1], cmp, OP_BOOL_NOT);
+    MAKE_ATTRREF(attr, 2);
+    MAKE_CONS(cons, stringToValue("i7"));
+    MAKE_BINOP_EXPR(terms[2], attr, cons, OP_COMP_EQUAL);
+    MAKE_NARY_EXPR(cond, terms, 3, OP_BOOL_AND);
+
+    PredProgram *prog;
+    PredRuntime *rt;
+    if (compilePredicate(cond, schema, &prog) != RC_OK || createPredRuntime(prog, &rt) != RC_OK)
+    {
+        printf("failed to compile the benchmark condition\n");
+        return 1;
+    }
+
+    int staticHits = 0, adaptiveHits = 0;
+    bool pass;
+
+    double t0 = nowSeconds();
+    for (int i = 0; i < numRows; i++)
+    {
+        evalPredicate(prog, rows + (size_t) i * recSize, &pass);
+        staticHits += pass;
+    }
+    double t1 = nowSeconds();
+    for (int i = 0; i < numRows; i++)
+    {
+        evalPredicateAdaptive(prog, rt, rows + (size_t) i * recSize, &pass);
+        adaptiveHits += pass;
+    }
+    double t2 = nowSeconds();
+
+    uint64_t *sel = (uint64_t *) malloc(SEL_WORDS(numRows) * sizeof(uint64_t));
+    evalPredicateBatch(prog, rows, recSize, numRows, sel);
+    double t3 = nowSeconds();
+    int batchHits = selCount(sel, numRows);
+
+    // a 64 MB INT column filtered with c < 7, well beyond the caches
+    int *column = (int *) malloc(sizeof(int) * COLUMN_VALUES);
+    uint64_t *colSel = (uint64_t *) malloc(SEL_WORDS(COLUMN_VALUES) * sizeof(uint64_t));
+    for (int i = 0; i < COLUMN_VALUES; i++)
+        column[i] = skewedValue();
+    memset(colSel, 0, SEL_WORDS(COLUMN_VALUES) * sizeof(uint64_t));
+    double best = 1e9;
+    for (int run = 0; run < 5; run++)
+    {
+        double start = nowSeconds();
+        selCompareInt((char *) column, sizeof(int), COLUMN_VALUES, SEL_LT, 7, colSel);
+        if (nowSeconds() - start < best)
+            best = nowSeconds() - start;
+    }
+    size_t colBytes = sizeof(int) * (size_t) COLUMN_VALUES;
+    double memcpyStart = nowSeconds();
+    memcpy(rows, column, (colBytes < (size_t) numRows * recSize) ? colBytes : (size_t) numRows * recSize);
+    double memcpyEnd = nowSeconds();
+    size_t copied = (colBytes < (size_t) numRows * recSize) ? colBytes : (size_t) numRows * recSize;
+
+    // c IN (0, 2, ..., 1998) as a value set and as 1,000 ORed equalities
+    Value *inVals[IN_VALUES];
+    Expr *eqs[IN_VALUES], *inCond, *orCond;
+    ValueSet *set;
+    for (int i = 0; i < IN_VALUES; i++)
+    {
+        MAKE_VALUE(inVals[i], DT_INT, 2 * i);
+        MAKE_ATTRREF(attr, 2);
+        MAKE_CONS(cons, inVals[i]);
+        MAKE_BINOP_EXPR(eqs[i], attr, cons, OP_COMP_EQUAL);
+    }
+    createValueSet(DT_INT, inVals, IN_VALUES, &set);
+    MAKE_NARY_EXPR(orCond, eqs, IN_VALUES, OP_BOOL_OR);
+    MAKE_ATTRREF(attr, 2);
+    MAKE_VALUESET(cons, set);
+    MAKE_BINOP_EXPR(inCond, attr, cons, OP_COMP_IN);
+
+    PredProgram *inProg;
+    compilePredicate(inCond, schema, &inProg);
+    int orRows = numRows / 10, inHits = 0, orHits = 0;
+    double t6 = nowSeconds();
+    for (int i = 0; i < numRows; i++)
+    {
+        evalPredicate(inProg, rows + (size_t) i * recSize, &pass);
+        inHits += pass;
+    }
+    double t7 = nowSeconds();
+    for (int i = 0; i < orRows; i++)
+    {
+        Value *res;
+        rec.data = rows + (size_t) i * recSize;
+        evalExpr(&rec, schema, orCond, &res);
+        orHits += res->v.boolV;
+        freeVal(res);
+    }
+    double t8 = nowSeconds();
+
+    int order[PRED_MAX_TERMS];
+    int n = getPredTermOrder(rt, order);
+
+    printf("rows:            %d (%d matched, %.3f%%)\n", numRows, staticHits, 100.0 * staticHits / numRows);
+    printf("written order:   %.2f ns/row\n", (t1 - t0) * 1e9 / numRows);
+    printf("adaptive order:  %.2f ns/row (%d matched)\n", (t2 - t1) * 1e9 / numRows, adaptiveHits);
+    printf("learned order:  ");
+    for (int i = 0; i < n; i++)
+        printf(" %d", order[i]);
+    printf("\n");
+    printf("selection bitmap: %.2f ns/row (%d matched, %s)\n", (t3 - t2) * 1e9 / numRows, batchHits,
+           !predicateIsVectorized(prog) ? "row-wise fallback" : selUsesAvx2() ? "AVX2" : "scalar");
+    printf("INT column scan: %.2f GB/s (%d of %d values < 7)\n", colBytes / best / 1e9,
+           selCount(colSel, COLUMN_VALUES), COLUMN_VALUES);
+    printf("memcpy:          %.2f GB/s (read + write, for reference)\n", 2.0 * copied / (memcpyEnd - memcpyStart) / 1e9);
+    printf("IN (%d values):  %.2f ns/row (%d matched)\n", IN_VALUES, (t7 - t6) * 1e9 / numRows, inHits);
+    printf("%d ORs:        %.2f ns/row (%d matched in the first %d rows)\n", IN_VALUES, (t8 - t7) * 1e9 / orRows,
+           orHits, orRows);
+
+    freePredicate(inProg);
+    freeExpr(inCond);
+    freeExpr(orCond);
+
+    free(colSel);
+    free(column);
+    free(sel);
+    freePredRuntime(rt);
+    freePredicate(prog);
+    freeExpr(cond);
+    freeSchema(schema);
+    free(rows);
+    return (staticHits == adaptiveHits && staticHits == batchHits) ? 0 : 1;
+}
@@ -0,0 +1,336 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "buffer_mgr.h"
+#include "dberror.h"
+#include "expr.h"
+#include "expr_parser.h"
+#include "record_mgr.h"
+#include "storage_mgr.h"
+#include "tables.h"
+
+/*
+ * bench_rm
+ * ---------------------------------------------------------------
+ * Timed every record operation of the record manager one call at a time:
+ * insertRecord, getRecord and updateRecord at random RIDs, an unfiltered
+ * and a filtered scan (10% of the rows matched), and deleteRecord in random
+ * order. It repeated them for each record size, buffer pool size and
+ * replacement strategy, then timed pinPage on a page that stayed in the
+ * pool (a hit) and on pages cycled through a smaller pool (a miss).
+ *
+ * The results went to stdout as one JSON document (the messages the
+ * storage manager printed were dropped): for each operation and
+ * configuration the operations per second and the latency percentiles in
+ * nanoseconds. "make bench" wrote it to bench_output.txt.
+ *
+ *   usage: bench_rm [numRecords]
+ */
+
+#define DEFAULT_RECORDS 20000
+#define PIN_OPS 200000
+#define PIN_FILE_PAGES 256
+#define TABLE_NAME "bench_table"
+#define PAGE_FILE_NAME "bench_pages"
+
+// bytes of the string attribute, setting the record size (8 more)
+static const int stringLengths[] = { 8, 92, 992 };
+static const int poolSizes[] = { 3, 64 };
+static const ReplacementStrategy strategies[] = { RS_FIFO, RS_LRU, RS_CLOCK };
+static const char *strategyNames[] = { "FIFO", "LRU", "CLOCK", "LFU", "LRU_K" };
+
+#define COUNT(_a) ((int) (sizeof(_a) / sizeof((_a)[0])))
+
+static bool firstResult = true;
+// stdout as it was at start; the managers' progress messages went to /dev/null
+static FILE *json;
+
+static uint64_t
+nowNanos(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static int
+compareNanos(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return (x > y) - (x < y);
+}
+
+static void
+check(RC rc, const char *what)
+{
+    if (rc != RC_OK)
+    {
+        fprintf(stderr, "bench_rm: %s failed with RC %d\n", what, rc);
+        exit(1);
+    }
+}
+
+/*
+ * report
+ * ------
+ * Sorted the latencies of n operations and printed one result object.
+ */
+static void
+report(const char *op, int recordSize, int poolPages, ReplacementStrategy strategy,
+       uint64_t *latency, int n, uint64_t totalNanos)
+{
+    qsort(latency, n, sizeof(uint64_t), compareNanos);
+#define PCT(_p) (n > 0 ? latency[(size_t) ((_p) * (n - 1))] : 0)
+    fprintf(json, "%s    {\"op\": \"%s\", \"recordSize\": %d, \"poolPages\": %d, \"strategy\": \"%s\", "
+           "\"ops\": %d, \"seconds\": %.6f, \"opsPerSec\": %.1f, "
+           "\"latencyNs\": {\"p50\": %llu, \"p90\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}}",
+           firstResult ? "" : ",\n", op, recordSize, poolPages, strategyNames[strategy],
+           n, totalNanos / 1e9, totalNanos > 0 ? n / (totalNanos / 1e9) : 0.0,
+           (unsigned long long) PCT(0.50), (unsigned long long) PCT(0.90),
+           (unsigned long long) PCT(0.99), (unsigned long long) PCT(0.999),
+           (unsigned long long) (n > 0 ? latency[n - 1] : 0));
+#undef PCT
+    firstResult = false;
+}
+
+static Schema *
+benchSchema(int stringLength)
+{
+    char *names[] = { "a", "b", "c" };
+    DataType dt[] = { DT_INT, DT_STRING, DT_INT };
+    int sizes[] = { 0, stringLength, 0 };
+    char **cpNames = (char **) malloc(sizeof(char*) * 3);
+    DataType *cpDt = (DataType *) malloc(sizeof(DataType) * 3);
+    int *cpSizes = (int *) malloc(sizeof(int) * 3);
+    int *cpKeys = (int *) malloc(sizeof(int));
+
+    for (int i = 0; i < 3; i++)
+        cpNames[i] = strdup(names[i]);
+    memcpy(cpDt, dt, sizeof(dt));
+    memcpy(cpSizes, sizes, sizeof(sizes));
+    cpKeys[0] = 0;
+    return createSchema(3, cpNames, cpDt, cpSizes, 1, cpKeys);
+}
+
+static void
+fillRecord(Record *r, int recordSize, int a, int c)
+{
+    memset(r->data, 0, recordSize);
+    memcpy(r->data, &a, sizeof(int));
+    memset(r->data + sizeof(int), 'a' + a % 26, 7);
+    memcpy(r->data + recordSize - sizeof(int), &c, sizeof(int));
+}
+
+static void
+shuffle(int *order, int n)
+{
+    for (int i = n - 1; i > 0; i--)
+    {
+        int j = rand() % (i + 1);
+        int t = order[i];
+        order[i] = order[j];
+        order[j] = t;
+    }
+}
+
+/*
+ * timeScan
+ * --------
+ * Timed each next() of a scan over the table, the last (failing) call
+ * included.
+ */
+static void
+timeScan(const char *op, RM_TableData *table, Expr *cond, int recordSize, int poolPages,
+         ReplacementStrategy strategy, uint64_t *latency, int numRecords)
+{
+    RM_ScanHandle scan;
+    Record *r;
+    int n = 0;
+    RC rc;
+
+    check(createRecord(&r, table->schema), "createRecord");
+    uint64_t start = nowNanos();
+    check(startScan(table, &scan, cond), "startScan");
+    do
+    {
+        uint64_t t = nowNanos();
+        rc = next(&scan, r);
+        if (n <= numRecords)
+            latency[n++] = nowNanos() - t;
+    } while (rc == RC_OK);
+    closeScan(&scan);
+    uint64_t total = nowNanos() - start;
+    if (rc != RC_RM_NO_MORE_TUPLES)
+        check(rc, "next");
+    report(op, recordSize, poolPages, strategy, latency, n, total);
+    freeRecord(r);
+}
+
+/*
+ * benchRecords
+ * ------------
+ * Ran the record operations on a new table of numRecords records with one
+ * record size and pool configuration.
+ */
+static void
+benchRecords(int stringLength, int poolPages, ReplacementStrategy strategy, int numRecords)
+{
+    Schema *schema = benchSchema(stringLength);
+    int recordSize = getRecordSize(schema);
+    uint64_t *latency = (uint64_t *) malloc(sizeof(uint64_t) * (numRecords + 1));
+    RID *rids = (RID *) malloc(sizeof(RID) * numRecords);
+    int *order = (int *) malloc(sizeof(int) * numRecords);
+    RM_TableData table;
+    Record *r;
+    Expr *cond;
+    uint64_t start, t;
+
+    check(setTablePoolOptions(poolPages, strategy), "setTablePoolOptions");
+    check(createTable(TABLE_NAME, schema), "createTable");
+    check(openTable(&table, TABLE_NAME), "openTable");
+    check(createRecord(&r, schema), "createRecord");
+
+    start = nowNanos();
+    for (int i = 0; i < numRecords; i++)
+    {
+        fillRecord(r, recordSize, i, i % 100);
+        t = nowNanos();
+        check(insertRecord(&table, r), "insertRecord");
+        latency[i] = nowNanos() - t;
+        rids[i] = r->id;
+    }
+    report("insertRecord", recordSize, poolPages, strategy, latency, numRecords, nowNanos() - start);
+
+    start = nowNanos();
+    for (int i = 0; i < numRecords; i++)
+    {
+        RID id = rids[rand() % numRecords];
+        t = nowNanos();
+        check(getRecord(&table, id, r), "getRecord");
+        latency[i] = nowNanos() - t;
+    }
+    report("getRecord", recordSize, poolPages, strategy, latency, numRecords, nowNanos() - start);
+
+    start = nowNanos();
+    for (int i = 0; i < numRecords; i++)
+    {
+        int k = rand() % numRecords;
+        fillRecord(r, recordSize, k, k % 100);
+        r->id = rids[k];
+        t = nowNanos();
+        check(updateRecord(&table, r), "updateRecord");
+        latency[i] = nowNanos() - t;
+    }
+    report("updateRecord", recordSize, poolPages, strategy, latency, numRecords, nowNanos() - start);
+
+    timeScan("scan", &table, NULL, recordSize, poolPages, strategy, latency, numRecords);
+    check(parseCondition("c < 10", schema, &cond), "parseCondition");
+    timeScan("scanFiltered", &table, cond, recordSize, poolPages, strategy, latency, numRecords);
+    freeExpr(cond);
+
+    for (int i = 0; i < numRecords; i++)
+        order[i] = i;
+    shuffle(order, numRecords);
+    start = nowNanos();
+    for (int i = 0; i < numRecords; i++)
+    {
+        t = nowNanos();
+        check(deleteRecord(&table, rids[order[i]]), "deleteRecord");
+        latency[i] = nowNanos() - t;
+    }
+    report("deleteRecord", recordSize, poolPages, strategy, latency, numRecords, nowNanos() - start);
+
+    freeRecord(r);
+    check(closeTable(&table), "closeTable");
+    check(deleteTable(TABLE_NAME), "deleteTable");
+    freeSchema(schema);
+    free(latency);
+    free(rids);
+    free(order);
+}
+
+/*
+ * benchPins
+ * ---------
+ * Timed pin and unpin of one page that stayed in the pool, then of pages
+ * taken in turn from a file larger than the pool, so each pin read a page.
+ */
+static void
+benchPins(int poolPages, ReplacementStrategy strategy)
+{
+    uint64_t *latency = (uint64_t *) malloc(sizeof(uint64_t) * PIN_OPS);
+    BM_BufferPool pool;
+    BM_PageHandle page;
+    uint64_t start, t;
+
+    check(initBufferPool(&pool, PAGE_FILE_NAME, poolPages, strategy, NULL), "initBufferPool");
+    check(pinPage(&pool, &page, 0), "pinPage");
+    check(unpinPage(&pool, &page), "unpinPage");
+    start = nowNanos();
+    for (int i = 0; i < PIN_OPS; i++)
+    {
+        t = nowNanos();
+        check(pinPage(&pool, &page, 0), "pinPage");
+        latency[i] = nowNanos() - t;
+        check(unpinPage(&pool, &page), "unpinPage");
+    }
+    report("pinPageHit", PAGE_SIZE, poolPages, strategy, latency, PIN_OPS, nowNanos() - start);
+
+    // misses read from disk, so fewer of them were timed
+    int misses = PIN_OPS / 10;
+    start = nowNanos();
+    for (int i = 0; i < misses; i++)
+    {
+        t = nowNanos();
+        check(pinPage(&pool, &page, 1 + i % (PIN_FILE_PAGES - 1)), "pinPage");
+        latency[i] = nowNanos() - t;
+        check(unpinPage(&pool, &page), "unpinPage");
+    }
+    report("pinPageMiss", PAGE_SIZE, poolPages, strategy, latency, misses, nowNanos() - start);
+
+    check(shutdownBufferPool(&pool), "shutdownBufferPool");
+    free(latency);
+}
+
+int
+main(int argc, char **argv)
+{
+    int numRecords = (argc > 1) ? atoi(argv[1]) : DEFAULT_RECORDS;
+    SM_FileHandle fh;
+
+    if (numRecords < 1)
+        numRecords = DEFAULT_RECORDS;
+    json = fdopen(dup(STDOUT_FILENO), "w");
+    if (json == NULL || freopen("/dev/null", "w", stdout) == NULL)
+    {
+        fprintf(stderr, "bench_rm: cannot redirect stdout\n");
+        return 1;
+    }
+    srand(42);
+    check(initRecordManager(NULL), "initRecordManager");
+
+    fprintf(json, "{\n  \"benchmark\": \"bench_rm\",\n  \"records\": %d,\n  \"results\": [\n", numRecords);
+    for (int s = 0; s < COUNT(stringLengths); s++)
+        for (int p = 0; p < COUNT(poolSizes); p++)
+            for (int k = 0; k < COUNT(strategies); k++)
+                benchRecords(stringLengths[s], poolSizes[p], strategies[k], numRecords);
+
+    check(createPageFile(PAGE_FILE_NAME), "createPageFile");
+    check(openPageFile(PAGE_FILE_NAME, &fh), "openPageFile");
+    check(ensureCapacity(PIN_FILE_PAGES, &fh), "ensureCapacity");
+    check(closePageFile(&fh), "closePageFile");
+    for (int p = 0; p < COUNT(poolSizes); p++)
+        for (int k = 0; k < COUNT(strategies); k++)
+            benchPins(poolSizes[p], strategies[k]);
+    check(destroyPageFile(PAGE_FILE_NAME), "destroyPageFile");
+    fprintf(json, "\n  ]\n}\n");
+    fclose(json);
+
+    setTablePoolOptions(RM_DEFAULT_POOL_PAGES, RM_DEFAULT_POOL_STRATEGY);
+    check(shutdownRecordManager(), "shutdownRecordManager");
+    return 0;
+}
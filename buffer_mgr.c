@@ -3,9 +3,12 @@
 #include "dberror.h"
 #include "dt.h"
 
+#include <errno.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 /*
  * Data Structures
@@ -17,6 +20,16 @@
  *                 and a usage counter for LRU or CLOCK.
  *   2. BM_MgmtData: Managed the array of PageFrame objects and also tracked
  *                   read/write IO counts and a clock pointer if needed.
+ *
+ * Threads could share a pool: every call that read or changed the frames
+ * held the pool's mutex for its duration (reads and writes of the page file
+ * included), and a pinned frame was never reused, so a page handle stayed
+ * valid until its page was unpinned. Guarding the bytes of a pinned page
+ * was up to the callers.
+ *
+ * A pool could be grown and shrunk while in use: new frames started empty,
+ * and a shrink dropped unpinned frames (writing them first if dirty), or,
+ * while too few were unpinned, the next ones to be unpinned.
  */
 
 /* This struct had represented one page frame in the buffer pool. */
@@ -37,6 +50,10 @@ typedef struct BM_MgmtData
     int readIO;         // This counted how many reads were performed
     int writeIO;        // This counted how many writes were performed
     int clockPointer;   // If using CLOCK, this was the pointer
+    int capacity;       // This had been the number of PageFrame structures allocated
+    int excess;         // This had been how many frames were to be dropped once unpinned
+    pthread_mutex_t lock;      // This had been held while a call used the frames
+    pthread_cond_t unpinned;   // This had been signalled when a frame's fixCount reached 0
 } BM_MgmtData;
 
 /*
@@ -52,6 +69,8 @@ static int findPageFrame(BM_MgmtData *mgmt, int numPages, PageNumber pageNum);
 static int findFreeFrame(BM_MgmtData *mgmt, int numPages);
 static int findVictimFrame(BM_BufferPool *bm, BM_MgmtData *mgmt);
 static RC writeDirtyPageToDisk(BM_BufferPool *bm, PageFrame *pf);
+static RC flushFrames(BM_BufferPool *bm, BM_MgmtData *mgmt);
+static RC dropFrames(BM_BufferPool *bm, BM_MgmtData *mgmt);
 
 /* 
  * initBufferPool
@@ -87,11 +106,17 @@ RC initBufferPool(BM_BufferPool *const bm,
     mgmt->readIO       = 0;
     mgmt->writeIO      = 0;
     mgmt->clockPointer = 0;
+    mgmt->capacity     = numPages;
+    mgmt->excess       = 0;
+    pthread_mutex_init(&mgmt->lock, NULL);
+    pthread_cond_init(&mgmt->unpinned, NULL);
 
     // Allocated and initialized an array of PageFrame
     RC rc = initPageFrameArray(mgmt, numPages);
     if (rc != RC_OK)
     {
+        pthread_mutex_destroy(&mgmt->lock);
+        pthread_cond_destroy(&mgmt->unpinned);
         free(mgmt);
         return rc;
     }
@@ -117,16 +142,26 @@ RC shutdownBufferPool(BM_BufferPool *const bm)
     BM_MgmtData *mgmt = (BM_MgmtData*) bm->mgmtData;
 
     // Flushed all dirty pages
-    RC rc = forceFlushPool(bm);
+    pthread_mutex_lock(&mgmt->lock);
+    RC rc = flushFrames(bm, mgmt);
     if (rc != RC_OK)
+    {
+        pthread_mutex_unlock(&mgmt->lock);
         return rc;
+    }
 
     // Ensured no pinned pages remained
     for (int i=0; i<bm->numPages; i++)
     {
         if (mgmt->frames[i].fixCount > 0)
+        {
+            pthread_mutex_unlock(&mgmt->lock);
             return RC_ERROR; // or a specialized code if pinned pages are not allowed
+        }
     }
+    pthread_mutex_unlock(&mgmt->lock);
+    pthread_mutex_destroy(&mgmt->lock);
+    pthread_cond_destroy(&mgmt->unpinned);
 
     // Freed each page's data
     for (int i=0; i<bm->numPages; i++)
@@ -155,23 +190,74 @@ RC forceFlushPool(BM_BufferPool *const bm)
         return RC_ERROR;
 
     BM_MgmtData *mgmt = (BM_MgmtData*) bm->mgmtData;
+    pthread_mutex_lock(&mgmt->lock);
+    RC rc = flushFrames(bm, mgmt);
+    pthread_mutex_unlock(&mgmt->lock);
+    return rc;
+}
 
-    // Checked each frame
-    for (int i=0; i<bm->numPages; i++)
+/*
+ * growBufferPool / shrinkBufferPool
+ * ---------------------------------
+ * Added numPages empty frames to the pool, or took numPages frames away. A
+ * grow first kept frames an earlier shrink had not dropped yet, and woke the
+ * pins waiting for a frame. A shrink dropped unpinned frames, the least used
+ * first, and left the rest to unpinPage; it never left the pool without a
+ * frame.
+ */
+RC growBufferPool(BM_BufferPool *const bm, const int numPages)
+{
+    if (!bm || !bm->mgmtData || numPages < 0)
+        return RC_ERROR;
+
+    BM_MgmtData *mgmt = (BM_MgmtData*) bm->mgmtData;
+    pthread_mutex_lock(&mgmt->lock);
+    int kept  = (mgmt->excess < numPages) ? mgmt->excess : numPages;
+    int total = bm->numPages + numPages - kept;
+    if (total > mgmt->capacity)
     {
-        PageFrame *pf = &mgmt->frames[i];
-        // If the page was dirty and not pinned
-        if (pf->dirty && pf->fixCount == 0)
+        int capacity = (2 * mgmt->capacity > total) ? 2 * mgmt->capacity : total;
+        PageFrame *frames = (PageFrame*) realloc(mgmt->frames, sizeof(PageFrame) * capacity);
+        if (!frames)
         {
-            RC rc = writeDirtyPageToDisk(bm, pf);
-            if (rc != RC_OK)
-                return rc;
-            pf->dirty = false;
+            pthread_mutex_unlock(&mgmt->lock);
+            return RC_MEMORY_ALLOCATION_ERROR;
         }
+        mgmt->frames   = frames;
+        mgmt->capacity = capacity;
     }
+    for (int i = bm->numPages; i < total; i++)
+    {
+        mgmt->frames[i].data     = NULL;
+        mgmt->frames[i].pageNum  = -1;
+        mgmt->frames[i].dirty    = false;
+        mgmt->frames[i].fixCount = 0;
+        mgmt->frames[i].usage    = 0;
+    }
+    mgmt->excess -= kept;
+    bm->numPages  = total;
+    pthread_cond_broadcast(&mgmt->unpinned);
+    pthread_mutex_unlock(&mgmt->lock);
     return RC_OK;
 }
 
+RC shrinkBufferPool(BM_BufferPool *const bm, const int numPages)
+{
+    if (!bm || !bm->mgmtData || numPages < 0)
+        return RC_ERROR;
+
+    BM_MgmtData *mgmt = (BM_MgmtData*) bm->mgmtData;
+    RC rc = RC_ERROR;
+    pthread_mutex_lock(&mgmt->lock);
+    if (bm->numPages - mgmt->excess - numPages >= 1)
+    {
+        mgmt->excess += numPages;
+        rc = dropFrames(bm, mgmt);
+    }
+    pthread_mutex_unlock(&mgmt->lock);
+    return rc;
+}
+
 /*
  * markDirty
  * ---------
@@ -184,19 +270,21 @@ RC markDirty(BM_BufferPool *const bm, BM_PageHandle *const page)
         return RC_ERROR;
 
     BM_MgmtData *mgmt = (BM_MgmtData*) bm->mgmtData;
+    pthread_mutex_lock(&mgmt->lock);
     int index = findPageFrame(mgmt, bm->numPages, page->pageNum);
-    if (index < 0)
-        return RC_ERROR;
-
-    mgmt->frames[index].dirty = true;
-    return RC_OK;
+    if (index >= 0)
+        mgmt->frames[index].dirty = true;
+    pthread_mutex_unlock(&mgmt->lock);
+    return (index >= 0) ? RC_OK : RC_ERROR;
 }
 
 /*
  * unpinPage
  * ---------
  * Decremented fixCount for a page in the buffer pool. It found the frame
- * with page->pageNum, then fixCount-- if it was >0.
+ * with page->pageNum, then fixCount-- if it was >0, and woke the pins
+ * waiting for a frame once the page was no longer pinned (or dropped its
+ * frame, if the pool had been shrunk meanwhile).
  */
 RC unpinPage(BM_BufferPool *const bm, BM_PageHandle *const page)
 {
@@ -204,14 +292,17 @@ RC unpinPage(BM_BufferPool *const bm, BM_PageHandle *const page)
         return RC_ERROR;
 
     BM_MgmtData *mgmt = (BM_MgmtData*) bm->mgmtData;
+    pthread_mutex_lock(&mgmt->lock);
     int index = findPageFrame(mgmt, bm->numPages, page->pageNum);
-    if (index < 0)
-        return RC_ERROR;
-
-    if (mgmt->frames[index].fixCount > 0)
-        mgmt->frames[index].fixCount--;
-
-    return RC_OK;
+    RC rc = (index >= 0) ? RC_OK : RC_ERROR;
+    if (index >= 0 && mgmt->frames[index].fixCount > 0
+        && --mgmt->frames[index].fixCount == 0)
+    {
+        pthread_cond_broadcast(&mgmt->unpinned);
+        rc = dropFrames(bm, mgmt);
+    }
+    pthread_mutex_unlock(&mgmt->lock);
+    return rc;
 }
 
 /*
@@ -226,19 +317,21 @@ RC forcePage(BM_BufferPool *const bm, BM_PageHandle *const page)
         return RC_ERROR;
 
     BM_MgmtData *mgmt = (BM_MgmtData*) bm->mgmtData;
+    RC rc = RC_OK;
+    pthread_mutex_lock(&mgmt->lock);
     int index = findPageFrame(mgmt, bm->numPages, page->pageNum);
     if (index < 0)
-        return RC_ERROR;
+        rc = RC_ERROR;
 
     // If dirty, wrote out
-    if (mgmt->frames[index].dirty)
+    else if (mgmt->frames[index].dirty)
     {
-        RC rc = writeDirtyPageToDisk(bm, &mgmt->frames[index]);
-        if (rc != RC_OK)
-            return rc;
-        mgmt->frames[index].dirty = false;
+        rc = writeDirtyPageToDisk(bm, &mgmt->frames[index]);
+        if (rc == RC_OK)
+            mgmt->frames[index].dirty = false;
     }
-    return RC_OK;
+    pthread_mutex_unlock(&mgmt->lock);
+    return rc;
 }
 
 /*
@@ -247,6 +340,9 @@ RC forcePage(BM_BufferPool *const bm, BM_PageHandle *const page)
  * Pinned the requested page into the buffer pool. If the page was found in memory,
  * fixCount++ and usage++ for LRU. If not found, found a free frame or victim,
  * wrote out if dirty, read from disk, updated readIO, and set fixCount=1, usage=1.
+ * If every frame was pinned, it waited for an unpin (another thread might
+ * load the page meanwhile, so it looked again) and failed with
+ * RC_PINNED_PAGES_IN_BUFFER after BM_PIN_WAIT_MS.
  */
 RC pinPage(BM_BufferPool *const bm, BM_PageHandle *const page, const PageNumber pageNum)
 {
@@ -256,65 +352,101 @@ RC pinPage(BM_BufferPool *const bm, BM_PageHandle *const page, const PageNumber
         return RC_ERROR;
 
     BM_MgmtData *mgmt = (BM_MgmtData*) bm->mgmtData;
+    struct timespec deadline;
+    bool waiting = false;
+    int freeIndex;
 
-    // Checked if page was already in memory
-    int idx = findPageFrame(mgmt, bm->numPages, pageNum);
-    if (idx >= 0)
-    {
-        // Found it => fixCount++, usage++ (for LRU)
-        mgmt->frames[idx].fixCount++;
-        mgmt->frames[idx].usage++;
-        page->data = mgmt->frames[idx].data;
-        page->pageNum = pageNum;
-        return RC_OK;
-    }
-    else
+    pthread_mutex_lock(&mgmt->lock);
+    while (true)
     {
+        // Checked if page was already in memory
+        int idx = findPageFrame(mgmt, bm->numPages, pageNum);
+        if (idx >= 0)
+        {
+            // Found it => fixCount++, usage++ (for LRU)
+            mgmt->frames[idx].fixCount++;
+            mgmt->frames[idx].usage++;
+            page->data = mgmt->frames[idx].data;
+            page->pageNum = pageNum;
+            pthread_mutex_unlock(&mgmt->lock);
+            return RC_OK;
+        }
+
         // Not in memory => find free or victim
-        int freeIndex = findFreeFrame(mgmt, bm->numPages);
+        freeIndex = findFreeFrame(mgmt, bm->numPages);
         if (freeIndex < 0)
             freeIndex = findVictimFrame(bm, mgmt);
+        if (freeIndex >= 0)
+            break;
 
-        // If victim was dirty, wrote out
-        if (mgmt->frames[freeIndex].dirty)
+        if (!waiting)
         {
-            RC rc = writeDirtyPageToDisk(bm, &mgmt->frames[freeIndex]);
-            if (rc != RC_OK)
-                return rc;
-            mgmt->frames[freeIndex].dirty = false;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_sec  += BM_PIN_WAIT_MS / 1000;
+            deadline.tv_nsec += (long) (BM_PIN_WAIT_MS % 1000) * 1000000L;
+            if (deadline.tv_nsec >= 1000000000L)
+            {
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            waiting = true;
         }
+        if (pthread_cond_timedwait(&mgmt->unpinned, &mgmt->lock, &deadline) == ETIMEDOUT)
+        {
+            pthread_mutex_unlock(&mgmt->lock);
+            return RC_PINNED_PAGES_IN_BUFFER;
+        }
+    }
 
-        // Read from disk
-        SM_FileHandle fh;
-        if (openPageFile(bm->pageFile, &fh) != RC_OK)
-            return RC_ERROR;
-
-        // If the frame had no data allocated yet, allocated
-        if (!mgmt->frames[freeIndex].data)
-            mgmt->frames[freeIndex].data = calloc(PAGE_SIZE, sizeof(char));
-
-        // Ensured capacity, then read
-        if (ensureCapacity(pageNum+1, &fh) != RC_OK)
-            return RC_ERROR;
-
-        fseek(fh.mgmtInfo, pageNum * PAGE_SIZE, SEEK_SET);
-        size_t ret = fread(mgmt->frames[freeIndex].data, 1, PAGE_SIZE, fh.mgmtInfo);
-        if (ret < PAGE_SIZE)
-            memset(mgmt->frames[freeIndex].data + ret, 0, PAGE_SIZE - ret);
-        mgmt->readIO++;
-        closePageFile(&fh);
-
-        // Updated the frame info
-        mgmt->frames[freeIndex].pageNum  = pageNum;
-        mgmt->frames[freeIndex].dirty    = false;
-        mgmt->frames[freeIndex].fixCount = 1;
-        mgmt->frames[freeIndex].usage    = 1;
-
-        // Returned via page handle
-        page->data    = mgmt->frames[freeIndex].data;
-        page->pageNum = pageNum;
-        return RC_OK;
+    // If victim was dirty, wrote out
+    if (mgmt->frames[freeIndex].dirty)
+    {
+        RC rc = writeDirtyPageToDisk(bm, &mgmt->frames[freeIndex]);
+        if (rc != RC_OK)
+        {
+            pthread_mutex_unlock(&mgmt->lock);
+            return rc;
+        }
+        mgmt->frames[freeIndex].dirty = false;
     }
+
+    // Read from disk
+    SM_FileHandle fh;
+    if (openPageFile(bm->pageFile, &fh) != RC_OK)
+    {
+        pthread_mutex_unlock(&mgmt->lock);
+        return RC_ERROR;
+    }
+
+    // If the frame had no data allocated yet, allocated
+    if (!mgmt->frames[freeIndex].data)
+        mgmt->frames[freeIndex].data = calloc(PAGE_SIZE, sizeof(char));
+
+    // Ensured capacity, then read
+    if (ensureCapacity(pageNum+1, &fh) != RC_OK)
+    {
+        pthread_mutex_unlock(&mgmt->lock);
+        return RC_ERROR;
+    }
+
+    fseek(fh.mgmtInfo, pageNum * PAGE_SIZE, SEEK_SET);
+    size_t ret = fread(mgmt->frames[freeIndex].data, 1, PAGE_SIZE, fh.mgmtInfo);
+    if (ret < PAGE_SIZE)
+        memset(mgmt->frames[freeIndex].data + ret, 0, PAGE_SIZE - ret);
+    mgmt->readIO++;
+    closePageFile(&fh);
+
+    // Updated the frame info
+    mgmt->frames[freeIndex].pageNum  = pageNum;
+    mgmt->frames[freeIndex].dirty    = false;
+    mgmt->frames[freeIndex].fixCount = 1;
+    mgmt->frames[freeIndex].usage    = 1;
+
+    // Returned via page handle
+    page->data    = mgmt->frames[freeIndex].data;
+    page->pageNum = pageNum;
+    pthread_mutex_unlock(&mgmt->lock);
+    return RC_OK;
 }
 
 /*
@@ -329,14 +461,16 @@ PageNumber *getFrameContents(BM_BufferPool *const bm)
         return NULL;
     BM_MgmtData *mgmt = (BM_MgmtData*) bm->mgmtData;
 
+    pthread_mutex_lock(&mgmt->lock);
     PageNumber *arr = malloc(sizeof(PageNumber) * bm->numPages);
-    for (int i=0; i<bm->numPages; i++)
+    for (int i=0; arr && i<bm->numPages; i++)
     {
         if (mgmt->frames[i].pageNum == -1)
             arr[i] = NO_PAGE;
         else
             arr[i] = mgmt->frames[i].pageNum;
     }
+    pthread_mutex_unlock(&mgmt->lock);
     return arr;
 }
 
@@ -351,9 +485,11 @@ bool *getDirtyFlags(BM_BufferPool *const bm)
         return NULL;
     BM_MgmtData *mgmt = (BM_MgmtData*) bm->mgmtData;
 
+    pthread_mutex_lock(&mgmt->lock);
     bool *arr = malloc(sizeof(bool)*bm->numPages);
-    for (int i=0; i<bm->numPages; i++)
+    for (int i=0; arr && i<bm->numPages; i++)
         arr[i] = mgmt->frames[i].dirty;
+    pthread_mutex_unlock(&mgmt->lock);
     return arr;
 }
 
@@ -368,9 +504,11 @@ int *getFixCounts(BM_BufferPool *const bm)
         return NULL;
     BM_MgmtData *mgmt = (BM_MgmtData*) bm->mgmtData;
 
+    pthread_mutex_lock(&mgmt->lock);
     int *arr = malloc(sizeof(int)*bm->numPages);
-    for (int i=0; i<bm->numPages; i++)
+    for (int i=0; arr && i<bm->numPages; i++)
         arr[i] = mgmt->frames[i].fixCount;
+    pthread_mutex_unlock(&mgmt->lock);
     return arr;
 }
 
@@ -464,7 +602,8 @@ static int findFreeFrame(BM_MgmtData *mgmt, int numPages)
  * findVictimFrame
  * ---------------
  * For a simple LRU: picked the frame with the smallest usage among those
- * with fixCount=0. If all pinned => returned 0 as fallback.
+ * with fixCount=0. If all pinned => returned -1, as a pinned frame was
+ * still in use by whoever pinned it.
  */
 static int findVictimFrame(BM_BufferPool *bm, BM_MgmtData *mgmt)
 {
@@ -481,9 +620,6 @@ static int findVictimFrame(BM_BufferPool *bm, BM_MgmtData *mgmt)
             }
         }
     }
-    // if all pinned => fallback to index 0
-    if (victimIndex < 0)
-        victimIndex = 0;
     return victimIndex;
 }
 
@@ -508,4 +644,61 @@ static RC writeDirtyPageToDisk(BM_BufferPool *bm, PageFrame *pf)
     mgmt->writeIO++;
 
     return (wrote == PAGE_SIZE) ? RC_OK : RC_ERROR;
+}
+
+/*
+ * flushFrames
+ * -----------
+ * Wrote all dirty pages with fixCount=0 out to disk, for forceFlushPool and
+ * shutdownBufferPool. Called with mgmt->lock held.
+ */
+static RC flushFrames(BM_BufferPool *bm, BM_MgmtData *mgmt)
+{
+    // Checked each frame
+    for (int i=0; i<bm->numPages; i++)
+    {
+        PageFrame *pf = &mgmt->frames[i];
+        // If the page was dirty and not pinned
+        if (pf->dirty && pf->fixCount == 0)
+        {
+            RC rc = writeDirtyPageToDisk(bm, pf);
+            if (rc != RC_OK)
+                return rc;
+            pf->dirty = false;
+        }
+    }
+    return RC_OK;
+}
+
+/*
+ * dropFrames
+ * ----------
+ * Dropped unpinned frames, the least used first, while the pool had been
+ * shrunk by more frames than it had dropped so far. A dirty frame was written
+ * out first. Called with mgmt->lock held.
+ */
+static RC dropFrames(BM_BufferPool *bm, BM_MgmtData *mgmt)
+{
+    while (mgmt->excess > 0)
+    {
+        int index = findVictimFrame(bm, mgmt);
+        if (index < 0)
+            break;
+
+        PageFrame *pf = &mgmt->frames[index];
+        if (pf->dirty)
+        {
+            RC rc = writeDirtyPageToDisk(bm, pf);
+            if (rc != RC_OK)
+                return rc;
+        }
+        free(pf->data);
+
+        // The last frame took the dropped one's place
+        *pf = mgmt->frames[--bm->numPages];
+        mgmt->excess--;
+    }
+    if (mgmt->clockPointer >= bm->numPages)
+        mgmt->clockPointer = 0;
+    return RC_OK;
 }
\ No newline at end of file
@@ -20,6 +20,9 @@ typedef enum ReplacementStrategy {
 typedef int PageNumber;
 #define NO_PAGE -1
 
+// how long pinPage waits for a frame while all of them are pinned
+#define BM_PIN_WAIT_MS 1000
+
 typedef struct BM_BufferPool {
 	char *pageFile;
 	int numPages;
@@ -46,6 +49,8 @@ RC initBufferPool(BM_BufferPool *const bm, const char *const pageFileName,
 		void *stratData);
 RC shutdownBufferPool(BM_BufferPool *const bm);
 RC forceFlushPool(BM_BufferPool *const bm);
+RC growBufferPool(BM_BufferPool *const bm, const int numPages);
+RC shrinkBufferPool(BM_BufferPool *const bm, const int numPages);
 
 // Buffer Manager Interface Access Pages
 RC markDirty (BM_BufferPool *const bm, BM_PageHandle *const page);
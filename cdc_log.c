@@ -0,0 +1,342 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "cdc_log.h"
+#include "dberror.h"
+
+/*
+ * Change streams
+ * ---------------------------------------------------------------
+ * A change stream was an append-only file of events, each written with one
+ * write so a reader saw an event either whole or not yet:
+ *
+ *   u32 length of the rest | u64 seq | u8 type | i32 page | i32 slot |
+ *   u32 before length | before | u32 after length | after
+ *
+ * Sequence numbers grew by one per event and carried on from the file when
+ * it was opened again. Events were not synced one by one; the stream was
+ * as durable as the page file it described.
+ *
+ * A reader kept its file offset, so tailing cost one read per new event
+ * rather than a pass over the table. When it had caught up it slept on a
+ * condition variable every append in the process broadcast, so events
+ * written by this process reached it at once and those of other processes
+ * by the end of its timeout.
+ */
+
+#define EVENT_HEADER (4 + 8 + 1 + 4 + 4 + 4 + 4)
+
+struct CDC_Log {
+    int fd;
+    uint64_t lastSeq;
+    pthread_mutex_t lock;   // kept seq order and file order the same
+};
+
+struct CDC_Reader {
+    FILE *file;
+    long offset;            // where the next event started
+    uint64_t fromSeq;
+    char *buf;
+    size_t bufSize;
+};
+
+static pthread_mutex_t appendedLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t appended = PTHREAD_COND_INITIALIZER;
+static unsigned long appendCount = 0;
+
+/* --------------------------------------------------------------------------
+   Events
+   -------------------------------------------------------------------------- */
+
+/*
+ * decodeEvent
+ * -----------
+ * Filled event from an encoded body of length bytes (after the length
+ * word), pointing the images into it. False if the body was malformed.
+ */
+static bool
+decodeEvent(char *body, uint32_t length, CDC_Event *event)
+{
+    uint32_t beforeLen, afterLen;
+    int32_t page, slot;
+    uint8_t type;
+
+    if (length < EVENT_HEADER - 4)
+        return false;
+    memcpy(&event->seq, body, 8);
+    memcpy(&type, body + 8, 1);
+    memcpy(&page, body + 9, 4);
+    memcpy(&slot, body + 13, 4);
+    memcpy(&beforeLen, body + 17, 4);
+    if (beforeLen > length - (EVENT_HEADER - 4))
+        return false;
+    memcpy(&afterLen, body + 21 + beforeLen, 4);
+    if ((uint64_t) EVENT_HEADER - 4 + beforeLen + afterLen != length)
+        return false;
+
+    event->type      = (CDC_EventType) type;
+    event->id.page   = page;
+    event->id.slot   = slot;
+    event->beforeLen = (int) beforeLen;
+    event->before    = beforeLen ? body + 21 : NULL;
+    event->afterLen  = (int) afterLen;
+    event->after     = afterLen ? body + 25 + beforeLen : NULL;
+    return true;
+}
+
+/*
+ * readEvent
+ * ---------
+ * Read the event at the reader's offset into its buffer. False when the
+ * file ended before the whole event (not written yet, or torn).
+ */
+static bool
+readEvent(CDC_Reader *reader, CDC_Event *event, uint32_t *length)
+{
+    if (fseek(reader->file, reader->offset, SEEK_SET) != 0)
+        return false;
+    if (fread(length, 1, 4, reader->file) != 4)
+        return false;
+    if (*length > reader->bufSize)
+    {
+        char *buf = (char *) realloc(reader->buf, *length);
+        if (buf == NULL)
+            return false;
+        reader->buf = buf;
+        reader->bufSize = *length;
+    }
+    if (fread(reader->buf, 1, *length, reader->file) != *length)
+        return false;
+    return decodeEvent(reader->buf, *length, event);
+}
+
+/* --------------------------------------------------------------------------
+   Writing
+   -------------------------------------------------------------------------- */
+
+/*
+ * openChangeLog
+ * -------------
+ * Opened (or created) a stream for appending. The events already in it were
+ * walked to find the last sequence number, and a torn event at the end was
+ * cut off so new events followed the last whole one.
+ */
+RC
+openChangeLog(char *path, CDC_Log **log)
+{
+    CDC_Log *l = (CDC_Log *) malloc(sizeof(CDC_Log));
+    CDC_Reader scan = { NULL, 0, 0, NULL, 0 };
+    CDC_Event event;
+    uint32_t length;
+
+    if (l == NULL)
+        THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate a change log");
+    l->fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (l->fd < 0)
+    {
+        free(l);
+        THROW(RC_FILE_NOT_FOUND, "cannot open the change log");
+    }
+    l->lastSeq = 0;
+
+    scan.file = fopen(path, "rb");
+    while (scan.file != NULL && readEvent(&scan, &event, &length))
+    {
+        l->lastSeq = event.seq;
+        scan.offset += 4 + length;
+    }
+    if (scan.file != NULL)
+        fclose(scan.file);
+    free(scan.buf);
+    if (ftruncate(l->fd, scan.offset) != 0)
+    {
+        close(l->fd);
+        free(l);
+        THROW(RC_WRITE_FAILED, "cannot cut off a torn change event");
+    }
+
+    pthread_mutex_init(&l->lock, NULL);
+    *log = l;
+    return RC_OK;
+}
+
+RC
+closeChangeLog(CDC_Log *log)
+{
+    if (log == NULL)
+        return RC_OK;
+    close(log->fd);
+    pthread_mutex_destroy(&log->lock);
+    free(log);
+    return RC_OK;
+}
+
+/*
+ * appendChange
+ * ------------
+ * Numbered an event and appended it with one write, then woke the readers
+ * waiting in this process. before or after was NULL for an insert or a
+ * delete; both images were len bytes.
+ */
+RC
+appendChange(CDC_Log *log, CDC_EventType type, RID id, char *before, char *after, int len, uint64_t *seq)
+{
+    uint32_t beforeLen = before ? (uint32_t) len : 0;
+    uint32_t afterLen  = after ? (uint32_t) len : 0;
+    uint32_t length    = EVENT_HEADER - 4 + beforeLen + afterLen;
+    uint8_t code       = (uint8_t) type;
+    int32_t page = id.page, slot = id.slot;
+    char stackBuf[512];
+    char *buf = (4 + length <= sizeof(stackBuf)) ? stackBuf : (char *) malloc(4 + length);
+    RC rc = RC_OK;
+
+    if (buf == NULL)
+        THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate a change event");
+
+    pthread_mutex_lock(&log->lock);
+    uint64_t s = log->lastSeq + 1;
+    char *p = buf;
+    memcpy(p, &length, 4);          p += 4;
+    memcpy(p, &s, 8);               p += 8;
+    memcpy(p, &code, 1);            p += 1;
+    memcpy(p, &page, 4);            p += 4;
+    memcpy(p, &slot, 4);            p += 4;
+    memcpy(p, &beforeLen, 4);       p += 4;
+    if (beforeLen)
+    {
+        memcpy(p, before, beforeLen);
+        p += beforeLen;
+    }
+    memcpy(p, &afterLen, 4);        p += 4;
+    if (afterLen)
+        memcpy(p, after, afterLen);
+
+    if (write(log->fd, buf, 4 + length) != (ssize_t) (4 + length))
+        rc = RC_WRITE_FAILED;
+    else
+        log->lastSeq = s;
+    pthread_mutex_unlock(&log->lock);
+
+    if (buf != stackBuf)
+        free(buf);
+    if (rc != RC_OK)
+        THROW(rc, "cannot append a change event");
+
+    pthread_mutex_lock(&appendedLock);
+    appendCount++;
+    pthread_cond_broadcast(&appended);
+    pthread_mutex_unlock(&appendedLock);
+
+    if (seq != NULL)
+        *seq = s;
+    return RC_OK;
+}
+
+uint64_t
+getLastChangeSeq(CDC_Log *log)
+{
+    uint64_t seq;
+    pthread_mutex_lock(&log->lock);
+    seq = log->lastSeq;
+    pthread_mutex_unlock(&log->lock);
+    return seq;
+}
+
+/* --------------------------------------------------------------------------
+   Reading
+   -------------------------------------------------------------------------- */
+
+RC
+openChangeStream(char *path, uint64_t fromSeq, CDC_Reader **reader)
+{
+    CDC_Reader *r = (CDC_Reader *) malloc(sizeof(CDC_Reader));
+    if (r == NULL)
+        THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate a change reader");
+    r->file = fopen(path, "rb");
+    if (r->file == NULL)
+    {
+        free(r);
+        THROW(RC_FILE_NOT_FOUND, "no such change log");
+    }
+    r->offset  = 0;
+    r->fromSeq = fromSeq;
+    r->buf     = NULL;
+    r->bufSize = 0;
+    *reader = r;
+    return RC_OK;
+}
+
+/*
+ * readChange
+ * ----------
+ * Returned the next event at or after the reader's starting sequence
+ * number (older ones were skipped once), waiting up to timeoutMs for one to
+ * be appended when the reader had caught up.
+ */
+RC
+readChange(CDC_Reader *reader, CDC_Event *event, int timeoutMs)
+{
+    struct timespec deadline;
+    uint32_t length;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec  += timeoutMs / 1000;
+    deadline.tv_nsec += (long) (timeoutMs % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    while (true)
+    {
+        pthread_mutex_lock(&appendedLock);
+        unsigned long seen = appendCount;
+        pthread_mutex_unlock(&appendedLock);
+
+        clearerr(reader->file);
+        while (readEvent(reader, event, &length))
+        {
+            reader->offset += 4 + length;
+            if (event->seq >= reader->fromSeq)
+                return RC_OK;
+        }
+
+        // Caught up: slept until an append or the deadline
+        bool timedOut = false;
+        pthread_mutex_lock(&appendedLock);
+        while (appendCount == seen && !timedOut)
+            timedOut = (pthread_cond_timedwait(&appended, &appendedLock, &deadline) == ETIMEDOUT);
+        pthread_mutex_unlock(&appendedLock);
+        if (timedOut)
+        {
+            // an event of another process could have arrived meanwhile
+            clearerr(reader->file);
+            if (readEvent(reader, event, &length))
+            {
+                reader->offset += 4 + length;
+                if (event->seq >= reader->fromSeq)
+                    return RC_OK;
+                continue;
+            }
+            return RC_RM_NO_MORE_TUPLES;
+        }
+    }
+}
+
+RC
+closeChangeStream(CDC_Reader *reader)
+{
+    if (reader == NULL)
+        return RC_OK;
+    fclose(reader->file);
+    free(reader->buf);
+    free(reader);
+    return RC_OK;
+}
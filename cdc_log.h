@@ -0,0 +1,50 @@
+#ifndef CDC_LOG_H
+#define CDC_LOG_H
+
+#include <stdint.h>
+
+#include "dberror.h"
+#include "tables.h"
+
+// change stream file of a table unless enableChangeCapture named another
+#define CDC_SUFFIX ".cdc"
+
+typedef enum CDC_EventType {
+	CDC_INSERT = 1,
+	CDC_UPDATE = 2,
+	CDC_DELETE = 3
+} CDC_EventType;
+
+// one change; an insert has no before image, a delete no after image
+typedef struct CDC_Event {
+	uint64_t seq;
+	CDC_EventType type;
+	RID id;
+	int beforeLen;
+	char *before;
+	int afterLen;
+	char *after;
+} CDC_Event;
+
+// the appending end of a change stream
+typedef struct CDC_Log CDC_Log;
+// a consumer tailing a change stream
+typedef struct CDC_Reader CDC_Reader;
+
+// opening continues the sequence numbers found in the file and cuts off a
+// torn last event
+extern RC openChangeLog (char *path, CDC_Log **log);
+extern RC closeChangeLog (CDC_Log *log);
+extern RC appendChange (CDC_Log *log, CDC_EventType type, RID id,
+		char *before, char *after, int len, uint64_t *seq);
+extern uint64_t getLastChangeSeq (CDC_Log *log);
+
+// reading starts at the first event numbered fromSeq or later; readChange
+// waits up to timeoutMs for the next event and fails with
+// RC_RM_NO_MORE_TUPLES when none came. The images point into the reader
+// and stay valid until its next readChange.
+extern RC openChangeStream (char *path, uint64_t fromSeq, CDC_Reader **reader);
+extern RC readChange (CDC_Reader *reader, CDC_Event *event, int timeoutMs);
+extern RC closeChangeStream (CDC_Reader *reader);
+
+#endif // CDC_LOG_H
@@ -21,6 +21,13 @@ typedef int RC;
 #define RC_RM_NO_MORE_TUPLES 203
 #define RC_RM_NO_PRINT_FOR_DATATYPE 204
 #define RC_RM_UNKOWN_DATATYPE 205
+#define RC_SCAN_NOT_STARTED 206
+#define RC_PARSE_ERROR 207
+#define RC_RM_DIVISION_BY_ZERO 208
+#define RC_RM_ARITH_ARG_IS_NOT_NUMERIC 209
+#define RC_RM_CAST_FAILED 210
+#define RC_RM_LOCK_TIMEOUT 211
+#define RC_RM_BAD_PARTITION 212
 
 #define RC_IM_KEY_NOT_FOUND 300
 #define RC_IM_KEY_ALREADY_EXISTS 301
@@ -0,0 +1,511 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dberror.h"
+#include "distinct.h"
+#include "expr.h"
+#include "record_mgr.h"
+
+/*
+ * Distinct scans
+ * ---------------------------------------------------------------
+ * A distinct scan ran an ordinary scan and built a key for each record from
+ * the bytes of the chosen attributes, laid end to end. Keys went into an
+ * open-addressing hash table with linear probing; slots held the index of
+ * an entry plus one (0 meant empty), and an entry held the key's 64-bit hash
+ * followed by the key, so a probe compared hashes before bytes. A record
+ * whose key was new was returned at once, so the first distinct records
+ * came back without waiting for the end of the scan.
+ *
+ * The table grew by doubling until it reached the memory budget. After
+ * that, a record whose key was not in the table was written to one of
+ * DISTINCT_SPILL_PARTITIONS temporary files picked by the top bits of its
+ * hash. A key that was not in the full table never entered it later, so
+ * all its records went to the same file and none of them had been
+ * returned. When the input ended, the table was emptied and each file was
+ * read back as a new input with a different hash seed, spilling again if
+ * its keys still did not fit.
+ *
+ * estimateDistinct hashed the keys the same way into HyperLogLog registers
+ * and returned the harmonic-mean estimate, with linear counting for small
+ * cardinalities.
+ */
+
+// the fewest entries a budget was rounded up to
+#define MIN_ENTRIES 64
+// slots of a new table
+#define INITIAL_SLOTS 1024
+
+typedef struct KeyPart {
+    int offset;
+    int len;
+} KeyPart;
+
+struct RM_DistinctScan {
+    RM_TableData *rel;
+    int recordSize;
+    KeyPart *parts;
+    int numParts;
+    int keyLen;
+    char *key;              // key of the record at hand
+
+    uint32_t *slots;
+    uint32_t mask;          // number of slots - 1
+    char *entries;          // u64 hash | key, entrySize bytes each
+    int entrySize;
+    int numEntries;
+    int entryCap;           // entries allocated
+    int maxEntries;         // entries the budget allowed
+    uint64_t seed;          // hash seed of the input being read
+
+    RM_ScanHandle scan;
+    bool scanning;          // reading the table (false: a spilled file)
+    bool done;
+    FILE *input;            // spilled file being read back
+    int level;              // spill depth of the input
+    char *spillBuf;         // RID and record read back from a file
+
+    FILE *spill[DISTINCT_SPILL_PARTITIONS]; // partitions of the input (NULL until used)
+    FILE **pending;         // spilled files not read back yet
+    int *pendingLevel;
+    int numPending;
+    int pendingCap;
+    int numSpilled;
+};
+
+/* --------------------------------------------------------------------------
+   Keys
+   -------------------------------------------------------------------------- */
+
+/*
+ * hashKey
+ * -------
+ * Hashed a key 8 bytes at a time and finished with the splitmix64
+ * finalizer, so every bit of the result depended on every key byte.
+ */
+static uint64_t
+hashKey(const char *key, int len, uint64_t seed)
+{
+    uint64_t h = seed ^ ((uint64_t) len * 0x9e3779b97f4a7c15ULL);
+    int i = 0;
+    for (; i + 8 <= len; i += 8)
+    {
+        uint64_t w;
+        memcpy(&w, key + i, 8);
+        h = (h ^ w) * 0x100000001b3ULL;
+        h ^= h >> 29;
+    }
+    if (i < len)
+    {
+        uint64_t w = 0;
+        memcpy(&w, key + i, len - i);
+        h = (h ^ w) * 0x100000001b3ULL;
+    }
+    h ^= h >> 30;
+    h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27;
+    h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+    return h;
+}
+
+// seed of spill depth level; 0 at the table itself
+static uint64_t
+levelSeed(int level)
+{
+    return (uint64_t) level * 0xd6e8feb86659fd93ULL;
+}
+
+/*
+ * keyParts
+ * --------
+ * Found where the key attributes lay in a record (all of them when attrs
+ * was NULL or numAttrs 0) and the length of the key.
+ */
+static RC
+keyParts(Schema *schema, int numAttrs, int *attrs, KeyPart **parts, int *keyLen)
+{
+    int n = (attrs == NULL || numAttrs <= 0) ? schema->numAttr : numAttrs;
+    KeyPart *p = (KeyPart *) malloc(sizeof(KeyPart) * n);
+
+    if (p == NULL)
+        THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate a distinct key");
+    *keyLen = 0;
+    for (int i = 0; i < n; i++)
+    {
+        int a = (attrs == NULL || numAttrs <= 0) ? i : attrs[i];
+        if (a < 0 || a >= schema->numAttr)
+        {
+            free(p);
+            THROW(RC_ERROR, "distinct key is not an attribute");
+        }
+        p[i].offset = getAttrOffset(schema, a);
+        switch (schema->dataTypes[a])
+        {
+            case DT_INT:    p[i].len = sizeof(int); break;
+            case DT_FLOAT:  p[i].len = sizeof(float); break;
+            case DT_BOOL:   p[i].len = sizeof(bool); break;
+            case DT_STRING: p[i].len = schema->typeLength[a]; break;
+        }
+        *keyLen += p[i].len;
+    }
+    *parts = p;
+    return RC_OK;
+}
+
+static void
+makeKey(KeyPart *parts, int numParts, char *data, char *key)
+{
+    for (int i = 0; i < numParts; i++)
+    {
+        memcpy(key, data + parts[i].offset, parts[i].len);
+        key += parts[i].len;
+    }
+}
+
+/* --------------------------------------------------------------------------
+   Hash table
+   -------------------------------------------------------------------------- */
+
+static RC
+resizeTable(RM_DistinctScan *d, uint32_t numSlots)
+{
+    uint32_t *slots = (uint32_t *) calloc(numSlots, sizeof(uint32_t));
+    int cap = (int) (numSlots / 2) < d->maxEntries ? (int) (numSlots / 2) : d->maxEntries;
+    char *entries = (char *) realloc(d->entries, (size_t) cap * d->entrySize);
+
+    if (slots == NULL || entries == NULL)
+    {
+        free(slots);
+        if (entries != NULL)
+            d->entries = entries;
+        THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot grow the distinct table");
+    }
+    d->entries  = entries;
+    d->entryCap = cap;
+    d->mask     = numSlots - 1;
+    for (int e = 0; e < d->numEntries; e++)
+    {
+        uint64_t h;
+        memcpy(&h, entries + (size_t) e * d->entrySize, 8);
+        uint32_t s = (uint32_t) h & d->mask;
+        while (slots[s] != 0)
+            s = (s + 1) & d->mask;
+        slots[s] = (uint32_t) e + 1;
+    }
+    free(d->slots);
+    d->slots = slots;
+    return RC_OK;
+}
+
+/*
+ * insertKey
+ * ---------
+ * Added the key to the table. Set *added when it was new and *full when it
+ * was new but there was no room for it within the budget.
+ */
+static RC
+insertKey(RM_DistinctScan *d, const char *key, uint64_t hash, bool *added, bool *full)
+{
+    *added = false;
+    *full  = false;
+
+    uint32_t s = (uint32_t) hash & d->mask;
+    for (; d->slots[s] != 0; s = (s + 1) & d->mask)
+    {
+        char *e = d->entries + (size_t) (d->slots[s] - 1) * d->entrySize;
+        if (memcmp(e, &hash, 8) == 0 && memcmp(e + 8, key, d->keyLen) == 0)
+            return RC_OK;
+    }
+
+    if (d->numEntries == d->entryCap)
+    {
+        if (d->entryCap >= d->maxEntries)
+        {
+            *full = true;
+            return RC_OK;
+        }
+        RC rc = resizeTable(d, (d->mask + 1) * 2);
+        if (rc != RC_OK)
+            return rc;
+        for (s = (uint32_t) hash & d->mask; d->slots[s] != 0; s = (s + 1) & d->mask)
+            ;
+    }
+
+    char *e = d->entries + (size_t) d->numEntries * d->entrySize;
+    memcpy(e, &hash, 8);
+    memcpy(e + 8, key, d->keyLen);
+    d->slots[s] = (uint32_t) ++d->numEntries;
+    *added = true;
+    return RC_OK;
+}
+
+/* --------------------------------------------------------------------------
+   Spilling
+   -------------------------------------------------------------------------- */
+
+static RC
+spillRecord(RM_DistinctScan *d, Record *record, uint64_t hash)
+{
+    int p = (int) (hash >> 60) % DISTINCT_SPILL_PARTITIONS;
+
+    if (d->spill[p] == NULL && (d->spill[p] = tmpfile()) == NULL)
+        THROW(RC_WRITE_FAILED, "cannot create a distinct spill file");
+    if (fwrite(&record->id.page, sizeof(int), 1, d->spill[p]) != 1
+        || fwrite(&record->id.slot, sizeof(int), 1, d->spill[p]) != 1
+        || fwrite(record->data, d->recordSize, 1, d->spill[p]) != 1)
+        THROW(RC_WRITE_FAILED, "cannot write a distinct spill file");
+    d->numSpilled++;
+    return RC_OK;
+}
+
+/*
+ * nextInput
+ * ---------
+ * Finished the input at hand: its spill files joined the pending ones, the
+ * table was emptied and the next pending file became the input, read with
+ * the seed of its depth. RC_RM_NO_MORE_TUPLES when none was left.
+ */
+static RC
+nextInput(RM_DistinctScan *d)
+{
+    if (d->scanning)
+    {
+        closeScan(&d->scan);
+        d->scanning = false;
+    }
+    else if (d->input != NULL)
+    {
+        fclose(d->input);
+        d->input = NULL;
+    }
+
+    for (int p = 0; p < DISTINCT_SPILL_PARTITIONS; p++)
+    {
+        if (d->spill[p] == NULL)
+            continue;
+        if (d->numPending == d->pendingCap)
+        {
+            int cap = d->pendingCap ? d->pendingCap * 2 : DISTINCT_SPILL_PARTITIONS;
+            FILE **files = (FILE **) realloc(d->pending, sizeof(FILE *) * cap);
+            if (files != NULL)
+                d->pending = files;
+            int *levels = (int *) realloc(d->pendingLevel, sizeof(int) * cap);
+            if (levels != NULL)
+                d->pendingLevel = levels;
+            if (files == NULL || levels == NULL)
+                THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot remember a distinct spill file");
+            d->pendingCap = cap;
+        }
+        rewind(d->spill[p]);
+        d->pending[d->numPending] = d->spill[p];
+        d->pendingLevel[d->numPending++] = d->level + 1;
+        d->spill[p] = NULL;
+    }
+
+    d->numEntries = 0;
+    memset(d->slots, 0, sizeof(uint32_t) * (d->mask + 1));
+
+    if (d->numPending == 0)
+    {
+        d->done = true;
+        return RC_RM_NO_MORE_TUPLES;
+    }
+    d->numPending--;
+    d->input = d->pending[d->numPending];
+    d->level = d->pendingLevel[d->numPending];
+    d->seed  = levelSeed(d->level);
+    return RC_OK;
+}
+
+// the next record of the input at hand
+static RC
+readInput(RM_DistinctScan *d, Record *record)
+{
+    if (d->scanning)
+        return next(&d->scan, record);
+    if (d->input == NULL || fread(d->spillBuf, 2 * sizeof(int) + d->recordSize, 1, d->input) != 1)
+        return RC_RM_NO_MORE_TUPLES;
+    memcpy(&record->id.page, d->spillBuf, sizeof(int));
+    memcpy(&record->id.slot, d->spillBuf + sizeof(int), sizeof(int));
+    memcpy(record->data, d->spillBuf + 2 * sizeof(int), d->recordSize);
+    return RC_OK;
+}
+
+/* --------------------------------------------------------------------------
+   Interface
+   -------------------------------------------------------------------------- */
+
+/*
+ * startDistinct
+ * -------------
+ * Set up the key, a small table and the scan. The budget capped the
+ * entries and the slots (two per entry) together.
+ */
+RC
+startDistinct(RM_TableData *rel, Expr *cond, int numAttrs, int *attrs, size_t memoryBudget, RM_DistinctScan **distinct)
+{
+    RM_DistinctScan *d = (RM_DistinctScan *) calloc(1, sizeof(RM_DistinctScan));
+    RC rc;
+
+    if (d == NULL)
+        THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate a distinct scan");
+    if ((rc = keyParts(rel->schema, numAttrs, attrs, &d->parts, &d->keyLen)) != RC_OK)
+    {
+        free(d);
+        return rc;
+    }
+    d->rel        = rel;
+    d->recordSize = getRecordSize(rel->schema);
+    d->numParts   = (attrs == NULL || numAttrs <= 0) ? rel->schema->numAttr : numAttrs;
+    d->entrySize  = 8 + d->keyLen;
+    if (memoryBudget == 0)
+        memoryBudget = DISTINCT_DEFAULT_BUDGET;
+    size_t maxEntries = memoryBudget / (d->entrySize + 2 * sizeof(uint32_t));
+    d->maxEntries = maxEntries < MIN_ENTRIES ? MIN_ENTRIES : maxEntries > INT32_MAX / 4 ? INT32_MAX / 4 : (int) maxEntries;
+
+    d->key      = (char *) malloc(d->keyLen > 0 ? d->keyLen : 1);
+    d->spillBuf = (char *) malloc(2 * sizeof(int) + d->recordSize);
+    uint32_t slots = INITIAL_SLOTS;
+    while (slots / 2 > (uint32_t) d->maxEntries && slots > 2 * MIN_ENTRIES)
+        slots /= 2;
+    if (d->key == NULL || d->spillBuf == NULL || resizeTable(d, slots) != RC_OK)
+    {
+        closeDistinct(d);
+        THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate a distinct scan");
+    }
+
+    startScan(rel, &d->scan, cond);
+    d->scanning = true;
+    *distinct = d;
+    return RC_OK;
+}
+
+/*
+ * nextDistinct
+ * ------------
+ * Returned the next record whose key had not come up before, reading on
+ * through the table and then the spilled files.
+ */
+RC
+nextDistinct(RM_DistinctScan *d, Record *record)
+{
+    while (!d->done)
+    {
+        RC rc = readInput(d, record);
+        if (rc == RC_RM_NO_MORE_TUPLES)
+        {
+            if ((rc = nextInput(d)) != RC_OK)
+                return rc;
+            continue;
+        }
+        if (rc != RC_OK)
+            return rc;
+
+        bool added, full;
+        makeKey(d->parts, d->numParts, record->data, d->key);
+        uint64_t hash = hashKey(d->key, d->keyLen, d->seed);
+        if ((rc = insertKey(d, d->key, hash, &added, &full)) != RC_OK)
+            return rc;
+        if (added)
+            return RC_OK;
+        if (full && (rc = spillRecord(d, record, hash)) != RC_OK)
+            return rc;
+    }
+    return RC_RM_NO_MORE_TUPLES;
+}
+
+RC
+closeDistinct(RM_DistinctScan *d)
+{
+    if (d == NULL)
+        return RC_OK;
+    if (d->scanning)
+        closeScan(&d->scan);
+    if (d->input != NULL)
+        fclose(d->input);
+    for (int p = 0; p < DISTINCT_SPILL_PARTITIONS; p++)
+        if (d->spill[p] != NULL)
+            fclose(d->spill[p]);
+    for (int i = 0; i < d->numPending; i++)
+        fclose(d->pending[i]);
+    free(d->pending);
+    free(d->pendingLevel);
+    free(d->slots);
+    free(d->entries);
+    free(d->parts);
+    free(d->key);
+    free(d->spillBuf);
+    free(d);
+    return RC_OK;
+}
+
+int
+getNumSpilledRecords(RM_DistinctScan *d)
+{
+    return d->numSpilled;
+}
+
+/*
+ * estimateDistinct
+ * ----------------
+ * Fed the hash of every matching key to 2^DISTINCT_HLL_BITS HyperLogLog
+ * registers: the top bits picked a register, which kept the longest run of
+ * leading zeros (plus one) seen in the remaining bits.
+ */
+RC
+estimateDistinct(RM_TableData *rel, Expr *cond, int numAttrs, int *attrs, double *estimate)
+{
+    const int m = 1 << DISTINCT_HLL_BITS;
+    uint8_t registers[1 << DISTINCT_HLL_BITS];
+    RM_ScanHandle scan;
+    KeyPart *parts;
+    Record *record;
+    int keyLen;
+    RC rc;
+
+    if ((rc = keyParts(rel->schema, numAttrs, attrs, &parts, &keyLen)) != RC_OK)
+        return rc;
+    int numParts = (attrs == NULL || numAttrs <= 0) ? rel->schema->numAttr : numAttrs;
+    char *key = (char *) malloc(keyLen > 0 ? keyLen : 1);
+    if (key == NULL)
+    {
+        free(parts);
+        THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate a distinct key");
+    }
+    memset(registers, 0, sizeof(registers));
+
+    createRecord(&record, rel->schema);
+    startScan(rel, &scan, cond);
+    while ((rc = next(&scan, record)) == RC_OK)
+    {
+        makeKey(parts, numParts, record->data, key);
+        uint64_t h = hashKey(key, keyLen, levelSeed(0));
+        int r = (int) (h >> (64 - DISTINCT_HLL_BITS));
+        uint8_t rank = (uint8_t) (__builtin_clzll((h << DISTINCT_HLL_BITS) | ((uint64_t) 1 << (DISTINCT_HLL_BITS - 1))) + 1);
+        if (rank > registers[r])
+            registers[r] = rank;
+    }
+    closeScan(&scan);
+    freeRecord(record);
+    free(key);
+    free(parts);
+    if (rc != RC_RM_NO_MORE_TUPLES)
+        return rc;
+
+    double sum = 0;
+    int zeros = 0;
+    for (int r = 0; r < m; r++)
+    {
+        sum += 1.0 / (double) ((uint64_t) 1 << registers[r]);
+        zeros += (registers[r] == 0);
+    }
+    double alpha = 0.7213 / (1.0 + 1.079 / m);
+    *estimate = alpha * m * m / sum;
+    if (*estimate <= 2.5 * m && zeros > 0)
+        *estimate = m * log((double) m / zeros);
+    return RC_OK;
+}
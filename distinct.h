@@ -0,0 +1,36 @@
+#ifndef DISTINCT_H
+#define DISTINCT_H
+
+#include <stddef.h>
+
+#include "dberror.h"
+#include "expr.h"
+#include "record_mgr.h"
+#include "tables.h"
+
+// memory a distinct scan used for its hash table unless told otherwise
+#define DISTINCT_DEFAULT_BUDGET (16 * 1024 * 1024)
+// files the records of a full hash table were spilled to
+#define DISTINCT_SPILL_PARTITIONS 16
+// HyperLogLog registers (2^DISTINCT_HLL_BITS): about 1.6% standard error
+#define DISTINCT_HLL_BITS 12
+
+// a scan returning one record per distinct key
+typedef struct RM_DistinctScan RM_DistinctScan;
+
+// keys are the bytes of attrs (numAttrs of them; 0 or NULL: the whole
+// record), so strings compare as stored and FLOATs bit for bit. next returns
+// a whole record for each key, with its RID, in no particular order; keys
+// that did not fit in memoryBudget bytes (0: the default) come last, after
+// their records were spilled to temporary files
+extern RC startDistinct (RM_TableData *rel, Expr *cond, int numAttrs, int *attrs,
+		size_t memoryBudget, RM_DistinctScan **distinct);
+extern RC nextDistinct (RM_DistinctScan *distinct, Record *record);
+extern RC closeDistinct (RM_DistinctScan *distinct);
+extern int getNumSpilledRecords (RM_DistinctScan *distinct);
+
+// HyperLogLog estimate of the number of distinct keys among the matching
+// records, in constant memory
+extern RC estimateDistinct (RM_TableData *rel, Expr *cond, int numAttrs, int *attrs, double *estimate);
+
+#endif // DISTINCT_H
@@ -1,6 +1,10 @@
 #ifndef DT_H
 #define DT_H
 
+// use the C99 bool everywhere so every translation unit agrees on its size
+// (record_mgr.c pulled in stdbool.h while other files fell back to short)
+#include <stdbool.h>
+
 // define bool if not defined
 #ifndef bool
     typedef short bool;
@@ -1,10 +1,15 @@
+#include <limits.h>
+#include <stdio.h>
 #include <string.h>
+#include <strings.h>
 #include <stdlib.h>
 
+#include "arena.h"
 #include "dberror.h"
 #include "record_mgr.h"
 #include "expr.h"
 #include "tables.h"
+#include "value_set.h"
 
 // implementations
 RC 
@@ -50,6 +55,7 @@ valueSmaller (Value *left, Value *right, Value *result)
 		break;
 	case DT_BOOL:
 		result->v.boolV = (left->v.boolV < right->v.boolV);
+		break;
 	case DT_STRING:
 		result->v.boolV = (strcmp(left->v.stringV, right->v.stringV) < 0);
 		break;
@@ -58,6 +64,235 @@ valueSmaller (Value *left, Value *right, Value *result)
 	return RC_OK;
 }
 
+// whether a three-way comparison result (<0, 0, >0) satisfied a comparison
+// operator; unordered (NaN) operands only satisfied !=
+static bool
+compareResult (OpType op, int cmp, bool unordered)
+{
+	if (unordered)
+		return (op == OP_COMP_NOT_EQUAL);
+
+	switch(op) {
+	case OP_COMP_EQUAL:
+		return cmp == 0;
+	case OP_COMP_SMALLER:
+		return cmp < 0;
+	case OP_COMP_GREATER:
+		return cmp > 0;
+	case OP_COMP_SMALLER_EQUAL:
+		return cmp <= 0;
+	case OP_COMP_GREATER_EQUAL:
+		return cmp >= 0;
+	case OP_COMP_NOT_EQUAL:
+		return cmp != 0;
+	default:
+		return false;
+	}
+}
+
+RC 
+valueCompare (OpType op, Value *left, Value *right, Value *result)
+{
+	int cmp = 0;
+	bool unordered = false;
+
+	if(left->dt != right->dt)
+		THROW(RC_RM_COMPARE_VALUE_OF_DIFFERENT_DATATYPE, "comparison only supported for values of the same datatype");
+
+	switch(left->dt) {
+	case DT_INT:
+		cmp = (left->v.intV > right->v.intV) - (left->v.intV < right->v.intV);
+		break;
+	case DT_FLOAT:
+		unordered = (left->v.floatV != left->v.floatV || right->v.floatV != right->v.floatV);
+		cmp = (left->v.floatV > right->v.floatV) - (left->v.floatV < right->v.floatV);
+		break;
+	case DT_BOOL:
+		cmp = (int) left->v.boolV - (int) right->v.boolV;
+		break;
+	case DT_STRING:
+		cmp = strcmp(left->v.stringV, right->v.stringV);
+		break;
+	}
+
+	result->dt = DT_BOOL;
+	result->v.boolV = compareResult(op, cmp, unordered);
+
+	return RC_OK;
+}
+
+static bool
+isNumeric (DataType dt)
+{
+	return dt == DT_INT || dt == DT_FLOAT;
+}
+
+static float
+asFloat (Value *v)
+{
+	return (v->dt == DT_INT) ? (float) v->v.intV : v->v.floatV;
+}
+
+// INT operands gave an INT result that wrapped around on overflow; an INT
+// mixed with a FLOAT was widened to FLOAT first
+RC
+valueArith (OpType op, Value *left, Value *right, Value *result)
+{
+	if (!isNumeric(left->dt) || !isNumeric(right->dt))
+		THROW(RC_RM_ARITH_ARG_IS_NOT_NUMERIC, "arithmetic requires INT or FLOAT operands");
+
+	if (left->dt == DT_INT && right->dt == DT_INT)
+	{
+		unsigned l = (unsigned) left->v.intV, r = (unsigned) right->v.intV;
+		result->dt = DT_INT;
+		switch(op) {
+		case OP_ARITH_ADD:
+			result->v.intV = (int) (l + r);
+			break;
+		case OP_ARITH_SUB:
+			result->v.intV = (int) (l - r);
+			break;
+		case OP_ARITH_MUL:
+			result->v.intV = (int) (l * r);
+			break;
+		case OP_ARITH_DIV:
+		case OP_ARITH_MOD:
+			if (right->v.intV == 0)
+				THROW(RC_RM_DIVISION_BY_ZERO, "integer division by zero");
+			// INT_MIN / -1 overflowed like the other operators did
+			if (right->v.intV == -1)
+				result->v.intV = (op == OP_ARITH_DIV) ? (int) (0u - l) : 0;
+			else
+				result->v.intV = (op == OP_ARITH_DIV) ? left->v.intV / right->v.intV
+								      : left->v.intV % right->v.intV;
+			break;
+		default:
+			THROW(RC_ERROR, "not an arithmetic operator");
+		}
+		return RC_OK;
+	}
+
+	float l = asFloat(left), r = asFloat(right);
+	result->dt = DT_FLOAT;
+	switch(op) {
+	case OP_ARITH_ADD:
+		result->v.floatV = l + r;
+		break;
+	case OP_ARITH_SUB:
+		result->v.floatV = l - r;
+		break;
+	case OP_ARITH_MUL:
+		result->v.floatV = l * r;
+		break;
+	case OP_ARITH_DIV:
+		result->v.floatV = l / r;
+		break;
+	case OP_ARITH_MOD:
+		THROW(RC_RM_ARITH_ARG_IS_NOT_NUMERIC, "modulo requires INT operands");
+	default:
+		THROW(RC_ERROR, "not an arithmetic operator");
+	}
+	return RC_OK;
+}
+
+// FLOAT to INT truncated and failed outside the INT range (or on NaN),
+// strings were parsed in full, and BOOL converted to and from 0/1 and
+// "true"/"false"; a STRING result came from evalAlloc
+RC
+valueCast (Value *input, DataType dt, Value *result)
+{
+	char buf[32];
+	char *end;
+	char *src;
+
+	result->dt = dt;
+	switch(dt) {
+	case DT_INT:
+		switch(input->dt) {
+		case DT_INT:
+			result->v.intV = input->v.intV;
+			break;
+		case DT_FLOAT:
+			if (!(input->v.floatV >= (float) INT_MIN && input->v.floatV < -(float) INT_MIN))
+				THROW(RC_RM_CAST_FAILED, "FLOAT out of the INT range");
+			result->v.intV = (int) input->v.floatV;
+			break;
+		case DT_BOOL:
+			result->v.intV = input->v.boolV ? 1 : 0;
+			break;
+		case DT_STRING:
+		{
+			long l = strtol(input->v.stringV, &end, 10);
+			if (end == input->v.stringV || *end != '\0' || l < INT_MIN || l > INT_MAX)
+				THROW(RC_RM_CAST_FAILED, "string is not an INT");
+			result->v.intV = (int) l;
+		}
+		break;
+		}
+		break;
+	case DT_FLOAT:
+		switch(input->dt) {
+		case DT_INT:
+			result->v.floatV = (float) input->v.intV;
+			break;
+		case DT_FLOAT:
+			result->v.floatV = input->v.floatV;
+			break;
+		case DT_BOOL:
+			result->v.floatV = input->v.boolV ? 1.0f : 0.0f;
+			break;
+		case DT_STRING:
+			result->v.floatV = strtof(input->v.stringV, &end);
+			if (end == input->v.stringV || *end != '\0')
+				THROW(RC_RM_CAST_FAILED, "string is not a FLOAT");
+			break;
+		}
+		break;
+	case DT_BOOL:
+		switch(input->dt) {
+		case DT_INT:
+			result->v.boolV = (input->v.intV != 0);
+			break;
+		case DT_FLOAT:
+			result->v.boolV = (input->v.floatV != 0);
+			break;
+		case DT_BOOL:
+			result->v.boolV = input->v.boolV;
+			break;
+		case DT_STRING:
+			if (strcasecmp(input->v.stringV, "true") == 0)
+				result->v.boolV = true;
+			else if (strcasecmp(input->v.stringV, "false") == 0)
+				result->v.boolV = false;
+			else
+				THROW(RC_RM_CAST_FAILED, "string is not a BOOL");
+			break;
+		}
+		break;
+	case DT_STRING:
+		switch(input->dt) {
+		case DT_INT:
+			sprintf(buf, "%d", input->v.intV);
+			break;
+		case DT_FLOAT:
+			sprintf(buf, "%.9g", input->v.floatV);
+			break;
+		case DT_BOOL:
+			strcpy(buf, input->v.boolV ? "true" : "false");
+			break;
+		case DT_STRING:
+			break;
+		}
+		src = (input->dt == DT_STRING) ? input->v.stringV : buf;
+		result->v.stringV = (char *) evalAlloc(strlen(src) + 1);
+		if (result->v.stringV == NULL)
+			return RC_MEMORY_ALLOCATION_ERROR;
+		strcpy(result->v.stringV, src);
+		break;
+	}
+	return RC_OK;
+}
+
 RC 
 boolNot (Value *input, Value *result)
 {
@@ -74,6 +309,7 @@ boolAnd (Value *left, Value *right, Value *result)
 {
 	if (left->dt != DT_BOOL || right->dt != DT_BOOL)
 		THROW(RC_RM_BOOLEAN_EXPR_ARG_IS_NOT_BOOLEAN, "boolean AND requires boolean inputs");
+	result->dt = DT_BOOL;
 	result->v.boolV = (left->v.boolV && right->v.boolV);
 
 	return RC_OK;
@@ -84,47 +320,176 @@ boolOr (Value *left, Value *right, Value *result)
 {
 	if (left->dt != DT_BOOL || right->dt != DT_BOOL)
 		THROW(RC_RM_BOOLEAN_EXPR_ARG_IS_NOT_BOOLEAN, "boolean OR requires boolean inputs");
+	result->dt = DT_BOOL;
 	result->v.boolV = (left->v.boolV || right->v.boolV);
 
 	return RC_OK;
 }
 
+static DataType
+castType (OpType op)
+{
+	switch(op) {
+	case OP_CAST_INT:
+		return DT_INT;
+	case OP_CAST_FLOAT:
+		return DT_FLOAT;
+	case OP_CAST_BOOL:
+		return DT_BOOL;
+	default:
+		return DT_STRING;
+	}
+}
+
+// CPVAL with the string taken from evalAlloc
+static void
+copyValue (Value *result, Value *input)
+{
+	result->dt = input->dt;
+	if (input->dt == DT_STRING)
+	{
+		result->v.stringV = (char *) evalAlloc(strlen(input->v.stringV) + 1);
+		strcpy(result->v.stringV, input->v.stringV);
+	}
+	else
+		result->v = input->v;
+}
+
+// dropped the result of an expression that failed and passed its error on,
+// so a failing operand anywhere below reached evalExpr's caller
+static RC
+failEval (Value **result, RC rc)
+{
+	evalFree(*result);
+	*result = NULL;
+	return rc;
+}
+
 RC
 evalExpr (Record *record, Schema *schema, Expr *expr, Value **result)
 {
 	Value *lIn;
 	Value *rIn;
-	MAKE_VALUE(*result, DT_INT, -1);
+	RC rc;
+
+	// the result and every temporary came from evalAlloc, so a scan that
+	// installed an arena did not touch malloc while evaluating a row
+	*result = (Value *) evalAlloc(sizeof(Value));
+	(*result)->dt = DT_INT;
+	(*result)->v.intV = -1;
 
 	switch(expr->type)
 	{
 	case EXPR_OP:
 	{
 		Operator *op = expr->expr.op;
-		bool twoArgs = (op->type != OP_BOOL_NOT);
+		bool twoArgs = (op->numArgs > 1);
 		//      lIn = (Value *) malloc(sizeof(Value));
 		//    rIn = (Value *) malloc(sizeof(Value));
 
-		CHECK(evalExpr(record, schema, op->args[0], &lIn));
-		if (twoArgs)
-			CHECK(evalExpr(record, schema, op->args[1], &rIn));
+		// AND/OR evaluated their arguments left to right and stopped at the
+		// first one that decided the result
+		if (op->type == OP_BOOL_AND || op->type == OP_BOOL_OR)
+		{
+			bool stopOn = (op->type == OP_BOOL_OR);
+			(*result)->dt = DT_BOOL;
+			(*result)->v.boolV = !stopOn;
+			for (int i = 0; i < op->numArgs; i++)
+			{
+				if ((rc = evalExpr(record, schema, op->args[i], &lIn)) != RC_OK)
+					return failEval(result, rc);
+				if (lIn->dt != DT_BOOL)
+				{
+					freeVal(lIn);
+					THROW(failEval(result, RC_RM_BOOLEAN_EXPR_ARG_IS_NOT_BOOLEAN), "boolean AND/OR requires boolean inputs");
+				}
+				bool b = lIn->v.boolV;
+				freeVal(lIn);
+				if (b == stopOn)
+				{
+					(*result)->v.boolV = stopOn;
+					break;
+				}
+			}
+			break;
+		}
 
-		switch(op->type)
+		// IN probed the pre-built set once instead of comparing with every value
+		if (op->type == OP_COMP_IN)
 		{
-		case OP_BOOL_NOT:
-			CHECK(boolNot(lIn, *result));
+			bool found;
+			if (op->args[1]->type != EXPR_VALUESET)
+				THROW(failEval(result, RC_ERROR), "IN requires a value set as its right-hand side");
+			if ((rc = evalExpr(record, schema, op->args[0], &lIn)) != RC_OK)
+				return failEval(result, rc);
+			rc = valueSetContains(op->args[1]->expr.set, lIn, &found);
+			freeVal(lIn);
+			if (rc != RC_OK)
+				return failEval(result, rc);
+			(*result)->dt = DT_BOOL;
+			(*result)->v.boolV = found;
 			break;
-		case OP_BOOL_AND:
-			CHECK(boolAnd(lIn, rIn, *result));
+		}
+
+		// BETWEEN evaluated its value once and compared it with both bounds
+		if (op->type == OP_COMP_BETWEEN)
+		{
+			Value *bound, cmp;
+			rc = evalExpr(record, schema, op->args[0], &lIn);
+			if (rc == RC_OK)
+			{
+				if ((rc = evalExpr(record, schema, op->args[1], &bound)) == RC_OK)
+				{
+					rc = valueCompare(OP_COMP_GREATER_EQUAL, lIn, bound, &cmp);
+					freeVal(bound);
+				}
+				if (rc == RC_OK && cmp.v.boolV
+					&& (rc = evalExpr(record, schema, op->args[2], &bound)) == RC_OK)
+				{
+					rc = valueCompare(OP_COMP_SMALLER_EQUAL, lIn, bound, &cmp);
+					freeVal(bound);
+				}
+				freeVal(lIn);
+			}
+			// a value or bound that failed to evaluate left nothing behind
+			if (rc != RC_OK)
+				return failEval(result, rc);
+			(*result)->dt = DT_BOOL;
+			(*result)->v.boolV = cmp.v.boolV;
 			break;
-		case OP_BOOL_OR:
-			CHECK(boolOr(lIn, rIn, *result));
+		}
+
+		// an operand that failed (division by zero, a string that did not
+		// parse) failed the whole expression
+		if ((rc = evalExpr(record, schema, op->args[0], &lIn)) != RC_OK)
+			return failEval(result, rc);
+		if (twoArgs && (rc = evalExpr(record, schema, op->args[1], &rIn)) != RC_OK)
+		{
+			freeVal(lIn);
+			return failEval(result, rc);
+		}
+
+		// arithmetic and casts reported their errors to the caller as well
+		if (op->type >= OP_CAST_INT)
+			rc = valueCast(lIn, castType(op->type), *result);
+		else if (op->type >= OP_ARITH_ADD)
+			rc = valueArith(op->type, lIn, rIn, *result);
+		else switch(op->type)
+		{
+		case OP_BOOL_NOT:
+			rc = boolNot(lIn, *result);
 			break;
 		case OP_COMP_EQUAL:
-			CHECK(valueEquals(lIn, rIn, *result));
+			rc = valueEquals(lIn, rIn, *result);
 			break;
 		case OP_COMP_SMALLER:
-			CHECK(valueSmaller(lIn, rIn, *result));
+			rc = valueSmaller(lIn, rIn, *result);
+			break;
+		case OP_COMP_GREATER:
+		case OP_COMP_SMALLER_EQUAL:
+		case OP_COMP_GREATER_EQUAL:
+		case OP_COMP_NOT_EQUAL:
+			rc = valueCompare(op->type, lIn, rIn, *result);
 			break;
 		default:
 			break;
@@ -134,14 +499,25 @@ evalExpr (Record *record, Schema *schema, Expr *expr, Value **result)
 		freeVal(lIn);
 		if (twoArgs)
 			freeVal(rIn);
+		if (rc != RC_OK)
+			return failEval(result, rc);
 	}
 	break;
 	case EXPR_CONST:
-		CPVAL(*result,expr->expr.cons);
+		copyValue(*result, expr->expr.cons);
+		break;
+	case EXPR_PARAM:
+		copyValue(*result, expr->expr.param);
 		break;
+	case EXPR_VALUESET:
+		THROW(failEval(result, RC_ERROR), "a value set can only be the right-hand side of IN");
 	case EXPR_ATTRREF:
-		free(*result);
-		CHECK(getAttr(record, schema, expr->expr.attrRef, result));
+		evalFree(*result);
+		if ((rc = getAttr(record, schema, expr->expr.attrRef, result)) != RC_OK)
+		{
+			*result = NULL;
+			return rc;
+		}
 		break;
 	}
 
@@ -156,23 +532,20 @@ freeExpr (Expr *expr)
 	case EXPR_OP:
 	{
 		Operator *op = expr->expr.op;
-		switch(op->type)
-		{
-		case OP_BOOL_NOT:
-			freeExpr(op->args[0]);
-			break;
-		default:
-			freeExpr(op->args[0]);
-			freeExpr(op->args[1]);
-			break;
-		}
+		for (int i = 0; i < op->numArgs; i++)
+			freeExpr(op->args[i]);
 		free(op->args);
+		free(op);
 	}
 	break;
 	case EXPR_CONST:
 		freeVal(expr->expr.cons);
 		break;
+	case EXPR_VALUESET:
+		freeValueSet(expr->expr.set);
+		break;
 	case EXPR_ATTRREF:
+	case EXPR_PARAM:
 		break;
 	}
 	free(expr);
@@ -180,11 +553,185 @@ freeExpr (Expr *expr)
 	return RC_OK;
 }
 
+// deep copy of a tree; parameters still point at the caller's slots
+RC
+copyExpr (Expr *expr, Expr **copy)
+{
+	Expr *c = (Expr *) malloc(sizeof(Expr));
+	RC rc = RC_OK;
+
+	*copy = NULL;
+	if (c == NULL)
+		return RC_MEMORY_ALLOCATION_ERROR;
+	*c = *expr;
+
+	switch(expr->type)
+	{
+	case EXPR_OP:
+	{
+		Operator *op = expr->expr.op;
+		Operator *cop = (Operator *) malloc(sizeof(Operator));
+		Expr **args = (Expr **) calloc(op->numArgs, sizeof(Expr*));
+		if (cop == NULL || args == NULL)
+		{
+			free(cop);
+			free(args);
+			free(c);
+			return RC_MEMORY_ALLOCATION_ERROR;
+		}
+		cop->type = op->type;
+		cop->numArgs = op->numArgs;
+		cop->args = args;
+		c->expr.op = cop;
+		for (int i = 0; i < op->numArgs && rc == RC_OK; i++)
+			rc = copyExpr(op->args[i], &args[i]);
+		if (rc != RC_OK)
+		{
+			// freed the partial copy; unset arguments were skipped
+			for (int i = 0; i < op->numArgs; i++)
+				if (args[i] != NULL)
+					freeExpr(args[i]);
+			free(args);
+			free(cop);
+			free(c);
+			return rc;
+		}
+	}
+	break;
+	case EXPR_CONST:
+		c->expr.cons = (Value *) malloc(sizeof(Value));
+		if (c->expr.cons == NULL)
+		{
+			free(c);
+			return RC_MEMORY_ALLOCATION_ERROR;
+		}
+		CPVAL(c->expr.cons, expr->expr.cons);
+		break;
+	case EXPR_VALUESET:
+		if ((rc = copyValueSet(expr->expr.set, &c->expr.set)) != RC_OK)
+		{
+			free(c);
+			return rc;
+		}
+		break;
+	case EXPR_ATTRREF:
+	case EXPR_PARAM:
+		break;
+	}
+
+	*copy = c;
+	return RC_OK;
+}
+
+// data type an expression evaluates to, without evaluating it (parameters
+// had the type of their slot's current value)
+RC
+exprType (Expr *expr, Schema *schema, DataType *dt)
+{
+	switch(expr->type)
+	{
+	case EXPR_CONST:
+		*dt = expr->expr.cons->dt;
+		return RC_OK;
+	case EXPR_PARAM:
+		*dt = expr->expr.param->dt;
+		return RC_OK;
+	case EXPR_ATTRREF:
+		if (schema == NULL || expr->expr.attrRef < 0 || expr->expr.attrRef >= schema->numAttr)
+			THROW(RC_ERROR, "attribute reference outside the schema");
+		*dt = schema->dataTypes[expr->expr.attrRef];
+		return RC_OK;
+	case EXPR_VALUESET:
+		THROW(RC_ERROR, "a value set has no value type");
+	case EXPR_OP:
+		break;
+	}
+
+	Operator *op = expr->expr.op;
+	if (op->type >= OP_CAST_INT)
+	{
+		*dt = castType(op->type);
+		return RC_OK;
+	}
+	if (op->type < OP_ARITH_ADD)
+	{
+		*dt = DT_BOOL;
+		return RC_OK;
+	}
+
+	DataType l, r;
+	RC rc;
+	if ((rc = exprType(op->args[0], schema, &l)) != RC_OK ||
+	    (rc = exprType(op->args[1], schema, &r)) != RC_OK)
+		return rc;
+	if (!isNumeric(l) || !isNumeric(r))
+		THROW(RC_RM_ARITH_ARG_IS_NOT_NUMERIC, "arithmetic requires INT or FLOAT operands");
+	if (op->type == OP_ARITH_MOD && (l != DT_INT || r != DT_INT))
+		THROW(RC_RM_ARITH_ARG_IS_NOT_NUMERIC, "modulo requires INT operands");
+	*dt = (l == DT_INT && r == DT_INT) ? DT_INT : DT_FLOAT;
+	return RC_OK;
+}
+
+// merge nested AND (OR) chains into one n-ary AND (OR), in place
+RC
+flattenExpr (Expr *expr)
+{
+	if (expr->type != EXPR_OP)
+		return RC_OK;
+
+	Operator *op = expr->expr.op;
+	for (int i = 0; i < op->numArgs; i++)
+		flattenExpr(op->args[i]);
+
+	if (op->type != OP_BOOL_AND && op->type != OP_BOOL_OR)
+		return RC_OK;
+
+	int n = 0;
+	for (int i = 0; i < op->numArgs; i++)
+	{
+		Expr *a = op->args[i];
+		if (a->type == EXPR_OP && a->expr.op->type == op->type)
+			n += a->expr.op->numArgs;
+		else
+			n++;
+	}
+	if (n == op->numArgs)
+		return RC_OK;
+
+	Expr **args = (Expr **) malloc(n * sizeof(Expr*));
+	if (args == NULL)
+		return RC_MEMORY_ALLOCATION_ERROR;
+
+	int k = 0;
+	for (int i = 0; i < op->numArgs; i++)
+	{
+		Expr *a = op->args[i];
+		if (a->type == EXPR_OP && a->expr.op->type == op->type)
+		{
+			Operator *child = a->expr.op;
+			memcpy(args + k, child->args, child->numArgs * sizeof(Expr*));
+			k += child->numArgs;
+			free(child->args);
+			free(child);
+			free(a);
+		}
+		else
+			args[k++] = a;
+	}
+	free(op->args);
+	op->args = args;
+	op->numArgs = n;
+
+	return RC_OK;
+}
+
+// values from evalExpr and getAttr may live in an evaluation arena, which
+// evalFree left alone
 void 
 freeVal (Value *val)
 {
 	if (val->dt == DT_STRING)
-		free(val->v.stringV);
-	free(val);
+		evalFree(val->v.stringV);
+	evalFree(val);
 }
 
@@ -8,7 +8,9 @@
 typedef enum ExprType {
   EXPR_OP,
   EXPR_CONST,
-  EXPR_ATTRREF
+  EXPR_ATTRREF,
+  EXPR_PARAM,
+  EXPR_VALUESET
 } ExprType;
 
 typedef struct Expr {
@@ -17,31 +19,58 @@ typedef struct Expr {
     Value *cons;
     int attrRef;
     struct Operator *op;
+    Value *param; // caller-owned slot, rebound in place between scans
+    struct ValueSet *set; // right-hand side of OP_COMP_IN, owned by the Expr
   } expr;
 } Expr;
 
-// comparison operators
+// operators
 typedef enum OpType {
   OP_BOOL_AND,
   OP_BOOL_OR,
   OP_BOOL_NOT,
   OP_COMP_EQUAL,
-  OP_COMP_SMALLER
+  OP_COMP_SMALLER,
+  OP_COMP_GREATER,
+  OP_COMP_SMALLER_EQUAL,
+  OP_COMP_GREATER_EQUAL,
+  OP_COMP_NOT_EQUAL,
+  OP_COMP_BETWEEN,  // low <= args[0] <= high, both bounds inclusive
+  OP_COMP_IN,       // args[0] is a member of the EXPR_VALUESET in args[1]
+  OP_ARITH_ADD,     // INT with INT gave an INT, mixed with a FLOAT a FLOAT
+  OP_ARITH_SUB,
+  OP_ARITH_MUL,
+  OP_ARITH_DIV,     // INT division truncated and failed on a zero divisor
+  OP_ARITH_MOD,     // INT operands only
+  OP_CAST_INT,      // args[0] converted to the named type
+  OP_CAST_FLOAT,
+  OP_CAST_STRING,
+  OP_CAST_BOOL
 } OpType;
 
+// AND and OR take numArgs >= 2 arguments and stop at the first one that
+// decides the result; NOT and the casts take one, BETWEEN takes three
+// (value, low, high), other comparisons and arithmetic take two
 typedef struct Operator {
   OpType type;
+  int numArgs;
   Expr **args;
 } Operator;
 
 // expression evaluation methods
 extern RC valueEquals (Value *left, Value *right, Value *result);
 extern RC valueSmaller (Value *left, Value *right, Value *result);
+extern RC valueCompare (OpType op, Value *left, Value *right, Value *result);
+extern RC valueArith (OpType op, Value *left, Value *right, Value *result);
+extern RC valueCast (Value *input, DataType dt, Value *result);
 extern RC boolNot (Value *input, Value *result);
 extern RC boolAnd (Value *left, Value *right, Value *result);
 extern RC boolOr (Value *left, Value *right, Value *result);
 extern RC evalExpr (Record *record, Schema *schema, Expr *expr, Value **result);
 extern RC freeExpr (Expr *expr);
+extern RC flattenExpr (Expr *expr);
+extern RC copyExpr (Expr *expr, Expr **copy);
+extern RC exprType (Expr *expr, Schema *schema, DataType *dt);
 extern void freeVal(Value *val);
 
 
@@ -73,6 +102,7 @@ extern void freeVal(Value *val);
       _result->type = EXPR_OP;						\
       _result->expr.op = _op;						\
       _op->type = _optype;						\
+      _op->numArgs = 2;							\
       _op->args = (Expr **) malloc(2 * sizeof(Expr*));			\
       _op->args[0] = _left;						\
       _op->args[1] = _right;						\
@@ -85,10 +115,38 @@ extern void freeVal(Value *val);
     _result->type = EXPR_OP;						\
     _result->expr.op = _op;						\
     _op->type = _optype;						\
+    _op->numArgs = 1;							\
     _op->args = (Expr **) malloc(sizeof(Expr*));			\
     _op->args[0] = _input;						\
   } while (0)
 
+// n-ary AND/OR over the _n expressions in _inputs (the array is copied)
+#define MAKE_NARY_EXPR(_result,_inputs,_n,_optype)			\
+  do {									\
+    Operator *_op = (Operator *) malloc(sizeof(Operator));		\
+    _result = (Expr *) malloc(sizeof(Expr));				\
+    _result->type = EXPR_OP;						\
+    _result->expr.op = _op;						\
+    _op->type = _optype;						\
+    _op->numArgs = (_n);						\
+    _op->args = (Expr **) malloc((_n) * sizeof(Expr*));			\
+    memcpy(_op->args, (_inputs), (_n) * sizeof(Expr*));			\
+  } while (0)
+
+#define MAKE_BETWEEN_EXPR(_result,_input,_low,_high)			\
+  do {									\
+    Operator *_op = (Operator *) malloc(sizeof(Operator));		\
+    _result = (Expr *) malloc(sizeof(Expr));				\
+    _result->type = EXPR_OP;						\
+    _result->expr.op = _op;						\
+    _op->type = OP_COMP_BETWEEN;					\
+    _op->numArgs = 3;							\
+    _op->args = (Expr **) malloc(3 * sizeof(Expr*));			\
+    _op->args[0] = _input;						\
+    _op->args[1] = _low;						\
+    _op->args[2] = _high;						\
+  } while (0)
+
 #define MAKE_ATTRREF(_result,_attr)					\
   do {									\
     _result = (Expr *) malloc(sizeof(Expr));				\
@@ -103,6 +161,25 @@ extern void freeVal(Value *val);
     _result->expr.cons = _value;					\
   } while(0)
 
+// a parameter reads its value from _slot at evaluation time; the slot is
+// not freed by freeExpr, so the caller can rebind it without rebuilding
+// the tree
+#define MAKE_PARAM(_result,_slot)					\
+  do {									\
+    _result = (Expr *) malloc(sizeof(Expr));				\
+    _result->type = EXPR_PARAM;						\
+    _result->expr.param = _slot;					\
+  } while(0)
+
+// a set built with createValueSet (value_set.h), used as the right-hand
+// side of OP_COMP_IN; freeExpr frees the set
+#define MAKE_VALUESET(_result,_set)					\
+  do {									\
+    _result = (Expr *) malloc(sizeof(Expr));				\
+    _result->type = EXPR_VALUESET;					\
+    _result->expr.set = _set;						\
+  } while(0)
+
 
 
 #endif // EXPR
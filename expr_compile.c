@@ -0,0 +1,1594 @@
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dberror.h"
+#include "expr.h"
+#include "expr_compile.h"
+#include "pred_simd.h"
+#include "record_mgr.h"
+#include "tables.h"
+#include "value_set.h"
+
+/*
+ * Compiled predicates
+ * ---------------------------------------------------------------
+ * compilePredicate flattened an Expr tree into a list of register
+ * instructions. Attribute references were resolved to byte offsets once,
+ * constants were decoded once into the initial register file, and the
+ * interpreter in evalPredicate then ran over raw record bytes without
+ * allocating anything. Nested AND/OR chains were flattened and compiled to
+ * conditional jumps, so evaluation stopped at the first deciding term.
+ * Comparisons were specialized by data type at compile time. Strings of a
+ * fixed-length attribute were compared in place as zero-padded buffers of
+ * the attribute's width, against another attribute of that width or a
+ * constant padded to it, with a comparator resolved once for the width.
+ * > and >= were compiled as < and <= with swapped operands, != as = followed
+ * by a NOT, BETWEEN as two <= joined by a jump, and IN as one probe of the
+ * operator's ValueSet. Arithmetic on INT and FLOAT registers was compiled
+ * too, with an INT operand widened by a conversion instruction when the
+ * other one was a FLOAT, as were casts between INT and FLOAT; casts from or
+ * to STRING and BOOL were left to evalExpr.
+ *
+ * compileValueExpr compiled an expression that produced a value instead of
+ * a condition (a computed column), and evalValueExpr wrote that value into
+ * a buffer in the record layout.
+ *
+ * A top-level conjunction was compiled as one code segment (term) per
+ * conjunct. evalPredicate ran the terms in the order written; with a
+ * PredRuntime, evalPredicateAdaptive tracked the pass rate and executed cost
+ * of each term and periodically moved cheap, selective terms to the front.
+ * A term that could fail (a division, a FLOAT to INT conversion, a parameter
+ * of the wrong type) was never moved, nor was any term moved past it, so
+ * "b != 0 AND a / b > 1" still guarded the division.
+ *
+ * When every leaf of the condition was an attribute compared with a constant
+ * or parameter in a shape pred_simd.c had a kernel for, the program also got
+ * a selection plan: the condition in postfix form over selection bitmaps,
+ * evaluated a block of records at a time by evalPredicateBatch.
+ */
+
+/* The instruction set of the predicate interpreter. */
+typedef enum PredOpCode {
+    PI_LOAD_ATTR,   // regs[dst] = attribute at data + offset
+    PI_LOAD_PARAM,  // regs[dst] = current value of a parameter slot
+    PI_EQ_INT,
+    PI_EQ_FLOAT,
+    PI_EQ_BOOL,
+    PI_EQ_STRING,
+    PI_LT_INT,
+    PI_LT_FLOAT,
+    PI_LT_BOOL,
+    PI_LT_STRING,
+    PI_LE_INT,
+    PI_LE_FLOAT,
+    PI_LE_BOOL,
+    PI_LE_STRING,
+    PI_EQ_FIXED,    // zero-padded strings of len bytes, compared with bytes()
+    PI_LT_FIXED,
+    PI_LE_FIXED,
+    PI_IN,          // regs[dst] = regs[a] is in set (of type dt)
+    PI_ADD_INT,     // INT arithmetic wrapped around like valueArith
+    PI_SUB_INT,
+    PI_MUL_INT,
+    PI_DIV_INT,     // failed on a zero divisor
+    PI_MOD_INT,
+    PI_ADD_FLOAT,
+    PI_SUB_FLOAT,
+    PI_MUL_FLOAT,
+    PI_DIV_FLOAT,
+    PI_INT_TO_FLOAT,
+    PI_FLOAT_TO_INT, // failed outside the INT range
+    PI_NOT,
+    PI_MOVE,        // regs[dst] = regs[a]
+    PI_JUMP_FALSE,  // continue at target if regs[a] was false
+    PI_JUMP_TRUE    // continue at target if regs[a] was true
+} PredOpCode;
+
+/* One register. Strings pointed into the record or at a decoded constant. */
+typedef struct PredReg {
+    union {
+        int intV;
+        float floatV;
+        bool boolV;
+        struct {
+            const char *ptr;
+            int len;        // maximum length; the string ended earlier at a NUL
+        } str;
+    } v;
+} PredReg;
+
+/* One instruction; only the fields its opcode used were set. */
+typedef struct PredInstr {
+    PredOpCode op;
+    int dst;
+    int a;
+    int b;
+    int target;      // PI_JUMP_*
+    int offset;      // PI_LOAD_ATTR
+    int len;         // PI_LOAD_ATTR on strings
+    DataType dt;     // PI_LOAD_ATTR / PI_LOAD_PARAM
+    Value *param;    // PI_LOAD_PARAM
+    ValueSet *set;   // PI_IN
+    ByteComparator bytes; // PI_*_FIXED, resolved for len at compile time
+    int weight;      // relative cost charged when the instruction ran
+} PredInstr;
+
+/* One conjunct of the condition: code[start, end) left its result in reg. */
+typedef struct PredTerm {
+    int start;
+    int end;
+    int reg;
+    bool mayFail;    // had an instruction that could return an error
+} PredTerm;
+
+/* One step of a selection plan, in postfix order. */
+typedef enum SelStepKind {
+    SS_LEAF,   // pushed the bitmap of one comparison
+    SS_AND,    // replaced the top n bitmaps with their AND
+    SS_OR,     // replaced the top n bitmaps with their OR
+    SS_NOT     // inverted the top bitmap
+} SelStepKind;
+
+typedef struct SelStep {
+    SelStepKind kind;
+    int n;                 // SS_AND / SS_OR
+    DataType dt;           // SS_LEAF: attribute type
+    SelCompare cmp;
+    int offset;
+    int len;
+    PredReg cons;          // decoded constant (strings: zero padded to len)
+    Value *param;          // instead of cons when the leaf compared with a parameter
+    ValueSet *set;         // instead of cons and cmp for an IN leaf
+    bool never;            // a string constant longer than the attribute
+} SelStep;
+
+#define SEL_MAX_STEPS 32
+#define SEL_MAX_DEPTH 8
+#define SEL_BLOCK 1024     // records per block; a multiple of 64
+
+struct PredProgram {
+    PredInstr *code;
+    int numInstr;
+    int capInstr;
+    PredReg init[PRED_MAX_REGS];  // registers pre-loaded with constants
+    int numRegs;
+    PredTerm terms[PRED_MAX_TERMS];
+    int numTerms;                 // the condition was the AND of all terms
+    char **strings;               // decoded string constants owned by the program
+    int numStrings;
+    SelStep plan[SEL_MAX_STEPS];  // selection plan, if numSteps > 0
+    int numSteps;
+    DataType resultType;          // type of terms[0].reg in a value program
+};
+
+/* Per-scan statistics used to reorder the terms of one program. */
+typedef struct PredTermStats {
+    double evals;    // how often the term ran (decayed)
+    double passes;   // how often it was true (decayed)
+    double cost;     // summed weights of the instructions it executed (decayed)
+} PredTermStats;
+
+struct PredRuntime {
+    PredProgram *prog;
+    int order[PRED_MAX_TERMS];
+    PredTermStats stats[PRED_MAX_TERMS];
+    int sinceReorder;
+};
+
+/* --------------------------------------------------------------------------
+   Helpers
+   -------------------------------------------------------------------------- */
+
+/*
+ * compareStrings
+ * --------------
+ * Compared two fixed-capacity strings with strcmp semantics: each ended at its
+ * first NUL or at its capacity, whichever came first.
+ */
+static int
+compareStrings(const char *a, int alen, const char *b, int blen)
+{
+    int la = (int) strnlen(a, alen);
+    int lb = (int) strnlen(b, blen);
+    int r  = memcmp(a, b, la < lb ? la : lb);
+    if (r != 0)
+        return r;
+    return la - lb;
+}
+
+/*
+ * newReg / emit
+ * -------------
+ * Allocated a register or appended an instruction. Returned -1 (newReg) or
+ * NULL (emit) when the program would exceed its limits.
+ */
+static int
+newReg(PredProgram *prog)
+{
+    if (prog->numRegs >= PRED_MAX_REGS)
+        return -1;
+    memset(&prog->init[prog->numRegs], 0, sizeof(PredReg));
+    return prog->numRegs++;
+}
+
+static PredInstr *
+emit(PredProgram *prog, PredOpCode op, int dst, int a, int b)
+{
+    if (prog->numInstr == prog->capInstr)
+    {
+        int cap = prog->capInstr ? prog->capInstr * 2 : 16;
+        PredInstr *code = (PredInstr *) realloc(prog->code, cap * sizeof(PredInstr));
+        if (code == NULL)
+            return NULL;
+        prog->code     = code;
+        prog->capInstr = cap;
+    }
+    PredInstr *in = &prog->code[prog->numInstr++];
+    memset(in, 0, sizeof(PredInstr));
+    in->op  = op;
+    in->dst = dst;
+    in->a   = (a < 0) ? dst : a;   // unused operands pointed at a valid register
+    in->b   = (b < 0) ? dst : b;
+    in->weight = (op == PI_EQ_STRING || op == PI_LT_STRING || op == PI_LE_STRING) ? 4 :
+                 (op == PI_IN) ? 3 :
+                 (op == PI_EQ_FIXED || op == PI_LT_FIXED || op == PI_LE_FIXED) ? 2 : 1;
+    return in;
+}
+
+/*
+ * loadConstant
+ * ------------
+ * Decoded a constant into a fresh register of the initial register file.
+ * String constants were copied once and owned by the program.
+ */
+static RC
+loadConstant(PredProgram *prog, Value *val, int *reg)
+{
+    int r = newReg(prog);
+    if (r < 0)
+        return RC_ERROR;
+
+    switch (val->dt)
+    {
+        case DT_INT:
+            prog->init[r].v.intV = val->v.intV;
+            break;
+        case DT_FLOAT:
+            prog->init[r].v.floatV = val->v.floatV;
+            break;
+        case DT_BOOL:
+            prog->init[r].v.boolV = val->v.boolV;
+            break;
+        case DT_STRING:
+        {
+            char **strings = (char **) realloc(prog->strings, (prog->numStrings + 1) * sizeof(char *));
+            if (strings == NULL)
+                return RC_MEMORY_ALLOCATION_ERROR;
+            prog->strings = strings;
+            char *copy = strdup(val->v.stringV);
+            if (copy == NULL)
+                return RC_MEMORY_ALLOCATION_ERROR;
+            prog->strings[prog->numStrings++] = copy;
+            prog->init[r].v.str.ptr = copy;
+            prog->init[r].v.str.len = (int) strlen(copy);
+        }
+        break;
+    }
+    *reg = r;
+    return RC_OK;
+}
+
+/*
+ * fixedWidth
+ * ----------
+ * Found the width at which two string operands could be compared in place:
+ * the length of an attribute, when the other side was an attribute of the
+ * same length or a constant that fit (its register was then re-pointed at a
+ * copy padded with zeros, the way setAttr padded attributes). Returned 0 when
+ * neither applied, e.g. for parameters.
+ */
+static int
+fixedWidth(PredProgram *prog, Schema *schema, Expr *x, int rx, Expr *y, int ry)
+{
+    if (x->type != EXPR_ATTRREF)
+    {
+        Expr *te = x; x = y; y = te;
+        int tr = rx; rx = ry; ry = tr;
+    }
+    if (x->type != EXPR_ATTRREF)
+        return 0;
+
+    int len = schema->typeLength[x->expr.attrRef];
+    if (y->type == EXPR_ATTRREF)
+        return (schema->typeLength[y->expr.attrRef] == len) ? len : 0;
+    if (y->type != EXPR_CONST || (int) strlen(y->expr.cons->v.stringV) > len)
+        return 0;
+
+    char **strings = (char **) realloc(prog->strings, (prog->numStrings + 1) * sizeof(char *));
+    if (strings == NULL)
+        return 0;
+    prog->strings = strings;
+    char *padded = (char *) calloc(len + 1, 1);
+    if (padded == NULL)
+        return 0;
+    strcpy(padded, y->expr.cons->v.stringV);
+    prog->strings[prog->numStrings++] = padded;
+    prog->init[ry].v.str.ptr = padded;
+    prog->init[ry].v.str.len = len;
+    return len;
+}
+
+static RC compileNode(PredProgram *prog, Schema *schema, Expr *expr, DataType hint,
+                      bool hasHint, int *reg, DataType *dt);
+
+/*
+ * widen
+ * -----
+ * Converted an INT register to FLOAT in a new register.
+ */
+static RC
+widen(PredProgram *prog, int *reg)
+{
+    int r = newReg(prog);
+    if (r < 0)
+        return RC_ERROR;
+    if (emit(prog, PI_INT_TO_FLOAT, r, *reg, -1) == NULL)
+        return RC_MEMORY_ALLOCATION_ERROR;
+    *reg = r;
+    return RC_OK;
+}
+
+/*
+ * compileArith
+ * ------------
+ * Emitted the arithmetic instruction for two compiled operands. An INT next
+ * to a FLOAT was widened first; other types and FLOAT modulo were rejected.
+ */
+static RC
+compileArith(PredProgram *prog, OpType type, int ra, DataType da, int rb, DataType db,
+             int *reg, DataType *dt)
+{
+    RC rc;
+    if ((da != DT_INT && da != DT_FLOAT) || (db != DT_INT && db != DT_FLOAT))
+        return RC_ERROR;
+
+    bool isFloat = (da == DT_FLOAT || db == DT_FLOAT);
+    if (isFloat && type == OP_ARITH_MOD)
+        return RC_ERROR;
+    if (isFloat && da == DT_INT && (rc = widen(prog, &ra)) != RC_OK)
+        return rc;
+    if (isFloat && db == DT_INT && (rc = widen(prog, &rb)) != RC_OK)
+        return rc;
+
+    PredOpCode code;
+    switch (type)
+    {
+        case OP_ARITH_ADD: code = isFloat ? PI_ADD_FLOAT : PI_ADD_INT; break;
+        case OP_ARITH_SUB: code = isFloat ? PI_SUB_FLOAT : PI_SUB_INT; break;
+        case OP_ARITH_MUL: code = isFloat ? PI_MUL_FLOAT : PI_MUL_INT; break;
+        case OP_ARITH_DIV: code = isFloat ? PI_DIV_FLOAT : PI_DIV_INT; break;
+        case OP_ARITH_MOD: code = PI_MOD_INT;                          break;
+        default:
+            return RC_ERROR;
+    }
+
+    int r = newReg(prog);
+    if (r < 0)
+        return RC_ERROR;
+    if (emit(prog, code, r, ra, rb) == NULL)
+        return RC_MEMORY_ALLOCATION_ERROR;
+    *reg = r;
+    *dt  = isFloat ? DT_FLOAT : DT_INT;
+    return RC_OK;
+}
+
+/*
+ * compileCast
+ * -----------
+ * Compiled a cast between INT and FLOAT, or to the type the operand already
+ * had; other casts were rejected.
+ */
+static RC
+compileCast(PredProgram *prog, Schema *schema, Operator *op, int *reg, DataType *dt)
+{
+    DataType target = (op->type == OP_CAST_INT)   ? DT_INT :
+                      (op->type == OP_CAST_FLOAT) ? DT_FLOAT :
+                      (op->type == OP_CAST_BOOL)  ? DT_BOOL : DT_STRING;
+    int ra;
+    DataType da;
+    RC rc;
+
+    if (op->numArgs != 1 || op->args[0]->type == EXPR_PARAM)
+        return RC_ERROR;
+    if ((rc = compileNode(prog, schema, op->args[0], target, true, &ra, &da)) != RC_OK)
+        return rc;
+    *dt = target;
+    if (da == target)
+    {
+        *reg = ra;
+        return RC_OK;
+    }
+    if (da == DT_INT && target == DT_FLOAT)
+    {
+        *reg = ra;
+        return widen(prog, reg);
+    }
+    if (da != DT_FLOAT || target != DT_INT)
+        return RC_ERROR;
+
+    int r = newReg(prog);
+    if (r < 0)
+        return RC_ERROR;
+    if (emit(prog, PI_FLOAT_TO_INT, r, ra, -1) == NULL)
+        return RC_MEMORY_ALLOCATION_ERROR;
+    *reg = r;
+    return RC_OK;
+}
+
+/*
+ * compileChain
+ * ------------
+ * Compiled an AND/OR with all nested arguments of the same operator pulled up
+ * into one chain. Each term was copied into the result register followed by a
+ * jump to the end as soon as it decided the outcome.
+ */
+static RC
+compileChain(PredProgram *prog, Schema *schema, Operator *op, int dst,
+             int *pending, int *numPending)
+{
+    PredOpCode jump = (op->type == OP_BOOL_AND) ? PI_JUMP_FALSE : PI_JUMP_TRUE;
+
+    for (int i = 0; i < op->numArgs; i++)
+    {
+        Expr *arg = op->args[i];
+        RC rc;
+
+        if (arg->type == EXPR_OP && arg->expr.op->type == op->type)
+        {
+            if ((rc = compileChain(prog, schema, arg->expr.op, dst, pending, numPending)) != RC_OK)
+                return rc;
+            continue;
+        }
+
+        int r;
+        DataType dt;
+        if ((rc = compileNode(prog, schema, arg, DT_BOOL, true, &r, &dt)) != RC_OK)
+            return rc;
+        if (dt != DT_BOOL)
+            return RC_ERROR;
+        if (emit(prog, PI_MOVE, dst, r, -1) == NULL)
+            return RC_MEMORY_ALLOCATION_ERROR;
+
+        // Remembered the jump so its target could be patched once the end was known
+        if (*numPending >= PRED_MAX_REGS * 4)
+            return RC_ERROR;
+        if (emit(prog, jump, dst, dst, -1) == NULL)
+            return RC_MEMORY_ALLOCATION_ERROR;
+        pending[(*numPending)++] = prog->numInstr - 1;
+    }
+    return RC_OK;
+}
+
+/*
+ * compileNode
+ * -----------
+ * Compiled one node of the tree and reported the register and data type its
+ * value ended up in. Parameters took their type from the other side of the
+ * comparison (hint); a comparison of two parameters, mismatched types and
+ * non-boolean logic were rejected so that the caller fell back to evalExpr,
+ * which reported those errors exactly as before.
+ */
+static RC
+compileNode(PredProgram *prog, Schema *schema, Expr *expr, DataType hint,
+            bool hasHint, int *reg, DataType *dt)
+{
+    switch (expr->type)
+    {
+        case EXPR_CONST:
+            *dt = expr->expr.cons->dt;
+            return loadConstant(prog, expr->expr.cons, reg);
+
+        case EXPR_ATTRREF:
+        {
+            int attr = expr->expr.attrRef;
+            if (schema == NULL || attr < 0 || attr >= schema->numAttr)
+                return RC_ERROR;
+
+            int offset = getAttrOffset(schema, attr);
+
+            int r = newReg(prog);
+            if (r < 0)
+                return RC_ERROR;
+            PredInstr *in = emit(prog, PI_LOAD_ATTR, r, -1, -1);
+            if (in == NULL)
+                return RC_MEMORY_ALLOCATION_ERROR;
+            in->offset = offset;
+            in->dt     = schema->dataTypes[attr];
+            in->len    = schema->typeLength[attr];
+            *reg = r;
+            *dt  = in->dt;
+            return RC_OK;
+        }
+
+        case EXPR_PARAM:
+        {
+            if (!hasHint)
+                return RC_ERROR;
+            int r = newReg(prog);
+            if (r < 0)
+                return RC_ERROR;
+            PredInstr *in = emit(prog, PI_LOAD_PARAM, r, -1, -1);
+            if (in == NULL)
+                return RC_MEMORY_ALLOCATION_ERROR;
+            in->dt    = hint;
+            in->param = expr->expr.param;
+            *reg = r;
+            *dt  = hint;
+            return RC_OK;
+        }
+
+        case EXPR_VALUESET:
+            return RC_ERROR;
+
+        case EXPR_OP:
+            break;
+    }
+
+    Operator *op = expr->expr.op;
+    int ra, rb = -1;
+    DataType da;
+    RC rc;
+
+    if (op->type == OP_BOOL_AND || op->type == OP_BOOL_OR)
+    {
+        int pending[PRED_MAX_REGS * 4];
+        int numPending = 0;
+        int r = newReg(prog);
+        if (r < 0)
+            return RC_ERROR;
+        if ((rc = compileChain(prog, schema, op, r, pending, &numPending)) != RC_OK)
+            return rc;
+        for (int i = 0; i < numPending; i++)
+            prog->code[pending[i]].target = prog->numInstr;
+        *reg = r;
+        *dt  = DT_BOOL;
+        return RC_OK;
+    }
+
+    if (op->type == OP_BOOL_NOT)
+    {
+        if ((rc = compileNode(prog, schema, op->args[0], DT_BOOL, true, &ra, &da)) != RC_OK)
+            return rc;
+        if (da != DT_BOOL)
+            return RC_ERROR;
+        int r = newReg(prog);
+        if (r < 0)
+            return RC_ERROR;
+        if (emit(prog, PI_NOT, r, ra, -1) == NULL)
+            return RC_MEMORY_ALLOCATION_ERROR;
+        *reg = r;
+        *dt  = DT_BOOL;
+        return RC_OK;
+    }
+
+    if (op->type == OP_COMP_IN)
+    {
+        if (op->args[1]->type != EXPR_VALUESET)
+            return RC_ERROR;
+        ValueSet *set = op->args[1]->expr.set;
+        if ((rc = compileNode(prog, schema, op->args[0], valueSetType(set), true, &ra, &da)) != RC_OK)
+            return rc;
+        if (da != valueSetType(set))
+            return RC_ERROR;
+        int r = newReg(prog);
+        if (r < 0)
+            return RC_ERROR;
+        PredInstr *in = emit(prog, PI_IN, r, ra, -1);
+        if (in == NULL)
+            return RC_MEMORY_ALLOCATION_ERROR;
+        in->dt  = da;
+        in->set = set;
+        *reg = r;
+        *dt  = DT_BOOL;
+        return RC_OK;
+    }
+
+    if (op->type == OP_COMP_BETWEEN)
+    {
+        // low <= v, and only then v <= high, both into the same register
+        int rv, rl, rh;
+        DataType dv, dl, dh;
+        if (op->args[0]->type == EXPR_PARAM)
+            return RC_ERROR;
+        if ((rc = compileNode(prog, schema, op->args[0], DT_BOOL, false, &rv, &dv)) != RC_OK ||
+            (rc = compileNode(prog, schema, op->args[1], dv, true, &rl, &dl)) != RC_OK ||
+            (rc = compileNode(prog, schema, op->args[2], dv, true, &rh, &dh)) != RC_OK)
+            return rc;
+        if (dl != dv || dh != dv)
+            return RC_ERROR;
+
+        PredOpCode le = (dv == DT_INT)   ? PI_LE_INT :
+                        (dv == DT_FLOAT) ? PI_LE_FLOAT :
+                        (dv == DT_BOOL)  ? PI_LE_BOOL : PI_LE_STRING;
+        int r = newReg(prog);
+        if (r < 0)
+            return RC_ERROR;
+        if (emit(prog, le, r, rl, rv) == NULL || emit(prog, PI_JUMP_FALSE, r, r, -1) == NULL)
+            return RC_MEMORY_ALLOCATION_ERROR;
+        int jump = prog->numInstr - 1;
+        if (emit(prog, le, r, rv, rh) == NULL)
+            return RC_MEMORY_ALLOCATION_ERROR;
+        prog->code[jump].target = prog->numInstr;
+        *reg = r;
+        *dt  = DT_BOOL;
+        return RC_OK;
+    }
+
+    if (op->type >= OP_CAST_INT)
+        return compileCast(prog, schema, op, reg, dt);
+
+    if (op->numArgs != 2)
+        return RC_ERROR;
+
+    // Compiled the non-parameter side first so a parameter could borrow its type
+    bool paramFirst = (op->args[0]->type == EXPR_PARAM);
+    Expr *first  = paramFirst ? op->args[1] : op->args[0];
+    Expr *second = paramFirst ? op->args[0] : op->args[1];
+    int r1, r2;
+    DataType d1, d2;
+
+    if ((rc = compileNode(prog, schema, first, DT_BOOL, false, &r1, &d1)) != RC_OK)
+        return rc;
+    if ((rc = compileNode(prog, schema, second, d1, true, &r2, &d2)) != RC_OK)
+        return rc;
+
+    ra = paramFirst ? r2 : r1;
+    rb = paramFirst ? r1 : r2;
+    if (op->type >= OP_ARITH_ADD)
+        return compileArith(prog, op->type, ra, paramFirst ? d2 : d1, rb, paramFirst ? d1 : d2, reg, dt);
+    if (d1 != d2)
+        return RC_ERROR;
+    da = d1;
+
+    // a > b was b < a and a >= b was b <= a
+    if (op->type == OP_COMP_GREATER || op->type == OP_COMP_GREATER_EQUAL)
+    {
+        int t = ra;
+        ra = rb;
+        rb = t;
+    }
+
+    PredOpCode code;
+    switch (op->type)
+    {
+        case OP_COMP_EQUAL:
+        case OP_COMP_NOT_EQUAL:
+            code = (da == DT_INT)   ? PI_EQ_INT :
+                   (da == DT_FLOAT) ? PI_EQ_FLOAT :
+                   (da == DT_BOOL)  ? PI_EQ_BOOL : PI_EQ_STRING;
+            break;
+        case OP_COMP_SMALLER:
+        case OP_COMP_GREATER:
+            code = (da == DT_INT)   ? PI_LT_INT :
+                   (da == DT_FLOAT) ? PI_LT_FLOAT :
+                   (da == DT_BOOL)  ? PI_LT_BOOL : PI_LT_STRING;
+            break;
+        case OP_COMP_SMALLER_EQUAL:
+        case OP_COMP_GREATER_EQUAL:
+            code = (da == DT_INT)   ? PI_LE_INT :
+                   (da == DT_FLOAT) ? PI_LE_FLOAT :
+                   (da == DT_BOOL)  ? PI_LE_BOOL : PI_LE_STRING;
+            break;
+        default:
+            return RC_ERROR;
+    }
+
+    int width = (da == DT_STRING) ? fixedWidth(prog, schema, first, r1, second, r2) : 0;
+    if (width > 0)
+        code = (code == PI_EQ_STRING) ? PI_EQ_FIXED :
+               (code == PI_LT_STRING) ? PI_LT_FIXED : PI_LE_FIXED;
+
+    int r = newReg(prog);
+    if (r < 0)
+        return RC_ERROR;
+    PredInstr *in = emit(prog, code, r, ra, rb);
+    if (in == NULL)
+        return RC_MEMORY_ALLOCATION_ERROR;
+    if (width > 0)
+    {
+        in->len   = width;
+        in->bytes = selByteComparator(width);
+    }
+    if (op->type == OP_COMP_NOT_EQUAL && emit(prog, PI_NOT, r, r, -1) == NULL)
+        return RC_MEMORY_ALLOCATION_ERROR;
+    *reg = r;
+    *dt  = DT_BOOL;
+    return RC_OK;
+}
+
+/*
+ * collectConjuncts
+ * ----------------
+ * Listed the conjuncts of a condition: the arguments of a top-level AND with
+ * nested ANDs pulled up, or the condition itself. Failed with more than
+ * PRED_MAX_TERMS conjuncts.
+ */
+static RC
+collectConjuncts(Expr *expr, Expr **conj, int *numConj)
+{
+    if (expr->type == EXPR_OP && expr->expr.op->type == OP_BOOL_AND)
+    {
+        Operator *op = expr->expr.op;
+        for (int i = 0; i < op->numArgs; i++)
+        {
+            RC rc = collectConjuncts(op->args[i], conj, numConj);
+            if (rc != RC_OK)
+                return rc;
+        }
+        return RC_OK;
+    }
+    if (*numConj >= PRED_MAX_TERMS)
+        return RC_ERROR;
+    conj[(*numConj)++] = expr;
+    return RC_OK;
+}
+
+/*
+ * runCode
+ * -------
+ * Interpreted code[start, end) over one record and added the weights of the
+ * executed instructions to *cost.
+ */
+static RC
+runCode(PredProgram *prog, PredReg *regs, int start, int end, char *data, int *cost)
+{
+    PredInstr *in   = prog->code + start;
+    PredInstr *stop = prog->code + end;
+    int spent = 0;
+    for (; in < stop; in++)
+    {
+        PredReg *d = &regs[in->dst];
+        PredReg *a = &regs[in->a];
+        PredReg *b = &regs[in->b];
+        spent += in->weight;
+
+        switch (in->op)
+        {
+            case PI_LOAD_ATTR:
+            {
+                char *field = data + in->offset;
+                switch (in->dt)
+                {
+                    case DT_INT:    memcpy(&d->v.intV, field, sizeof(int));     break;
+                    case DT_FLOAT:  memcpy(&d->v.floatV, field, sizeof(float)); break;
+                    case DT_BOOL:   memcpy(&d->v.boolV, field, sizeof(bool));   break;
+                    case DT_STRING:
+                        d->v.str.ptr = field;
+                        d->v.str.len = in->len;
+                        break;
+                }
+            }
+            break;
+            case PI_LOAD_PARAM:
+            {
+                Value *pv = in->param;
+                if (pv->dt == DT_INT && in->dt == DT_FLOAT)
+                {
+                    // widened as evalExpr did when the slot was rebound
+                    d->v.floatV = (float) pv->v.intV;
+                    break;
+                }
+                if (pv->dt != in->dt)
+                    THROW(RC_RM_COMPARE_VALUE_OF_DIFFERENT_DATATYPE, "parameter type does not match the compared value");
+                switch (pv->dt)
+                {
+                    case DT_INT:   d->v.intV   = pv->v.intV;   break;
+                    case DT_FLOAT: d->v.floatV = pv->v.floatV; break;
+                    case DT_BOOL:  d->v.boolV  = pv->v.boolV;  break;
+                    case DT_STRING:
+                        d->v.str.ptr = pv->v.stringV;
+                        d->v.str.len = (int) strlen(pv->v.stringV);
+                        break;
+                }
+            }
+            break;
+            case PI_EQ_INT:    d->v.boolV = (a->v.intV == b->v.intV);     break;
+            case PI_EQ_FLOAT:  d->v.boolV = (a->v.floatV == b->v.floatV); break;
+            case PI_EQ_BOOL:   d->v.boolV = (a->v.boolV == b->v.boolV);   break;
+            case PI_EQ_STRING:
+                d->v.boolV = (compareStrings(a->v.str.ptr, a->v.str.len, b->v.str.ptr, b->v.str.len) == 0);
+                break;
+            case PI_LT_INT:    d->v.boolV = (a->v.intV < b->v.intV);      break;
+            case PI_LT_FLOAT:  d->v.boolV = (a->v.floatV < b->v.floatV);  break;
+            case PI_LT_BOOL:   d->v.boolV = (a->v.boolV < b->v.boolV);    break;
+            case PI_LT_STRING:
+                d->v.boolV = (compareStrings(a->v.str.ptr, a->v.str.len, b->v.str.ptr, b->v.str.len) < 0);
+                break;
+            case PI_LE_INT:    d->v.boolV = (a->v.intV <= b->v.intV);     break;
+            case PI_LE_FLOAT:  d->v.boolV = (a->v.floatV <= b->v.floatV); break;
+            case PI_LE_BOOL:   d->v.boolV = (a->v.boolV <= b->v.boolV);   break;
+            case PI_LE_STRING:
+                d->v.boolV = (compareStrings(a->v.str.ptr, a->v.str.len, b->v.str.ptr, b->v.str.len) <= 0);
+                break;
+            case PI_EQ_FIXED:
+                d->v.boolV = (in->bytes(a->v.str.ptr, b->v.str.ptr, in->len) == 0);
+                break;
+            case PI_LT_FIXED:
+                d->v.boolV = (in->bytes(a->v.str.ptr, b->v.str.ptr, in->len) < 0);
+                break;
+            case PI_LE_FIXED:
+                d->v.boolV = (in->bytes(a->v.str.ptr, b->v.str.ptr, in->len) <= 0);
+                break;
+            case PI_IN:
+                switch (in->dt)
+                {
+                    case DT_INT:    d->v.boolV = valueSetContainsInt(in->set, a->v.intV);     break;
+                    case DT_FLOAT:  d->v.boolV = valueSetContainsFloat(in->set, a->v.floatV); break;
+                    case DT_BOOL:   d->v.boolV = valueSetContainsBool(in->set, a->v.boolV);   break;
+                    case DT_STRING:
+                        d->v.boolV = valueSetContainsString(in->set, a->v.str.ptr, a->v.str.len);
+                        break;
+                }
+                break;
+            case PI_ADD_INT:   d->v.intV = (int) ((unsigned) a->v.intV + (unsigned) b->v.intV); break;
+            case PI_SUB_INT:   d->v.intV = (int) ((unsigned) a->v.intV - (unsigned) b->v.intV); break;
+            case PI_MUL_INT:   d->v.intV = (int) ((unsigned) a->v.intV * (unsigned) b->v.intV); break;
+            case PI_DIV_INT:
+            case PI_MOD_INT:
+                if (b->v.intV == 0)
+                    THROW(RC_RM_DIVISION_BY_ZERO, "integer division by zero");
+                if (b->v.intV == -1)
+                    d->v.intV = (in->op == PI_DIV_INT) ? (int) (0u - (unsigned) a->v.intV) : 0;
+                else
+                    d->v.intV = (in->op == PI_DIV_INT) ? a->v.intV / b->v.intV : a->v.intV % b->v.intV;
+                break;
+            case PI_ADD_FLOAT: d->v.floatV = a->v.floatV + b->v.floatV;   break;
+            case PI_SUB_FLOAT: d->v.floatV = a->v.floatV - b->v.floatV;   break;
+            case PI_MUL_FLOAT: d->v.floatV = a->v.floatV * b->v.floatV;   break;
+            case PI_DIV_FLOAT: d->v.floatV = a->v.floatV / b->v.floatV;   break;
+            case PI_INT_TO_FLOAT: d->v.floatV = (float) a->v.intV;        break;
+            case PI_FLOAT_TO_INT:
+                if (!(a->v.floatV >= (float) INT_MIN && a->v.floatV < -(float) INT_MIN))
+                    THROW(RC_RM_CAST_FAILED, "FLOAT out of the INT range");
+                d->v.intV = (int) a->v.floatV;
+                break;
+            case PI_NOT:       d->v.boolV = !a->v.boolV;                  break;
+            case PI_MOVE:      *d = *a;                                   break;
+            case PI_JUMP_FALSE:
+                if (!a->v.boolV)
+                    in = prog->code + in->target - 1;
+                break;
+            case PI_JUMP_TRUE:
+                if (a->v.boolV)
+                    in = prog->code + in->target - 1;
+                break;
+        }
+    }
+    *cost += spent;
+    return RC_OK;
+}
+
+/*
+ * termMayFail
+ * -----------
+ * Returned whether code[start, end) had an instruction that could return an
+ * error instead of a result.
+ */
+static bool
+termMayFail(PredProgram *prog, int start, int end)
+{
+    for (int i = start; i < end; i++)
+        switch (prog->code[i].op)
+        {
+            case PI_LOAD_PARAM:
+            case PI_DIV_INT:
+            case PI_MOD_INT:
+            case PI_FLOAT_TO_INT:
+                return true;
+            default:
+                break;
+        }
+    return false;
+}
+
+/*
+ * reorderTerms
+ * ------------
+ * Sorted the terms by expected cost per rejected row, cost / (1 - passRate),
+ * so terms that were cheap and rejected often ran first. Terms that could
+ * fail split the order into runs sorted separately: they kept their place,
+ * and the terms written before (after) them still ran before (after) them,
+ * so an error was raised exactly when the written order raised it. Then
+ * decayed the statistics so the order kept following the data.
+ */
+static void
+reorderTerms(PredRuntime *rt)
+{
+    int n = rt->prog->numTerms;
+    double rank[PRED_MAX_TERMS];
+
+    for (int i = 0; i < n; i++)
+    {
+        PredTermStats *st = &rt->stats[i];
+        if (st->evals <= 0)
+        {
+            rank[i] = 0;   // never ran: tried early to learn about it
+            continue;
+        }
+        double cost = st->cost / st->evals;
+        double reject = 1.0 - st->passes / st->evals;
+        rank[i] = cost / (reject > 1e-6 ? reject : 1e-6);
+    }
+
+    // Insertion sort of each run of terms that could not fail; stable, so
+    // equally ranked terms kept their order
+    for (int lo = 0; lo < n; lo++)
+    {
+        if (rt->prog->terms[rt->order[lo]].mayFail)
+            continue;
+        int hi = lo + 1;
+        while (hi < n && !rt->prog->terms[rt->order[hi]].mayFail)
+            hi++;
+        for (int i = lo + 1; i < hi; i++)
+        {
+            int t = rt->order[i];
+            int j = i - 1;
+            while (j >= lo && rank[rt->order[j]] > rank[t])
+            {
+                rt->order[j + 1] = rt->order[j];
+                j--;
+            }
+            rt->order[j + 1] = t;
+        }
+        lo = hi;
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        rt->stats[i].evals  /= 2;
+        rt->stats[i].passes /= 2;
+        rt->stats[i].cost   /= 2;
+    }
+    rt->sinceReorder = 0;
+}
+
+/*
+ * planLeaf / planNode
+ * -------------------
+ * Appended the postfix selection plan of a condition to prog->plan. Returned
+ * false for anything without a kernel (the program then had no plan).
+ * Comparisons the kernels lacked were built from the ones they had: != as
+ * NOT =, and for INT <= and >= as NOT > and NOT < (not for FLOAT, where NaN
+ * made them differ). IN leaves probed their set row by row.
+ */
+static bool
+pushStep(PredProgram *prog, SelStepKind kind, int n)
+{
+    if (prog->numSteps >= SEL_MAX_STEPS)
+        return false;
+    SelStep *st = &prog->plan[prog->numSteps++];
+    memset(st, 0, sizeof(SelStep));
+    st->kind = kind;
+    st->n    = n;
+    return true;
+}
+
+static bool
+planLeaf(PredProgram *prog, Schema *schema, OpType type, Expr *l, Expr *r)
+{
+    bool attrLeft = (l->type == EXPR_ATTRREF);
+    Expr *attr  = attrLeft ? l : r;
+    Expr *other = attrLeft ? r : l;
+
+    if (attr->type != EXPR_ATTRREF || prog->numSteps >= SEL_MAX_STEPS)
+        return false;
+    int a = attr->expr.attrRef;
+    if (schema == NULL || a < 0 || a >= schema->numAttr)
+        return false;
+
+    SelStep *st = &prog->plan[prog->numSteps];
+    memset(st, 0, sizeof(SelStep));
+    st->kind   = SS_LEAF;
+    st->dt     = schema->dataTypes[a];
+    st->offset = getAttrOffset(schema, a);
+    st->len    = schema->typeLength[a];
+
+    if (type == OP_COMP_IN)
+    {
+        if (!attrLeft || other->type != EXPR_VALUESET || valueSetType(other->expr.set) != st->dt)
+            return false;
+        st->set = other->expr.set;
+        prog->numSteps++;
+        return true;
+    }
+    if (other->type != EXPR_CONST && other->type != EXPR_PARAM)
+        return false;
+
+    // Mirrored the operator when the attribute was on the right
+    if (!attrLeft)
+    {
+        switch (type)
+        {
+            case OP_COMP_SMALLER:       type = OP_COMP_GREATER;       break;
+            case OP_COMP_GREATER:       type = OP_COMP_SMALLER;       break;
+            case OP_COMP_SMALLER_EQUAL: type = OP_COMP_GREATER_EQUAL; break;
+            case OP_COMP_GREATER_EQUAL: type = OP_COMP_SMALLER_EQUAL; break;
+            default: break;
+        }
+    }
+
+    bool ordered = (st->dt == DT_INT || st->dt == DT_FLOAT);
+    bool negate  = false;
+    switch (type)
+    {
+        case OP_COMP_EQUAL:         st->cmp = SEL_EQ; break;
+        case OP_COMP_NOT_EQUAL:     st->cmp = SEL_EQ; negate = true; break;
+        case OP_COMP_SMALLER:       st->cmp = SEL_LT; break;
+        case OP_COMP_GREATER:       st->cmp = SEL_GT; break;
+        case OP_COMP_SMALLER_EQUAL: st->cmp = SEL_GT; negate = true; ordered = (st->dt == DT_INT); break;
+        case OP_COMP_GREATER_EQUAL: st->cmp = SEL_LT; negate = true; ordered = (st->dt == DT_INT); break;
+        default:
+            return false;
+    }
+    if (st->cmp != SEL_EQ && !ordered)
+        return false;
+
+    if (other->type == EXPR_PARAM)
+    {
+        if (st->dt == DT_STRING)
+            return false;
+        st->param = other->expr.param;
+        prog->numSteps++;
+        return !negate || pushStep(prog, SS_NOT, 0);
+    }
+
+    Value *c = other->expr.cons;
+    if (c->dt != st->dt)
+        return false;
+    switch (c->dt)
+    {
+        case DT_INT:   st->cons.v.intV   = c->v.intV;   break;
+        case DT_FLOAT: st->cons.v.floatV = c->v.floatV; break;
+        case DT_BOOL:  st->cons.v.boolV  = c->v.boolV;  break;
+        case DT_STRING:
+        {
+            int clen = (int) strlen(c->v.stringV);
+            if (clen > st->len)
+            {
+                st->never = true;
+                break;
+            }
+            char **strings = (char **) realloc(prog->strings, (prog->numStrings + 1) * sizeof(char *));
+            if (strings == NULL)
+                return false;
+            prog->strings = strings;
+            char *padded = (char *) calloc(st->len + 1, 1);
+            if (padded == NULL)
+                return false;
+            memcpy(padded, c->v.stringV, clen);
+            prog->strings[prog->numStrings++] = padded;
+            st->cons.v.str.ptr = padded;
+            st->cons.v.str.len = st->len;
+        }
+        break;
+    }
+    prog->numSteps++;
+    return !negate || pushStep(prog, SS_NOT, 0);
+}
+
+static bool
+planNode(PredProgram *prog, Schema *schema, Expr *expr, int depth)
+{
+    if (expr->type != EXPR_OP || prog->numSteps >= SEL_MAX_STEPS || depth >= SEL_MAX_DEPTH)
+        return false;
+
+    Operator *op = expr->expr.op;
+    switch (op->type)
+    {
+        case OP_COMP_EQUAL:
+        case OP_COMP_SMALLER:
+        case OP_COMP_GREATER:
+        case OP_COMP_SMALLER_EQUAL:
+        case OP_COMP_GREATER_EQUAL:
+        case OP_COMP_NOT_EQUAL:
+        case OP_COMP_IN:
+            return planLeaf(prog, schema, op->type, op->args[0], op->args[1]);
+        case OP_COMP_BETWEEN:
+            return planLeaf(prog, schema, OP_COMP_GREATER_EQUAL, op->args[0], op->args[1]) &&
+                   planLeaf(prog, schema, OP_COMP_SMALLER_EQUAL, op->args[0], op->args[2]) &&
+                   pushStep(prog, SS_AND, 2);
+        case OP_BOOL_NOT:
+            return planNode(prog, schema, op->args[0], depth) && pushStep(prog, SS_NOT, 0);
+        case OP_BOOL_AND:
+        case OP_BOOL_OR:
+            // Combined after every argument past the first, so the stack of
+            // bitmaps only grew with the nesting depth
+            for (int i = 0; i < op->numArgs; i++)
+            {
+                if (!planNode(prog, schema, op->args[i], depth + (i > 0)))
+                    return false;
+                if (i > 0 && !pushStep(prog, (op->type == OP_BOOL_AND) ? SS_AND : SS_OR, 2))
+                    return false;
+            }
+            return true;
+        default:
+            return false;
+    }
+}
+
+/*
+ * runLeaf
+ * -------
+ * Ran the kernel of one plan leaf over a block of records.
+ */
+static RC
+runLeaf(SelStep *st, const char *base, int stride, int count, uint64_t *sel)
+{
+    const char *field = base + st->offset;
+    PredReg c = st->cons;
+
+    if (st->set != NULL)
+    {
+        memset(sel, 0, SEL_WORDS(count) * sizeof(uint64_t));
+        for (int i = 0; i < count; i++)
+        {
+            const char *f = field + (size_t) i * stride;
+            bool hit = false;
+            switch (st->dt)
+            {
+                case DT_INT:
+                {
+                    int v;
+                    memcpy(&v, f, sizeof(int));
+                    hit = valueSetContainsInt(st->set, v);
+                }
+                break;
+                case DT_FLOAT:
+                {
+                    float v;
+                    memcpy(&v, f, sizeof(float));
+                    hit = valueSetContainsFloat(st->set, v);
+                }
+                break;
+                case DT_BOOL:
+                {
+                    bool v;
+                    memcpy(&v, f, sizeof(bool));
+                    hit = valueSetContainsBool(st->set, v);
+                }
+                break;
+                case DT_STRING:
+                    hit = valueSetContainsString(st->set, f, st->len);
+                    break;
+            }
+            if (hit)
+                sel[i >> 6] |= (uint64_t) 1 << (i & 63);
+        }
+        return RC_OK;
+    }
+
+    if (st->param != NULL)
+    {
+        if (st->param->dt != st->dt && (st->param->dt != DT_INT || st->dt != DT_FLOAT))
+            THROW(RC_RM_COMPARE_VALUE_OF_DIFFERENT_DATATYPE, "parameter type does not match the compared value");
+        c.v.intV = 0;
+        switch (st->dt)
+        {
+            case DT_INT:   c.v.intV   = st->param->v.intV;   break;
+            case DT_FLOAT:
+                c.v.floatV = (st->param->dt == DT_INT) ? (float) st->param->v.intV : st->param->v.floatV;
+                break;
+            case DT_BOOL:  c.v.boolV  = st->param->v.boolV;  break;
+            case DT_STRING: break;
+        }
+    }
+
+    switch (st->dt)
+    {
+        case DT_INT:
+            selCompareInt(field, stride, count, st->cmp, c.v.intV, sel);
+            break;
+        case DT_FLOAT:
+            selCompareFloat(field, stride, count, st->cmp, c.v.floatV, sel);
+            break;
+        case DT_BOOL:
+            selEqualsBool(field, stride, count, c.v.boolV, sel);
+            break;
+        case DT_STRING:
+            if (st->never)
+                memset(sel, 0, SEL_WORDS(count) * sizeof(uint64_t));
+            else
+                selEqualsString(field, stride, count, c.v.str.ptr, st->len, sel);
+            break;
+    }
+    return RC_OK;
+}
+
+/*
+ * runPlan
+ * -------
+ * Evaluated the selection plan over one block of at most SEL_BLOCK records
+ * with a small stack of bitmaps.
+ */
+static RC
+runPlan(PredProgram *prog, const char *base, int stride, int count, uint64_t *sel)
+{
+    uint64_t stack[SEL_MAX_DEPTH + 1][SEL_WORDS(SEL_BLOCK)];
+    int top = 0;
+
+    for (int i = 0; i < prog->numSteps; i++)
+    {
+        SelStep *st = &prog->plan[i];
+        switch (st->kind)
+        {
+            case SS_LEAF:
+            {
+                RC rc = runLeaf(st, base, stride, count, stack[top++]);
+                if (rc != RC_OK)
+                    return rc;
+            }
+            break;
+            case SS_NOT:
+                selNot(stack[top - 1], count);
+                break;
+            case SS_AND:
+            case SS_OR:
+                for (int k = top - st->n + 1; k < top; k++)
+                {
+                    if (st->kind == SS_AND)
+                        selAnd(stack[top - st->n], stack[k], count);
+                    else
+                        selOr(stack[top - st->n], stack[k], count);
+                }
+                top -= st->n - 1;
+                break;
+        }
+    }
+    memcpy(sel, stack[0], SEL_WORDS(count) * sizeof(uint64_t));
+    return RC_OK;
+}
+
+/* --------------------------------------------------------------------------
+   Interface
+   -------------------------------------------------------------------------- */
+
+/*
+ * compilePredicate
+ * ----------------
+ * Compiled a condition against a schema. Returned RC_ERROR (and no program)
+ * for shapes the interpreter did not cover, so callers could keep using
+ * evalExpr for those.
+ */
+RC
+compilePredicate(Expr *expr, Schema *schema, PredProgram **prog)
+{
+    *prog = NULL;
+    if (expr == NULL)
+        return RC_ERROR;
+
+    PredProgram *p = (PredProgram *) calloc(1, sizeof(PredProgram));
+    if (p == NULL)
+        return RC_MEMORY_ALLOCATION_ERROR;
+
+    // Split a top-level conjunction (nested ANDs included) into its terms
+    Expr *conj[PRED_MAX_TERMS];
+    int numConj = 0;
+    RC rc = RC_OK;
+    if (collectConjuncts(expr, conj, &numConj) != RC_OK)
+    {
+        // Too many conjuncts to track separately: compiled as a single term
+        conj[0] = expr;
+        numConj = 1;
+    }
+
+    for (int i = 0; rc == RC_OK && i < numConj; i++)
+    {
+        PredTerm *t = &p->terms[p->numTerms++];
+        DataType dt;
+        t->start = p->numInstr;
+        rc = compileNode(p, schema, conj[i], DT_BOOL, true, &t->reg, &dt);
+        if (rc == RC_OK && dt != DT_BOOL)
+            rc = RC_ERROR;
+        t->end = p->numInstr;
+        t->mayFail = termMayFail(p, t->start, t->end);
+    }
+    if (rc != RC_OK)
+    {
+        freePredicate(p);
+        return rc;
+    }
+
+    // Added a selection plan when every leaf had a kernel
+    if (!planNode(p, schema, expr, 0))
+        p->numSteps = 0;
+
+    *prog = p;
+    return RC_OK;
+}
+
+/*
+ * evalPredicate
+ * -------------
+ * Ran a compiled program over the bytes of one record, term by term in the
+ * order written. The register file lived on the stack and was seeded from
+ * the pre-decoded constants.
+ */
+RC
+evalPredicate(PredProgram *prog, char *data, bool *result)
+{
+    PredReg regs[PRED_MAX_REGS];
+    memcpy(regs, prog->init, prog->numRegs * sizeof(PredReg));
+
+    int cost = 0;
+    for (int i = 0; i < prog->numTerms; i++)
+    {
+        PredTerm *t = &prog->terms[i];
+        RC rc = runCode(prog, regs, t->start, t->end, data, &cost);
+        if (rc != RC_OK)
+            return rc;
+        if (!regs[t->reg].v.boolV)
+        {
+            *result = false;
+            return RC_OK;
+        }
+    }
+    *result = true;
+    return RC_OK;
+}
+
+/*
+ * compileValueExpr / evalValueExpr
+ * --------------------------------
+ * Compiled an expression producing a value of any type into a program of
+ * one term and reported that type, or ran such a program over one record
+ * and wrote the value to out in the record layout: four bytes for INT and
+ * FLOAT, one for BOOL, and len bytes zero-padded (or truncated) for STRING.
+ */
+RC
+compileValueExpr(Expr *expr, Schema *schema, PredProgram **prog, DataType *dt)
+{
+    *prog = NULL;
+    if (expr == NULL)
+        return RC_ERROR;
+
+    PredProgram *p = (PredProgram *) calloc(1, sizeof(PredProgram));
+    if (p == NULL)
+        return RC_MEMORY_ALLOCATION_ERROR;
+
+    PredTerm *t = &p->terms[p->numTerms++];
+    RC rc = compileNode(p, schema, expr, DT_BOOL, false, &t->reg, &p->resultType);
+    t->end = p->numInstr;
+    if (rc != RC_OK)
+    {
+        freePredicate(p);
+        return rc;
+    }
+    *dt   = p->resultType;
+    *prog = p;
+    return RC_OK;
+}
+
+RC
+evalValueExpr(PredProgram *prog, char *data, char *out, int len)
+{
+    PredReg regs[PRED_MAX_REGS];
+    memcpy(regs, prog->init, prog->numRegs * sizeof(PredReg));
+
+    int cost = 0;
+    PredTerm *t = &prog->terms[0];
+    RC rc = runCode(prog, regs, t->start, t->end, data, &cost);
+    if (rc != RC_OK)
+        return rc;
+
+    PredReg *r = &regs[t->reg];
+    switch (prog->resultType)
+    {
+        case DT_INT:   memcpy(out, &r->v.intV, sizeof(int));     break;
+        case DT_FLOAT: memcpy(out, &r->v.floatV, sizeof(float)); break;
+        case DT_BOOL:  memcpy(out, &r->v.boolV, sizeof(bool));   break;
+        case DT_STRING:
+        {
+            int n = 0;
+            while (n < len && n < r->v.str.len && r->v.str.ptr[n] != '\0')
+                n++;
+            memcpy(out, r->v.str.ptr, n);
+            memset(out + n, 0, len - n);
+        }
+        break;
+    }
+    return RC_OK;
+}
+
+/*
+ * evalPredicateBatch
+ * ------------------
+ * Evaluated the condition for count records starting at base, stride bytes
+ * apart, and wrote a selection bitmap (see pred_simd.h). Used the SIMD
+ * selection plan when the program had one, block by block, and otherwise
+ * set the bits row by row with evalPredicate.
+ */
+RC
+evalPredicateBatch(PredProgram *prog, char *base, int stride, int count, uint64_t *sel)
+{
+    if (prog->numSteps == 0)
+    {
+        memset(sel, 0, SEL_WORDS(count) * sizeof(uint64_t));
+        for (int i = 0; i < count; i++)
+        {
+            bool pass;
+            RC rc = evalPredicate(prog, base + (size_t) i * stride, &pass);
+            if (rc != RC_OK)
+                return rc;
+            if (pass)
+                sel[i >> 6] |= (uint64_t) 1 << (i & 63);
+        }
+        return RC_OK;
+    }
+
+    for (int start = 0; start < count; start += SEL_BLOCK)
+    {
+        int n = (count - start < SEL_BLOCK) ? count - start : SEL_BLOCK;
+        RC rc = runPlan(prog, base + (size_t) start * stride, stride, n, sel + start / 64);
+        if (rc != RC_OK)
+            return rc;
+    }
+    return RC_OK;
+}
+
+/*
+ * predicateIsVectorized
+ * ---------------------
+ * Told whether evalPredicateBatch ran SIMD kernels for this program.
+ */
+bool
+predicateIsVectorized(PredProgram *prog)
+{
+    return prog->numSteps > 0;
+}
+
+/*
+ * createPredRuntime
+ * -----------------
+ * Allocated the adaptive state for one scan over a program: the current term
+ * order (initially as written) and zeroed statistics.
+ */
+RC
+createPredRuntime(PredProgram *prog, PredRuntime **rt)
+{
+    PredRuntime *r = (PredRuntime *) calloc(1, sizeof(PredRuntime));
+    if (r == NULL)
+        return RC_MEMORY_ALLOCATION_ERROR;
+    r->prog = prog;
+    for (int i = 0; i < prog->numTerms; i++)
+        r->order[i] = i;
+    *rt = r;
+    return RC_OK;
+}
+
+/*
+ * evalPredicateAdaptive
+ * ---------------------
+ * Evaluated like evalPredicate but in the runtime's current term order,
+ * recorded pass rate and cost per term, and reordered the terms every
+ * PRED_REORDER_INTERVAL rows. An AND of terms that could not fail did not
+ * depend on their order, and terms that could fail were not moved (see
+ * reorderTerms), so the result and any error were evalPredicate's.
+ */
+RC
+evalPredicateAdaptive(PredProgram *prog, PredRuntime *rt, char *data, bool *result)
+{
+    if (prog->numTerms < 2)
+        return evalPredicate(prog, data, result);
+
+    PredReg regs[PRED_MAX_REGS];
+    memcpy(regs, prog->init, prog->numRegs * sizeof(PredReg));
+
+    *result = true;
+    for (int i = 0; i < prog->numTerms; i++)
+    {
+        int k = rt->order[i];
+        PredTerm *t = &prog->terms[k];
+        int cost = 0;
+        RC rc = runCode(prog, regs, t->start, t->end, data, &cost);
+        if (rc != RC_OK)
+            return rc;
+
+        bool pass = regs[t->reg].v.boolV;
+        rt->stats[k].evals  += 1;
+        rt->stats[k].passes += pass;
+        rt->stats[k].cost   += cost;
+        if (!pass)
+        {
+            *result = false;
+            break;
+        }
+    }
+
+    if (++rt->sinceReorder >= PRED_REORDER_INTERVAL)
+        reorderTerms(rt);
+    return RC_OK;
+}
+
+/*
+ * getPredTermOrder
+ * ----------------
+ * Copied the runtime's current term order into order and returned the
+ * number of terms.
+ */
+int
+getPredTermOrder(PredRuntime *rt, int *order)
+{
+    memcpy(order, rt->order, rt->prog->numTerms * sizeof(int));
+    return rt->prog->numTerms;
+}
+
+/*
+ * freePredRuntime
+ * ---------------
+ * Freed the adaptive state; the program it referred to was left alone.
+ */
+RC
+freePredRuntime(PredRuntime *rt)
+{
+    free(rt);
+    return RC_OK;
+}
+
+/*
+ * rebindPredicate
+ * ---------------
+ * Copied a program for another set of parameter slots: the instructions
+ * were copied and every parameter from[i] they or the selection plan read
+ * became to[i]. The decoded constants and value sets stayed those of prog,
+ * so the copy owned only its instructions.
+ */
+RC
+rebindPredicate(PredProgram *prog, int numParams, Value **from, Value **to, PredProgram **copy)
+{
+    PredProgram *p = (PredProgram *) malloc(sizeof(PredProgram));
+    if (p == NULL)
+        return RC_MEMORY_ALLOCATION_ERROR;
+    *p = *prog;
+    p->strings    = NULL;
+    p->numStrings = 0;
+    p->capInstr   = prog->numInstr;
+    p->code       = (PredInstr *) malloc((prog->numInstr > 0 ? prog->numInstr : 1) * sizeof(PredInstr));
+    if (p->code == NULL)
+    {
+        free(p);
+        return RC_MEMORY_ALLOCATION_ERROR;
+    }
+    memcpy(p->code, prog->code, prog->numInstr * sizeof(PredInstr));
+
+    for (int k = 0; k < numParams; k++)
+    {
+        for (int i = 0; i < p->numInstr; i++)
+            if (p->code[i].op == PI_LOAD_PARAM && p->code[i].param == from[k])
+                p->code[i].param = to[k];
+        for (int i = 0; i < p->numSteps; i++)
+            if (p->plan[i].param == from[k])
+                p->plan[i].param = to[k];
+    }
+    *copy = p;
+    return RC_OK;
+}
+
+/*
+ * freePredicate
+ * -------------
+ * Freed the instructions, the decoded string constants and the program.
+ */
+RC
+freePredicate(PredProgram *prog)
+{
+    if (prog == NULL)
+        return RC_OK;
+    for (int i = 0; i < prog->numStrings; i++)
+        free(prog->strings[i]);
+    free(prog->strings);
+    free(prog->code);
+    free(prog);
+    return RC_OK;
+}
@@ -0,0 +1,49 @@
+#ifndef EXPR_COMPILE_H
+#define EXPR_COMPILE_H
+
+#include <stdint.h>
+
+#include "dberror.h"
+#include "expr.h"
+#include "tables.h"
+
+// upper bound on registers a compiled predicate may use; larger
+// expressions fail to compile and are evaluated with evalExpr instead
+#define PRED_MAX_REGS 64
+
+// a top-level AND is split into at most this many separately evaluated terms
+#define PRED_MAX_TERMS 16
+
+// rows between two reorderings of the terms in evalPredicateAdaptive
+#define PRED_REORDER_INTERVAL 1024
+
+// a condition compiled against one schema into a flat register program
+typedef struct PredProgram PredProgram;
+
+// per-scan pass-rate and cost statistics used to reorder conjuncts
+typedef struct PredRuntime PredRuntime;
+
+// compiling and evaluating predicates on raw record bytes
+extern RC compilePredicate (Expr *expr, Schema *schema, PredProgram **prog);
+extern RC evalPredicate (PredProgram *prog, char *data, bool *result);
+extern RC freePredicate (PredProgram *prog);
+
+// a program sharing prog's code and constants, reading parameter slot to[i]
+// wherever prog read from[i]; prog (and its tree) had to outlive the copy
+extern RC rebindPredicate (PredProgram *prog, int numParams, Value **from, Value **to, PredProgram **copy);
+
+// compiling an expression that computes a value (e.g. a projected column)
+extern RC compileValueExpr (Expr *expr, Schema *schema, PredProgram **prog, DataType *dt);
+extern RC evalValueExpr (PredProgram *prog, char *data, char *out, int len);
+
+// evaluating a block of records into a selection bitmap (see pred_simd.h)
+extern RC evalPredicateBatch (PredProgram *prog, char *base, int stride, int count, uint64_t *sel);
+extern bool predicateIsVectorized (PredProgram *prog);
+
+// adaptive evaluation of conjunctions
+extern RC createPredRuntime (PredProgram *prog, PredRuntime **rt);
+extern RC evalPredicateAdaptive (PredProgram *prog, PredRuntime *rt, char *data, bool *result);
+extern int getPredTermOrder (PredRuntime *rt, int *order);
+extern RC freePredRuntime (PredRuntime *rt);
+
+#endif // EXPR_COMPILE_H
@@ -0,0 +1,398 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dberror.h"
+#include "expr.h"
+#include "expr_optimize.h"
+#include "tables.h"
+#include "value_set.h"
+
+/*
+ * Condition optimizer
+ * ---------------------------------------------------------------
+ * optimizeExpr rewrote a tree bottom-up:
+ *
+ *   - operators whose arguments were all constants were folded into a
+ *     constant (only when the operand types matched and arithmetic or a
+ *     cast succeeded, so conditions that failed with evalExpr still failed
+ *     the same way);
+ *   - NOT NOT x became x, and a NOT was pushed through AND/OR (De Morgan)
+ *     into the comparisons below it by inverting them: = and != always,
+ *     <, <=, > and >= only when the operands were known not to be FLOAT,
+ *     since a NaN made NOT (a < b) differ from a >= b;
+ *   - nested AND/OR chains were flattened; true was dropped from an AND and
+ *     false from an OR, while false in an AND (true in an OR) decided it;
+ *   - comparisons with the constant on the left were mirrored so the
+ *     attribute came first, and BETWEEN with low > high became false.
+ *
+ * Parameters were never treated as constants, since their slots could be
+ * rebound between scans. Every node the rewrite dropped was freed.
+ */
+
+/* --------------------------------------------------------------------------
+   Helpers
+   -------------------------------------------------------------------------- */
+
+static bool
+isConst(Expr *e)
+{
+    return e->type == EXPR_CONST;
+}
+
+static bool
+isBoolConst(Expr *e)
+{
+    return e->type == EXPR_CONST && e->expr.cons->dt == DT_BOOL;
+}
+
+/*
+ * operandType
+ * -----------
+ * Reported the data type of a comparison operand when it was known before
+ * evaluation: constants, with a schema attribute references, casts, and
+ * arithmetic over operands whose types were known.
+ */
+static bool
+operandType(Expr *e, Schema *schema, DataType *dt)
+{
+    if (e->type == EXPR_CONST)
+    {
+        *dt = e->expr.cons->dt;
+        return true;
+    }
+    if (e->type == EXPR_ATTRREF && schema != NULL && e->expr.attrRef >= 0 && e->expr.attrRef < schema->numAttr)
+    {
+        *dt = schema->dataTypes[e->expr.attrRef];
+        return true;
+    }
+    if (e->type == EXPR_OP && e->expr.op->type >= OP_CAST_INT)
+        return exprType(e, schema, dt) == RC_OK;
+    if (e->type == EXPR_OP && e->expr.op->type >= OP_ARITH_ADD)
+    {
+        DataType l, r;
+        return operandType(e->expr.op->args[0], schema, &l) &&
+               operandType(e->expr.op->args[1], schema, &r) &&
+               exprType(e, schema, dt) == RC_OK;
+    }
+    return false;
+}
+
+/*
+ * freeShell / replaceNode / replaceWithBool
+ * -----------------------------------------
+ * Freed an operator node without its arguments, put another node in its
+ * place, or replaced a whole subtree with a boolean constant.
+ */
+static void
+freeShell(Expr *e)
+{
+    free(e->expr.op->args);
+    free(e->expr.op);
+    free(e);
+}
+
+static void
+replaceNode(Expr **slot, Expr *with)
+{
+    freeShell(*slot);
+    *slot = with;
+}
+
+static RC
+replaceWithBool(Expr **slot, bool b)
+{
+    Value *v;
+    Expr *c;
+    MAKE_VALUE(v, DT_BOOL, b);
+    MAKE_CONS(c, v);
+    freeExpr(*slot);
+    *slot = c;
+    return RC_OK;
+}
+
+static bool
+isComparison(OpType t)
+{
+    return t == OP_COMP_EQUAL || t == OP_COMP_NOT_EQUAL || t == OP_COMP_SMALLER ||
+           t == OP_COMP_GREATER || t == OP_COMP_SMALLER_EQUAL || t == OP_COMP_GREATER_EQUAL;
+}
+
+/*
+ * canNegate / negate
+ * ------------------
+ * Checked whether NOT could be absorbed by a subtree without leaving a NOT
+ * node behind, and did so in place.
+ */
+static bool
+canNegate(Expr *e, Schema *schema)
+{
+    if (isBoolConst(e))
+        return true;
+    if (e->type != EXPR_OP)
+        return false;
+
+    Operator *op = e->expr.op;
+    switch (op->type)
+    {
+        case OP_BOOL_NOT:
+        case OP_COMP_EQUAL:
+        case OP_COMP_NOT_EQUAL:
+            return true;
+        case OP_COMP_SMALLER:
+        case OP_COMP_GREATER:
+        case OP_COMP_SMALLER_EQUAL:
+        case OP_COMP_GREATER_EQUAL:
+        {
+            DataType dt;
+            return (operandType(op->args[0], schema, &dt) || operandType(op->args[1], schema, &dt)) &&
+                   dt != DT_FLOAT;
+        }
+        case OP_BOOL_AND:
+        case OP_BOOL_OR:
+            for (int i = 0; i < op->numArgs; i++)
+                if (!canNegate(op->args[i], schema))
+                    return false;
+            return true;
+        default:
+            return false;
+    }
+}
+
+static void
+negate(Expr **slot)
+{
+    Expr *e = *slot;
+    if (e->type == EXPR_CONST)
+    {
+        e->expr.cons->v.boolV = !e->expr.cons->v.boolV;
+        return;
+    }
+
+    Operator *op = e->expr.op;
+    switch (op->type)
+    {
+        case OP_BOOL_NOT:           replaceNode(slot, op->args[0]);        break;
+        case OP_COMP_EQUAL:         op->type = OP_COMP_NOT_EQUAL;          break;
+        case OP_COMP_NOT_EQUAL:     op->type = OP_COMP_EQUAL;              break;
+        case OP_COMP_SMALLER:       op->type = OP_COMP_GREATER_EQUAL;      break;
+        case OP_COMP_GREATER_EQUAL: op->type = OP_COMP_SMALLER;            break;
+        case OP_COMP_GREATER:       op->type = OP_COMP_SMALLER_EQUAL;      break;
+        case OP_COMP_SMALLER_EQUAL: op->type = OP_COMP_GREATER;            break;
+        case OP_BOOL_AND:
+        case OP_BOOL_OR:
+            op->type = (op->type == OP_BOOL_AND) ? OP_BOOL_OR : OP_BOOL_AND;
+            for (int i = 0; i < op->numArgs; i++)
+                negate(&op->args[i]);
+            break;
+        default:
+            break;
+    }
+}
+
+/*
+ * simplifyChain
+ * -------------
+ * Dropped the neutral constants of a flattened AND/OR and collapsed it when
+ * a constant decided it or at most one argument was left.
+ */
+static RC
+simplifyChain(Expr **slot)
+{
+    Operator *op = (*slot)->expr.op;
+    bool decider = (op->type == OP_BOOL_OR);   // the value that decided the chain
+    int k = 0;
+
+    for (int i = 0; i < op->numArgs; i++)
+    {
+        Expr *a = op->args[i];
+        if (isBoolConst(a) && a->expr.cons->v.boolV == decider)
+        {
+            // Constants before it were already freed: kept only the live
+            // arguments for replaceWithBool to free
+            for (int j = i; j < op->numArgs; j++)
+                op->args[k++] = op->args[j];
+            op->numArgs = k;
+            return replaceWithBool(slot, decider);
+        }
+        if (isBoolConst(a))
+            freeExpr(a);
+        else
+            op->args[k++] = a;
+    }
+    op->numArgs = k;
+
+    if (k == 0)
+        return replaceWithBool(slot, !decider);
+    if (k == 1)
+        replaceNode(slot, op->args[0]);
+    return RC_OK;
+}
+
+/*
+ * foldOperator
+ * ------------
+ * Evaluated an operator whose arguments were all constants. Left the node
+ * alone when the operand types did not match.
+ */
+static RC
+foldOperator(Expr **slot)
+{
+    Operator *op = (*slot)->expr.op;
+    Value res;
+
+    for (int i = 0; i < op->numArgs; i++)
+        if (!isConst(op->args[i]) && !(op->type == OP_COMP_IN && i == 1))
+            return RC_OK;
+
+    // Arithmetic and casts that failed (division by zero, a string that did
+    // not parse) were left for evalExpr to report
+    if (op->type >= OP_ARITH_ADD)
+    {
+        DataType dt;
+        Value *v = (Value *) malloc(sizeof(Value));
+        Expr *c;
+        if (v == NULL)
+            return RC_MEMORY_ALLOCATION_ERROR;
+        RC rc = (op->type >= OP_CAST_INT)
+            ? (exprType(*slot, NULL, &dt) == RC_OK ? valueCast(op->args[0]->expr.cons, dt, v) : RC_ERROR)
+            : valueArith(op->type, op->args[0]->expr.cons, op->args[1]->expr.cons, v);
+        if (rc != RC_OK)
+        {
+            free(v);
+            return RC_OK;
+        }
+        MAKE_CONS(c, v);
+        freeExpr(*slot);
+        *slot = c;
+        return RC_OK;
+    }
+
+    switch (op->type)
+    {
+        case OP_BOOL_NOT:
+            if (!isBoolConst(op->args[0]))
+                return RC_OK;
+            return replaceWithBool(slot, !op->args[0]->expr.cons->v.boolV);
+
+        case OP_COMP_IN:
+        {
+            bool found;
+            if (op->args[1]->type != EXPR_VALUESET ||
+                op->args[0]->expr.cons->dt != valueSetType(op->args[1]->expr.set))
+                return RC_OK;
+            valueSetContains(op->args[1]->expr.set, op->args[0]->expr.cons, &found);
+            return replaceWithBool(slot, found);
+        }
+
+        case OP_COMP_BETWEEN:
+        {
+            Value hi;
+            Value *v = op->args[0]->expr.cons;
+            if (v->dt != op->args[1]->expr.cons->dt || v->dt != op->args[2]->expr.cons->dt)
+                return RC_OK;
+            valueCompare(OP_COMP_GREATER_EQUAL, v, op->args[1]->expr.cons, &res);
+            valueCompare(OP_COMP_SMALLER_EQUAL, v, op->args[2]->expr.cons, &hi);
+            return replaceWithBool(slot, res.v.boolV && hi.v.boolV);
+        }
+
+        default:
+            if (!isComparison(op->type) || op->args[0]->expr.cons->dt != op->args[1]->expr.cons->dt)
+                return RC_OK;
+            valueCompare(op->type, op->args[0]->expr.cons, op->args[1]->expr.cons, &res);
+            return replaceWithBool(slot, res.v.boolV);
+    }
+}
+
+/*
+ * optimizeNode
+ * ------------
+ * Optimized the subtree in *slot after its arguments, possibly replacing it.
+ */
+static RC
+optimizeNode(Expr **slot, Schema *schema)
+{
+    Expr *e = *slot;
+    if (e->type != EXPR_OP)
+        return RC_OK;
+
+    Operator *op = e->expr.op;
+    RC rc;
+    for (int i = 0; i < op->numArgs; i++)
+        if ((rc = optimizeNode(&op->args[i], schema)) != RC_OK)
+            return rc;
+
+    switch (op->type)
+    {
+        case OP_BOOL_NOT:
+            if (canNegate(op->args[0], schema))
+            {
+                negate(&op->args[0]);
+                replaceNode(slot, op->args[0]);
+                return RC_OK;
+            }
+            return foldOperator(slot);
+
+        case OP_BOOL_AND:
+        case OP_BOOL_OR:
+            if ((rc = flattenExpr(e)) != RC_OK)
+                return rc;
+            return simplifyChain(slot);
+
+        case OP_COMP_BETWEEN:
+        {
+            Value res;
+            Expr *lo = op->args[1], *hi = op->args[2];
+            if (isConst(lo) && isConst(hi) && lo->expr.cons->dt == hi->expr.cons->dt &&
+                valueCompare(OP_COMP_GREATER, lo->expr.cons, hi->expr.cons, &res) == RC_OK && res.v.boolV)
+            {
+                DataType dt;
+                if (!operandType(op->args[0], schema, &dt) || dt == lo->expr.cons->dt)
+                    return replaceWithBool(slot, false);
+            }
+            return foldOperator(slot);
+        }
+
+        default:
+            if (isComparison(op->type) && isConst(op->args[0]) && op->args[1]->type == EXPR_ATTRREF)
+            {
+                Expr *t = op->args[0];
+                op->args[0] = op->args[1];
+                op->args[1] = t;
+                switch (op->type)
+                {
+                    case OP_COMP_SMALLER:       op->type = OP_COMP_GREATER;       break;
+                    case OP_COMP_GREATER:       op->type = OP_COMP_SMALLER;       break;
+                    case OP_COMP_SMALLER_EQUAL: op->type = OP_COMP_GREATER_EQUAL; break;
+                    case OP_COMP_GREATER_EQUAL: op->type = OP_COMP_SMALLER_EQUAL; break;
+                    default: break;
+                }
+                return RC_OK;
+            }
+            return foldOperator(slot);
+    }
+}
+
+/* --------------------------------------------------------------------------
+   Interface
+   -------------------------------------------------------------------------- */
+
+/*
+ * optimizeExpr
+ * ------------
+ * Rewrote *expr in place into an equivalent, cheaper condition; *expr could
+ * end up pointing at a different node (e.g. a constant).
+ */
+RC
+optimizeExpr(Expr **expr, Schema *schema)
+{
+    if (expr == NULL || *expr == NULL)
+        return RC_OK;
+    return optimizeNode(expr, schema);
+}
+
+bool
+exprIsConstant(Expr *expr, bool value)
+{
+    return expr != NULL && isBoolConst(expr) && expr->expr.cons->v.boolV == value;
+}
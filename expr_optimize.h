@@ -0,0 +1,15 @@
+#ifndef EXPR_OPTIMIZE_H
+#define EXPR_OPTIMIZE_H
+
+#include "dberror.h"
+#include "expr.h"
+#include "tables.h"
+
+// rewriting a condition into a cheaper equivalent one, in place; schema may
+// be NULL, in which case attribute types are treated as unknown
+extern RC optimizeExpr (Expr **expr, Schema *schema);
+
+// whether an (optimized) condition is the boolean constant value
+extern bool exprIsConstant (Expr *expr, bool value);
+
+#endif // EXPR_OPTIMIZE_H
@@ -0,0 +1,1347 @@
+#include <ctype.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "dberror.h"
+#include "expr.h"
+#include "expr_compile.h"
+#include "expr_optimize.h"
+#include "expr_parser.h"
+#include "record_mgr.h"
+#include "tables.h"
+#include "value_set.h"
+
+/*
+ * Condition parser
+ * ---------------------------------------------------------------
+ * A hand-written recursive descent parser over a small tokenizer. It built
+ * the same Expr trees the MAKE_* macros did: attribute names were resolved
+ * against the schema, literals became EXPR_CONST, IN lists became a
+ * ValueSet and each '?' became an EXPR_PARAM pointing at a slot owned by
+ * the prepared condition. Integer literals compared with a FLOAT operand
+ * were converted to FLOAT. Operands could be arithmetic over attributes,
+ * literals and placeholders, and CASTs.
+ *
+ * prepareCondition kept the parsed, optimized and compiled condition in a
+ * small cache keyed by the text and a signature of the schema (attribute
+ * names, types and lengths), so a query shape seen before cost one hash
+ * lookup. A cache entry was never changed once built; each call returned
+ * a handle of its own holding the entry's tree and program rebound to the
+ * handle's parameter slots (a copy, not a recompilation), so binding a
+ * placeholder of one handle never changed the condition of another. Entries
+ * counted their handles and handles their references; when the cache was
+ * full the least recently used entry without handles was evicted. One
+ * mutex guarded the cache, its statistics and all the counts.
+ */
+
+typedef enum TokenType {
+    TK_END,
+    TK_IDENT,
+    TK_INT,
+    TK_FLOAT,
+    TK_STRING,
+    TK_PARAM,
+    TK_LPAREN,
+    TK_RPAREN,
+    TK_COMMA,
+    TK_MINUS,
+    TK_PLUS,
+    TK_STAR,
+    TK_SLASH,
+    TK_PERCENT,
+    TK_EQ,
+    TK_NE,
+    TK_LT,
+    TK_LE,
+    TK_GT,
+    TK_GE,
+    TK_AND,
+    TK_OR,
+    TK_NOT,
+    TK_BETWEEN,
+    TK_IN,
+    TK_TRUE,
+    TK_FALSE,
+    TK_CAST,
+    TK_AS
+} TokenType;
+
+typedef struct Token {
+    TokenType type;
+    const char *start;
+    int len;
+} Token;
+
+typedef struct Parser {
+    const char *pos;      // next character to tokenize
+    Token tok;            // current token
+    Schema *schema;
+    bool allowParams;
+    Value **params;       // placeholder slots in order of appearance
+    int numParams;
+    int capParams;
+} Parser;
+
+/* A parsed, optimized and compiled condition, shared by its handles. */
+typedef struct PreparedEntry {
+    char *text;
+    char *schemaSig;
+    uint32_t hash;
+    Expr *expr;           // optimized tree; parameters point into params
+    PredProgram *prog;    // expr compiled for the schema (NULL if it did not compile)
+    Value **params;       // typed slots, never bound
+    int numParams;
+    int handles;          // handles using the entry
+    bool cached;          // still in the cache (freed with its last handle otherwise)
+    unsigned long lastUse;
+} PreparedEntry;
+
+/* What prepareCondition returned: an entry bound to slots of its own. */
+struct PreparedCond {
+    PreparedEntry *entry;
+    Expr *expr;           // the entry's tree reading params
+    PredProgram *prog;    // the entry's program reading params (NULL if none)
+    Value **params;
+    int numParams;
+    int refs;
+};
+
+static PreparedEntry *cache[PREPARED_CACHE_SIZE];
+static int cacheSize = 0;
+static unsigned long useClock = 0;
+static int cacheHits = 0;
+static int cacheMisses = 0;
+static pthread_mutex_t cacheLock = PTHREAD_MUTEX_INITIALIZER;
+
+static RC parseOr(Parser *p, Expr **out);
+static RC parseOperand(Parser *p, Expr **out);
+static RC parseTerm(Parser *p, Expr **out);
+
+/* --------------------------------------------------------------------------
+   Tokenizer
+   -------------------------------------------------------------------------- */
+
+static bool
+isKeyword(const char *s, int len, const char *kw)
+{
+    return (int) strlen(kw) == len && strncasecmp(s, kw, len) == 0;
+}
+
+/*
+ * nextToken
+ * ---------
+ * Read the next token into p->tok. Failed on characters outside the grammar
+ * and on unterminated strings.
+ */
+static RC
+nextToken(Parser *p)
+{
+    const char *s = p->pos;
+    while (isspace((unsigned char) *s))
+        s++;
+
+    Token *t = &p->tok;
+    t->start = s;
+    t->len   = 1;
+
+    if (*s == '\0')
+    {
+        t->type = TK_END;
+        t->len  = 0;
+    }
+    else if (isalpha((unsigned char) *s) || *s == '_')
+    {
+        const char *e = s;
+        while (isalnum((unsigned char) *e) || *e == '_')
+            e++;
+        t->len = (int) (e - s);
+        t->type = isKeyword(s, t->len, "AND")     ? TK_AND :
+                  isKeyword(s, t->len, "OR")      ? TK_OR :
+                  isKeyword(s, t->len, "NOT")     ? TK_NOT :
+                  isKeyword(s, t->len, "BETWEEN") ? TK_BETWEEN :
+                  isKeyword(s, t->len, "IN")      ? TK_IN :
+                  isKeyword(s, t->len, "TRUE")    ? TK_TRUE :
+                  isKeyword(s, t->len, "FALSE")   ? TK_FALSE :
+                  isKeyword(s, t->len, "CAST")    ? TK_CAST :
+                  isKeyword(s, t->len, "AS")      ? TK_AS : TK_IDENT;
+    }
+    else if (isdigit((unsigned char) *s) || (*s == '.' && isdigit((unsigned char) s[1])))
+    {
+        char *e;
+        strtod(s, &e);
+        t->len  = (int) (e - s);
+        t->type = TK_INT;
+        for (int i = 0; i < t->len; i++)
+            if (s[i] == '.' || s[i] == 'e' || s[i] == 'E')
+                t->type = TK_FLOAT;
+    }
+    else if (*s == '\'')
+    {
+        const char *e = s + 1;
+        while (*e != '\0' && !(*e == '\'' && e[1] != '\''))
+            e += (*e == '\'') ? 2 : 1;
+        if (*e != '\'')
+            THROW(RC_PARSE_ERROR, "unterminated string literal in condition");
+        t->type = TK_STRING;
+        t->len  = (int) (e - s) + 1;
+    }
+    else
+    {
+        switch (*s)
+        {
+            case '?': t->type = TK_PARAM;  break;
+            case '(': t->type = TK_LPAREN; break;
+            case ')': t->type = TK_RPAREN; break;
+            case ',': t->type = TK_COMMA;  break;
+            case '-': t->type = TK_MINUS;  break;
+            case '+': t->type = TK_PLUS;   break;
+            case '*': t->type = TK_STAR;   break;
+            case '/': t->type = TK_SLASH;  break;
+            case '%': t->type = TK_PERCENT; break;
+            case '=':
+                t->type = TK_EQ;
+                t->len  = (s[1] == '=') ? 2 : 1;
+                break;
+            case '!':
+                if (s[1] != '=')
+                    THROW(RC_PARSE_ERROR, "unexpected '!' in condition");
+                t->type = TK_NE;
+                t->len  = 2;
+                break;
+            case '<':
+                t->type = (s[1] == '=') ? TK_LE : (s[1] == '>') ? TK_NE : TK_LT;
+                t->len  = (s[1] == '=' || s[1] == '>') ? 2 : 1;
+                break;
+            case '>':
+                t->type = (s[1] == '=') ? TK_GE : TK_GT;
+                t->len  = (s[1] == '=') ? 2 : 1;
+                break;
+            default:
+                THROW(RC_PARSE_ERROR, "unexpected character in condition");
+        }
+    }
+    p->pos = s + t->len;
+    return RC_OK;
+}
+
+static RC
+expect(Parser *p, TokenType type, char *message)
+{
+    if (p->tok.type != type)
+        THROW(RC_PARSE_ERROR, message);
+    return nextToken(p);
+}
+
+/* --------------------------------------------------------------------------
+   Helpers
+   -------------------------------------------------------------------------- */
+
+/*
+ * operandType
+ * -----------
+ * Reported the type of an operand known at parse time: literals,
+ * attributes, casts and arithmetic over operands of known types (not
+ * placeholders).
+ */
+static bool
+operandType(Parser *p, Expr *e, DataType *dt)
+{
+    if (e->type == EXPR_CONST)
+        *dt = e->expr.cons->dt;
+    else if (e->type == EXPR_ATTRREF)
+        *dt = p->schema->dataTypes[e->expr.attrRef];
+    else if (e->type == EXPR_OP && e->expr.op->type >= OP_CAST_INT)
+        return exprType(e, p->schema, dt) == RC_OK;
+    else if (e->type == EXPR_OP && e->expr.op->type >= OP_ARITH_ADD)
+    {
+        DataType l, r;
+        return operandType(p, e->expr.op->args[0], &l) && operandType(p, e->expr.op->args[1], &r) &&
+               exprType(e, p->schema, dt) == RC_OK;
+    }
+    else
+        return false;
+    return true;
+}
+
+/*
+ * coerce
+ * ------
+ * Fitted an operand to the type of the other side: typed a placeholder and
+ * turned an integer literal compared with a FLOAT into a float.
+ */
+static RC
+coerce(Expr *e, DataType dt)
+{
+    if (e->type == EXPR_PARAM)
+    {
+        Value *slot = e->expr.param;
+        slot->dt = dt;
+        if (dt == DT_STRING)
+        {
+            slot->v.stringV = (char *) calloc(1, 1);
+            if (slot->v.stringV == NULL)
+                return RC_MEMORY_ALLOCATION_ERROR;
+        }
+        else
+            slot->v.intV = 0;
+    }
+    else if (e->type == EXPR_CONST && e->expr.cons->dt == DT_INT && dt == DT_FLOAT)
+    {
+        e->expr.cons->dt = DT_FLOAT;
+        e->expr.cons->v.floatV = (float) e->expr.cons->v.intV;
+    }
+    return RC_OK;
+}
+
+/*
+ * typeOperands
+ * ------------
+ * Gave all operands of one comparison a common type taken from the first
+ * operand whose type was known. Failed when only placeholders were compared.
+ */
+static RC
+typeOperands(Parser *p, Expr **ops, int n)
+{
+    DataType dt = DT_INT;
+    bool known = false;
+
+    // An attribute or computed operand decided the type before a literal did
+    for (int i = 0; i < n && !known; i++)
+        if (ops[i]->type != EXPR_CONST)
+            known = operandType(p, ops[i], &dt);
+    for (int i = 0; i < n && !known; i++)
+        known = operandType(p, ops[i], &dt);
+    if (!known)
+        THROW(RC_PARSE_ERROR, "cannot infer the type of a placeholder");
+
+    for (int i = 0; i < n; i++)
+    {
+        DataType other;
+        RC rc = coerce(ops[i], dt);
+        if (rc != RC_OK)
+            return rc;
+        if (operandType(p, ops[i], &other) && other != dt)
+            THROW(RC_PARSE_ERROR, "comparison of values of different types");
+    }
+    return RC_OK;
+}
+
+/*
+ * advancePast
+ * -----------
+ * Moved to the token after a parsed node, freeing the node if that failed.
+ */
+static RC
+advancePast(Parser *p, Expr **node)
+{
+    RC rc = nextToken(p);
+    if (rc != RC_OK)
+    {
+        freeExpr(*node);
+        *node = NULL;
+    }
+    return rc;
+}
+
+/*
+ * parseLiteral
+ * ------------
+ * Parsed a number (with an optional leading minus), a quoted string or a
+ * boolean into a new Value. Left the literal as the current token.
+ */
+static RC
+parseLiteral(Parser *p, Value **val)
+{
+    bool negative = false;
+    RC rc;
+
+    if (p->tok.type == TK_MINUS)
+    {
+        negative = true;
+        if ((rc = nextToken(p)) != RC_OK)
+            return rc;
+        if (p->tok.type != TK_INT && p->tok.type != TK_FLOAT)
+            THROW(RC_PARSE_ERROR, "expected a number after '-'");
+    }
+
+    Token t = p->tok;
+    switch (t.type)
+    {
+        case TK_INT:
+        {
+            long v = strtol(t.start, NULL, 10);
+            MAKE_VALUE(*val, DT_INT, (int) (negative ? -v : v));
+        }
+        break;
+        case TK_FLOAT:
+        {
+            double v = strtod(t.start, NULL);
+            MAKE_VALUE(*val, DT_FLOAT, (float) (negative ? -v : v));
+        }
+        break;
+        case TK_TRUE:
+        case TK_FALSE:
+            MAKE_VALUE(*val, DT_BOOL, t.type == TK_TRUE);
+            break;
+        case TK_STRING:
+        {
+            char *s = (char *) malloc(t.len);
+            int n = 0;
+            if (s == NULL)
+                return RC_MEMORY_ALLOCATION_ERROR;
+            for (int i = 1; i < t.len - 1; i++)
+            {
+                s[n++] = t.start[i];
+                if (t.start[i] == '\'')
+                    i++;   // '' stood for one quote
+            }
+            s[n] = '\0';
+            *val = (Value *) malloc(sizeof(Value));
+            (*val)->dt = DT_STRING;
+            (*val)->v.stringV = s;
+        }
+        break;
+        default:
+            THROW(RC_PARSE_ERROR, "expected a literal");
+    }
+    return RC_OK;
+}
+
+/*
+ * makeArith
+ * ---------
+ * Built an arithmetic node, typing a placeholder on one side after the
+ * other side. Freed both operands on failure.
+ */
+static RC
+makeArith(Parser *p, OpType type, Expr *left, Expr *right, Expr **out)
+{
+    DataType dt;
+    RC rc = RC_OK;
+
+    *out = NULL;
+    if (left->type == EXPR_PARAM && right->type == EXPR_PARAM)
+    {
+        rc = RC_PARSE_ERROR;
+        RC_message = "cannot infer the type of a placeholder";
+    }
+    else if (left->type == EXPR_PARAM || right->type == EXPR_PARAM)
+    {
+        Expr *known = (left->type == EXPR_PARAM) ? right : left;
+        if (!operandType(p, known, &dt))
+        {
+            rc = RC_PARSE_ERROR;
+            RC_message = "cannot infer the type of a placeholder";
+        }
+        else
+            rc = coerce(known == left ? right : left, dt);
+    }
+    if (rc != RC_OK)
+    {
+        freeExpr(left);
+        freeExpr(right);
+        return rc;
+    }
+    MAKE_BINOP_EXPR((*out), left, right, type);
+    return RC_OK;
+}
+
+/*
+ * parseCast
+ * ---------
+ * Parsed CAST '(' operand AS type ')'.
+ */
+static RC
+parseCast(Parser *p, Expr **out)
+{
+    Expr *inner;
+    OpType type;
+    RC rc;
+
+    *out = NULL;
+    if ((rc = nextToken(p)) != RC_OK || (rc = expect(p, TK_LPAREN, "expected '(' after CAST")) != RC_OK)
+        return rc;
+    if ((rc = parseOperand(p, &inner)) != RC_OK)
+        return rc;
+
+    Token t = p->tok;
+    if (inner->type == EXPR_PARAM)
+    {
+        rc = RC_PARSE_ERROR;
+        RC_message = "cannot infer the type of a placeholder";
+    }
+    else if ((rc = expect(p, TK_AS, "expected AS in CAST")) == RC_OK)
+    {
+        t = p->tok;
+        if (t.type != TK_IDENT)
+        {
+            rc = RC_PARSE_ERROR;
+            RC_message = "expected a type name in CAST";
+        }
+    }
+    if (rc == RC_OK)
+    {
+        if (isKeyword(t.start, t.len, "INT") || isKeyword(t.start, t.len, "INTEGER"))
+            type = OP_CAST_INT;
+        else if (isKeyword(t.start, t.len, "FLOAT"))
+            type = OP_CAST_FLOAT;
+        else if (isKeyword(t.start, t.len, "STRING"))
+            type = OP_CAST_STRING;
+        else if (isKeyword(t.start, t.len, "BOOL") || isKeyword(t.start, t.len, "BOOLEAN"))
+            type = OP_CAST_BOOL;
+        else
+        {
+            rc = RC_PARSE_ERROR;
+            RC_message = "unknown type in CAST";
+        }
+    }
+    if (rc == RC_OK && (rc = nextToken(p)) == RC_OK)
+        rc = expect(p, TK_RPAREN, "expected ')' after CAST");
+    if (rc != RC_OK)
+    {
+        freeExpr(inner);
+        return rc;
+    }
+    MAKE_UNOP_EXPR((*out), inner, type);
+    return RC_OK;
+}
+
+/*
+ * parseFactor
+ * -----------
+ * Parsed an attribute name, a literal, a placeholder, a parenthesized
+ * expression, a CAST or a negated factor.
+ */
+static RC
+parseFactor(Parser *p, Expr **out)
+{
+    RC rc;
+    *out = NULL;
+
+    if (p->tok.type == TK_LPAREN)
+    {
+        if ((rc = nextToken(p)) != RC_OK || (rc = parseOr(p, out)) != RC_OK)
+            return rc;
+        if ((rc = expect(p, TK_RPAREN, "expected ')'")) != RC_OK)
+        {
+            freeExpr(*out);
+            *out = NULL;
+        }
+        return rc;
+    }
+
+    if (p->tok.type == TK_CAST)
+        return parseCast(p, out);
+
+    if (p->tok.type == TK_MINUS)
+    {
+        // -3 stayed a literal; anything else became 0 - factor
+        const char *pos = p->pos;
+        Token minus = p->tok;
+        if ((rc = nextToken(p)) != RC_OK)
+            return rc;
+        if (p->tok.type == TK_INT || p->tok.type == TK_FLOAT)
+        {
+            p->pos = pos;
+            p->tok = minus;
+        }
+        else
+        {
+            Expr *inner, *zero;
+            Value *v;
+            if ((rc = parseFactor(p, &inner)) != RC_OK)
+                return rc;
+            MAKE_VALUE(v, DT_INT, 0);
+            MAKE_CONS(zero, v);
+            return makeArith(p, OP_ARITH_SUB, zero, inner, out);
+        }
+    }
+
+    if (p->tok.type == TK_IDENT)
+    {
+        int attr = getAttrIndexN(p->schema, p->tok.start, p->tok.len);
+        if (attr < 0)
+            THROW(RC_PARSE_ERROR, "unknown attribute in condition");
+        MAKE_ATTRREF((*out), attr);
+        return advancePast(p, out);
+    }
+
+    if (p->tok.type == TK_PARAM)
+    {
+        if (!p->allowParams)
+            THROW(RC_PARSE_ERROR, "placeholders need prepareCondition");
+        if (p->numParams == p->capParams)
+        {
+            int cap = p->capParams ? p->capParams * 2 : 4;
+            Value **params = (Value **) realloc(p->params, cap * sizeof(Value *));
+            if (params == NULL)
+                return RC_MEMORY_ALLOCATION_ERROR;
+            p->params = params;
+            p->capParams = cap;
+        }
+        Value *slot = (Value *) calloc(1, sizeof(Value));
+        if (slot == NULL)
+            return RC_MEMORY_ALLOCATION_ERROR;
+        slot->dt = DT_INT;
+        p->params[p->numParams++] = slot;
+        MAKE_PARAM((*out), slot);
+        return advancePast(p, out);
+    }
+
+    Value *v;
+    if ((rc = parseLiteral(p, &v)) != RC_OK)
+        return rc;
+    MAKE_CONS((*out), v);
+    return advancePast(p, out);
+}
+
+/*
+ * parseTerm / parseOperand
+ * ------------------------
+ * Parsed factors joined by '*', '/' and '%', and terms joined by '+' and
+ * '-', both left-associative.
+ */
+static RC
+parseArithLevel(Parser *p, Expr **out, bool additive)
+{
+    RC rc;
+    Expr *right;
+
+    rc = additive ? parseTerm(p, out) : parseFactor(p, out);
+    while (rc == RC_OK)
+    {
+        OpType type;
+        switch (p->tok.type)
+        {
+            case TK_PLUS:    type = OP_ARITH_ADD; break;
+            case TK_MINUS:   type = OP_ARITH_SUB; break;
+            case TK_STAR:    type = OP_ARITH_MUL; break;
+            case TK_SLASH:   type = OP_ARITH_DIV; break;
+            case TK_PERCENT: type = OP_ARITH_MOD; break;
+            default:         return RC_OK;
+        }
+        if (additive != (type == OP_ARITH_ADD || type == OP_ARITH_SUB))
+            return RC_OK;
+
+        if ((rc = nextToken(p)) != RC_OK ||
+            (rc = (additive ? parseTerm(p, &right) : parseFactor(p, &right))) != RC_OK)
+            break;
+        Expr *left = *out;
+        rc = makeArith(p, type, left, right, out);
+    }
+    if (rc != RC_OK && *out != NULL)
+    {
+        freeExpr(*out);
+        *out = NULL;
+    }
+    return rc;
+}
+
+static RC
+parseTerm(Parser *p, Expr **out)
+{
+    return parseArithLevel(p, out, false);
+}
+
+static RC
+parseOperand(Parser *p, Expr **out)
+{
+    return parseArithLevel(p, out, true);
+}
+
+/*
+ * parseInList
+ * -----------
+ * Parsed '(' literal { ',' literal } ')' into a ValueSet of the operand's
+ * type (integers were widened for a FLOAT operand).
+ */
+static RC
+parseInList(Parser *p, Expr *operand, Expr **out)
+{
+    Value **vals = NULL;
+    int n = 0, cap = 0;
+    RC rc;
+
+    *out = NULL;
+    if ((rc = expect(p, TK_LPAREN, "expected '(' after IN")) != RC_OK)
+        return rc;
+
+    while (rc == RC_OK)
+    {
+        if (n == cap)
+        {
+            cap = cap ? cap * 2 : 8;
+            Value **grown = (Value **) realloc(vals, cap * sizeof(Value *));
+            if (grown == NULL)
+            {
+                rc = RC_MEMORY_ALLOCATION_ERROR;
+                break;
+            }
+            vals = grown;
+        }
+        if ((rc = parseLiteral(p, &vals[n])) != RC_OK)
+            break;
+        n++;
+        if ((rc = nextToken(p)) != RC_OK || p->tok.type != TK_COMMA)
+            break;
+        rc = nextToken(p);
+    }
+    if (rc == RC_OK)
+        rc = expect(p, TK_RPAREN, "expected ')' after IN list");
+
+    DataType dt = vals != NULL && n > 0 ? vals[0]->dt : DT_INT;
+    if (rc == RC_OK && operandType(p, operand, &dt) == false && operand->type == EXPR_PARAM)
+        rc = coerce(operand, dt);
+    for (int i = 0; rc == RC_OK && i < n; i++)
+        if (vals[i]->dt == DT_INT && dt == DT_FLOAT)
+        {
+            vals[i]->dt = DT_FLOAT;
+            vals[i]->v.floatV = (float) vals[i]->v.intV;
+        }
+
+    ValueSet *set = NULL;
+    if (rc == RC_OK)
+        rc = createValueSet(dt, vals, n, &set);
+    for (int i = 0; i < n; i++)
+        freeVal(vals[i]);
+    free(vals);
+    if (rc != RC_OK)
+        return rc;
+
+    MAKE_VALUESET((*out), set);
+    return RC_OK;
+}
+
+/*
+ * parsePrimary
+ * ------------
+ * Parsed a comparison, or an operand standing alone as a condition.
+ */
+static RC
+parsePrimary(Parser *p, Expr **out)
+{
+    Expr *left = NULL, *right = NULL, *high = NULL;
+    RC rc;
+
+    *out = NULL;
+    if ((rc = parseOperand(p, &left)) != RC_OK)
+        return rc;
+
+    // an operand on its own (a BOOL attribute or literal, a parenthesized
+    // condition) was a condition of its own
+    TokenType t = p->tok.type;
+    if (t == TK_END || t == TK_AND || t == TK_OR || t == TK_RPAREN)
+    {
+        *out = left;
+        return RC_OK;
+    }
+
+    bool negated = false;
+    if (t == TK_NOT)
+    {
+        negated = true;
+        if ((rc = nextToken(p)) != RC_OK)
+            goto fail;
+        t = p->tok.type;
+        if (t != TK_BETWEEN && t != TK_IN)
+        {
+            rc = RC_PARSE_ERROR;
+            RC_message = "expected BETWEEN or IN after NOT";
+            goto fail;
+        }
+    }
+
+    if (t == TK_IN)
+    {
+        if ((rc = nextToken(p)) != RC_OK || (rc = parseInList(p, left, &right)) != RC_OK)
+            goto fail;
+        MAKE_BINOP_EXPR((*out), left, right, OP_COMP_IN);
+    }
+    else if (t == TK_BETWEEN)
+    {
+        if ((rc = nextToken(p)) != RC_OK || (rc = parseOperand(p, &right)) != RC_OK)
+            goto fail;
+        if ((rc = expect(p, TK_AND, "expected AND in BETWEEN")) != RC_OK ||
+            (rc = parseOperand(p, &high)) != RC_OK)
+            goto fail;
+        Expr *ops[3] = { left, right, high };
+        if ((rc = typeOperands(p, ops, 3)) != RC_OK)
+            goto fail;
+        MAKE_BETWEEN_EXPR((*out), left, right, high);
+    }
+    else
+    {
+        OpType op;
+        switch (t)
+        {
+            case TK_EQ: op = OP_COMP_EQUAL;         break;
+            case TK_NE: op = OP_COMP_NOT_EQUAL;     break;
+            case TK_LT: op = OP_COMP_SMALLER;       break;
+            case TK_LE: op = OP_COMP_SMALLER_EQUAL; break;
+            case TK_GT: op = OP_COMP_GREATER;       break;
+            case TK_GE: op = OP_COMP_GREATER_EQUAL; break;
+            default:
+                rc = RC_PARSE_ERROR;
+                RC_message = "expected a comparison operator";
+                goto fail;
+        }
+        if ((rc = nextToken(p)) != RC_OK || (rc = parseOperand(p, &right)) != RC_OK)
+            goto fail;
+        Expr *ops[2] = { left, right };
+        if ((rc = typeOperands(p, ops, 2)) != RC_OK)
+            goto fail;
+        MAKE_BINOP_EXPR((*out), left, right, op);
+    }
+
+    if (negated)
+    {
+        Expr *inner = *out;
+        MAKE_UNOP_EXPR((*out), inner, OP_BOOL_NOT);
+    }
+    return RC_OK;
+
+fail:
+    if (left != NULL)
+        freeExpr(left);
+    if (right != NULL)
+        freeExpr(right);
+    if (high != NULL)
+        freeExpr(high);
+    return rc;
+}
+
+static RC
+parseNot(Parser *p, Expr **out)
+{
+    RC rc;
+    if (p->tok.type != TK_NOT)
+        return parsePrimary(p, out);
+
+    Expr *inner;
+    if ((rc = nextToken(p)) != RC_OK || (rc = parseNot(p, &inner)) != RC_OK)
+        return rc;
+    MAKE_UNOP_EXPR((*out), inner, OP_BOOL_NOT);
+    return RC_OK;
+}
+
+/*
+ * parseChain
+ * ----------
+ * Parsed one or more operands separated by AND (OR) into one n-ary node.
+ */
+static RC
+parseChain(Parser *p, Expr **out, TokenType sep, OpType type, RC (*operand)(Parser *, Expr **))
+{
+    Expr **args = NULL;
+    int n = 0, cap = 0;
+    RC rc;
+
+    *out = NULL;
+    while (true)
+    {
+        if (n == cap)
+        {
+            cap = cap ? cap * 2 : 4;
+            Expr **grown = (Expr **) realloc(args, cap * sizeof(Expr *));
+            if (grown == NULL)
+            {
+                rc = RC_MEMORY_ALLOCATION_ERROR;
+                break;
+            }
+            args = grown;
+        }
+        if ((rc = operand(p, &args[n])) != RC_OK)
+            break;
+        n++;
+        if (p->tok.type != sep)
+            break;
+        if ((rc = nextToken(p)) != RC_OK)
+            break;
+    }
+
+    if (rc != RC_OK)
+    {
+        for (int i = 0; i < n; i++)
+            freeExpr(args[i]);
+        free(args);
+        return rc;
+    }
+    if (n == 1)
+        *out = args[0];
+    else
+        MAKE_NARY_EXPR((*out), args, n, type);
+    free(args);
+    return RC_OK;
+}
+
+static RC
+parseAnd(Parser *p, Expr **out)
+{
+    return parseChain(p, out, TK_AND, OP_BOOL_AND, parseNot);
+}
+
+static RC
+parseOr(Parser *p, Expr **out)
+{
+    return parseChain(p, out, TK_OR, OP_BOOL_OR, parseAnd);
+}
+
+/*
+ * parseText
+ * ---------
+ * Parsed a whole condition. Placeholder slots were left in p->params for
+ * the caller to keep or free.
+ */
+static RC
+parseText(Parser *p, char *text, Schema *schema, bool allowParams, Expr **expr)
+{
+    RC rc;
+    memset(p, 0, sizeof(Parser));
+    p->pos         = text;
+    p->schema      = schema;
+    p->allowParams = allowParams;
+    *expr = NULL;
+
+    if ((rc = nextToken(p)) == RC_OK && (rc = parseOr(p, expr)) == RC_OK && p->tok.type != TK_END)
+    {
+        freeExpr(*expr);
+        *expr = NULL;
+        rc = RC_PARSE_ERROR;
+        RC_message = "unexpected text after the condition";
+    }
+    return rc;
+}
+
+static void
+freeParams(Value **params, int n)
+{
+    for (int i = 0; i < n; i++)
+    {
+        if (params[i]->dt == DT_STRING)
+            free(params[i]->v.stringV);
+        free(params[i]);
+    }
+    free(params);
+}
+
+/*
+ * schemaSignature / hashText
+ * --------------------------
+ * Described a schema as a string of names, types, lengths and offsets (a
+ * packed and an aligned layout compiled differently), and hashed a
+ * condition together with that signature (FNV-1a).
+ */
+static char *
+schemaSignature(Schema *schema)
+{
+    size_t size = 1;
+    for (int i = 0; i < schema->numAttr; i++)
+        size += strlen(schema->attrNames[i]) + 36;
+
+    char *sig = (char *) malloc(size);
+    if (sig == NULL)
+        return NULL;
+    char *s = sig;
+    *s = '\0';
+    for (int i = 0; i < schema->numAttr; i++)
+        s += sprintf(s, "%s:%d:%d@%d;", schema->attrNames[i], (int) schema->dataTypes[i], schema->typeLength[i],
+                     getAttrOffset(schema, i));
+    return sig;
+}
+
+static uint32_t
+hashText(const char *text, const char *sig)
+{
+    uint32_t h = 2166136261u;
+    for (const char *s = text; *s; s++)
+        h = (h ^ (unsigned char) *s) * 16777619u;
+    h = (h ^ 0xff) * 16777619u;
+    for (const char *s = sig; *s; s++)
+        h = (h ^ (unsigned char) *s) * 16777619u;
+    return h;
+}
+
+static void
+freeEntry(PreparedEntry *e)
+{
+    if (e->prog != NULL)
+        freePredicate(e->prog);
+    if (e->expr != NULL)
+        freeExpr(e->expr);
+    freeParams(e->params, e->numParams);
+    free(e->text);
+    free(e->schemaSig);
+    free(e);
+}
+
+/*
+ * cacheLookup / cacheInsert
+ * -------------------------
+ * Found the entry of a text and schema signature and took a handle count on
+ * it, or added an entry, evicting the least recently used one without
+ * handles when the cache was full (the entry stayed uncached if every slot
+ * was in use). Both ran with cacheLock held.
+ */
+static PreparedEntry *
+cacheLookup(uint32_t h, char *text, char *sig)
+{
+    for (int i = 0; i < cacheSize; i++)
+    {
+        PreparedEntry *e = cache[i];
+        if (e->hash == h && strcmp(e->text, text) == 0 && strcmp(e->schemaSig, sig) == 0)
+        {
+            e->handles++;
+            e->lastUse = ++useClock;
+            return e;
+        }
+    }
+    return NULL;
+}
+
+static void
+cacheInsert(PreparedEntry *e)
+{
+    int victim = -1;
+    if (cacheSize < PREPARED_CACHE_SIZE)
+        victim = cacheSize++;
+    else
+    {
+        for (int i = 0; i < cacheSize; i++)
+            if (cache[i]->handles == 0 && (victim < 0 || cache[i]->lastUse < cache[victim]->lastUse))
+                victim = i;
+        if (victim < 0)
+            return;
+        freeEntry(cache[victim]);
+    }
+    cache[victim] = e;
+    e->cached = true;
+}
+
+// dropped a handle count; an entry no longer cached went with its last one
+static void
+releaseEntry(PreparedEntry *e)
+{
+    pthread_mutex_lock(&cacheLock);
+    bool last = (--e->handles == 0 && !e->cached);
+    pthread_mutex_unlock(&cacheLock);
+    if (last)
+        freeEntry(e);
+}
+
+// pointed the parameters of a tree at to[i] instead of from[i]
+static void
+rebindExpr(Expr *expr, int numParams, Value **from, Value **to)
+{
+    if (expr->type == EXPR_OP)
+    {
+        for (int i = 0; i < expr->expr.op->numArgs; i++)
+            rebindExpr(expr->expr.op->args[i], numParams, from, to);
+    }
+    else if (expr->type == EXPR_PARAM)
+    {
+        for (int i = 0; i < numParams; i++)
+            if (expr->expr.param == from[i])
+                expr->expr.param = to[i];
+    }
+}
+
+static void
+freeHandle(PreparedCond *c)
+{
+    if (c->prog != NULL)
+        freePredicate(c->prog);
+    if (c->expr != NULL)
+        freeExpr(c->expr);
+    freeParams(c->params, c->numParams);
+    free(c);
+}
+
+/*
+ * newHandle
+ * ---------
+ * Made a handle on an entry whose handle count the caller had taken: fresh
+ * slots of the placeholder types, and the entry's tree and program copied
+ * to read them.
+ */
+static RC
+newHandle(PreparedEntry *e, PreparedCond **cond)
+{
+    PreparedCond *c = (PreparedCond *) calloc(1, sizeof(PreparedCond));
+    if (c == NULL)
+        return RC_MEMORY_ALLOCATION_ERROR;
+    c->entry = e;
+    c->refs  = 1;
+    c->params = (Value **) calloc(e->numParams > 0 ? e->numParams : 1, sizeof(Value *));
+    if (c->params == NULL)
+    {
+        free(c);
+        return RC_MEMORY_ALLOCATION_ERROR;
+    }
+    for (; c->numParams < e->numParams; c->numParams++)
+    {
+        Value *slot = (Value *) calloc(1, sizeof(Value));
+        if (slot == NULL)
+        {
+            freeHandle(c);
+            return RC_MEMORY_ALLOCATION_ERROR;
+        }
+        slot->dt = e->params[c->numParams]->dt;
+        c->params[c->numParams] = slot;
+    }
+
+    RC rc = copyExpr(e->expr, &c->expr);
+    if (rc == RC_OK)
+    {
+        rebindExpr(c->expr, c->numParams, e->params, c->params);
+        if (e->prog != NULL)
+            rc = rebindPredicate(e->prog, c->numParams, e->params, c->params, &c->prog);
+    }
+    if (rc != RC_OK)
+    {
+        freeHandle(c);
+        return rc;
+    }
+    *cond = c;
+    return RC_OK;
+}
+
+/* --------------------------------------------------------------------------
+   Interface
+   -------------------------------------------------------------------------- */
+
+/*
+ * parseCondition
+ * --------------
+ * Parsed text against a schema into a new tree without placeholders. The
+ * caller freed it with freeExpr.
+ */
+RC
+parseCondition(char *text, Schema *schema, Expr **expr)
+{
+    Parser p;
+    if (text == NULL || schema == NULL)
+        return RC_ERROR;
+    RC rc = parseText(&p, text, schema, false, expr);
+    free(p.params);
+    return rc;
+}
+
+/*
+ * prepareCondition
+ * ----------------
+ * Returned a new handle on the prepared condition for text and schema,
+ * from the cache when the same text had been prepared for an equal schema
+ * before. Otherwise parsed, optimized and compiled it (without holding the
+ * cache lock) and cached the result. Each successful call had to be paired
+ * with releaseCondition.
+ */
+RC
+prepareCondition(char *text, Schema *schema, PreparedCond **cond)
+{
+    *cond = NULL;
+    if (text == NULL || schema == NULL)
+        return RC_ERROR;
+
+    char *sig = schemaSignature(schema);
+    if (sig == NULL)
+        return RC_MEMORY_ALLOCATION_ERROR;
+    uint32_t h = hashText(text, sig);
+
+    pthread_mutex_lock(&cacheLock);
+    PreparedEntry *e = cacheLookup(h, text, sig);
+    if (e != NULL)
+        cacheHits++;
+    else
+        cacheMisses++;
+    pthread_mutex_unlock(&cacheLock);
+
+    if (e != NULL)
+        free(sig);
+    else
+    {
+        Parser p;
+        Expr *expr;
+        RC rc = parseText(&p, text, schema, true, &expr);
+        if (rc != RC_OK)
+        {
+            freeParams(p.params, p.numParams);
+            free(sig);
+            return rc;
+        }
+
+        e = (PreparedEntry *) calloc(1, sizeof(PreparedEntry));
+        if (e == NULL)
+        {
+            freeExpr(expr);
+            freeParams(p.params, p.numParams);
+            free(sig);
+            return RC_MEMORY_ALLOCATION_ERROR;
+        }
+        e->text      = strdup(text);
+        e->schemaSig = sig;
+        e->hash      = h;
+        e->expr      = expr;
+        e->params    = p.params;
+        e->numParams = p.numParams;
+        e->handles   = 1;
+
+        optimizeExpr(&e->expr, schema);
+        if (compilePredicate(e->expr, schema, &e->prog) != RC_OK)
+            e->prog = NULL;
+
+        // Another thread might have cached the same condition meanwhile
+        pthread_mutex_lock(&cacheLock);
+        PreparedEntry *other = cacheLookup(h, text, sig);
+        if (other == NULL)
+        {
+            e->lastUse = ++useClock;
+            cacheInsert(e);
+        }
+        pthread_mutex_unlock(&cacheLock);
+        if (other != NULL)
+        {
+            freeEntry(e);
+            e = other;
+        }
+    }
+
+    RC rc = newHandle(e, cond);
+    if (rc != RC_OK)
+        releaseEntry(e);
+    return rc;
+}
+
+/*
+ * retainCondition / releaseCondition
+ * ----------------------------------
+ * Took another reference to a handle (a scan kept one while it was open)
+ * or dropped one; the last reference freed the handle and its count on the
+ * entry, and an entry no longer in the cache went with its last handle.
+ */
+RC
+retainCondition(PreparedCond *cond)
+{
+    RC rc = RC_OK;
+    if (cond == NULL)
+        return RC_ERROR;
+    pthread_mutex_lock(&cacheLock);
+    if (cond->refs <= 0)
+        rc = RC_ERROR;
+    else
+        cond->refs++;
+    pthread_mutex_unlock(&cacheLock);
+    return rc;
+}
+
+RC
+releaseCondition(PreparedCond *cond)
+{
+    bool last;
+    if (cond == NULL)
+        return RC_ERROR;
+    pthread_mutex_lock(&cacheLock);
+    if (cond->refs <= 0)
+    {
+        pthread_mutex_unlock(&cacheLock);
+        return RC_ERROR;
+    }
+    last = (--cond->refs == 0);
+    pthread_mutex_unlock(&cacheLock);
+
+    if (last)
+    {
+        PreparedEntry *e = cond->entry;
+        freeHandle(cond);
+        releaseEntry(e);
+    }
+    return RC_OK;
+}
+
+/*
+ * bindParam
+ * ---------
+ * Copied a value into placeholder index of this handle only. The value had
+ * to have the type the placeholder was inferred to have; an INT bound to a
+ * FLOAT placeholder was widened, as evalExpr would have done.
+ */
+RC
+bindParam(PreparedCond *cond, int index, Value *value)
+{
+    if (index < 0 || index >= cond->numParams)
+        THROW(RC_ERROR, "placeholder index out of range");
+
+    Value *slot = cond->params[index];
+    if (slot->dt == DT_FLOAT && value->dt == DT_INT)
+    {
+        slot->v.floatV = (float) value->v.intV;
+        return RC_OK;
+    }
+    if (slot->dt != value->dt)
+        THROW(RC_RM_COMPARE_VALUE_OF_DIFFERENT_DATATYPE, "value does not match the type of the placeholder");
+
+    if (value->dt == DT_STRING)
+    {
+        char *copy = strdup(value->v.stringV);
+        if (copy == NULL)
+            return RC_MEMORY_ALLOCATION_ERROR;
+        free(slot->v.stringV);
+        slot->v.stringV = copy;
+    }
+    else
+        slot->v = value->v;
+    return RC_OK;
+}
+
+int
+getNumParams(PreparedCond *cond)
+{
+    return cond->numParams;
+}
+
+Expr *
+getPreparedExpr(PreparedCond *cond)
+{
+    return cond->expr;
+}
+
+PredProgram *
+getPreparedProgram(PreparedCond *cond)
+{
+    return cond->prog;
+}
+
+void
+getConditionCacheStats(int *hits, int *misses)
+{
+    pthread_mutex_lock(&cacheLock);
+    *hits   = cacheHits;
+    *misses = cacheMisses;
+    pthread_mutex_unlock(&cacheLock);
+}
+
+/*
+ * clearConditionCache
+ * -------------------
+ * Emptied the cache and reset its statistics. Entries that still had
+ * handles were freed when their last handle was released.
+ */
+RC
+clearConditionCache(void)
+{
+    pthread_mutex_lock(&cacheLock);
+    for (int i = 0; i < cacheSize; i++)
+    {
+        cache[i]->cached = false;
+        if (cache[i]->handles == 0)
+            freeEntry(cache[i]);
+    }
+    cacheSize   = 0;
+    cacheHits   = 0;
+    cacheMisses = 0;
+    pthread_mutex_unlock(&cacheLock);
+    return RC_OK;
+}
@@ -0,0 +1,53 @@
+#ifndef EXPR_PARSER_H
+#define EXPR_PARSER_H
+
+#include "dberror.h"
+#include "expr.h"
+#include "expr_compile.h"
+#include "tables.h"
+
+// prepared conditions kept in the cache at most; unused ones are evicted
+#define PREPARED_CACHE_SIZE 64
+
+/*
+ * A condition parsed from text against a schema, optimized and compiled
+ * once. Grammar (keywords are case-insensitive):
+ *
+ *   cond    := and { OR and }
+ *   and     := not { AND not }
+ *   not     := NOT not | primary
+ *   primary := operand
+ *            | operand cmp operand
+ *            | operand [NOT] BETWEEN operand AND operand
+ *            | operand [NOT] IN '(' literal { ',' literal } ')'
+ *   cmp     := '=' | '==' | '!=' | '<>' | '<' | '<=' | '>' | '>='
+ *   operand := term { ('+' | '-') term }
+ *   term    := factor { ('*' | '/' | '%') factor }
+ *   factor  := attribute name | literal | '?' | '(' cond ')' | '-' factor
+ *            | CAST '(' operand AS (INT | FLOAT | STRING | BOOL) ')'
+ *   literal := integer | float | 'string' ('' inside quotes) | TRUE | FALSE
+ *
+ * Each '?' is a placeholder numbered from 0 in order of appearance; its
+ * type is that of the other side of its comparison or arithmetic. An
+ * operand on its own must evaluate to a BOOL.
+ */
+typedef struct PreparedCond PreparedCond;
+
+// parsing a condition into a new Expr tree the caller owns
+extern RC parseCondition (char *text, Schema *schema, Expr **expr);
+
+// looking up (or parsing, optimizing and compiling) a cached condition;
+// every call returns a handle of its own, whose placeholders only it binds
+extern RC prepareCondition (char *text, Schema *schema, PreparedCond **cond);
+extern RC retainCondition (PreparedCond *cond);
+extern RC releaseCondition (PreparedCond *cond);
+extern RC bindParam (PreparedCond *cond, int index, Value *value);
+extern int getNumParams (PreparedCond *cond);
+extern Expr *getPreparedExpr (PreparedCond *cond);
+extern PredProgram *getPreparedProgram (PreparedCond *cond);
+
+// the cache shared by all prepared conditions
+extern void getConditionCacheStats (int *hits, int *misses);
+extern RC clearConditionCache (void);
+
+#endif // EXPR_PARSER_H
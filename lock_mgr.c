@@ -0,0 +1,424 @@
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "dberror.h"
+#include "lock_mgr.h"
+
+/*
+ * Lock manager
+ * ---------------------------------------------------------------
+ * Record locks were kept in a hash table keyed by (table id, RID) and split
+ * into LOCK_PARTITIONS partitions, each with its own mutex, condition
+ * variable and LOCK_BUCKETS chains, so requests for unrelated records
+ * rarely touched the same mutex. An entry listed its holders with their
+ * modes; it existed only while someone held or waited for the lock.
+ *
+ * Shared locks were compatible with each other, an exclusive lock with
+ * nothing held by another owner. An owner that already held a lock got it
+ * again at once, and its only shared lock on a record could be upgraded to
+ * exclusive. A request that had to wait slept on its partition's condition
+ * variable, which every release on the partition broadcast, and gave up with
+ * RC_RM_LOCK_TIMEOUT after the lock timeout: a wait that long was treated as
+ * a deadlock, and the caller was expected to release its locks (abort) and
+ * retry.
+ *
+ * Each owner remembered the locks it was granted, so releaseAllLocks (at the
+ * end of a transaction) did not search the table. An owner was used by one
+ * thread at a time, so that list needed no latch.
+ */
+
+typedef struct LockHolder {
+    RM_LockOwner *owner;
+    LockMode mode;
+    struct LockHolder *next;
+} LockHolder;
+
+typedef struct LockEntry {
+    int tableId;
+    RID id;
+    LockHolder *holders;
+    int waiters;
+    struct LockEntry *next;
+} LockEntry;
+
+typedef struct LockPartition {
+    pthread_mutex_t lock;
+    pthread_cond_t released;
+    LockEntry *buckets[LOCK_BUCKETS];
+} LockPartition;
+
+typedef struct HeldLock {
+    int tableId;
+    RID id;
+    struct HeldLock *next;
+} HeldLock;
+
+struct RM_LockOwner {
+    HeldLock *held;
+    int numHeld;
+};
+
+typedef struct LockTableName {
+    char *name;
+    int id;
+    struct LockTableName *next;
+} LockTableName;
+
+static LockPartition partitions[LOCK_PARTITIONS];
+static pthread_once_t partitionsOnce = PTHREAD_ONCE_INIT;
+static int lockTimeoutMs = LOCK_TIMEOUT_MS;   // read and written atomically
+
+static pthread_mutex_t namesLock = PTHREAD_MUTEX_INITIALIZER;
+static LockTableName *tableNames = NULL;
+static int nextTableId = 1;
+
+static __thread RM_LockOwner *currentOwner = NULL;
+
+/* --------------------------------------------------------------------------
+   Lock table
+   -------------------------------------------------------------------------- */
+
+static void
+initPartitions(void)
+{
+    for (int i = 0; i < LOCK_PARTITIONS; i++)
+    {
+        pthread_mutex_init(&partitions[i].lock, NULL);
+        pthread_cond_init(&partitions[i].released, NULL);
+        memset(partitions[i].buckets, 0, sizeof(partitions[i].buckets));
+    }
+}
+
+/*
+ * hashLock
+ * --------
+ * Mixed a table id and RID into one hash; the low bits chose the partition
+ * and the next bits the bucket inside it.
+ */
+static unsigned
+hashLock(int tableId, RID id)
+{
+    unsigned h = (unsigned) tableId * 0x9E3779B1u;
+    h = (h ^ (unsigned) id.page) * 0x85EBCA77u;
+    h = (h ^ (unsigned) id.slot) * 0xC2B2AE3Du;
+    return h ^ (h >> 16);
+}
+
+/*
+ * findEntry
+ * ---------
+ * Looked up the entry of a record in its partition (locked by the caller),
+ * creating it when create was set. NULL if absent or out of memory.
+ */
+static LockEntry *
+findEntry(LockPartition *part, unsigned hash, int tableId, RID id, bool create)
+{
+    LockEntry **bucket = &part->buckets[(hash / LOCK_PARTITIONS) % LOCK_BUCKETS];
+    for (LockEntry *e = *bucket; e != NULL; e = e->next)
+        if (e->tableId == tableId && e->id.page == id.page && e->id.slot == id.slot)
+            return e;
+    if (!create)
+        return NULL;
+
+    LockEntry *e = (LockEntry *) malloc(sizeof(LockEntry));
+    if (e == NULL)
+        return NULL;
+    e->tableId = tableId;
+    e->id = id;
+    e->holders = NULL;
+    e->waiters = 0;
+    e->next = *bucket;
+    *bucket = e;
+    return e;
+}
+
+// unlinked and freed an entry nobody held or waited for
+static void
+dropEntryIfUnused(LockPartition *part, unsigned hash, LockEntry *entry)
+{
+    if (entry->holders != NULL || entry->waiters > 0)
+        return;
+    for (LockEntry **e = &part->buckets[(hash / LOCK_PARTITIONS) % LOCK_BUCKETS]; *e != NULL; e = &(*e)->next)
+        if (*e == entry)
+        {
+            *e = entry->next;
+            free(entry);
+            return;
+        }
+}
+
+/*
+ * grantable
+ * ---------
+ * Told whether owner could hold the lock in mode next to the other holders,
+ * and returned its own holder record if it already had one.
+ */
+static bool
+grantable(LockEntry *entry, RM_LockOwner *owner, LockMode mode, LockHolder **mine)
+{
+    bool ok = true;
+    *mine = NULL;
+    for (LockHolder *h = entry->holders; h != NULL; h = h->next)
+    {
+        if (h->owner == owner)
+            *mine = h;
+        else if (mode == LOCK_EXCLUSIVE || h->mode == LOCK_EXCLUSIVE)
+            ok = false;
+    }
+    return ok;
+}
+
+/* --------------------------------------------------------------------------
+   Owners and requests
+   -------------------------------------------------------------------------- */
+
+RC
+createLockOwner(RM_LockOwner **owner)
+{
+    pthread_once(&partitionsOnce, initPartitions);
+    *owner = (RM_LockOwner *) malloc(sizeof(RM_LockOwner));
+    if (*owner == NULL)
+        THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate a lock owner");
+    (*owner)->held = NULL;
+    (*owner)->numHeld = 0;
+    return RC_OK;
+}
+
+RC
+freeLockOwner(RM_LockOwner *owner)
+{
+    if (owner == NULL)
+        return RC_OK;
+    releaseAllLocks(owner);
+    if (currentOwner == owner)
+        currentOwner = NULL;
+    free(owner);
+    return RC_OK;
+}
+
+/*
+ * getLockTableId
+ * --------------
+ * Returned the id locks of the named table were filed under; every handle
+ * opened on the same table name got the same id.
+ */
+int
+getLockTableId(char *tableName)
+{
+    int id;
+    pthread_mutex_lock(&namesLock);
+    for (LockTableName *t = tableNames; t != NULL; t = t->next)
+        if (strcmp(t->name, tableName) == 0)
+        {
+            pthread_mutex_unlock(&namesLock);
+            return t->id;
+        }
+    LockTableName *t = (LockTableName *) malloc(sizeof(LockTableName));
+    t->name = strdup(tableName);
+    t->id = id = nextTableId++;
+    t->next = tableNames;
+    tableNames = t;
+    pthread_mutex_unlock(&namesLock);
+    return id;
+}
+
+/*
+ * acquireLock
+ * -----------
+ * Granted owner a lock on the record in mode, waiting (if wait was set)
+ * while another owner held a conflicting one. A lock the owner already held
+ * in the same or a stronger mode was granted at once, a shared one was
+ * upgraded in place. Failed with RC_RM_LOCK_TIMEOUT when the wait exceeded
+ * the lock timeout, or at once when it was not to wait.
+ */
+static RC
+acquireLock(RM_LockOwner *owner, int tableId, RID id, LockMode mode, bool wait)
+{
+    unsigned hash = hashLock(tableId, id);
+    LockPartition *part = &partitions[hash % LOCK_PARTITIONS];
+    struct timespec deadline;
+    LockHolder *mine;
+    bool timedOut = false;
+
+    pthread_mutex_lock(&part->lock);
+    LockEntry *entry = findEntry(part, hash, tableId, id, true);
+    if (entry == NULL)
+    {
+        pthread_mutex_unlock(&part->lock);
+        THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate a lock entry");
+    }
+
+    if (!wait && !grantable(entry, owner, mode, &mine))
+    {
+        dropEntryIfUnused(part, hash, entry);
+        pthread_mutex_unlock(&part->lock);
+        THROW(RC_RM_LOCK_TIMEOUT, "record is locked by another owner");
+    }
+    if (!grantable(entry, owner, mode, &mine))
+    {
+        int timeoutMs = __atomic_load_n(&lockTimeoutMs, __ATOMIC_RELAXED);
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec  += timeoutMs / 1000;
+        deadline.tv_nsec += (long) (timeoutMs % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        entry->waiters++;
+        while (!grantable(entry, owner, mode, &mine) && !timedOut)
+            timedOut = (pthread_cond_timedwait(&part->released, &part->lock, &deadline) == ETIMEDOUT);
+        entry->waiters--;
+        if (!grantable(entry, owner, mode, &mine))
+        {
+            dropEntryIfUnused(part, hash, entry);
+            pthread_mutex_unlock(&part->lock);
+            THROW(RC_RM_LOCK_TIMEOUT, "lock wait timed out (possible deadlock)");
+        }
+    }
+
+    if (mine != NULL)
+    {
+        if (mode == LOCK_EXCLUSIVE)
+            mine->mode = LOCK_EXCLUSIVE;
+        pthread_mutex_unlock(&part->lock);
+        return RC_OK;
+    }
+
+    LockHolder *h = (LockHolder *) malloc(sizeof(LockHolder));
+    HeldLock *held = (HeldLock *) malloc(sizeof(HeldLock));
+    if (h == NULL || held == NULL)
+    {
+        free(h);
+        free(held);
+        dropEntryIfUnused(part, hash, entry);
+        pthread_mutex_unlock(&part->lock);
+        THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate a lock holder");
+    }
+    h->owner = owner;
+    h->mode = mode;
+    h->next = entry->holders;
+    entry->holders = h;
+    pthread_mutex_unlock(&part->lock);
+
+    held->tableId = tableId;
+    held->id = id;
+    held->next = owner->held;
+    owner->held = held;
+    owner->numHeld++;
+    return RC_OK;
+}
+
+RC
+lockRecord(RM_LockOwner *owner, int tableId, RID id, LockMode mode)
+{
+    return acquireLock(owner, tableId, id, mode, true);
+}
+
+/*
+ * tryLockRecord
+ * -------------
+ * Like lockRecord, but never waited, so it could be called while holding a
+ * latch: a conflicting lock failed it with RC_RM_LOCK_TIMEOUT at once.
+ */
+RC
+tryLockRecord(RM_LockOwner *owner, int tableId, RID id, LockMode mode)
+{
+    return acquireLock(owner, tableId, id, mode, false);
+}
+
+/*
+ * releaseLock
+ * -----------
+ * Removed owner from the holders of one record and woke the waiters of the
+ * partition.
+ */
+static void
+releaseLock(RM_LockOwner *owner, int tableId, RID id)
+{
+    unsigned hash = hashLock(tableId, id);
+    LockPartition *part = &partitions[hash % LOCK_PARTITIONS];
+
+    pthread_mutex_lock(&part->lock);
+    LockEntry *entry = findEntry(part, hash, tableId, id, false);
+    if (entry != NULL)
+    {
+        for (LockHolder **h = &entry->holders; *h != NULL; h = &(*h)->next)
+            if ((*h)->owner == owner)
+            {
+                LockHolder *gone = *h;
+                *h = gone->next;
+                free(gone);
+                break;
+            }
+        if (entry->waiters > 0)
+            pthread_cond_broadcast(&part->released);
+        dropEntryIfUnused(part, hash, entry);
+    }
+    pthread_mutex_unlock(&part->lock);
+}
+
+RC
+unlockRecord(RM_LockOwner *owner, int tableId, RID id)
+{
+    for (HeldLock **l = &owner->held; *l != NULL; l = &(*l)->next)
+        if ((*l)->tableId == tableId && (*l)->id.page == id.page && (*l)->id.slot == id.slot)
+        {
+            HeldLock *gone = *l;
+            *l = gone->next;
+            free(gone);
+            owner->numHeld--;
+            releaseLock(owner, tableId, id);
+            return RC_OK;
+        }
+    THROW(RC_ERROR, "record lock was not held");
+}
+
+RC
+releaseAllLocks(RM_LockOwner *owner)
+{
+    while (owner->held != NULL)
+    {
+        HeldLock *l = owner->held;
+        owner->held = l->next;
+        releaseLock(owner, l->tableId, l->id);
+        free(l);
+    }
+    owner->numHeld = 0;
+    return RC_OK;
+}
+
+int
+getNumLocksHeld(RM_LockOwner *owner)
+{
+    return owner->numHeld;
+}
+
+void
+setLockTimeout(int milliseconds)
+{
+    __atomic_store_n(&lockTimeoutMs, milliseconds > 0 ? milliseconds : 0, __ATOMIC_RELAXED);
+}
+
+/*
+ * setLockOwner / getLockOwner
+ * ---------------------------
+ * Installed the owner getRecord, insertRecord, updateRecord and deleteRecord
+ * of the calling thread locked records for, returning the previous one.
+ */
+RM_LockOwner *
+setLockOwner(RM_LockOwner *owner)
+{
+    RM_LockOwner *prev = currentOwner;
+    currentOwner = owner;
+    return prev;
+}
+
+RM_LockOwner *
+getLockOwner(void)
+{
+    return currentOwner;
+}
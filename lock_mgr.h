@@ -0,0 +1,41 @@
+#ifndef LOCK_MGR_H
+#define LOCK_MGR_H
+
+#include "dberror.h"
+#include "tables.h"
+
+// independently latched parts of the lock table and hash buckets in each
+#define LOCK_PARTITIONS 64
+#define LOCK_BUCKETS 256
+// how long a lock request waits before it is taken for a deadlock
+#define LOCK_TIMEOUT_MS 200
+
+typedef enum LockMode {
+	LOCK_SHARED = 0,
+	LOCK_EXCLUSIVE = 1
+} LockMode;
+
+// who holds locks: one transaction or request, used by one thread at a time
+typedef struct RM_LockOwner RM_LockOwner;
+
+extern RC createLockOwner (RM_LockOwner **owner);
+// releases whatever the owner still holds
+extern RC freeLockOwner (RM_LockOwner *owner);
+
+// record locks of a table, identified by getLockTableId (same name, same id)
+extern int getLockTableId (char *tableName);
+extern RC lockRecord (RM_LockOwner *owner, int tableId, RID id, LockMode mode);
+// fails with RC_RM_LOCK_TIMEOUT at once instead of waiting
+extern RC tryLockRecord (RM_LockOwner *owner, int tableId, RID id, LockMode mode);
+extern RC unlockRecord (RM_LockOwner *owner, int tableId, RID id);
+extern RC releaseAllLocks (RM_LockOwner *owner);
+extern int getNumLocksHeld (RM_LockOwner *owner);
+
+// waiting longer than this fails with RC_RM_LOCK_TIMEOUT (0 means no waiting)
+extern void setLockTimeout (int milliseconds);
+
+// the owner the record operations of the calling thread lock for (NULL: none)
+extern RM_LockOwner *setLockOwner (RM_LockOwner *owner);
+extern RM_LockOwner *getLockOwner (void);
+
+#endif // LOCK_MGR_H
@@ -0,0 +1,572 @@
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dberror.h"
+#include "expr.h"
+#include "partition.h"
+#include "record_mgr.h"
+#include "storage_mgr.h"
+
+/*
+ * Partitioned tables
+ * ---------------------------------------------------------------
+ * A partitioned table was a catalog page file under the table's name, whose
+ * first page held the partitioning as text ("kind keyAttr numPartitions" and
+ * the range bounds), and one ordinary table per partition in its own page
+ * file, opened with its own buffer pool. Every partition had the same
+ * schema, so openPartitionedTable took it from the first one.
+ *
+ * An insert went to the partition of the record's key. A scan worked out
+ * which partitions the conjuncts of its condition on the key left possible
+ * (a key range for range partitioning, an equality for hash partitioning)
+ * and ran an ordinary scan on each of those in turn. Dropping a partition
+ * deleted its page file and put an empty one in its place.
+ */
+
+/* --------------------------------------------------------------------------
+   Catalog
+   -------------------------------------------------------------------------- */
+
+// name of partition i's page file, owned by the caller
+static char *
+partitionFileName(char *name, int partition)
+{
+    char *file = (char *) malloc(strlen(name) + 16);
+    if (file != NULL)
+        sprintf(file, "%s.p%d", name, partition);
+    return file;
+}
+
+/*
+ * checkSpec
+ * ---------
+ * Rejected a partitioning the schema could not support: too many or too few
+ * partitions, a key out of range, a range key that was not an INT or range
+ * bounds that did not ascend.
+ */
+static RC
+checkSpec(Schema *schema, RM_PartitionSpec *spec)
+{
+    if (spec->numPartitions < 1 || spec->numPartitions > MAX_PARTITIONS)
+        THROW(RC_RM_BAD_PARTITION, "unsupported number of partitions");
+    if (spec->keyAttr < 0 || spec->keyAttr >= schema->numAttr)
+        THROW(RC_RM_BAD_PARTITION, "partition key is not an attribute");
+    if (spec->kind == RM_PARTITION_HASH)
+        return RC_OK;
+    if (spec->kind != RM_PARTITION_RANGE || schema->dataTypes[spec->keyAttr] != DT_INT)
+        THROW(RC_RM_BAD_PARTITION, "range partitioning needs an INT key");
+    for (int i = 1; i < spec->numPartitions - 1; i++)
+        if (spec->bounds[i] <= spec->bounds[i - 1])
+            THROW(RC_RM_BAD_PARTITION, "range bounds must ascend");
+    return RC_OK;
+}
+
+/*
+ * writeCatalog / readCatalog
+ * --------------------------
+ * Stored the partitioning on the first page of the catalog file and read
+ * it back (bounds into a new array).
+ */
+static RC
+writeCatalog(char *name, RM_PartitionSpec *spec)
+{
+    SM_FileHandle fh;
+    char page[PAGE_SIZE];
+    int offset;
+
+    memset(page, 0, PAGE_SIZE);
+    offset = sprintf(page, "%d %d %d\n", (int) spec->kind, spec->keyAttr, spec->numPartitions);
+    for (int i = 0; spec->kind == RM_PARTITION_RANGE && i < spec->numPartitions - 1; i++)
+        offset += sprintf(page + offset, "%d ", spec->bounds[i]);
+
+    RC rc = openPageFile(name, &fh);
+    if (rc != RC_OK)
+        return rc;
+    rc = writeBlock(0, &fh, page);
+    closePageFile(&fh);
+    return rc;
+}
+
+static RC
+readCatalog(char *name, RM_PartitionSpec *spec)
+{
+    SM_FileHandle fh;
+    char page[PAGE_SIZE];
+    int kind, used = 0;
+
+    RC rc = openPageFile(name, &fh);
+    if (rc != RC_OK)
+        return rc;
+    rc = readBlock(0, &fh, page);
+    closePageFile(&fh);
+    if (rc != RC_OK)
+        return rc;
+
+    char *p = page;
+    if (sscanf(p, "%d %d %d\n%n", &kind, &spec->keyAttr, &spec->numPartitions, &used) != 3
+        || spec->numPartitions < 1 || spec->numPartitions > MAX_PARTITIONS)
+        THROW(RC_RM_BAD_PARTITION, "not a partitioned table");
+    spec->kind = (RM_PartitionKind) kind;
+    spec->bounds = NULL;
+    if (spec->kind == RM_PARTITION_RANGE && spec->numPartitions > 1)
+    {
+        spec->bounds = (int *) malloc((spec->numPartitions - 1) * sizeof(int));
+        if (spec->bounds == NULL)
+            THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate partition bounds");
+        p += used;
+        for (int i = 0; i < spec->numPartitions - 1; i++)
+        {
+            sscanf(p, "%d %n", &spec->bounds[i], &used);
+            p += used;
+        }
+    }
+    return RC_OK;
+}
+
+/* --------------------------------------------------------------------------
+   Tables
+   -------------------------------------------------------------------------- */
+
+/*
+ * createPartitionedTable
+ * ----------------------
+ * Wrote the catalog and created an empty table for every partition (with
+ * the schema's layout, see setSchemaLayout).
+ */
+RC
+createPartitionedTable(char *name, Schema *schema, RM_PartitionSpec *spec)
+{
+    RC rc = checkSpec(schema, spec);
+    if (rc != RC_OK)
+        return rc;
+    rc = createPageFile(name);
+    if (rc != RC_OK)
+        return rc;
+    rc = writeCatalog(name, spec);
+
+    for (int i = 0; rc == RC_OK && i < spec->numPartitions; i++)
+    {
+        char *file = partitionFileName(name, i);
+        if (file == NULL)
+            THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate a partition name");
+        rc = createTable(file, schema);
+        free(file);
+    }
+    return rc;
+}
+
+/*
+ * openPartitionedTable
+ * --------------------
+ * Read the catalog and opened every partition's table.
+ */
+RC
+openPartitionedTable(RM_PartitionedTable *pt, char *name)
+{
+    RC rc = readCatalog(name, &pt->spec);
+    if (rc != RC_OK)
+        return rc;
+
+    int n = pt->spec.numPartitions;
+    pt->name      = name;
+    pt->partNames = (char **) calloc(n, sizeof(char *));
+    pt->parts     = (RM_TableData *) calloc(n, sizeof(RM_TableData));
+    if (pt->partNames == NULL || pt->parts == NULL)
+    {
+        free(pt->partNames);
+        free(pt->parts);
+        free(pt->spec.bounds);
+        THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate partitions");
+    }
+
+    for (int i = 0; i < n; i++)
+    {
+        pt->partNames[i] = partitionFileName(name, i);
+        rc = openTable(&pt->parts[i], pt->partNames[i]);
+        if (rc != RC_OK)
+            return rc;
+    }
+    pt->schema = pt->parts[0].schema;
+    return RC_OK;
+}
+
+RC
+closePartitionedTable(RM_PartitionedTable *pt)
+{
+    RC result = RC_OK;
+
+    for (int i = 0; i < pt->spec.numPartitions; i++)
+    {
+        RC rc = closeTable(&pt->parts[i]);
+        if (result == RC_OK)
+            result = rc;
+        free(pt->partNames[i]);
+    }
+    free(pt->partNames);
+    free(pt->parts);
+    free(pt->spec.bounds);
+    pt->partNames = NULL;
+    pt->parts = NULL;
+    pt->schema = NULL;
+    return result;
+}
+
+RC
+deletePartitionedTable(char *name)
+{
+    RM_PartitionSpec spec;
+    RC rc = readCatalog(name, &spec);
+    if (rc != RC_OK)
+        return rc;
+
+    for (int i = 0; i < spec.numPartitions; i++)
+    {
+        char *file = partitionFileName(name, i);
+        deleteTable(file);
+        free(file);
+    }
+    free(spec.bounds);
+    return destroyPageFile(name);
+}
+
+int
+getNumTuplesPartitioned(RM_PartitionedTable *pt)
+{
+    int total = 0;
+    for (int i = 0; i < pt->spec.numPartitions; i++)
+        total += getNumTuples(&pt->parts[i]);
+    return total;
+}
+
+RM_TableData *
+getPartitionTable(RM_PartitionedTable *pt, int partition)
+{
+    if (partition < 0 || partition >= pt->spec.numPartitions)
+        return NULL;
+    return &pt->parts[partition];
+}
+
+/*
+ * dropPartition
+ * -------------
+ * Emptied a partition at the cost of a file delete and create, however many
+ * records it held. Its key range (or hash bucket) stayed with it, so later
+ * inserts of such keys still found a place.
+ */
+RC
+dropPartition(RM_PartitionedTable *pt, int partition)
+{
+    if (partition < 0 || partition >= pt->spec.numPartitions)
+        THROW(RC_RM_BAD_PARTITION, "no such partition");
+
+    // The empty file was created first, while the schema was still open
+    RM_TableData *rel = &pt->parts[partition];
+    char *file = pt->partNames[partition];
+    char *fresh = (char *) malloc(strlen(file) + 5);
+    if (fresh == NULL)
+        THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate a partition name");
+    sprintf(fresh, "%s.new", file);
+
+    RC rc = createTable(fresh, pt->schema);
+    if (rc == RC_OK)
+        rc = closeTable(rel);
+    if (rc == RC_OK)
+        rc = destroyPageFile(file);
+    if (rc == RC_OK && rename(fresh, file) != 0)
+        rc = RC_WRITE_FAILED;
+    free(fresh);
+    if (rc != RC_OK)
+        return rc;
+
+    rc = openTable(rel, file);
+    if (rc == RC_OK && partition == 0)
+        pt->schema = rel->schema;
+    return rc;
+}
+
+/* --------------------------------------------------------------------------
+   Routing
+   -------------------------------------------------------------------------- */
+
+/*
+ * hashKey
+ * -------
+ * FNV-1a over the bytes that decided a key's equality: the int, the float
+ * (with -0 taken as 0), the bool or the string up to its end, so a record's
+ * key and an equal constant of a condition landed in the same partition.
+ */
+static unsigned
+hashKey(Value *key)
+{
+    unsigned h = 2166136261u;
+    const unsigned char *p;
+    size_t len;
+    float f;
+    char b;
+
+    switch (key->dt)
+    {
+        case DT_INT:
+            p = (const unsigned char *) &key->v.intV;
+            len = sizeof(int);
+            break;
+        case DT_FLOAT:
+            f = (key->v.floatV == 0.0f) ? 0.0f : key->v.floatV;
+            p = (const unsigned char *) &f;
+            len = sizeof(float);
+            break;
+        case DT_BOOL:
+            b = key->v.boolV ? 1 : 0;
+            p = (const unsigned char *) &b;
+            len = 1;
+            break;
+        default:
+            p = (const unsigned char *) key->v.stringV;
+            len = strlen(key->v.stringV);
+            break;
+    }
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ p[i]) * 16777619u;
+    return h;
+}
+
+// partition a key belonged to
+static int
+partitionOfKey(RM_PartitionSpec *spec, Value *key)
+{
+    if (spec->kind == RM_PARTITION_HASH)
+        return (int) (hashKey(key) % (unsigned) spec->numPartitions);
+
+    int lo = 0, hi = spec->numPartitions - 1;
+    while (lo < hi)
+    {
+        int mid = (lo + hi) / 2;
+        if (key->v.intV < spec->bounds[mid])
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    return lo;
+}
+
+int
+getPartitionOf(RM_PartitionedTable *pt, Record *record)
+{
+    Value *key;
+    if (getAttr(record, pt->schema, pt->spec.keyAttr, &key) != RC_OK)
+        return -1;
+    int partition = partitionOfKey(&pt->spec, key);
+    freeVal(key);
+    return partition;
+}
+
+RC
+insertPartitioned(RM_PartitionedTable *pt, Record *record, int *partition)
+{
+    int p = getPartitionOf(pt, record);
+    if (p < 0)
+        THROW(RC_RM_BAD_PARTITION, "cannot read the partition key");
+    if (partition != NULL)
+        *partition = p;
+    return insertRecord(&pt->parts[p], record);
+}
+
+/* --------------------------------------------------------------------------
+   Pruning and scans
+   -------------------------------------------------------------------------- */
+
+// the value of a constant or bound parameter, NULL for anything else
+static Value *
+constantOf(Expr *e)
+{
+    if (e->type == EXPR_CONST)
+        return e->expr.cons;
+    if (e->type == EXPR_PARAM)
+        return e->expr.param;
+    return NULL;
+}
+
+static bool
+isKey(RM_PartitionedTable *pt, Expr *e)
+{
+    return e->type == EXPR_ATTRREF && e->expr.attrRef == pt->spec.keyAttr;
+}
+
+/*
+ * keepRange
+ * ---------
+ * Unselected the range partitions holding no key in [lo, hi].
+ */
+static void
+keepRange(RM_PartitionSpec *spec, long long lo, long long hi, bool *selected)
+{
+    for (int i = 0; i < spec->numPartitions; i++)
+    {
+        long long first = (i == 0) ? LLONG_MIN : spec->bounds[i - 1];
+        long long last  = (i == spec->numPartitions - 1) ? LLONG_MAX : (long long) spec->bounds[i] - 1;
+        if (hi < first || lo > last)
+            selected[i] = false;
+    }
+}
+
+/*
+ * prune
+ * -----
+ * Narrowed selected down with every conjunct of cond that compared the key
+ * to a constant: an INT comparison or BETWEEN for range partitioning, an
+ * equality for hash partitioning. Anything else (OR, NOT, other columns)
+ * ruled out nothing.
+ */
+static void
+prune(RM_PartitionedTable *pt, Expr *cond, bool *selected)
+{
+    RM_PartitionSpec *spec = &pt->spec;
+
+    if (cond == NULL || cond->type != EXPR_OP)
+        return;
+    Operator *op = cond->expr.op;
+
+    if (op->type == OP_BOOL_AND)
+    {
+        for (int i = 0; i < op->numArgs; i++)
+            prune(pt, op->args[i], selected);
+        return;
+    }
+
+    if (op->type == OP_COMP_BETWEEN && spec->kind == RM_PARTITION_RANGE && isKey(pt, op->args[0]))
+    {
+        Value *low = constantOf(op->args[1]), *high = constantOf(op->args[2]);
+        if (low != NULL && high != NULL && low->dt == DT_INT && high->dt == DT_INT)
+            keepRange(spec, low->v.intV, high->v.intV, selected);
+        return;
+    }
+
+    if (op->numArgs != 2)
+        return;
+    OpType type = op->type;
+    Value *c;
+    if (isKey(pt, op->args[0]) && (c = constantOf(op->args[1])) != NULL)
+        ;
+    else if (isKey(pt, op->args[1]) && (c = constantOf(op->args[0])) != NULL)
+    {
+        // constant on the left: the comparison seen from the key
+        if (type == OP_COMP_SMALLER)            type = OP_COMP_GREATER;
+        else if (type == OP_COMP_GREATER)       type = OP_COMP_SMALLER;
+        else if (type == OP_COMP_SMALLER_EQUAL) type = OP_COMP_GREATER_EQUAL;
+        else if (type == OP_COMP_GREATER_EQUAL) type = OP_COMP_SMALLER_EQUAL;
+    }
+    else
+        return;
+    if (c->dt != pt->schema->dataTypes[spec->keyAttr])
+        return;
+
+    if (spec->kind == RM_PARTITION_HASH)
+    {
+        if (type != OP_COMP_EQUAL)
+            return;
+        int keep = partitionOfKey(spec, c);
+        for (int i = 0; i < spec->numPartitions; i++)
+            if (i != keep)
+                selected[i] = false;
+        return;
+    }
+
+    long long v = c->v.intV;
+    switch (type)
+    {
+        case OP_COMP_EQUAL:         keepRange(spec, v, v, selected); break;
+        case OP_COMP_SMALLER:       keepRange(spec, LLONG_MIN, v - 1, selected); break;
+        case OP_COMP_SMALLER_EQUAL: keepRange(spec, LLONG_MIN, v, selected); break;
+        case OP_COMP_GREATER:       keepRange(spec, v + 1, LLONG_MAX, selected); break;
+        case OP_COMP_GREATER_EQUAL: keepRange(spec, v, LLONG_MAX, selected); break;
+        default: break;
+    }
+}
+
+/*
+ * startPartitionedScan
+ * --------------------
+ * Chose the partitions cond could match; the first one's scan started with
+ * the first call of nextPartitioned. cond stayed the caller's.
+ */
+RC
+startPartitionedScan(RM_PartitionedTable *pt, RM_PartitionScan *scan, Expr *cond)
+{
+    scan->pt      = pt;
+    scan->cond    = cond;
+    scan->current = -1;
+    for (int i = 0; i < pt->spec.numPartitions; i++)
+        scan->selected[i] = true;
+    prune(pt, cond, scan->selected);
+    return RC_OK;
+}
+
+/*
+ * nextPartitioned
+ * ---------------
+ * Returned the next match of the current partition's scan, moving on to the
+ * next selected partition when it ran out, and told which partition the
+ * record (and its RID) belonged to.
+ */
+RC
+nextPartitioned(RM_PartitionScan *scan, Record *record, int *partition)
+{
+    RM_PartitionedTable *pt = scan->pt;
+
+    while (true)
+    {
+        if (scan->current >= 0)
+        {
+            RC rc = next(&scan->scan, record);
+            if (rc == RC_OK)
+            {
+                if (partition != NULL)
+                    *partition = scan->current;
+                return RC_OK;
+            }
+            closeScan(&scan->scan);
+            if (rc != RC_RM_NO_MORE_TUPLES)
+            {
+                scan->current = pt->spec.numPartitions;
+                return rc;
+            }
+        }
+
+        int p = scan->current + 1;
+        while (p < pt->spec.numPartitions && !scan->selected[p])
+            p++;
+        if (p >= pt->spec.numPartitions)
+        {
+            scan->current = pt->spec.numPartitions;
+            return RC_RM_NO_MORE_TUPLES;
+        }
+        scan->current = p;
+        RC rc = startScan(&pt->parts[p], &scan->scan, scan->cond);
+        if (rc != RC_OK)
+        {
+            scan->current = pt->spec.numPartitions;
+            return rc;
+        }
+    }
+}
+
+RC
+closePartitionedScan(RM_PartitionScan *scan)
+{
+    if (scan->current >= 0 && scan->current < scan->pt->spec.numPartitions)
+        closeScan(&scan->scan);
+    scan->current = scan->pt->spec.numPartitions;
+    return RC_OK;
+}
+
+int
+getNumScannedPartitions(RM_PartitionScan *scan)
+{
+    int n = 0;
+    for (int i = 0; i < scan->pt->spec.numPartitions; i++)
+        n += scan->selected[i];
+    return n;
+}
@@ -0,0 +1,65 @@
+#ifndef PARTITION_H
+#define PARTITION_H
+
+#include "dberror.h"
+#include "expr.h"
+#include "record_mgr.h"
+#include "tables.h"
+
+// most partitions a table could be split into
+#define MAX_PARTITIONS 64
+
+typedef enum RM_PartitionKind {
+	RM_PARTITION_RANGE = 0,   // INT key; partition i holds keys below bounds[i]
+	RM_PARTITION_HASH = 1     // any key type; partition = hash(key) % numPartitions
+} RM_PartitionKind;
+
+// how the records of a table were spread over partitions
+typedef struct RM_PartitionSpec {
+	RM_PartitionKind kind;
+	int keyAttr;
+	int numPartitions;
+	int *bounds;   // RANGE: numPartitions - 1 ascending bounds, the last partition takes the rest
+} RM_PartitionSpec;
+
+// an open partitioned table: one page file, buffer pool and table per partition
+typedef struct RM_PartitionedTable {
+	char *name;
+	Schema *schema;
+	RM_PartitionSpec spec;
+	char **partNames;
+	RM_TableData *parts;
+} RM_PartitionedTable;
+
+// a scan over the partitions its condition could match
+typedef struct RM_PartitionScan {
+	RM_PartitionedTable *pt;
+	Expr *cond;
+	bool selected[MAX_PARTITIONS];
+	int current;   // partition being scanned (-1 before the first)
+	RM_ScanHandle scan;
+} RM_PartitionScan;
+
+// partitioned tables; the partitions are page files named "<name>.p<i>"
+extern RC createPartitionedTable (char *name, Schema *schema, RM_PartitionSpec *spec);
+extern RC openPartitionedTable (RM_PartitionedTable *pt, char *name);
+extern RC closePartitionedTable (RM_PartitionedTable *pt);
+extern RC deletePartitionedTable (char *name);
+extern int getNumTuplesPartitioned (RM_PartitionedTable *pt);
+
+// records are inserted into the partition of their key; a RID is only
+// meaningful in its partition's table (getPartitionTable)
+extern int getPartitionOf (RM_PartitionedTable *pt, Record *record);
+extern RC insertPartitioned (RM_PartitionedTable *pt, Record *record, int *partition);
+extern RM_TableData *getPartitionTable (RM_PartitionedTable *pt, int partition);
+
+// empties a partition by deleting and recreating its page file
+extern RC dropPartition (RM_PartitionedTable *pt, int partition);
+
+// scans skip partitions the condition's conjuncts on the key rule out
+extern RC startPartitionedScan (RM_PartitionedTable *pt, RM_PartitionScan *scan, Expr *cond);
+extern RC nextPartitioned (RM_PartitionScan *scan, Record *record, int *partition);
+extern RC closePartitionedScan (RM_PartitionScan *scan);
+extern int getNumScannedPartitions (RM_PartitionScan *scan);
+
+#endif // PARTITION_H
@@ -0,0 +1,605 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "pred_simd.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SEL_X86 1
+#include <immintrin.h>
+#endif
+
+/*
+ * Predicate kernels
+ * ---------------------------------------------------------------
+ * Each kernel had a scalar version and, on x86 with GCC/Clang, an AVX2
+ * version compiled with a target attribute. The AVX2 version was picked at
+ * run time, so the rest of the build did not need -mavx2. Row data was read
+ * with 32-bit gathers (stride = record size); columnar data with plain
+ * vector loads.
+ */
+
+/* --------------------------------------------------------------------------
+   Helpers
+   -------------------------------------------------------------------------- */
+
+static void
+selClear(uint64_t *sel, int count)
+{
+    memset(sel, 0, SEL_WORDS(count) * sizeof(uint64_t));
+}
+
+static inline void
+selSet(uint64_t *sel, int i)
+{
+    sel[i >> 6] |= (uint64_t) 1 << (i & 63);
+}
+
+/*
+ * cpuHasAvx2
+ * ----------
+ * Checked once whether the CPU supported AVX2.
+ */
+static bool
+cpuHasAvx2(void)
+{
+#ifdef SEL_X86
+    static int cached = -1;
+    if (cached < 0)
+    {
+        __builtin_cpu_init();
+        cached = __builtin_cpu_supports("avx2") ? 1 : 0;
+    }
+    return cached == 1;
+#else
+    return false;
+#endif
+}
+
+bool
+selUsesAvx2(void)
+{
+    return cpuHasAvx2();
+}
+
+/* --------------------------------------------------------------------------
+   Scalar kernels
+   -------------------------------------------------------------------------- */
+
+static void
+selCompareIntScalar(const char *base, int stride, int from, int count, SelCompare cmp, int value, uint64_t *sel)
+{
+    for (int i = from; i < count; i++)
+    {
+        int v;
+        memcpy(&v, base + (size_t) i * stride, sizeof(int));
+        bool pass = (cmp == SEL_EQ) ? (v == value) : (cmp == SEL_LT) ? (v < value) : (v > value);
+        if (pass)
+            selSet(sel, i);
+    }
+}
+
+static void
+selCompareFloatScalar(const char *base, int stride, int from, int count, SelCompare cmp, float value, uint64_t *sel)
+{
+    for (int i = from; i < count; i++)
+    {
+        float v;
+        memcpy(&v, base + (size_t) i * stride, sizeof(float));
+        bool pass = (cmp == SEL_EQ) ? (v == value) : (cmp == SEL_LT) ? (v < value) : (v > value);
+        if (pass)
+            selSet(sel, i);
+    }
+}
+
+static void
+selAggregateIntScalar(const char *base, int stride, int from, int count, const uint64_t *sel,
+                      int64_t *sum, int *min, int *max)
+{
+    for (int i = selNext(sel, count, from); i >= 0; i = selNext(sel, count, i + 1))
+    {
+        int v;
+        memcpy(&v, base + (size_t) i * stride, sizeof(int));
+        *sum += v;
+        if (v < *min)
+            *min = v;
+        if (v > *max)
+            *max = v;
+    }
+}
+
+static void
+selAggregateFloatScalar(const char *base, int stride, int from, int count, const uint64_t *sel,
+                        double *sum, float *min, float *max)
+{
+    for (int i = selNext(sel, count, from); i >= 0; i = selNext(sel, count, i + 1))
+    {
+        float v;
+        memcpy(&v, base + (size_t) i * stride, sizeof(float));
+        *sum += v;
+        if (v < *min)
+            *min = v;
+        if (v > *max)
+            *max = v;
+    }
+}
+
+/* --------------------------------------------------------------------------
+   AVX2 kernels
+   -------------------------------------------------------------------------- */
+
+#ifdef SEL_X86
+
+__attribute__((target("avx2")))
+static __m256i
+loadInts(const char *p, int stride, __m256i idx)
+{
+    if (stride == (int) sizeof(int))
+        return _mm256_loadu_si256((const __m256i *) p);
+    return _mm256_i32gather_epi32((const int *) p, idx, 1);
+}
+
+__attribute__((target("avx2")))
+static inline __m256i
+compareInts(__m256i x, __m256i val, SelCompare cmp)
+{
+    return (cmp == SEL_EQ) ? _mm256_cmpeq_epi32(x, val)
+         : (cmp == SEL_LT) ? _mm256_cmpgt_epi32(val, x)
+         :                   _mm256_cmpgt_epi32(x, val);
+}
+
+/* Always inlined with a constant cmp so each comparison got its own loop */
+__attribute__((target("avx2"), always_inline))
+static inline int
+selCompareIntLoop(const char *base, int stride, int count, SelCompare cmp, int value, uint64_t *sel)
+{
+    __m256i idx = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+    __m256i val = _mm256_set1_epi32(value);
+    int i = 0;
+
+    // Eight vectors (one 64-bit word of the bitmap) per iteration to keep
+    // enough loads in flight
+    for (; i + 64 <= count; i += 64)
+    {
+        uint64_t bits = 0;
+        for (int k = 0; k < 8; k++)
+        {
+            __m256i x = loadInts(base + (size_t) (i + 8 * k) * stride, stride, idx);
+            bits |= (uint64_t) (unsigned) _mm256_movemask_ps(_mm256_castsi256_ps(compareInts(x, val, cmp))) << (8 * k);
+        }
+        sel[i >> 6] = bits;
+    }
+    for (; i + 8 <= count; i += 8)
+    {
+        __m256i x = loadInts(base + (size_t) i * stride, stride, idx);
+        sel[i >> 6] |= (uint64_t) (unsigned) _mm256_movemask_ps(_mm256_castsi256_ps(compareInts(x, val, cmp))) << (i & 63);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static int
+selCompareIntAvx2(const char *base, int stride, int count, SelCompare cmp, int value, uint64_t *sel)
+{
+    switch (cmp)
+    {
+    case SEL_EQ:
+        return selCompareIntLoop(base, stride, count, SEL_EQ, value, sel);
+    case SEL_LT:
+        return selCompareIntLoop(base, stride, count, SEL_LT, value, sel);
+    default:
+        return selCompareIntLoop(base, stride, count, SEL_GT, value, sel);
+    }
+}
+
+__attribute__((target("avx2")))
+static int
+selCompareFloatAvx2(const char *base, int stride, int count, SelCompare cmp, float value, uint64_t *sel)
+{
+    __m256i idx = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+    __m256 val = _mm256_set1_ps(value);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        const char *p = base + (size_t) i * stride;
+        __m256 x = (stride == (int) sizeof(float)) ? _mm256_loadu_ps((const float *) p)
+                                                   : _mm256_i32gather_ps((const float *) p, idx, 1);
+        __m256 m = (cmp == SEL_EQ) ? _mm256_cmp_ps(x, val, _CMP_EQ_OQ)
+                 : (cmp == SEL_LT) ? _mm256_cmp_ps(x, val, _CMP_LT_OQ)
+                 :                   _mm256_cmp_ps(x, val, _CMP_GT_OQ);
+        sel[i >> 6] |= (uint64_t) (unsigned) _mm256_movemask_ps(m) << (i & 63);
+    }
+    return i;
+}
+
+/* Compared 32 contiguous bytes at a time; used for bools stored back to back
+   and for the slot directory of a page. */
+__attribute__((target("avx2")))
+static int
+selBytesAvx2(const char *base, int count, int value, bool equal, uint64_t *sel)
+{
+    __m256i val = _mm256_set1_epi8((char) value);
+    int i = 0;
+    for (; i + 32 <= count; i += 32)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *) (base + i));
+        uint64_t bits = (uint32_t) _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, val));
+        if (!equal)
+            bits = ~bits & 0xFFFFFFFFu;
+        sel[i >> 6] |= bits << (i & 63);
+    }
+    return i;
+}
+
+__attribute__((target("avx2")))
+static bool
+memEqualAvx2(const char *a, const char *b, int len)
+{
+    int i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *) (a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *) (b + i));
+        if ((unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)) != 0xFFFFFFFFu)
+            return false;
+    }
+    return memcmp(a + i, b + i, len - i) == 0;
+}
+
+/* Found the first differing 32-byte block and compared the bytes there. */
+__attribute__((target("avx2")))
+static int
+memCompareAvx2(const char *a, const char *b, int len)
+{
+    int i = 0;
+    for (; i + 32 <= len; i += 32)
+    {
+        __m256i x = _mm256_loadu_si256((const __m256i *) (a + i));
+        __m256i y = _mm256_loadu_si256((const __m256i *) (b + i));
+        unsigned eq = (unsigned) _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+        if (eq != 0xFFFFFFFFu)
+        {
+            int k = i + __builtin_ctz(~eq);
+            return (int) (unsigned char) a[k] - (int) (unsigned char) b[k];
+        }
+    }
+    return memcmp(a + i, b + i, len - i);
+}
+
+/* Turned the eight selection bits of a vector into an all-ones/zero lane mask. */
+__attribute__((target("avx2")))
+static inline __m256i
+laneMask(const uint64_t *sel, int i)
+{
+    __m256i lanes = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256i bits = _mm256_set1_epi32((int) ((sel[i >> 6] >> (i & 63)) & 0xFF));
+    return _mm256_cmpeq_epi32(_mm256_and_si256(bits, lanes), lanes);
+}
+
+/* Kept eight running sums (as 64-bit halves), minima and maxima and folded
+   them into the caller's at the end; unselected lanes added 0 and kept the
+   running minimum and maximum. */
+__attribute__((target("avx2")))
+static int
+selAggregateIntAvx2(const char *base, int stride, int count, const uint64_t *sel,
+                    int64_t *sum, int *min, int *max)
+{
+    __m256i idx = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+    __m256i sums = _mm256_setzero_si256();
+    __m256i lo = _mm256_set1_epi32(*min);
+    __m256i hi = _mm256_set1_epi32(*max);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        if (((sel[i >> 6] >> (i & 63)) & 0xFF) == 0)
+            continue;
+        __m256i m = laneMask(sel, i);
+        __m256i x = loadInts(base + (size_t) i * stride, stride, idx);
+        __m256i xs = _mm256_and_si256(x, m);
+        sums = _mm256_add_epi64(sums, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(xs)));
+        sums = _mm256_add_epi64(sums, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(xs, 1)));
+        lo = _mm256_min_epi32(lo, _mm256_blendv_epi8(lo, x, m));
+        hi = _mm256_max_epi32(hi, _mm256_blendv_epi8(hi, x, m));
+    }
+
+    int64_t s[4];
+    int l[8], h[8];
+    _mm256_storeu_si256((__m256i *) s, sums);
+    _mm256_storeu_si256((__m256i *) l, lo);
+    _mm256_storeu_si256((__m256i *) h, hi);
+    *sum += s[0] + s[1] + s[2] + s[3];
+    for (int k = 0; k < 8; k++)
+    {
+        if (l[k] < *min)
+            *min = l[k];
+        if (h[k] > *max)
+            *max = h[k];
+    }
+    return i;
+}
+
+/* Summed in double lanes so long runs of floats kept their precision. */
+__attribute__((target("avx2")))
+static int
+selAggregateFloatAvx2(const char *base, int stride, int count, const uint64_t *sel,
+                      double *sum, float *min, float *max)
+{
+    __m256i idx = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(stride));
+    __m256d sums = _mm256_setzero_pd();
+    __m256 lo = _mm256_set1_ps(*min);
+    __m256 hi = _mm256_set1_ps(*max);
+    int i = 0;
+
+    for (; i + 8 <= count; i += 8)
+    {
+        if (((sel[i >> 6] >> (i & 63)) & 0xFF) == 0)
+            continue;
+        __m256 m = _mm256_castsi256_ps(laneMask(sel, i));
+        const char *p = base + (size_t) i * stride;
+        __m256 x = (stride == (int) sizeof(float)) ? _mm256_loadu_ps((const float *) p)
+                                                   : _mm256_i32gather_ps((const float *) p, idx, 1);
+        __m256 xs = _mm256_and_ps(x, m);
+        sums = _mm256_add_pd(sums, _mm256_cvtps_pd(_mm256_castps256_ps128(xs)));
+        sums = _mm256_add_pd(sums, _mm256_cvtps_pd(_mm256_extractf128_ps(xs, 1)));
+        lo = _mm256_min_ps(lo, _mm256_blendv_ps(lo, x, m));
+        hi = _mm256_max_ps(hi, _mm256_blendv_ps(hi, x, m));
+    }
+
+    double s[4];
+    float l[8], h[8];
+    _mm256_storeu_pd(s, sums);
+    _mm256_storeu_ps(l, lo);
+    _mm256_storeu_ps(h, hi);
+    *sum += s[0] + s[1] + s[2] + s[3];
+    for (int k = 0; k < 8; k++)
+    {
+        if (l[k] < *min)
+            *min = l[k];
+        if (h[k] > *max)
+            *max = h[k];
+    }
+    return i;
+}
+
+#endif // SEL_X86
+
+static int
+memCompareScalar(const char *a, const char *b, int len)
+{
+    return memcmp(a, b, len);
+}
+
+/* --------------------------------------------------------------------------
+   Interface
+   -------------------------------------------------------------------------- */
+
+/*
+ * selCompareInt / selCompareFloat
+ * -------------------------------
+ * Compared count INT (FLOAT) values with a constant.
+ */
+void
+selCompareInt(const char *base, int stride, int count, SelCompare cmp, int value, uint64_t *sel)
+{
+    int done = 0;
+    selClear(sel, count);
+#ifdef SEL_X86
+    if (cpuHasAvx2())
+        done = selCompareIntAvx2(base, stride, count, cmp, value, sel);
+#endif
+    selCompareIntScalar(base, stride, done, count, cmp, value, sel);
+}
+
+void
+selCompareFloat(const char *base, int stride, int count, SelCompare cmp, float value, uint64_t *sel)
+{
+    int done = 0;
+    selClear(sel, count);
+#ifdef SEL_X86
+    if (cpuHasAvx2())
+        done = selCompareFloatAvx2(base, stride, count, cmp, value, sel);
+#endif
+    selCompareFloatScalar(base, stride, done, count, cmp, value, sel);
+}
+
+/*
+ * selEqualsBool
+ * -------------
+ * Compared count one-byte bools with a constant. Only contiguous bools were
+ * vectorized; a 32-bit gather could have read past the end of a page.
+ */
+void
+selEqualsBool(const char *base, int stride, int count, bool value, uint64_t *sel)
+{
+    int done = 0;
+    selClear(sel, count);
+#ifdef SEL_X86
+    if (stride == 1 && cpuHasAvx2())
+        done = selBytesAvx2(base, count, value ? 1 : 0, true, sel);
+#endif
+    for (int i = done; i < count; i++)
+    {
+        bool v;
+        memcpy(&v, base + (size_t) i * stride, sizeof(bool));
+        if (v == value)
+            selSet(sel, i);
+    }
+}
+
+/*
+ * selEqualsString
+ * ---------------
+ * Compared count fixed-length strings with a constant of the same length,
+ * zero padded the way setAttr padded attributes, so a plain byte comparison
+ * matched strcmp equality on the terminated strings.
+ */
+void
+selEqualsString(const char *base, int stride, int count, const char *value, int len, uint64_t *sel)
+{
+    selClear(sel, count);
+#ifdef SEL_X86
+    if (len >= 32 && cpuHasAvx2())
+    {
+        for (int i = 0; i < count; i++)
+            if (memEqualAvx2(base + (size_t) i * stride, value, len))
+                selSet(sel, i);
+        return;
+    }
+#endif
+    for (int i = 0; i < count; i++)
+        if (memcmp(base + (size_t) i * stride, value, len) == 0)
+            selSet(sel, i);
+}
+
+/*
+ * selByteComparator
+ * -----------------
+ * Resolved the comparator for strings of len bytes, so callers that compared
+ * the same attribute over and over did not dispatch on every call.
+ */
+ByteComparator
+selByteComparator(int len)
+{
+#ifdef SEL_X86
+    if (len >= 32 && cpuHasAvx2())
+        return memCompareAvx2;
+#endif
+    return memCompareScalar;
+}
+
+/*
+ * selNonZeroBytes
+ * ---------------
+ * Selected the positions of non-zero bytes, e.g. the used slots of a page.
+ */
+void
+selNonZeroBytes(const char *base, int count, uint64_t *sel)
+{
+    int done = 0;
+    selClear(sel, count);
+#ifdef SEL_X86
+    if (cpuHasAvx2())
+        done = selBytesAvx2(base, count, 0, false, sel);
+#endif
+    for (int i = done; i < count; i++)
+        if (base[i] != 0)
+            selSet(sel, i);
+}
+
+/*
+ * selEqualBytes
+ * -------------
+ * Selected the positions of bytes equal to value, e.g. the slots of a page
+ * whose usage flag said "used" and not "deleted, not yet committed".
+ */
+void
+selEqualBytes(const char *base, int count, int value, uint64_t *sel)
+{
+    int done = 0;
+    selClear(sel, count);
+#ifdef SEL_X86
+    if (cpuHasAvx2())
+        done = selBytesAvx2(base, count, value, true, sel);
+#endif
+    for (int i = done; i < count; i++)
+        if ((unsigned char) base[i] == (unsigned char) value)
+            selSet(sel, i);
+}
+
+/*
+ * selAnd / selOr / selNot
+ * -----------------------
+ * Combined bitmaps word by word; selNot kept the bits past count cleared.
+ */
+void
+selAnd(uint64_t *dst, const uint64_t *src, int count)
+{
+    for (int w = 0; w < SEL_WORDS(count); w++)
+        dst[w] &= src[w];
+}
+
+void
+selOr(uint64_t *dst, const uint64_t *src, int count)
+{
+    for (int w = 0; w < SEL_WORDS(count); w++)
+        dst[w] |= src[w];
+}
+
+void
+selNot(uint64_t *dst, int count)
+{
+    int words = SEL_WORDS(count);
+    for (int w = 0; w < words; w++)
+        dst[w] = ~dst[w];
+    if (count & 63)
+        dst[words - 1] &= ((uint64_t) 1 << (count & 63)) - 1;
+}
+
+/*
+ * selCount
+ * --------
+ * Returned the number of selected positions.
+ */
+int
+selCount(const uint64_t *sel, int count)
+{
+    int n = 0;
+    for (int w = 0; w < SEL_WORDS(count); w++)
+        n += __builtin_popcountll(sel[w]);
+    return n;
+}
+
+/*
+ * selAggregateInt / selAggregateFloat
+ * -----------------------------------
+ * Folded the selected INT (FLOAT) values into *sum, *min and *max, which the
+ * caller had initialized, without a branch per value in the AVX2 version.
+ */
+void
+selAggregateInt(const char *base, int stride, int count, const uint64_t *sel, int64_t *sum, int *min, int *max)
+{
+    int done = 0;
+#ifdef SEL_X86
+    if (cpuHasAvx2())
+        done = selAggregateIntAvx2(base, stride, count, sel, sum, min, max);
+#endif
+    selAggregateIntScalar(base, stride, done, count, sel, sum, min, max);
+}
+
+void
+selAggregateFloat(const char *base, int stride, int count, const uint64_t *sel, double *sum, float *min, float *max)
+{
+    int done = 0;
+#ifdef SEL_X86
+    if (cpuHasAvx2())
+        done = selAggregateFloatAvx2(base, stride, count, sel, sum, min, max);
+#endif
+    selAggregateFloatScalar(base, stride, done, count, sel, sum, min, max);
+}
+
+/*
+ * selNext
+ * -------
+ * Returned the first selected position >= from, or -1 if there was none.
+ */
+int
+selNext(const uint64_t *sel, int count, int from)
+{
+    if (from >= count)
+        return -1;
+    int w = from >> 6;
+    uint64_t bits = sel[w] & (~(uint64_t) 0 << (from & 63));
+    while (true)
+    {
+        if (bits != 0)
+        {
+            int i = (w << 6) + __builtin_ctzll(bits);
+            return (i < count) ? i : -1;
+        }
+        if (++w >= SEL_WORDS(count))
+            return -1;
+        bits = sel[w];
+    }
+}
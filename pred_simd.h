@@ -0,0 +1,52 @@
+#ifndef PRED_SIMD_H
+#define PRED_SIMD_H
+
+#include <stdint.h>
+
+#include "dt.h"
+
+/*
+ * Selection bitmaps: bit i of sel[i / 64] is set when value i passed. The
+ * kernels read count values starting at base, stride bytes apart (stride
+ * equal to the value width for columnar data, the record size for rows in a
+ * page), and overwrite the first SEL_WORDS(count) words of sel. They use
+ * AVX2 when the CPU supports it and a scalar loop otherwise.
+ */
+#define SEL_WORDS(_count) (((_count) + 63) / 64)
+
+typedef enum SelCompare {
+  SEL_EQ,
+  SEL_LT,    // value < constant
+  SEL_GT     // value > constant (a constant on the left of <)
+} SelCompare;
+
+// kernels for the common predicate shapes
+extern void selCompareInt (const char *base, int stride, int count, SelCompare cmp, int value, uint64_t *sel);
+extern void selCompareFloat (const char *base, int stride, int count, SelCompare cmp, float value, uint64_t *sel);
+extern void selEqualsBool (const char *base, int stride, int count, bool value, uint64_t *sel);
+extern void selEqualsString (const char *base, int stride, int count, const char *value, int len, uint64_t *sel);
+extern void selNonZeroBytes (const char *base, int count, uint64_t *sel);
+extern void selEqualBytes (const char *base, int count, int value, uint64_t *sel);
+
+// combining bitmaps of count bits
+extern void selAnd (uint64_t *dst, const uint64_t *src, int count);
+extern void selOr (uint64_t *dst, const uint64_t *src, int count);
+extern void selNot (uint64_t *dst, int count);
+extern int selCount (const uint64_t *sel, int count);
+extern int selNext (const uint64_t *sel, int count, int from);
+
+// sum, minimum and maximum of the selected values, folded into the caller's
+extern void selAggregateInt (const char *base, int stride, int count, const uint64_t *sel,
+		int64_t *sum, int *min, int *max);
+extern void selAggregateFloat (const char *base, int stride, int count, const uint64_t *sel,
+		double *sum, float *min, float *max);
+
+// three-way comparison of two fixed-length, zero-padded byte strings (memcmp
+// semantics), picked once per width: AVX2 for long widths, memcmp otherwise
+typedef int (*ByteComparator) (const char *left, const char *right, int len);
+extern ByteComparator selByteComparator (int len);
+
+// whether the AVX2 kernels are in use on this machine
+extern bool selUsesAvx2 (void);
+
+#endif // PRED_SIMD_H
@@ -1,13 +1,26 @@
+#include <float.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>      // for memcpy, memset, etc.
+#include <time.h>
 #include <stdbool.h>
 #include "record_mgr.h"
 #include "buffer_mgr.h"
+#include "cdc_log.h"
 #include "storage_mgr.h"
+#include "arena.h"
 #include "dberror.h"
 #include "expr.h"
+#include "expr_compile.h"
+#include "expr_optimize.h"
+#include "expr_parser.h"
+#include "lock_mgr.h"
+#include "pred_simd.h"
 #include "tables.h"
+#include "txn_log.h"
 
 /*
  * Data structures used internally
@@ -16,54 +29,199 @@
  * - RM_ScanMgmtData : stored scan-related information (current page, slot, etc.).
  */
 
+#define ALIGN_UP(_n, _a) (((_n) + (_a) - 1) / (_a) * (_a))
+
+// page latches of an open table; data page p is guarded by latch p % RM_PAGE_LATCHES
+#define RM_PAGE_LATCHES 64
+
+// a data page began with slotsUsed (4 bytes) and its LSN (8 bytes), then one
+// flag per slot; pages of tables written before they had an LSN began with
+// slotsUsed alone
+#define PAGE_HEADER_SIZE 12
+#define PAGE_HEADER_NO_LSN 4
+
 /* This structure stored the essential table metadata. */
 typedef struct RM_TableMgmtData {
     BM_BufferPool bufferPool; // This had been the buffer pool used by the table
     int numTuples;            // This had been the total number of tuples present in the table
     int nextFreePage;         // This had been the first data page that might have free slots (-1 if none)
     int recordSize;           // This had been the size, in bytes, of each record
+    int maxSlots;             // This had been the number of slots on a data page
+    int dataOffset;           // This had been where the first slot's record began on a data page
+    int pageHeader;           // This had been where the slot flags began on a data page
+    int numPages;             // This had been the number of pages in the page file
+    unsigned version;         // This had been bumped by every insert, update and delete
+    int lockTableId;          // This had been the id the table's record locks were filed under
+    pthread_mutex_t latch;    // This had been held while the counters, free page or change stream were used
+    pthread_mutex_t pageLatches[RM_PAGE_LATCHES]; // These had been held while a thread used a data page's bytes
+    uint64_t appliedLsn;      // This had been the last log entry the table file was known to hold
+    CDC_Log *cdc;             // This had been where changes were captured (NULL if they were not)
 } RM_TableMgmtData;
 
+/* One change made by a transaction, kept so it could be undone. */
+typedef struct RM_TxnOp {
+    TxnLogOp type;          // insert, update or delete
+    RM_TableData *rel;      // table it changed (open until the transaction ended)
+    RID id;                 // its page was held until the transaction ended
+    char *before;           // record image before an update (NULL otherwise)
+    struct RM_TxnOp *prev;  // the change made before this one
+} RM_TxnOp;
+
+/* A page a transaction held (see holdPage). */
+typedef struct RM_HeldPage {
+    RM_TableData *rel;
+    int page;
+} RM_HeldPage;
+
+/* A transaction: its locks, the changes it made, newest first, and the pages they were on. */
+struct RM_Transaction {
+    RM_LockOwner *owner;        // locks held until commit or abort
+    RM_LockOwner *prevOwner;    // lock owner of the thread before begin
+    RM_TxnOp *ops;
+    int numOps;
+    RM_HeldPage *held;          // each pinned once until commit or abort
+    int numHeld;
+    int maxHeld;
+};
+
+/* One computed column of a projected scan. */
+typedef struct RM_ProjColumn {
+    Expr *expr;         // the caller's expression
+    PredProgram *prog;  // expr compiled for the table schema (NULL if it did not compile)
+    DataType dt;        // type of the column
+    int offset;         // position of the column in the output record
+    int len;            // bytes of a STRING column
+} RM_ProjColumn;
+
 /* This structure stored the state for a table scan in progress. */
 typedef struct RM_ScanMgmtData {
     int currentPage;    // Which page was being scanned
     int currentSlot;    // Which slot within that page
     Expr *cond;         // The scan condition (NULL if no filtering)
+    Expr *plan;         // optimized copy of cond that was evaluated
+    bool optimized;     // plan replaced cond (a NULL plan was always true)
+    bool empty;         // cond was always false, so nothing was scanned
+    PredProgram *prog;  // plan compiled for the schema (NULL if it did not compile)
+    PredRuntime *rt;    // pass-rate/cost statistics used to reorder prog's conjuncts
+    PreparedCond *prepared; // shared condition plan and prog came from (NULL if none)
+    RM_ProjColumn *proj; // computed columns returned instead of the record (NULL if none)
+    int numProj;
+    Arena *arena;       // temporaries of evalExpr on one row (NULL until first needed)
+    int selPage;        // page whose matches were in sel (-1 if none)
+    unsigned selVersion;// table version sel was computed for
+    uint64_t sel[SEL_WORDS(PAGE_SIZE)]; // matching used slots of selPage
+    int *samplePages;   // ascending data pages a sampling scan read (NULL: all of them)
+    int numSamplePages;
+    int sampleIdx;      // position of currentPage in samplePages
+    double sampleFraction; // share of the data pages the scan read
 } RM_ScanMgmtData;
 
+// buffer pool of the tables opened from now on (setTablePoolOptions)
+static int poolPages = RM_DEFAULT_POOL_PAGES;
+static ReplacementStrategy poolStrategy = RM_DEFAULT_POOL_STRATEGY;
+
 /* --------------------------------------------------------------------------
    Helpers
    -------------------------------------------------------------------------- */
 
+/*
+ * attrSize / attrAlign
+ * --------------------
+ * Returned the bytes an attribute occupied inside a record, and the
+ * alignment a direct load of it needed (strings were read byte by byte).
+ */
+static int
+attrSize(Schema *schema, int attrNum)
+{
+    switch (schema->dataTypes[attrNum])
+    {
+        case DT_INT:    return sizeof(int);
+        case DT_FLOAT:  return sizeof(float);
+        case DT_BOOL:   return sizeof(bool);
+        case DT_STRING: return schema->typeLength[attrNum];
+    }
+    return 0;
+}
+static int
+attrAlign(Schema *schema, int attrNum)
+{
+    switch (schema->dataTypes[attrNum])
+    {
+        case DT_INT:    return _Alignof(int);
+        case DT_FLOAT:  return _Alignof(float);
+        case DT_BOOL:   return _Alignof(bool);
+        case DT_STRING: return 1;
+    }
+    return 1;
+}
+
 /* 
  * computeRecordSize
  * -----------------
  * Determined how many bytes a record required, based on its schema.
- * Summed up the byte sizes for each attribute's data type.
+ * Summed up the byte sizes for each attribute's data type; an aligned record
+ * ended after its last attribute, padded to a multiple of its widest
+ * alignment so the next record in a page stayed aligned.
  */
 static int
 computeRecordSize(Schema *schema)
 {
-    int size = 0;
+    int size = 0, align = 1;
+    if (schema->offsets == NULL)
+    {
+        for (int i = 0; i < schema->numAttr; i++)
+            size += attrSize(schema, i);
+        return size;
+    }
     for (int i = 0; i < schema->numAttr; i++)
     {
-        switch (schema->dataTypes[i])
-        {
-            case DT_INT:    
-                size += sizeof(int);    
-                break;
-            case DT_FLOAT:  
-                size += sizeof(float);  
-                break;
-            case DT_BOOL:   
-                size += sizeof(bool);   
-                break;
-            case DT_STRING: 
-                size += schema->typeLength[i];  
-                break;
-        }
+        if (schema->offsets[i] + attrSize(schema, i) > size)
+            size = schema->offsets[i] + attrSize(schema, i);
+        if (attrAlign(schema, i) > align)
+            align = attrAlign(schema, i);
+    }
+    return ALIGN_UP(size, align);
+}
+
+/*
+ * computeMaxSlots
+ * ---------------
+ * Calculated how many records (slots) could fit in one page. We used header
+ * bytes to store "slotsUsed" (and the page LSN), plus 1 usage byte per slot,
+ * plus (recSize * #slots). This solved N * (recSize+1) + header <= PAGE_SIZE
+ * to get N.
+ */
+static int
+computeMaxSlots(int recSize, int header)
+{
+    return (PAGE_SIZE - header) / (recSize + 1);
+}
+
+/*
+ * setPageGeometry
+ * ---------------
+ * Set the record size, slot count and start of the record area of the
+ * table's data pages. With an aligned layout the record area started at a
+ * RECORD_AREA_ALIGN boundary, which could cost a slot.
+ */
+static void
+setPageGeometry(RM_TableMgmtData *tblData, Schema *schema)
+{
+    int header   = tblData->pageHeader;
+    int recSize  = computeRecordSize(schema);
+    int maxSlots = computeMaxSlots(recSize, header);
+
+    tblData->recordSize = recSize;
+    if (schema->offsets == NULL)
+    {
+        tblData->maxSlots   = maxSlots;
+        tblData->dataOffset = header + maxSlots;
+        return;
     }
-    return size;
+    while (ALIGN_UP(header + maxSlots, RECORD_AREA_ALIGN) + maxSlots * recSize > PAGE_SIZE)
+        maxSlots--;
+    tblData->maxSlots   = maxSlots;
+    tblData->dataOffset = ALIGN_UP(header + maxSlots, RECORD_AREA_ALIGN);
 }
 
 /* 
@@ -84,15 +242,17 @@ writeTableInfo(RM_TableData *rel)
     // Cleared out page 0
     memset(page.data, 0, PAGE_SIZE);
 
-    // First line: numTuples, nextFreePage
+    // First line: numTuples, nextFreePage and the last log entry applied
     char buffer[512];
-    sprintf(buffer, "%d %d\n", tblData->numTuples, tblData->nextFreePage);
+    sprintf(buffer, "%d %d %llu\n", tblData->numTuples, tblData->nextFreePage,
+            (unsigned long long) tblData->appliedLsn);
     strcpy(page.data, buffer);
     int offset = (int) strlen(buffer);
 
-    // Next line: number of attributes in the schema
+    // Next line: number of attributes in the schema, its layout and the data page header size
     Schema *sc = rel->schema;
-    sprintf(buffer, "%d\n", sc->numAttr);
+    sprintf(buffer, "%d %d %d\n", sc->numAttr, sc->offsets != NULL ? RM_LAYOUT_ALIGNED : RM_LAYOUT_PACKED,
+            tblData->pageHeader);
     strcpy(page.data + offset, buffer);
     offset += (int) strlen(buffer);
 
@@ -134,17 +294,31 @@ readTableInfo(RM_TableData *rel)
     int numT, freeP;
     int offset = 0;
 
-    // Parsed line 1: "numTuples nextFreePage"
-    sscanf(data, "%d %d\n%n", &numT, &freeP, &offset);
+    // Parsed line 1: "numTuples nextFreePage appliedLsn" (tables written
+    // before transactions existed had no LSN and had applied nothing)
+    unsigned long long lsn = 0;
+    int more = 0;
+    sscanf(data, "%d %d%n", &numT, &freeP, &offset);
+    if (data[offset] == ' ' && sscanf(data + offset, " %llu%n", &lsn, &more) == 1)
+        offset += more;
+    if (data[offset] == '\n')
+        offset++;
     tblData->numTuples    = numT;
     tblData->nextFreePage = freeP;
+    tblData->appliedLsn   = lsn;
 
-    // Parsed line 2: number of attributes
+    // Parsed line 2: number of attributes, the record layout and the data
+    // page header size (tables written before data pages had an LSN had none)
     data += offset;
-    int numAttr;
+    int numAttr, layout, header = PAGE_HEADER_NO_LSN;
     int used = 0;
-    sscanf(data, "%d\n%n", &numAttr, &used);
+    sscanf(data, "%d %d%n", &numAttr, &layout, &used);
     data += used;
+    if (*data == ' ' && sscanf(data, " %d%n", &header, &used) == 1)
+        data += used;
+    if (*data == '\n')
+        data++;
+    tblData->pageHeader = header;
 
     // Allocated arrays for attribute info
     char **attrNames = (char **) malloc(numAttr * sizeof(char*));
@@ -171,39 +345,214 @@ readTableInfo(RM_TableData *rel)
 
     // Built the schema from these arrays
     Schema *sc = createSchema(numAttr, attrNames, dataTypes, typeLength, 1, keys);
+    setSchemaLayout(sc, (RM_Layout) layout);
     rel->schema = sc;
 
-    // Computed record size
-    tblData->recordSize = computeRecordSize(sc);
+    // Computed record size and where records sat on a page
+    setPageGeometry(tblData, sc);
 
     unpinPage(&tblData->bufferPool, &page);
     return RC_OK;
 }
 
 /*
- * computeMaxSlots
- * ---------------
- * Calculated how many records (slots) could fit in one page. We used 4 bytes
- * to store "slotsUsed," plus 1 usage byte per slot, plus (recSize * #slots).
- * This solved N * (recSize+1) + 4 <= PAGE_SIZE to get N.
+ * getSlotFlag / setSlotFlag
+ * -------------------------
+ * Provided quick access to the 1-byte usage flags for each slot.
+ * If usage is 0 => free, 1 => used, 2 => deleted by a transaction that had
+ * not committed yet (still occupied, but no longer read or scanned).
  */
-static int
-computeMaxSlots(int recSize)
-{
-    return (PAGE_SIZE - 4) / (recSize + 1);
+#define SLOT_FREE 0
+#define SLOT_USED 1
+#define SLOT_DELETING 2
+
+static int getSlotFlag(RM_TableMgmtData *tblData, char *data, int slotNum) {
+    return (unsigned char)(data[tblData->pageHeader + slotNum]);
+}
+static void setSlotFlag(RM_TableMgmtData *tblData, char *data, int slotNum, int val) {
+    data[tblData->pageHeader + slotNum] = (char) val;
 }
 
 /*
- * getSlotFlag / setSlotFlag
- * -------------------------
- * Provided quick access to the 1-byte usage flags for each slot.
- * If usage is 0 => free, 1 => used, etc.
+ * getPageLsn / setPageLsn
+ * -----------------------
+ * Read or set the LSN of the newest committed log entry a data page held
+ * (see redoLogEntry). Pages without room for it read as 0, so every entry
+ * was replayed to them.
+ */
+static uint64_t getPageLsn(RM_TableMgmtData *tblData, char *data) {
+    uint64_t lsn = 0;
+    if (tblData->pageHeader >= PAGE_HEADER_SIZE)
+        memcpy(&lsn, data + sizeof(int), sizeof(lsn));
+    return lsn;
+}
+static void setPageLsn(RM_TableMgmtData *tblData, char *data, uint64_t lsn) {
+    if (tblData->pageHeader >= PAGE_HEADER_SIZE)
+        memcpy(data + sizeof(int), &lsn, sizeof(lsn));
+}
+
+/*
+ * pageLatch / bumpVersion
+ * -----------------------
+ * Threads could share an open table. The bytes of a data page (slot flags
+ * and records) were read and changed under the page's latch, the counters,
+ * next free page and change stream under the table latch. A thread held at
+ * most one page latch and took the table latch only after it, never the
+ * other way round, so threads working on different pages only met there
+ * for a moment. Every change of a page bumped the table version under the
+ * page's latch, so a scan holding it saw whether the page had changed.
+ */
+static pthread_mutex_t *pageLatch(RM_TableMgmtData *tblData, int pageNum) {
+    return &tblData->pageLatches[(unsigned) pageNum % RM_PAGE_LATCHES];
+}
+static void bumpVersion(RM_TableMgmtData *tblData) {
+    __atomic_add_fetch(&tblData->version, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * redoLogEntry
+ * ------------
+ * Applied one committed log entry to the table being opened. Entries were
+ * replayed whether or not their pages had reached the file before a crash,
+ * so each one only stated the end result: an insert or update wrote the
+ * image (an insert also occupied the slot), a delete freed the slot. A page
+ * that had reached the file with the entry (its LSN was as new) was left
+ * alone, as it might also hold newer changes made outside a transaction,
+ * which were not logged.
+ */
+static RC redoLogEntry(TxnLogEntry *entry, void *ctx) {
+    RM_TableData *rel = (RM_TableData *) ctx;
+    RM_TableMgmtData *tblData = (RM_TableMgmtData *) rel->mgmtData;
+    BM_PageHandle page;
+    RID id = entry->id;
+    RC rc;
+
+    if (id.page < 1 || id.slot < 0 || id.slot >= tblData->maxSlots)
+        return RC_OK;
+    if (entry->op != TXN_LOG_DELETE && entry->dataLen != tblData->recordSize)
+        return RC_OK;
+
+    // Pages appended after the table file was last written
+    if (id.page >= tblData->numPages)
+    {
+        SM_FileHandle fHandle;
+        rc = openPageFile(rel->name, &fHandle);
+        if (rc != RC_OK) return rc;
+        rc = ensureCapacity(id.page + 1, &fHandle);
+        closePageFile(&fHandle);
+        if (rc != RC_OK) return rc;
+        tblData->numPages = id.page + 1;
+    }
+
+    rc = pinPage(&tblData->bufferPool, &page, id.page);
+    if (rc != RC_OK) return rc;
+    if (entry->lsn <= getPageLsn(tblData, page.data))
+    {
+        unpinPage(&tblData->bufferPool, &page);
+        return RC_OK;
+    }
+
+    int slotsUsed;
+    memcpy(&slotsUsed, page.data, sizeof(int));
+    int flag = getSlotFlag(tblData, page.data, id.slot);
+
+    if (entry->op == TXN_LOG_DELETE)
+    {
+        if (flag != SLOT_FREE)
+        {
+            setSlotFlag(tblData, page.data, id.slot, SLOT_FREE);
+            slotsUsed--;
+            tblData->numTuples--;
+            tblData->nextFreePage = id.page;
+        }
+    }
+    else
+    {
+        memcpy(page.data + tblData->dataOffset + id.slot * tblData->recordSize, entry->data, entry->dataLen);
+        if (flag == SLOT_FREE)
+        {
+            slotsUsed++;
+            tblData->numTuples++;
+        }
+        setSlotFlag(tblData, page.data, id.slot, SLOT_USED);
+    }
+    memcpy(page.data, &slotsUsed, sizeof(int));
+    setPageLsn(tblData, page.data, entry->lsn);
+
+    markDirty(&tblData->bufferPool, &page);
+    unpinPage(&tblData->bufferPool, &page);
+    return RC_OK;
+}
+
+/*
+ * prepareScanCondition / releaseScanCondition
+ * -------------------------------------------
+ * Optimized a copy of the scan condition (the caller kept its own tree),
+ * compiled it and set up the adaptive term ordering for it, or released all
+ * of that. A condition that was always true needed no evaluation and one
+ * that was always false marked the scan empty. A condition the compiler
+ * rejected left prog NULL and was evaluated with evalExpr.
  */
-static int getSlotFlag(char *data, int slotNum) {
-    return (unsigned char)(data[4 + slotNum]);
+static void prepareScanCondition(RM_ScanMgmtData *sdata, Schema *schema) {
+    sdata->plan  = NULL;
+    sdata->optimized = false;
+    sdata->empty = false;
+    sdata->prog  = NULL;
+    sdata->rt    = NULL;
+    if (sdata->prepared != NULL)
+    {
+        // Already optimized and compiled; only the runtime was per scan
+        sdata->optimized = true;
+        sdata->empty = exprIsConstant(sdata->cond, false);
+        if (sdata->empty || exprIsConstant(sdata->cond, true))
+            return;
+        sdata->plan = sdata->cond;
+        sdata->prog = getPreparedProgram(sdata->prepared);
+        if (sdata->prog != NULL && createPredRuntime(sdata->prog, &sdata->rt) != RC_OK)
+            sdata->prog = NULL;
+        return;
+    }
+    if (sdata->cond == NULL)
+        return;
+    if (copyExpr(sdata->cond, &sdata->plan) != RC_OK)
+    {
+        sdata->plan = NULL;   // evaluated the caller's tree as written
+        return;
+    }
+    optimizeExpr(&sdata->plan, schema);
+    sdata->optimized = true;
+    if (exprIsConstant(sdata->plan, true) || exprIsConstant(sdata->plan, false))
+    {
+        sdata->empty = exprIsConstant(sdata->plan, false);
+        freeExpr(sdata->plan);
+        sdata->plan = NULL;
+        return;
+    }
+    if (compilePredicate(sdata->plan, schema, &sdata->prog) != RC_OK)
+        return;
+    if (createPredRuntime(sdata->prog, &sdata->rt) != RC_OK)
+    {
+        freePredicate(sdata->prog);
+        sdata->prog = NULL;
+    }
 }
-static void setSlotFlag(char *data, int slotNum, int val) {
-    data[4 + slotNum] = (char) val;
+static void releaseScanCondition(RM_ScanMgmtData *sdata) {
+    freePredRuntime(sdata->rt);
+    if (sdata->prepared != NULL)
+    {
+        releaseCondition(sdata->prepared);
+        sdata->prepared = NULL;
+        sdata->cond = NULL;
+    }
+    else
+    {
+        freePredicate(sdata->prog);
+        if (sdata->plan != NULL)
+            freeExpr(sdata->plan);
+    }
+    sdata->plan = NULL;
+    sdata->rt   = NULL;
+    sdata->prog = NULL;
 }
 
 /* --------------------------------------------------------------------------
@@ -246,10 +595,13 @@ RC createTable(char *name, Schema *schema)
     RM_TableMgmtData *tblData = (RM_TableMgmtData *) malloc(sizeof(RM_TableMgmtData));
     tblData->numTuples    = 0;
     tblData->nextFreePage = -1;
-    tblData->recordSize   = computeRecordSize(schema);
+    tblData->version      = 0;
+    tblData->appliedLsn   = getLastLsn(); // older entries were for a dropped namesake
+    tblData->pageHeader   = PAGE_HEADER_SIZE;
+    setPageGeometry(tblData, schema);
 
     // Initialized a buffer manager for this table
-    rc = initBufferPool(&tblData->bufferPool, name, /*numPages*/3, RS_FIFO, NULL);
+    rc = initBufferPool(&tblData->bufferPool, name, poolPages, poolStrategy, NULL);
     if (rc != RC_OK) return rc;
 
     // Built a temporary RM_TableData struct so we could call writeTableInfo
@@ -271,19 +623,50 @@ RC createTable(char *name, Schema *schema)
     return RC_OK;
 }
 
+/*
+ * createTableWithLayout
+ * ---------------------
+ * Set the schema's record layout (see setSchemaLayout), then created the
+ * table. Records for the table had to be built with this schema, and the
+ * layout was stored in the table so openTable restored it.
+ */
+RC createTableWithLayout(char *name, Schema *schema, RM_Layout layout)
+{
+    RC rc = setSchemaLayout(schema, layout);
+    if (rc != RC_OK) return rc;
+    return createTable(name, schema);
+}
+
 /*
  * openTable
  * ---------
  * Opened an existing table by creating new mgmt data, initing a buffer pool,
  * and reading table info from page 0. Set rel->schema and rel->mgmtData.
+ * Committed transactions the table file did not hold yet (the process had
+ * stopped before closeTable) were replayed from the transaction log. The
+ * file never held changes of transactions that had not committed (see
+ * holdPage), so there was nothing to undo.
  */
 RC openTable(RM_TableData *rel, char *name)
 {
     RM_TableMgmtData *tblData = (RM_TableMgmtData *) malloc(sizeof(RM_TableMgmtData));
 
-    RC rc = initBufferPool(&tblData->bufferPool, name, 3, RS_FIFO, NULL);
+    RC rc = initBufferPool(&tblData->bufferPool, name, poolPages, poolStrategy, NULL);
     if (rc != RC_OK) return rc;
 
+    // Recorded the file size once so scans did not reopen the file per page
+    SM_FileHandle fHandle;
+    rc = openPageFile(name, &fHandle);
+    if (rc != RC_OK) return rc;
+    tblData->numPages = fHandle.totalNumPages;
+    tblData->version  = 0;
+    tblData->lockTableId = getLockTableId(name);
+    tblData->cdc      = NULL;
+    pthread_mutex_init(&tblData->latch, NULL);
+    for (int i = 0; i < RM_PAGE_LATCHES; i++)
+        pthread_mutex_init(&tblData->pageLatches[i], NULL);
+    closePageFile(&fHandle);
+
     rel->name     = name;
     rel->schema   = NULL;
     rel->mgmtData = tblData;
@@ -291,18 +674,36 @@ RC openTable(RM_TableData *rel, char *name)
     rc = readTableInfo(rel);
     if (rc != RC_OK) return rc;
 
-    return RC_OK;
+    return replayTxnLog(name, tblData->appliedLsn, redoLogEntry, rel);
 }
 
 /*
  * closeTable
  * ----------
  * Wrote out metadata, shut down buffer pool, freed schema and mgmt data.
+ * The data pages were written before page 0, whose LSN then told openTable
+ * that every committed transaction so far was in the file. A transaction
+ * that had changed the table and not ended still held its pages, which
+ * could not be written yet, so the table stayed open and
+ * RC_PINNED_PAGES_IN_BUFFER was returned.
  */
 RC closeTable(RM_TableData *rel)
 {
     RM_TableMgmtData *tblData = (RM_TableMgmtData*) rel->mgmtData;
-    RC rc = writeTableInfo(rel);
+    int *fixCounts = getFixCounts(&tblData->bufferPool);
+    bool pinned = false;
+    for (int i = 0; fixCounts != NULL && i < tblData->bufferPool.numPages; i++)
+        pinned = pinned || fixCounts[i] > 0;
+    free(fixCounts);
+    if (pinned)
+        THROW(RC_PINNED_PAGES_IN_BUFFER, "a transaction still holds pages of the table");
+
+    disableChangeCapture(rel);
+    RC rc = forceFlushPool(&tblData->bufferPool);
+    if (rc != RC_OK) return rc;
+
+    tblData->appliedLsn = getLastLsn();
+    rc = writeTableInfo(rel);
     if (rc != RC_OK) return rc;
 
     rc = shutdownBufferPool(&tblData->bufferPool);
@@ -311,11 +712,60 @@ RC closeTable(RM_TableData *rel)
     freeSchema(rel->schema);
     rel->schema = NULL;
 
+    pthread_mutex_destroy(&tblData->latch);
+    for (int i = 0; i < RM_PAGE_LATCHES; i++)
+        pthread_mutex_destroy(&tblData->pageLatches[i]);
     free(tblData);
     rel->mgmtData = NULL;
     return RC_OK;
 }
 
+/*
+ * enableChangeCapture / disableChangeCapture
+ * ------------------------------------------
+ * Started appending an event for every insert, update and delete of the
+ * table to a change stream (path, or the table name with CDC_SUFFIX when
+ * NULL), continuing its sequence numbers, and stopped again. closeTable
+ * stopped capture; it was not remembered across openTable.
+ */
+RC enableChangeCapture(RM_TableData *rel, char *path)
+{
+    RM_TableMgmtData *tblData = (RM_TableMgmtData*) rel->mgmtData;
+    char *file = path;
+    RC rc = RC_OK;
+
+    if (file == NULL)
+    {
+        file = (char *) malloc(strlen(rel->name) + strlen(CDC_SUFFIX) + 1);
+        if (file == NULL)
+            THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate a change log name");
+        sprintf(file, "%s%s", rel->name, CDC_SUFFIX);
+    }
+
+    pthread_mutex_lock(&tblData->latch);
+    if (tblData->cdc == NULL)
+    {
+        CDC_Log *cdc;
+        if ((rc = openChangeLog(file, &cdc)) == RC_OK)
+            __atomic_store_n(&tblData->cdc, cdc, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&tblData->latch);
+
+    if (file != path)
+        free(file);
+    return rc;
+}
+
+RC disableChangeCapture(RM_TableData *rel)
+{
+    RM_TableMgmtData *tblData = (RM_TableMgmtData*) rel->mgmtData;
+    pthread_mutex_lock(&tblData->latch);
+    closeChangeLog(tblData->cdc);
+    __atomic_store_n(&tblData->cdc, NULL, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&tblData->latch);
+    return RC_OK;
+}
+
 /*
  * deleteTable
  * -----------
@@ -326,6 +776,21 @@ RC deleteTable(char *name)
     return destroyPageFile(name);
 }
 
+/*
+ * setTablePoolOptions
+ * -------------------
+ * Set the frames and replacement strategy of the buffer pool that tables
+ * opened (or created) afterwards got. Open tables kept theirs.
+ */
+RC setTablePoolOptions(int numPages, ReplacementStrategy strategy)
+{
+    if (numPages < 1)
+        THROW(RC_ERROR, "a buffer pool needs at least one frame");
+    poolPages    = numPages;
+    poolStrategy = strategy;
+    return RC_OK;
+}
+
 /*
  * getNumTuples
  * ------------
@@ -342,18 +807,100 @@ int getNumTuples(RM_TableData *rel)
    -------------------------------------------------------------------------- */
 
 /*
- * insertRecord
+ * capturing / captureChange
+ * -------------------------
+ * Told, without the table latch, whether changes were being captured (so a
+ * caller knew to keep the before image), and appended an event to the
+ * table's change stream if capture was on. captureChange was called with
+ * the changed page's latch held, so the events of a record came in the
+ * order its changes were made; the table latch kept the stream open while
+ * the event was appended.
+ */
+static bool capturing(RM_TableMgmtData *tblData) {
+    return __atomic_load_n(&tblData->cdc, __ATOMIC_ACQUIRE) != NULL;
+}
+
+static RC captureChange(RM_TableMgmtData *tblData, CDC_EventType type, RID id, char *before, char *after) {
+    RC rc = RC_OK;
+    pthread_mutex_lock(&tblData->latch);
+    if (tblData->cdc != NULL)
+        rc = appendChange(tblData->cdc, type, id, before, after, tblData->recordSize, NULL);
+    pthread_mutex_unlock(&tblData->latch);
+    return rc;
+}
+
+static __thread RM_Transaction *currentTxn = NULL;
+
+/*
+ * holdPage
+ * --------
+ * Pinned a page for the calling thread's transaction before it first
+ * changed the page. The transaction kept the pin until it ended, and the
+ * buffer pool neither evicted nor flushed a pinned page, so nothing a
+ * transaction changed reached the table file before it committed or its
+ * changes were undone (no-steal), and the log only needed redo entries.
+ * Every held page brought a frame of its own to the table's pool until the
+ * transaction ended, so a transaction could change more pages than the pool
+ * had frames, and other threads still found frames to pin.
+ */
+static RC holdPage(RM_TableData *rel, int pageNum) {
+    RM_TableMgmtData *tblData = (RM_TableMgmtData*) rel->mgmtData;
+    RM_Transaction *txn = currentTxn;
+    BM_PageHandle page;
+    RC rc;
+
+    // Newest first: a page was mostly changed again right after
+    for (int i = txn->numHeld - 1; i >= 0; i--)
+        if (txn->held[i].rel == rel && txn->held[i].page == pageNum)
+            return RC_OK;
+    if (txn->numHeld == txn->maxHeld)
+    {
+        int max = (txn->maxHeld > 0) ? 2 * txn->maxHeld : 8;
+        RM_HeldPage *held = (RM_HeldPage *) realloc(txn->held, max * sizeof(RM_HeldPage));
+        if (held == NULL)
+            THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot hold another page");
+        txn->held    = held;
+        txn->maxHeld = max;
+    }
+
+    rc = growBufferPool(&tblData->bufferPool, 1);
+    if (rc != RC_OK) return rc;
+    rc = pinPage(&tblData->bufferPool, &page, pageNum);
+    if (rc != RC_OK)
+    {
+        shrinkBufferPool(&tblData->bufferPool, 1);
+        return rc;
+    }
+    txn->held[txn->numHeld].rel  = rel;
+    txn->held[txn->numHeld].page = pageNum;
+    txn->numHeld++;
+    return RC_OK;
+}
+
+/*
+ * insertOnPage
  * ------------
- * Inserted a new record into the table. If nextFreePage < 1, appended a new data page.
- * Found a free slot or created a new page. Copied record->data into the free slot,
- * updated usage array, incremented numTuples. 
+ * Inserted a new record into the table. Took nextFreePage under the table
+ * latch, appending a new data page if it was < 1 (the page file appended it
+ * zeroed, which was an empty data page), then looked for a free slot under
+ * the page's latch. With a lock owner installed the slot's RID was locked
+ * exclusively first, without waiting: a free slot could still be locked by
+ * whoever had just freed it, and such a slot was passed over. If no slot
+ * was left, the page stopped being the next free page and the insert tried
+ * again. The record, the counters and the captured change were all done
+ * before the page latch was released, so nobody saw the record unlocked.
+ * Inside a transaction the page was held before the record was written
+ * (see holdPage).
  */
-RC insertRecord(RM_TableData *rel, Record *record)
+static RC insertOnPage(RM_TableData *rel, Record *record, RC *captured)
 {
     RM_TableMgmtData *tblData = (RM_TableMgmtData*) rel->mgmtData;
+    RM_LockOwner *owner = getLockOwner();
     BM_PageHandle page;
     RC rc;
     int recSize = tblData->recordSize;
+
+    pthread_mutex_lock(&tblData->latch);
     int pageNum = tblData->nextFreePage;
 
     // If nextFreePage was not valid, appended a new data page
@@ -361,93 +908,118 @@ RC insertRecord(RM_TableData *rel, Record *record)
     {
         SM_FileHandle fHandle;
         rc = openPageFile(rel->name, &fHandle);
-        if (rc != RC_OK) return rc;
+        if (rc != RC_OK)
+        {
+            pthread_mutex_unlock(&tblData->latch);
+            return rc;
+        }
 
         pageNum = fHandle.totalNumPages;  // The new data page
         ensureCapacity(pageNum + 1, &fHandle);
         closePageFile(&fHandle);
-
-        // pinned that new page
-        rc = pinPage(&tblData->bufferPool, &page, pageNum);
-        if (rc != RC_OK) return rc;
-
-        // zeroed out the entire page
-        memset(page.data, 0, PAGE_SIZE);
-
-        // stored slotsUsed = 0 in first 4 bytes
-        int slotsUsed = 0;
-        memcpy(page.data, &slotsUsed, sizeof(int));
-
-        markDirty(&tblData->bufferPool, &page);
-        unpinPage(&tblData->bufferPool, &page);
-
+        __atomic_store_n(&tblData->numPages, pageNum + 1, __ATOMIC_RELEASE);
         tblData->nextFreePage = pageNum;
     }
+    pthread_mutex_unlock(&tblData->latch);
 
     // pinned the nextFreePage
-    rc = pinPage(&tblData->bufferPool, &page, tblData->nextFreePage);
-    if (rc != RC_OK) return rc;
+    pthread_mutex_lock(pageLatch(tblData, pageNum));
+    rc = pinPage(&tblData->bufferPool, &page, pageNum);
+    if (rc != RC_OK)
+    {
+        pthread_mutex_unlock(pageLatch(tblData, pageNum));
+        return rc;
+    }
 
     char *data = page.data;
     int slotsUsed;
     memcpy(&slotsUsed, data, sizeof(int));
 
-    int maxSlots = computeMaxSlots(recSize);
+    int maxSlots = tblData->maxSlots;
     int freeSlot = -1;
 
-    // looked for a free slot
-    for (int i = 0; i < maxSlots; i++)
+    // looked for a free slot whose RID could be locked
+    for (int i = 0; i < maxSlots && freeSlot < 0; i++)
     {
-        if (getSlotFlag(data, i) == 0)
-        {
+        if (getSlotFlag(tblData, data, i) != SLOT_FREE)
+            continue;
+        RID id = { pageNum, i };
+        rc = (owner != NULL) ? tryLockRecord(owner, tblData->lockTableId, id, LOCK_EXCLUSIVE) : RC_OK;
+        if (rc == RC_OK)
             freeSlot = i;
-            break;
+        else if (rc != RC_RM_LOCK_TIMEOUT)
+        {
+            unpinPage(&tblData->bufferPool, &page);
+            pthread_mutex_unlock(pageLatch(tblData, pageNum));
+            return rc;
         }
     }
 
-    // if no slot was free, set nextFreePage = -1, unpin, reinsert
+    // if no slot was free, set nextFreePage = -1 (unless another insert had
+    // moved it on already), unpin, reinsert
     if (freeSlot < 0)
     {
-        tblData->nextFreePage = -1;
-        markDirty(&tblData->bufferPool, &page);
+        pthread_mutex_lock(&tblData->latch);
+        if (tblData->nextFreePage == pageNum)
+            tblData->nextFreePage = -1;
+        pthread_mutex_unlock(&tblData->latch);
+        unpinPage(&tblData->bufferPool, &page);
+        pthread_mutex_unlock(pageLatch(tblData, pageNum));
+        return insertOnPage(rel, record, captured);
+    }
+
+    rc = (currentTxn != NULL) ? holdPage(rel, pageNum) : RC_OK;
+    if (rc != RC_OK)
+    {
         unpinPage(&tblData->bufferPool, &page);
-        return insertRecord(rel, record);
+        pthread_mutex_unlock(pageLatch(tblData, pageNum));
+        return rc;
     }
 
     // wrote record->data into the page
-    int offset = 4 + maxSlots + (freeSlot * recSize);
+    int offset = tblData->dataOffset + (freeSlot * recSize);
     memcpy(data + offset, record->data, recSize);
 
     // updated usage
-    setSlotFlag(data, freeSlot, 1);
+    setSlotFlag(tblData, data, freeSlot, SLOT_USED);
     slotsUsed++;
     memcpy(data, &slotsUsed, sizeof(int));
+    bumpVersion(tblData);
 
     // assigned record->id
-    record->id.page = tblData->nextFreePage;
+    record->id.page = pageNum;
     record->id.slot = freeSlot;
 
     markDirty(&tblData->bufferPool, &page);
     unpinPage(&tblData->bufferPool, &page);
 
+    pthread_mutex_lock(&tblData->latch);
     tblData->numTuples++;
 
     // If page was full, set nextFreePage = -1, else keep the same page
-    if (slotsUsed == maxSlots)
-        tblData->nextFreePage = -1;
-    else
+    if (slotsUsed < maxSlots)
         tblData->nextFreePage = pageNum;
+    else if (tblData->nextFreePage == pageNum)
+        tblData->nextFreePage = -1;
+    pthread_mutex_unlock(&tblData->latch);
 
+    *captured = captureChange(tblData, CDC_INSERT, record->id, NULL, record->data);
+    pthread_mutex_unlock(pageLatch(tblData, pageNum));
     return RC_OK;
 }
 
 /*
- * deleteRecord
- * ------------
- * Freed a slot by marking usage=0, decreased the number of used slots,
- * and set nextFreePage if needed.
+ * changeSlotState
+ * ---------------
+ * Moved a slot whose flag was `from` to flag `to`, doing nothing otherwise.
+ * Freeing a slot decreased the number of used slots and numTuples and made
+ * the page the next free page if it had been full. A delete outside a
+ * transaction went from used to free; one inside went from used to
+ * deleting, and commit (deleting to free) or abort (deleting to used)
+ * settled it. changed (if not NULL) told whether the slot moved. Called
+ * with the page's latch held.
  */
-RC deleteRecord(RM_TableData *rel, RID id)
+static RC changeSlotState(RM_TableData *rel, RID id, int from, int to, bool *changed)
 {
     RM_TableMgmtData *tblData = (RM_TableMgmtData*) rel->mgmtData;
     BM_PageHandle page;
@@ -458,19 +1030,27 @@ RC deleteRecord(RM_TableData *rel, RID id)
     int slotsUsed;
     memcpy(&slotsUsed, data, sizeof(int));
 
-    // if usage was 1 => used, set it to 0 => free
-    if (getSlotFlag(data, id.slot) == 1)
+    bool moved = (getSlotFlag(tblData, data, id.slot) == from);
+    if (changed != NULL)
+        *changed = moved;
+    if (moved)
     {
-        setSlotFlag(data, id.slot, 0);
-        slotsUsed--;
-        memcpy(data, &slotsUsed, sizeof(int));
-        tblData->numTuples--;
-
-        // if the page used to be full, we updated nextFreePage to this one
-        int maxSlots = computeMaxSlots(tblData->recordSize);
-        if (slotsUsed == maxSlots - 1)
+        setSlotFlag(tblData, data, id.slot, to);
+        bumpVersion(tblData);
+        if (to == SLOT_FREE)
         {
-            tblData->nextFreePage = id.page;
+            slotsUsed--;
+            memcpy(data, &slotsUsed, sizeof(int));
+
+            pthread_mutex_lock(&tblData->latch);
+            tblData->numTuples--;
+
+            // if the page used to be full, we updated nextFreePage to this one
+            if (slotsUsed == tblData->maxSlots - 1)
+            {
+                tblData->nextFreePage = id.page;
+            }
+            pthread_mutex_unlock(&tblData->latch);
         }
     }
 
@@ -480,11 +1060,12 @@ RC deleteRecord(RM_TableData *rel, RID id)
 }
 
 /*
- * updateRecord
+ * updateOnPage
  * ------------
  * Overwrote the record data in an existing slot, if that slot usage was 1.
+ * Called with the page's latch held.
  */
-RC updateRecord(RM_TableData *rel, Record *record)
+static RC updateOnPage(RM_TableData *rel, Record *record)
 {
     RM_TableMgmtData *tblData = (RM_TableMgmtData*) rel->mgmtData;
     BM_PageHandle page;
@@ -494,16 +1075,16 @@ RC updateRecord(RM_TableData *rel, Record *record)
     RC rc = pinPage(&tblData->bufferPool, &page, pageNum);
     if (rc != RC_OK) return rc;
 
-    // if usage was 0 => cannot update
-    if (getSlotFlag(page.data, slotNum) == 0)
+    // if the slot was free (or being deleted) => cannot update
+    if (getSlotFlag(tblData, page.data, slotNum) != SLOT_USED)
     {
         unpinPage(&tblData->bufferPool, &page);
         return RC_READ_NON_EXISTING_PAGE;
     }
 
-    int maxSlots = computeMaxSlots(tblData->recordSize);
-    int offset = 4 + maxSlots + slotNum * tblData->recordSize;
+    int offset = tblData->dataOffset + slotNum * tblData->recordSize;
     memcpy(page.data + offset, record->data, tblData->recordSize);
+    bumpVersion(tblData);
 
     markDirty(&tblData->bufferPool, &page);
     unpinPage(&tblData->bufferPool, &page);
@@ -511,11 +1092,12 @@ RC updateRecord(RM_TableData *rel, Record *record)
 }
 
 /*
- * getRecord
- * ---------
- * Copied the record data out of the slot if usage was 1; if usage was 0, returned RC_RM_NO_MORE_TUPLES.
+ * readFromPage
+ * ------------
+ * Copied the record data out of the slot if usage was 1; otherwise returned RC_RM_NO_MORE_TUPLES.
+ * Called with the page's latch held.
  */
-RC getRecord(RM_TableData *rel, RID id, Record *record)
+static RC readFromPage(RM_TableData *rel, RID id, Record *record)
 {
     RM_TableMgmtData *tblData = (RM_TableMgmtData*) rel->mgmtData;
     BM_PageHandle page;
@@ -523,14 +1105,13 @@ RC getRecord(RM_TableData *rel, RID id, Record *record)
     if (rc != RC_OK) return rc;
 
     // check usage
-    if (getSlotFlag(page.data, id.slot) == 0)
+    if (getSlotFlag(tblData, page.data, id.slot) != SLOT_USED)
     {
         unpinPage(&tblData->bufferPool, &page);
         return RC_RM_NO_MORE_TUPLES;
     }
 
-    int maxSlots = computeMaxSlots(tblData->recordSize);
-    int offset   = 4 + maxSlots + (id.slot * tblData->recordSize);
+    int offset   = tblData->dataOffset + (id.slot * tblData->recordSize);
     memcpy(record->data, page.data + offset, tblData->recordSize);
 
     record->id.page = id.page;
@@ -540,84 +1121,912 @@ RC getRecord(RM_TableData *rel, RID id, Record *record)
     return RC_OK;
 }
 
-/* --------------------------------------------------------------------------
-   Scan operations
-   -------------------------------------------------------------------------- */
-
 /*
- * startScan
+ * slotImage
  * ---------
- * Allocated mgmt data for scanning: currentPage=1, currentSlot=0, stored the condition.
+ * Copied a slot's record bytes into image, or image into the slot when
+ * toPage was set, whatever the slot's flag. Used for the before images of
+ * transactions and for the images they logged. Called with the page's
+ * latch held.
  */
-RC startScan(RM_TableData *rel, RM_ScanHandle *scan, Expr *cond)
-{
-    RM_ScanMgmtData *scanData = (RM_ScanMgmtData*) malloc(sizeof(RM_ScanMgmtData));
-    scanData->currentPage = 1; 
-    scanData->currentSlot = 0;
-    scanData->cond        = cond;
+static RC slotImage(RM_TableData *rel, RID id, char *image, bool toPage) {
+    RM_TableMgmtData *tblData = (RM_TableMgmtData*) rel->mgmtData;
+    BM_PageHandle page;
+    RC rc = pinPage(&tblData->bufferPool, &page, id.page);
+    if (rc != RC_OK) return rc;
 
-    scan->rel      = rel;
-    scan->mgmtData = scanData;
+    char *slot = page.data + tblData->dataOffset + id.slot * tblData->recordSize;
+    if (toPage)
+    {
+        memcpy(slot, image, tblData->recordSize);
+        bumpVersion(tblData);
+        markDirty(&tblData->bufferPool, &page);
+    }
+    else
+        memcpy(image, slot, tblData->recordSize);
+    unpinPage(&tblData->bufferPool, &page);
     return RC_OK;
 }
 
 /*
- * next
- * ----
- * Retrieved the next matching record by scanning pages from currentPage onward,
- * skipping free slots (usage=0), returning the first that satisfies the condition (if any).
+ * lockForOwner
+ * ------------
+ * Locked a record for the lock owner installed on the calling thread, if
+ * any (see setLockOwner). Locks were held until the owner released them.
  */
-RC next(RM_ScanHandle *scan, Record *record)
-{
-    RM_TableData *rel         = scan->rel;
-    RM_TableMgmtData *tblData = (RM_TableMgmtData*) rel->mgmtData;
-    RM_ScanMgmtData *sdata    = (RM_ScanMgmtData*) scan->mgmtData;
+static RC lockForOwner(RM_TableMgmtData *tblData, RID id, LockMode mode) {
+    RM_LockOwner *owner = getLockOwner();
+    if (owner == NULL)
+        return RC_OK;
+    return lockRecord(owner, tblData->lockTableId, id, mode);
+}
 
-    int recSize = tblData->recordSize;
-    int maxSlots= computeMaxSlots(recSize);
+/*
+ * rememberOp
+ * ----------
+ * Added a change to the calling thread's transaction, if it had one, after
+ * the caller had held its page (see holdPage). before was the image an
+ * update replaced and became the transaction's.
+ */
+static RC rememberOp(TxnLogOp type, RM_TableData *rel, RID id, char *before) {
+    RM_Transaction *txn = currentTxn;
+    if (txn == NULL)
+        return RC_OK;
+
+    RM_TxnOp *op = (RM_TxnOp *) malloc(sizeof(RM_TxnOp));
+    if (op == NULL)
+    {
+        free(before);
+        THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot remember a transaction change");
+    }
+    op->type   = type;
+    op->rel    = rel;
+    op->id     = id;
+    op->before = before;
+    op->prev   = txn->ops;
+    txn->ops   = op;
+    txn->numOps++;
+    return RC_OK;
+}
+
+/*
+ * insertRecord / deleteRecord / updateRecord / getRecord
+ * ------------------------------------------------------
+ * Worked on the record's page under that page's latch, so threads using
+ * different pages did not wait for each other; the table latch was only
+ * taken for a moment to update the counters and the next free page. With a
+ * lock owner installed, reads took a shared and writes an exclusive record
+ * lock first, so a conflicting request waited for the holder outside any
+ * latch. An insert locked the RID it chose before the record could be
+ * seen (see insertOnPage).
+ *
+ * Inside a transaction the changes were also remembered for abort, and
+ * their pages held until it ended (see holdPage): an update kept the image
+ * it replaced, and a delete only marked the slot as being deleted, so no
+ * other insert could take it before commit. Deleting a record that was not
+ * there changed nothing, so nothing was remembered or logged for it.
+ *
+ * With change capture on, every change was appended to the change stream
+ * under the page latch, with the images before and after it. A failed append
+ * was reported, but the change itself stood.
+ */
+RC insertRecord(RM_TableData *rel, Record *record)
+{
+    RC captured = RC_OK;
+    RC rc = insertOnPage(rel, record, &captured);
+    if (rc != RC_OK) return rc;
+    rc = rememberOp(TXN_LOG_INSERT, rel, record->id, NULL);
+    return (rc != RC_OK) ? rc : captured;
+}
+
+RC deleteRecord(RM_TableData *rel, RID id)
+{
+    RM_TableMgmtData *tblData = (RM_TableMgmtData*) rel->mgmtData;
+    char *image = NULL;
+    RC captured = RC_OK;
+    bool changed;
+    RC rc = lockForOwner(tblData, id, LOCK_EXCLUSIVE);
+    if (rc != RC_OK) return rc;
+    if (capturing(tblData) && (image = (char *) malloc(tblData->recordSize)) == NULL)
+        THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate a before image");
+
+    pthread_mutex_lock(pageLatch(tblData, id.page));
+    rc = (currentTxn != NULL) ? holdPage(rel, id.page) : RC_OK;
+    if (rc == RC_OK)
+        rc = changeSlotState(rel, id, SLOT_USED, currentTxn ? SLOT_DELETING : SLOT_FREE, &changed);
+    if (rc == RC_OK && changed && image != NULL)
+    {
+        captured = slotImage(rel, id, image, false);
+        if (captured == RC_OK)
+            captured = captureChange(tblData, CDC_DELETE, id, image, NULL);
+    }
+    pthread_mutex_unlock(pageLatch(tblData, id.page));
+    free(image);
+    if (rc != RC_OK || !changed) return rc;
+    rc = rememberOp(TXN_LOG_DELETE, rel, id, NULL);
+    return (rc != RC_OK) ? rc : captured;
+}
+
+RC updateRecord(RM_TableData *rel, Record *record)
+{
+    RM_TableMgmtData *tblData = (RM_TableMgmtData*) rel->mgmtData;
+    char *before = NULL;
+    RC captured = RC_OK;
+    RC rc = lockForOwner(tblData, record->id, LOCK_EXCLUSIVE);
+    if (rc != RC_OK) return rc;
+    if ((currentTxn != NULL || capturing(tblData))
+        && (before = (char *) malloc(tblData->recordSize)) == NULL)
+        THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate a before image");
+
+    pthread_mutex_lock(pageLatch(tblData, record->id.page));
+    if (currentTxn != NULL)
+        rc = holdPage(rel, record->id.page);
+    if (rc == RC_OK && before != NULL)
+        rc = slotImage(rel, record->id, before, false);
+    if (rc == RC_OK)
+        rc = updateOnPage(rel, record);
+    if (rc == RC_OK && before != NULL)
+        captured = captureChange(tblData, CDC_UPDATE, record->id, before, record->data);
+    pthread_mutex_unlock(pageLatch(tblData, record->id.page));
+    if (rc != RC_OK || currentTxn == NULL)
+    {
+        free(before);
+        return (rc != RC_OK) ? rc : captured;
+    }
+    rc = rememberOp(TXN_LOG_UPDATE, rel, record->id, before);
+    return (rc != RC_OK) ? rc : captured;
+}
+
+RC getRecord(RM_TableData *rel, RID id, Record *record)
+{
+    RM_TableMgmtData *tblData = (RM_TableMgmtData*) rel->mgmtData;
+    RC rc = lockForOwner(tblData, id, LOCK_SHARED);
+    if (rc != RC_OK) return rc;
+    pthread_mutex_lock(pageLatch(tblData, id.page));
+    rc = readFromPage(rel, id, record);
+    pthread_mutex_unlock(pageLatch(tblData, id.page));
+    return rc;
+}
+
+/* --------------------------------------------------------------------------
+   Transactions
+   -------------------------------------------------------------------------- */
+
+/*
+ * beginTransaction
+ * ----------------
+ * Started a transaction on the calling thread: its record operations locked
+ * for the transaction's own lock owner until commit or abort, and their
+ * changes were remembered. A thread ran one transaction at a time: a nested
+ * one would have locked with an owner of its own and waited on the locks of
+ * the one it was begun in, so it failed instead.
+ */
+RC beginTransaction(RM_Transaction **txn)
+{
+    if (currentTxn != NULL)
+        THROW(RC_ERROR, "a transaction is already running on this thread");
+    RM_Transaction *t = (RM_Transaction *) malloc(sizeof(RM_Transaction));
+    if (t == NULL)
+        THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate a transaction");
+    RC rc = createLockOwner(&t->owner);
+    if (rc != RC_OK)
+    {
+        free(t);
+        return rc;
+    }
+    t->ops       = NULL;
+    t->numOps    = 0;
+    t->held      = NULL;
+    t->numHeld   = 0;
+    t->maxHeld   = 0;
+    t->prevOwner = setLockOwner(t->owner);
+    currentTxn   = t;
+    *txn = t;
+    return RC_OK;
+}
+
+/*
+ * endTransaction
+ * --------------
+ * Unpinned the pages the transaction had held and took their frames out of
+ * the pools again, released its locks, gave the thread back the lock owner
+ * it had before, and freed the transaction.
+ */
+static void endTransaction(RM_Transaction *txn) {
+    for (int i = 0; i < txn->numHeld; i++)
+    {
+        RM_TableMgmtData *tblData = (RM_TableMgmtData*) txn->held[i].rel->mgmtData;
+        BM_PageHandle page;
+        page.pageNum = txn->held[i].page;
+        unpinPage(&tblData->bufferPool, &page);
+        shrinkBufferPool(&tblData->bufferPool, 1);
+    }
+    free(txn->held);
+    for (RM_TxnOp *op = txn->ops, *prev; op != NULL; op = prev)
+    {
+        prev = op->prev;
+        free(op->before);
+        free(op);
+    }
+    freeLockOwner(txn->owner);
+    if (currentTxn == txn)
+    {
+        currentTxn = NULL;
+        setLockOwner(txn->prevOwner);
+    }
+    free(txn);
+}
+
+/*
+ * abortTransaction
+ * ----------------
+ * Undid the transaction's changes newest first (an update got its before
+ * image back, an insert's slot was freed, a delete's slot was used again)
+ * while its exclusive locks still kept everyone else off those records,
+ * then released them. A captured change stream got the undoing changes as
+ * events of their own, so a consumer replaying it ended up where the table
+ * did.
+ */
+RC abortTransaction(RM_Transaction *txn)
+{
+    RC result = RC_OK;
+
+    for (RM_TxnOp *op = txn->ops; op != NULL; op = op->prev)
+    {
+        RM_TableMgmtData *tblData = (RM_TableMgmtData*) op->rel->mgmtData;
+        bool capture = capturing(tblData);
+        char *image = capture ? (char *) malloc(tblData->recordSize) : NULL;
+        RC captured = (capture && image == NULL) ? RC_MEMORY_ALLOCATION_ERROR : RC_OK;
+        bool changed = true;
+        RC rc;
+
+        pthread_mutex_lock(pageLatch(tblData, op->id.page));
+        if (image != NULL)
+            captured = slotImage(op->rel, op->id, image, false);
+        capture = (image != NULL && captured == RC_OK);
+        if (op->type == TXN_LOG_UPDATE)
+        {
+            rc = slotImage(op->rel, op->id, op->before, true);
+            if (rc == RC_OK && capture)
+                captured = captureChange(tblData, CDC_UPDATE, op->id, image, op->before);
+        }
+        else if (op->type == TXN_LOG_INSERT)
+        {
+            rc = changeSlotState(op->rel, op->id, SLOT_USED, SLOT_FREE, &changed);
+            if (rc == RC_OK && changed && capture)
+                captured = captureChange(tblData, CDC_DELETE, op->id, image, NULL);
+        }
+        else
+        {
+            rc = changeSlotState(op->rel, op->id, SLOT_DELETING, SLOT_USED, &changed);
+            if (rc == RC_OK && changed && capture)
+                captured = captureChange(tblData, CDC_INSERT, op->id, NULL, image);
+        }
+        pthread_mutex_unlock(pageLatch(tblData, op->id.page));
+        free(image);
+        if (result == RC_OK)
+            result = (rc != RC_OK) ? rc : captured;
+    }
+    endTransaction(txn);
+    return result;
+}
+
+/*
+ * commitTransaction
+ * -----------------
+ * Logged the transaction oldest change first (the current image of each
+ * inserted or updated record, the RID of each deleted one) and made the log
+ * durable with one write and one sync, then freed the slots of its deletes,
+ * gave the pages it held the commit's LSN (see redoLogEntry) and released
+ * its locks and pages. The changed pages reached the table file later, with
+ * the buffer pool. If the log could not be written the transaction was
+ * aborted and the error returned.
+ */
+RC commitTransaction(RM_Transaction *txn)
+{
+    TxnLogEntry *entries = (TxnLogEntry *) calloc(txn->numOps > 0 ? txn->numOps : 1, sizeof(TxnLogEntry));
+    uint64_t commitLsn;
+    RC rc = RC_OK;
+    int n = txn->numOps;
+
+    if (entries == NULL)
+    {
+        abortTransaction(txn);
+        THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate the commit log entries");
+    }
+
+    // The list was newest first, the log went oldest first
+    RM_TxnOp *op = txn->ops;
+    for (int i = n - 1; i >= 0 && rc == RC_OK; i--, op = op->prev)
+    {
+        RM_TableMgmtData *tblData = (RM_TableMgmtData*) op->rel->mgmtData;
+        entries[i].op    = op->type;
+        entries[i].table = op->rel->name;
+        entries[i].id    = op->id;
+        if (op->type == TXN_LOG_DELETE)
+            continue;
+        entries[i].dataLen = tblData->recordSize;
+        entries[i].data    = (char *) malloc(tblData->recordSize);
+        if (entries[i].data == NULL)
+        {
+            rc = RC_MEMORY_ALLOCATION_ERROR;
+            break;
+        }
+        pthread_mutex_lock(pageLatch(tblData, op->id.page));
+        rc = slotImage(op->rel, op->id, entries[i].data, false);
+        pthread_mutex_unlock(pageLatch(tblData, op->id.page));
+    }
+
+    if (rc == RC_OK && n > 0)
+        rc = appendTxnLog(entries, n, &commitLsn);
+    for (int i = 0; i < n; i++)
+        free(entries[i].data);
+    free(entries);
+    if (rc != RC_OK)
+    {
+        abortTransaction(txn);
+        return rc;
+    }
+
+    for (op = txn->ops; op != NULL; op = op->prev)
+    {
+        if (op->type != TXN_LOG_DELETE)
+            continue;
+        RM_TableMgmtData *tblData = (RM_TableMgmtData*) op->rel->mgmtData;
+        pthread_mutex_lock(pageLatch(tblData, op->id.page));
+        changeSlotState(op->rel, op->id, SLOT_DELETING, SLOT_FREE, NULL);
+        pthread_mutex_unlock(pageLatch(tblData, op->id.page));
+    }
+
+    // Every committed change a held page had was logged at or below commitLsn
+    for (int i = 0; i < txn->numHeld && n > 0; i++)
+    {
+        RM_TableMgmtData *tblData = (RM_TableMgmtData*) txn->held[i].rel->mgmtData;
+        BM_PageHandle page;
+        pthread_mutex_lock(pageLatch(tblData, txn->held[i].page));
+        if (pinPage(&tblData->bufferPool, &page, txn->held[i].page) == RC_OK)
+        {
+            if (getPageLsn(tblData, page.data) < commitLsn)
+                setPageLsn(tblData, page.data, commitLsn);
+            markDirty(&tblData->bufferPool, &page);
+            unpinPage(&tblData->bufferPool, &page);
+        }
+        pthread_mutex_unlock(pageLatch(tblData, txn->held[i].page));
+    }
+    endTransaction(txn);
+    return RC_OK;
+}
+
+/*
+ * rowArena
+ * --------
+ * Returned the scan's evaluation arena, created on first use and emptied for
+ * the next row. NULL (malloc'd temporaries) if it could not be created.
+ */
+static Arena *rowArena(RM_ScanMgmtData *sdata) {
+    if (sdata->arena == NULL && createArena(&sdata->arena, 0) != RC_OK)
+        return NULL;
+    resetArena(sdata->arena);
+    return sdata->arena;
+}
+
+/*
+ * rowMatches
+ * ----------
+ * Evaluated the scan condition on the record at row, in place. The compiled
+ * program ran when there was one; otherwise evalExpr ran with its
+ * temporaries in the scan's arena, emptied row by row instead of freed
+ * value by value. No condition matched every row. A condition that failed
+ * on the row (a division by zero, say) failed the scan with its error.
+ */
+static RC rowMatches(RM_ScanMgmtData *sdata, Schema *schema, char *row, bool *pass) {
+    *pass = true;
+    if (sdata->prog != NULL)
+        return evalPredicateAdaptive(sdata->prog, sdata->rt, row, pass);
+    if (sdata->plan != NULL || (sdata->cond != NULL && !sdata->optimized))
+    {
+        Record inPage;
+        Value *res;
+        inPage.data = row;
+        Arena *prev = setEvalArena(rowArena(sdata));
+        RC rc = evalExpr(&inPage, schema, sdata->plan ? sdata->plan : sdata->cond, &res);
+        if (rc != RC_OK)
+        {
+            setEvalArena(prev);
+            return rc;
+        }
+        *pass = (res->v.boolV == TRUE);
+        freeVal(res);
+        setEvalArena(prev);
+    }
+    return RC_OK;
+}
+
+/*
+ * freeProjection / emitRecord
+ * ---------------------------
+ * Released the computed columns of a scan, or filled the caller's record
+ * for the row at src: a copy of the row, or the computed columns. Compiled
+ * columns were written straight into the output; the others went through
+ * evalExpr on the row in place.
+ */
+static void freeProjection(RM_ScanMgmtData *sdata) {
+    for (int i = 0; i < sdata->numProj; i++)
+        freePredicate(sdata->proj[i].prog);
+    free(sdata->proj);
+    sdata->proj    = NULL;
+    sdata->numProj = 0;
+}
+static RC emitRecord(RM_ScanMgmtData *sdata, Schema *schema, char *src, int recSize, Record *record) {
+    if (sdata->proj == NULL)
+    {
+        memcpy(record->data, src, recSize);
+        return RC_OK;
+    }
+    for (int i = 0; i < sdata->numProj; i++)
+    {
+        RM_ProjColumn *col = &sdata->proj[i];
+        char *out = record->data + col->offset;
+        if (col->prog != NULL)
+        {
+            RC rc = evalValueExpr(col->prog, src, out, col->len);
+            if (rc != RC_OK)
+                return rc;
+            continue;
+        }
+
+        Record inPage;
+        Value *res;
+        inPage.data = src;
+        Arena *prev = setEvalArena(rowArena(sdata));
+        RC rc = evalExpr(&inPage, schema, col->expr, &res);
+        if (rc != RC_OK)
+        {
+            setEvalArena(prev);
+            return rc;
+        }
+        if (res->dt != col->dt)
+        {
+            freeVal(res);
+            setEvalArena(prev);
+            THROW(RC_RM_COMPARE_VALUE_OF_DIFFERENT_DATATYPE, "computed column changed its type");
+        }
+        switch (res->dt)
+        {
+            case DT_INT:   memcpy(out, &res->v.intV, sizeof(int));     break;
+            case DT_FLOAT: memcpy(out, &res->v.floatV, sizeof(float)); break;
+            case DT_BOOL:  memcpy(out, &res->v.boolV, sizeof(bool));   break;
+            case DT_STRING:
+                memset(out, 0, col->len);
+                strncpy(out, res->v.stringV, col->len);
+                break;
+        }
+        freeVal(res);
+        setEvalArena(prev);
+    }
+    return RC_OK;
+}
+
+/* --------------------------------------------------------------------------
+   Scan operations
+   -------------------------------------------------------------------------- */
+
+/*
+ * startScan
+ * ---------
+ * Allocated mgmt data for scanning: currentPage=1, currentSlot=0, stored the condition.
+ */
+RC startScan(RM_TableData *rel, RM_ScanHandle *scan, Expr *cond)
+{
+    RM_ScanMgmtData *scanData = (RM_ScanMgmtData*) malloc(sizeof(RM_ScanMgmtData));
+    scanData->currentPage = 1; 
+    scanData->currentSlot = 0;
+    scanData->cond        = cond;
+    scanData->prepared    = NULL;
+    scanData->proj        = NULL;
+    scanData->numProj     = 0;
+    scanData->arena       = NULL;
+    scanData->selPage     = -1;
+    scanData->samplePages = NULL;
+    scanData->sampleFraction = 1.0;
+
+    // Compiled the condition once; shapes the compiler rejected used evalExpr
+    prepareScanCondition(scanData, rel->schema);
+
+    scan->rel      = rel;
+    scan->mgmtData = scanData;
+    return RC_OK;
+}
+
+/*
+ * startScanPrepared
+ * -----------------
+ * Started a scan filtered by a condition from prepareCondition, sharing its
+ * optimized tree and compiled program instead of building new ones. The
+ * scan held a reference to the condition until closeScan (or a restart with
+ * another condition); placeholders could be rebound between restarts.
+ */
+RC startScanPrepared(RM_TableData *rel, RM_ScanHandle *scan, PreparedCond *cond)
+{
+    if (cond == NULL)
+        return startScan(rel, scan, NULL);
+    if (retainCondition(cond) != RC_OK)
+        THROW(RC_ERROR, "prepared condition was already released");
+
+    RM_ScanMgmtData *scanData = (RM_ScanMgmtData*) malloc(sizeof(RM_ScanMgmtData));
+    scanData->currentPage = 1;
+    scanData->currentSlot = 0;
+    scanData->cond        = getPreparedExpr(cond);
+    scanData->prepared    = cond;
+    scanData->proj        = NULL;
+    scanData->numProj     = 0;
+    scanData->arena       = NULL;
+    scanData->selPage     = -1;
+    scanData->samplePages = NULL;
+    scanData->sampleFraction = 1.0;
+    prepareScanCondition(scanData, rel->schema);
+
+    scan->rel      = rel;
+    scan->mgmtData = scanData;
+    return RC_OK;
+}
+
+/*
+ * nextRandom
+ * ----------
+ * xorshift64* step of a sampler's generator, whose state was never 0.
+ */
+static uint64_t nextRandom(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545F4914F6CDD1DULL;
+}
+
+static int compareInts(const void *a, const void *b) {
+    int x = *(const int *) a, y = *(const int *) b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * samplePages
+ * -----------
+ * Chose the data pages (1 .. numPages-1) a sampling scan read: each page
+ * with probability rate (Bernoulli), or exactly ceil(rate * pages) of them
+ * drawn uniformly with a reservoir over the page numbers. Returned them in
+ * ascending order, so the file was still read front to back, along with
+ * the fraction of the data pages chosen.
+ */
+static RC samplePages(RM_ScanMgmtData *sdata, int numPages, RM_ScanOptions *options) {
+    static unsigned long scansStarted = 0;
+    int dataPages = numPages > 1 ? numPages - 1 : 0;
+    uint64_t state = options->seed ? options->seed
+                                   : ((uint64_t) time(NULL) << 20) ^ (uint64_t) (uintptr_t) sdata ^ ++scansStarted;
+    if (state == 0)
+        state = 1;
+
+    sdata->samplePages = (int *) malloc((dataPages > 0 ? dataPages : 1) * sizeof(int));
+    if (sdata->samplePages == NULL)
+        THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate the page sample");
+    sdata->numSamplePages = 0;
+
+    if (options->sample == RM_SAMPLE_BERNOULLI)
+    {
+        uint64_t threshold = options->rate >= 1.0 ? UINT64_MAX
+                                                  : (uint64_t) (options->rate * 18446744073709551616.0);
+        for (int p = 1; p < numPages; p++)
+            if (nextRandom(&state) < threshold || threshold == UINT64_MAX)
+                sdata->samplePages[sdata->numSamplePages++] = p;
+    }
+    else
+    {
+        int k = (int) (options->rate * dataPages);
+        if (k < options->rate * dataPages || k == 0)
+            k++;
+        if (k > dataPages)
+            k = dataPages;
+        // reservoir (algorithm R): page p replaced a random earlier pick
+        for (int i = 0; i < dataPages; i++)
+        {
+            if (i < k)
+                sdata->samplePages[i] = i + 1;
+            else
+            {
+                uint64_t j = nextRandom(&state) % (uint64_t) (i + 1);
+                if (j < (uint64_t) k)
+                    sdata->samplePages[j] = i + 1;
+            }
+        }
+        sdata->numSamplePages = k;
+        qsort(sdata->samplePages, k, sizeof(int), compareInts);
+    }
+
+    sdata->sampleIdx      = 0;
+    sdata->currentPage    = sdata->numSamplePages > 0 ? sdata->samplePages[0] : INT_MAX;
+    sdata->sampleFraction = dataPages > 0 ? (double) sdata->numSamplePages / dataPages : 1.0;
+    return RC_OK;
+}
+
+/*
+ * startScanWithOptions
+ * --------------------
+ * Started a scan like startScan, reading only a random sample of the data
+ * pages when options asked for one (NULL or RM_SAMPLE_NONE read them all).
+ * Records of a sampled page were all returned (block sampling), so counts
+ * and sums scaled by 1 / getScanSampleFraction estimated the full scan.
+ */
+RC startScanWithOptions(RM_TableData *rel, RM_ScanHandle *scan, Expr *cond, RM_ScanOptions *options)
+{
+    RM_TableMgmtData *tblData = (RM_TableMgmtData*) rel->mgmtData;
+
+    if (options != NULL && options->sample != RM_SAMPLE_NONE
+        && !(options->rate > 0.0 && options->rate <= 1.0))
+        THROW(RC_ERROR, "sampling rate must be in (0, 1]");
+
+    RC rc = startScan(rel, scan, cond);
+    if (rc != RC_OK || options == NULL || options->sample == RM_SAMPLE_NONE)
+        return rc;
+
+    int numPages = __atomic_load_n(&tblData->numPages, __ATOMIC_ACQUIRE);
+
+    rc = samplePages((RM_ScanMgmtData*) scan->mgmtData, numPages, options);
+    if (rc != RC_OK)
+        closeScan(scan);
+    return rc;
+}
+
+/*
+ * getScanSampleFraction
+ * ---------------------
+ * Returned the share of the table's data pages the scan read: 1 for a full
+ * scan, the sampled share for a sampling one.
+ */
+double getScanSampleFraction(RM_ScanHandle *scan)
+{
+    RM_ScanMgmtData *sdata = (RM_ScanMgmtData*) scan->mgmtData;
+    return sdata != NULL ? sdata->sampleFraction : 0.0;
+}
+
+/*
+ * restartScan
+ * -----------
+ * Rewound an open scan to the first data page and swapped in a new condition
+ * (NULL meant no filtering). Reused the existing mgmt data, so a caller could
+ * run many short scans on one handle without allocating. Parameter slots in
+ * the condition (MAKE_PARAM) could be rebound before each restart.
+ */
+RC restartScan(RM_ScanHandle *scan, Expr *cond)
+{
+    RM_ScanMgmtData *sdata = (RM_ScanMgmtData*) scan->mgmtData;
+    if (sdata == NULL)
+        return RC_SCAN_NOT_STARTED;
+
+    sdata->currentPage = 1;
+    sdata->currentSlot = 0;
+    sdata->selPage     = -1;   // parameters might have been rebound
+    if (sdata->samplePages != NULL)
+    {
+        // the same pages were sampled again
+        sdata->sampleIdx   = 0;
+        sdata->currentPage = sdata->numSamplePages > 0 ? sdata->samplePages[0] : INT_MAX;
+    }
+
+    // Kept the compiled program (and the term order learned so far) when the
+    // same condition came back; its parameters were read from their slots on
+    // every evaluation anyway
+    if (cond != sdata->cond)
+    {
+        releaseScanCondition(sdata);
+        sdata->cond = cond;
+        prepareScanCondition(sdata, scan->rel->schema);
+    }
+    return RC_OK;
+}
+
+/*
+ * setScanProjection
+ * -----------------
+ * Made next return computed columns instead of whole records: column i was
+ * exprs[i] evaluated on the row (attributes, constants, parameters,
+ * arithmetic, casts, conditions). Returned the schema of the output records
+ * in *result (freed by the caller with freeSchema); records passed to next
+ * had to be created with it. Columns were named after names[i], or after
+ * the attribute or "expr<i>" when names was NULL. A STRING column had the
+ * length of its attribute or constant, or PROJECTION_STRING_LENGTH. The
+ * expressions stayed owned by the caller; numExprs 0 went back to whole
+ * records. The projection lasted across restartScan.
+ */
+RC setScanProjection(RM_ScanHandle *scan, int numExprs, Expr **exprs, char **names, Schema **result)
+{
+    RM_ScanMgmtData *sdata = (RM_ScanMgmtData*) scan->mgmtData;
+    Schema *schema = scan->rel->schema;
+    RC rc = RC_OK;
+
+    if (result != NULL)
+        *result = NULL;
+    if (sdata == NULL)
+        return RC_SCAN_NOT_STARTED;
+    freeProjection(sdata);
+    if (numExprs <= 0)
+        return RC_OK;
+
+    RM_ProjColumn *proj = (RM_ProjColumn*) calloc(numExprs, sizeof(RM_ProjColumn));
+    char **attrNames = (char**) calloc(numExprs, sizeof(char*));
+    DataType *dataTypes = (DataType*) malloc(numExprs * sizeof(DataType));
+    int *typeLength = (int*) malloc(numExprs * sizeof(int));
+    if (proj == NULL || attrNames == NULL || dataTypes == NULL || typeLength == NULL)
+        rc = RC_MEMORY_ALLOCATION_ERROR;
+
+    int offset = 0;
+    for (int i = 0; rc == RC_OK && i < numExprs; i++)
+    {
+        RM_ProjColumn *col = &proj[i];
+        Expr *e = exprs[i];
+        char name[32];
+
+        col->expr = e;
+        if ((rc = exprType(e, schema, &col->dt)) != RC_OK)
+            break;
+        col->len = (col->dt != DT_STRING) ? 0 :
+                   (e->type == EXPR_ATTRREF) ? schema->typeLength[e->expr.attrRef] :
+                   (e->type == EXPR_CONST) ? (int) strlen(e->expr.cons->v.stringV) : PROJECTION_STRING_LENGTH;
+        col->offset = offset;
+        offset += (col->dt == DT_INT) ? (int) sizeof(int) : (col->dt == DT_FLOAT) ? (int) sizeof(float) :
+                  (col->dt == DT_BOOL) ? (int) sizeof(bool) : col->len;
+
+        // Computed columns the compiler rejected used evalExpr
+        DataType compiled;
+        if (compileValueExpr(e, schema, &col->prog, &compiled) == RC_OK && compiled != col->dt)
+        {
+            freePredicate(col->prog);
+            col->prog = NULL;
+        }
+
+        sprintf(name, "expr%d", i);
+        attrNames[i] = strdup(names != NULL ? names[i] :
+                              (e->type == EXPR_ATTRREF) ? schema->attrNames[e->expr.attrRef] : name);
+        dataTypes[i]  = col->dt;
+        typeLength[i] = col->len;
+        if (attrNames[i] == NULL)
+            rc = RC_MEMORY_ALLOCATION_ERROR;
+    }
+
+    if (rc != RC_OK)
+    {
+        for (int i = 0; proj != NULL && i < numExprs; i++)
+            freePredicate(proj[i].prog);
+        for (int i = 0; attrNames != NULL && i < numExprs; i++)
+            free(attrNames[i]);
+        free(proj);
+        free(attrNames);
+        free(dataTypes);
+        free(typeLength);
+        return rc;
+    }
+
+    sdata->proj    = proj;
+    sdata->numProj = numExprs;
+    if (result != NULL)
+        *result = createSchema(numExprs, attrNames, dataTypes, typeLength, 0, NULL);
+    else
+    {
+        for (int i = 0; i < numExprs; i++)
+            free(attrNames[i]);
+        free(attrNames);
+        free(dataTypes);
+        free(typeLength);
+    }
+    return RC_OK;
+}
+
+/*
+ * next
+ * ----
+ * Retrieved the next matching record by scanning pages from currentPage onward,
+ * skipping free slots (usage=0), returning the first that satisfies the condition (if any).
+ * Each page was read under its page latch; scans read without record locks.
+ */
+RC next(RM_ScanHandle *scan, Record *record)
+{
+    RM_TableData *rel         = scan->rel;
+    RM_TableMgmtData *tblData = (RM_TableMgmtData*) rel->mgmtData;
+    RM_ScanMgmtData *sdata    = (RM_ScanMgmtData*) scan->mgmtData;
+
+    int recSize = tblData->recordSize;
+    int maxSlots= tblData->maxSlots;
+
+    // A condition that could never hold did not touch a single page
+    if (sdata->empty)
+        return RC_RM_NO_MORE_TUPLES;
 
     while (true)
     {
-        if (sdata->currentPage < 1)
+        if (sdata->currentPage < 1 || sdata->currentPage >= __atomic_load_n(&tblData->numPages, __ATOMIC_ACQUIRE))
             return RC_RM_NO_MORE_TUPLES;
 
         BM_PageHandle page;
+        pthread_mutex_t *latch = pageLatch(tblData, sdata->currentPage);
+        pthread_mutex_lock(latch);
         // If pinPage fails => presumably no more pages exist
         if (pinPage(&tblData->bufferPool, &page, sdata->currentPage) != RC_OK)
+        {
+            pthread_mutex_unlock(latch);
             return RC_RM_NO_MORE_TUPLES;
+        }
 
         char *data = page.data;
         int slotsUsed;
         memcpy(&slotsUsed, data, sizeof(int));
 
         bool found = false;
-        while (sdata->currentSlot < maxSlots)
+        if (sdata->prog != NULL && predicateIsVectorized(sdata->prog))
         {
-            if (getSlotFlag(data, sdata->currentSlot) == 1)
+            // Filtered the whole page into a bitmap with the SIMD kernels once
+            // and reused it until the scan left the page or the table changed
+            unsigned version = __atomic_load_n(&tblData->version, __ATOMIC_RELAXED);
+            if (sdata->selPage != sdata->currentPage || sdata->selVersion != version)
             {
-                // Copied the record
-                int offset = 4 + maxSlots + (sdata->currentSlot * recSize);
-                memcpy(record->data, data + offset, recSize);
+                uint64_t used[SEL_WORDS(PAGE_SIZE)];
+                RC rc = evalPredicateBatch(sdata->prog, data + tblData->dataOffset, recSize, maxSlots, sdata->sel);
+                if (rc != RC_OK)
+                {
+                    unpinPage(&tblData->bufferPool, &page);
+                    pthread_mutex_unlock(latch);
+                    return rc;
+                }
+                selEqualBytes(data + tblData->pageHeader, maxSlots, SLOT_USED, used);
+                selAnd(sdata->sel, used, maxSlots);
+                sdata->selPage    = sdata->currentPage;
+                sdata->selVersion = version;
+            }
+
+            int slot = selNext(sdata->sel, maxSlots, sdata->currentSlot);
+            if (slot >= 0)
+            {
+                int offset = tblData->dataOffset + (slot * recSize);
+                RC rc = emitRecord(sdata, rel->schema, data + offset, recSize, record);
+                if (rc != RC_OK)
+                {
+                    unpinPage(&tblData->bufferPool, &page);
+                    pthread_mutex_unlock(latch);
+                    return rc;
+                }
                 record->id.page = sdata->currentPage;
-                record->id.slot = sdata->currentSlot;
+                record->id.slot = slot;
+                sdata->currentSlot = slot + 1;
+                found = true;
+            }
+            else
+                sdata->currentSlot = maxSlots;
+        }
 
-                // If there was a condition, we evaluated it
-                if (sdata->cond != NULL)
+        while (!found && sdata->currentSlot < maxSlots)
+        {
+            if (getSlotFlag(tblData, data, sdata->currentSlot) == SLOT_USED)
+            {
+                // Evaluated the condition on the slot bytes in the pinned
+                // frame; only a record that passed was copied out
+                int offset = tblData->dataOffset + (sdata->currentSlot * recSize);
+                bool pass;
+                RC rc = rowMatches(sdata, rel->schema, data + offset, &pass);
+                if (rc != RC_OK)
                 {
-                    Value *res;
-                    evalExpr(record, rel->schema, sdata->cond, &res);
-                    bool pass = (res->v.boolV == TRUE);
-                    freeVal(res);
-                    if (pass)
-                    {
-                        found = true;
-                        sdata->currentSlot++;
-                        break;
-                    }
+                    unpinPage(&tblData->bufferPool, &page);
+                    pthread_mutex_unlock(latch);
+                    return rc;
                 }
-                else
+
+                if (pass)
                 {
-                    // No condition => matched by default
+                    RC rc = emitRecord(sdata, rel->schema, data + offset, recSize, record);
+                    if (rc != RC_OK)
+                    {
+                        unpinPage(&tblData->bufferPool, &page);
+                        pthread_mutex_unlock(latch);
+                        return rc;
+                    }
+                    record->id.page = sdata->currentPage;
+                    record->id.slot = sdata->currentSlot;
                     found = true;
                     sdata->currentSlot++;
                     break;
@@ -627,25 +2036,40 @@ RC next(RM_ScanHandle *scan, Record *record)
         }
 
         unpinPage(&tblData->bufferPool, &page);
+        pthread_mutex_unlock(latch);
 
         if (found)
             return RC_OK;
 
-        // Moved on to the next page
-        sdata->currentPage++;
+        // Moved on to the next (sampled) page; the loop head checked it
+        // against numPages
+        if (sdata->samplePages == NULL)
+            sdata->currentPage++;
+        else if (++sdata->sampleIdx < sdata->numSamplePages)
+            sdata->currentPage = sdata->samplePages[sdata->sampleIdx];
+        else
+            sdata->currentPage = INT_MAX;
         sdata->currentSlot=0;
-
-        // Checked if new page was beyond file size
-        SM_FileHandle fHandle;
-        if (openPageFile(rel->name, &fHandle) != RC_OK)
-            return RC_RM_NO_MORE_TUPLES;
-        bool beyond = (sdata->currentPage >= fHandle.totalNumPages);
-        closePageFile(&fHandle);
-        if (beyond)
-            return RC_RM_NO_MORE_TUPLES;
     }
 }
 
+/*
+ * nextBatch
+ * ---------
+ * Filled up to maxRecords records (e.g. from createRecordBatch) with the next
+ * matches of the scan. Returned RC_RM_NO_MORE_TUPLES only when none was left.
+ */
+RC nextBatch(RM_ScanHandle *scan, Record **records, int maxRecords, int *numRecords)
+{
+    RC rc = RC_OK;
+    *numRecords = 0;
+    while (*numRecords < maxRecords && (rc = next(scan, records[*numRecords])) == RC_OK)
+        (*numRecords)++;
+    if (rc != RC_OK && rc != RC_RM_NO_MORE_TUPLES)
+        return rc;
+    return (*numRecords > 0) ? RC_OK : RC_RM_NO_MORE_TUPLES;
+}
+
 /*
  * closeScan
  * ---------
@@ -653,11 +2077,417 @@ RC next(RM_ScanHandle *scan, Record *record)
  */
 RC closeScan(RM_ScanHandle *scan)
 {
+    RM_ScanMgmtData *sdata = (RM_ScanMgmtData*) scan->mgmtData;
+    if (sdata != NULL)
+    {
+        releaseScanCondition(sdata);
+        freeProjection(sdata);
+        freeArena(sdata->arena);
+        free(sdata->samplePages);
+    }
     free(scan->mgmtData);
     scan->mgmtData = NULL;
     return RC_OK;
 }
 
+/* --------------------------------------------------------------------------
+   Counting
+   -------------------------------------------------------------------------- */
+
+/*
+ * matchOnPage
+ * -----------
+ * Selected the used slots of a data page that matched the scan's condition,
+ * without copying a record out. With no condition this was the slot
+ * directory's used flags; a vectorized program filtered the page into a
+ * bitmap; other conditions ran on each used slot in place, stopping once
+ * limit matches were found.
+ */
+static RC matchOnPage(RM_ScanMgmtData *sdata, RM_TableData *rel, char *data, int limit, uint64_t *sel) {
+    RM_TableMgmtData *tblData = (RM_TableMgmtData*) rel->mgmtData;
+    int maxSlots = tblData->maxSlots;
+    int recSize  = tblData->recordSize;
+    uint64_t used[SEL_WORDS(PAGE_SIZE)];
+
+    if (sdata->prog == NULL && sdata->plan == NULL && (sdata->cond == NULL || sdata->optimized))
+    {
+        selEqualBytes(data + tblData->pageHeader, maxSlots, SLOT_USED, sel);
+        return RC_OK;
+    }
+    selEqualBytes(data + tblData->pageHeader, maxSlots, SLOT_USED, used);
+    if (sdata->prog != NULL && predicateIsVectorized(sdata->prog))
+    {
+        RC rc = evalPredicateBatch(sdata->prog, data + tblData->dataOffset, recSize, maxSlots, sel);
+        selAnd(sel, used, maxSlots);
+        return rc;
+    }
+
+    int found = 0;
+    memset(sel, 0, SEL_WORDS(maxSlots) * sizeof(uint64_t));
+    for (int slot = selNext(used, maxSlots, 0); slot >= 0 && found < limit; slot = selNext(used, maxSlots, slot + 1))
+    {
+        bool pass;
+        RC rc = rowMatches(sdata, rel->schema, data + tblData->dataOffset + slot * recSize, &pass);
+        if (rc != RC_OK)
+            return rc;
+        if (pass)
+        {
+            sel[slot >> 6] |= (uint64_t) 1 << (slot & 63);
+            found++;
+        }
+    }
+    return RC_OK;
+}
+
+/*
+ * countMatches
+ * ------------
+ * Counted the records matching cond (NULL: all of them) page by page, each
+ * under its page latch, by popcounting matchOnPage's selection, stopping once
+ * limit were found. The condition was
+ * optimized and compiled as for a scan, so one that could never hold read
+ * no page. There were no indexes or zone maps to answer from, so every data
+ * page was visited otherwise.
+ */
+static RC countMatches(RM_TableData *rel, Expr *cond, int limit, int *count) {
+    RM_TableMgmtData *tblData = (RM_TableMgmtData*) rel->mgmtData;
+    RM_ScanHandle scan;
+    RC rc = RC_OK;
+
+    *count = 0;
+    startScan(rel, &scan, cond);
+    RM_ScanMgmtData *sdata = (RM_ScanMgmtData*) scan.mgmtData;
+
+    for (int pageNum = 1; !sdata->empty && rc == RC_OK && *count < limit; pageNum++)
+    {
+        BM_PageHandle page;
+        uint64_t sel[SEL_WORDS(PAGE_SIZE)];
+
+        if (pageNum >= __atomic_load_n(&tblData->numPages, __ATOMIC_ACQUIRE))
+            break;
+        pthread_mutex_lock(pageLatch(tblData, pageNum));
+        if (pinPage(&tblData->bufferPool, &page, pageNum) != RC_OK)
+        {
+            pthread_mutex_unlock(pageLatch(tblData, pageNum));
+            break;
+        }
+        rc = matchOnPage(sdata, rel, page.data, limit - *count, sel);
+        unpinPage(&tblData->bufferPool, &page);
+        pthread_mutex_unlock(pageLatch(tblData, pageNum));
+        if (rc == RC_OK)
+            *count += selCount(sel, tblData->maxSlots);
+    }
+
+    closeScan(&scan);
+    return rc;
+}
+
+/*
+ * countWhere / existsWhere
+ * ------------------------
+ * Counted the records matching cond, or found whether any did, without
+ * materializing them. existsWhere stopped at the first page with a match
+ * (the first matching row when the condition was evaluated row by row).
+ */
+RC countWhere(RM_TableData *rel, Expr *cond, int *count)
+{
+    return countMatches(rel, cond, INT_MAX, count);
+}
+
+RC existsWhere(RM_TableData *rel, Expr *cond, bool *exists)
+{
+    int count;
+    RC rc = countMatches(rel, cond, 1, &count);
+    *exists = (rc == RC_OK && count > 0);
+    return rc;
+}
+
+/* --------------------------------------------------------------------------
+   Aggregates
+   -------------------------------------------------------------------------- */
+
+// data pages a worker of aggregateWhere claimed at a time
+#define AGG_MORSEL_PAGES 16
+// most threads aggregateWhere ran
+#define AGG_MAX_WORKERS 64
+
+/* What one worker of aggregateWhere had folded in. */
+typedef struct RM_AggWorker {
+    struct RM_AggRun *run;
+    int count;
+    int64_t intSum;
+    double floatSum;
+    int intMin, intMax;
+    float floatMin, floatMax;
+    RC rc;
+} RM_AggWorker;
+
+/* An aggregateWhere in progress, shared by its workers. */
+typedef struct RM_AggRun {
+    RM_TableData *rel;
+    Expr *cond;
+    DataType dt;
+    int attrOffset;     // where the attribute started in a record
+    int numPages;       // pages of the table when the run started
+    int nextPage;       // first page of the next unclaimed morsel
+    pthread_mutex_t lock;
+} RM_AggRun;
+
+/*
+ * aggregateMorsels
+ * ----------------
+ * Body of one worker: claimed AGG_MORSEL_PAGES pages at a time until none
+ * were left. Each page was copied out under its page latch and filtered
+ * and reduced from the copy without it, so the workers' predicates and
+ * reductions ran in parallel with each other and with writers.
+ * Every worker had its own scan state, as compiled predicates adapted their
+ * term order as they ran.
+ */
+static void *aggregateMorsels(void *arg) {
+    RM_AggWorker *w  = (RM_AggWorker*) arg;
+    RM_AggRun *run   = w->run;
+    RM_TableMgmtData *tblData = (RM_TableMgmtData*) run->rel->mgmtData;
+    uint64_t sel[SEL_WORDS(PAGE_SIZE)];
+    RM_ScanHandle scan;
+
+    char *copy = (char*) malloc(PAGE_SIZE);
+    if (copy == NULL)
+    {
+        w->rc = RC_MEMORY_ALLOCATION_ERROR;
+        return NULL;
+    }
+    startScan(run->rel, &scan, run->cond);
+    RM_ScanMgmtData *sdata = (RM_ScanMgmtData*) scan.mgmtData;
+
+    while (w->rc == RC_OK && !sdata->empty)
+    {
+        pthread_mutex_lock(&run->lock);
+        int first = run->nextPage;
+        run->nextPage += AGG_MORSEL_PAGES;
+        pthread_mutex_unlock(&run->lock);
+        if (first >= run->numPages)
+            break;
+
+        for (int pageNum = first; pageNum < first + AGG_MORSEL_PAGES && pageNum < run->numPages && w->rc == RC_OK; pageNum++)
+        {
+            BM_PageHandle page;
+            pthread_mutex_lock(pageLatch(tblData, pageNum));
+            w->rc = pinPage(&tblData->bufferPool, &page, pageNum);
+            if (w->rc == RC_OK)
+            {
+                memcpy(copy, page.data, PAGE_SIZE);
+                unpinPage(&tblData->bufferPool, &page);
+            }
+            pthread_mutex_unlock(pageLatch(tblData, pageNum));
+            if (w->rc != RC_OK || (w->rc = matchOnPage(sdata, run->rel, copy, INT_MAX, sel)) != RC_OK)
+                break;
+
+            // Reduced the attribute column of the page straight from the row bytes
+            char *base = copy + tblData->dataOffset + run->attrOffset;
+            w->count += selCount(sel, tblData->maxSlots);
+            if (run->dt == DT_INT)
+                selAggregateInt(base, tblData->recordSize, tblData->maxSlots, sel, &w->intSum, &w->intMin, &w->intMax);
+            else
+                selAggregateFloat(base, tblData->recordSize, tblData->maxSlots, sel, &w->floatSum, &w->floatMin, &w->floatMax);
+        }
+    }
+
+    closeScan(&scan);
+    free(copy);
+    return NULL;
+}
+
+/*
+ * aggregateWhere
+ * --------------
+ * Computed the count, SUM, MIN, MAX and AVG of an INT or FLOAT attribute
+ * over the records matching cond (NULL: all of them) inside the page loop,
+ * reading the attribute from the page bytes rather than through getAttr.
+ * numWorkers threads (1 or less: the calling thread alone) shared the data
+ * pages in morsels and their partial results were merged at the end. INT
+ * sums were exact in 64 bits. Records changed while the run was going on
+ * could be seen or not.
+ */
+RC aggregateWhere(RM_TableData *rel, Expr *cond, int attrNum, int numWorkers, RM_Aggregate *agg)
+{
+    RM_TableMgmtData *tblData = (RM_TableMgmtData*) rel->mgmtData;
+    RM_AggWorker workers[AGG_MAX_WORKERS];
+    pthread_t threads[AGG_MAX_WORKERS];
+    RM_AggRun run;
+    RC rc = RC_OK;
+
+    if (attrNum < 0 || attrNum >= rel->schema->numAttr)
+        THROW(RC_ERROR, "no such attribute");
+    run.dt = rel->schema->dataTypes[attrNum];
+    if (run.dt != DT_INT && run.dt != DT_FLOAT)
+        THROW(RC_RM_ARITH_ARG_IS_NOT_NUMERIC, "aggregates take an INT or FLOAT attribute");
+    if (numWorkers < 1)
+        numWorkers = 1;
+    if (numWorkers > AGG_MAX_WORKERS)
+        numWorkers = AGG_MAX_WORKERS;
+
+    run.rel        = rel;
+    run.cond       = cond;
+    run.attrOffset = getAttrOffset(rel->schema, attrNum);
+    run.nextPage   = 1;
+    run.numPages   = __atomic_load_n(&tblData->numPages, __ATOMIC_ACQUIRE);
+    pthread_mutex_init(&run.lock, NULL);
+
+    int started = 0;
+    for (int i = 0; i < numWorkers; i++)
+    {
+        RM_AggWorker *w = &workers[i];
+        w->run      = &run;
+        w->count    = 0;
+        w->intSum   = 0;
+        w->floatSum = 0;
+        w->intMin   = INT_MAX;
+        w->intMax   = INT_MIN;
+        w->floatMin = FLT_MAX;
+        w->floatMax = -FLT_MAX;
+        w->rc       = RC_OK;
+    }
+    // Worker 0 was the calling thread; a thread that could not be started
+    // left its share to the others
+    for (int i = 1; i < numWorkers; i++)
+        if (pthread_create(&threads[started + 1], NULL, aggregateMorsels, &workers[started + 1]) == 0)
+            started++;
+    aggregateMorsels(&workers[0]);
+    for (int i = 1; i <= started; i++)
+        pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&run.lock);
+
+    // Merged the partial results
+    RM_AggWorker total = workers[0];
+    for (int i = 1; i <= started; i++)
+    {
+        RM_AggWorker *w = &workers[i];
+        if (total.rc == RC_OK)
+            total.rc = w->rc;
+        total.count    += w->count;
+        total.intSum   += w->intSum;
+        total.floatSum += w->floatSum;
+        if (w->intMin < total.intMin)
+            total.intMin = w->intMin;
+        if (w->intMax > total.intMax)
+            total.intMax = w->intMax;
+        if (w->floatMin < total.floatMin)
+            total.floatMin = w->floatMin;
+        if (w->floatMax > total.floatMax)
+            total.floatMax = w->floatMax;
+    }
+    rc = total.rc;
+    if (rc != RC_OK)
+        THROW(rc, "aggregate scan failed");
+
+    agg->count = total.count;
+    agg->sum   = (run.dt == DT_INT) ? (double) total.intSum : total.floatSum;
+    agg->min   = 0;
+    agg->max   = 0;
+    agg->avg   = 0;
+    if (total.count > 0)
+    {
+        agg->min = (run.dt == DT_INT) ? total.intMin : total.floatMin;
+        agg->max = (run.dt == DT_INT) ? total.intMax : total.floatMax;
+        agg->avg = agg->sum / total.count;
+    }
+    return RC_OK;
+}
+
+/* --------------------------------------------------------------------------
+   Statistics
+   -------------------------------------------------------------------------- */
+
+/*
+ * collectTableStats
+ * -----------------
+ * Estimated the number of records and the minimum, maximum and mean of the
+ * INT and FLOAT attributes with a scan, sampled as options asked (NULL read
+ * every page). Counts were scaled by the sampled fraction; minimum and
+ * maximum were those of the sample. Other attributes were left at 0.
+ */
+RC collectTableStats(RM_TableData *rel, RM_ScanOptions *options, RM_TableStats *stats)
+{
+    Schema *schema = rel->schema;
+    RM_ScanHandle scan;
+    Record *record;
+    long long seen = 0;
+
+    memset(stats, 0, sizeof(RM_TableStats));
+    stats->numAttr = schema->numAttr;
+    stats->min  = (double *) calloc(schema->numAttr, sizeof(double));
+    stats->max  = (double *) calloc(schema->numAttr, sizeof(double));
+    stats->mean = (double *) calloc(schema->numAttr, sizeof(double));
+    if (stats->min == NULL || stats->max == NULL || stats->mean == NULL)
+    {
+        freeTableStats(stats);
+        THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate table statistics");
+    }
+
+    RC rc = createRecord(&record, schema);
+    if (rc == RC_OK)
+        rc = startScanWithOptions(rel, &scan, NULL, options);
+    if (rc != RC_OK)
+    {
+        freeRecord(record);
+        freeTableStats(stats);
+        return rc;
+    }
+
+    while ((rc = next(&scan, record)) == RC_OK)
+    {
+        for (int i = 0; i < schema->numAttr; i++)
+        {
+            double v;
+            if (schema->dataTypes[i] == DT_INT)
+            {
+                int x;
+                memcpy(&x, record->data + getAttrOffset(schema, i), sizeof(int));
+                v = x;
+            }
+            else if (schema->dataTypes[i] == DT_FLOAT)
+            {
+                float x;
+                memcpy(&x, record->data + getAttrOffset(schema, i), sizeof(float));
+                v = x;
+            }
+            else
+                continue;
+            if (seen == 0 || v < stats->min[i]) stats->min[i] = v;
+            if (seen == 0 || v > stats->max[i]) stats->max[i] = v;
+            stats->mean[i] += v;
+        }
+        seen++;
+    }
+
+    stats->fraction      = getScanSampleFraction(&scan);
+    RM_ScanMgmtData *sdata = (RM_ScanMgmtData*) scan.mgmtData;
+    stats->pagesRead     = sdata->samplePages != NULL ? sdata->numSamplePages
+                                                      : __atomic_load_n(&((RM_TableMgmtData*) rel->mgmtData)->numPages, __ATOMIC_ACQUIRE) - 1;
+    stats->sampledTuples = (int) seen;
+    stats->estTuples     = stats->fraction > 0.0 ? seen / stats->fraction : 0.0;
+    for (int i = 0; i < schema->numAttr && seen > 0; i++)
+        stats->mean[i] /= seen;
+
+    closeScan(&scan);
+    freeRecord(record);
+    if (rc != RC_RM_NO_MORE_TUPLES)
+    {
+        freeTableStats(stats);
+        return rc;
+    }
+    return RC_OK;
+}
+
+RC freeTableStats(RM_TableStats *stats)
+{
+    free(stats->min);
+    free(stats->max);
+    free(stats->mean);
+    stats->min = stats->max = stats->mean = NULL;
+    return RC_OK;
+}
+
 /* --------------------------------------------------------------------------
    Schema & Record manipulation
    -------------------------------------------------------------------------- */
@@ -672,6 +2502,46 @@ int getRecordSize(Schema *schema)
     return computeRecordSize(schema);
 }
 
+/*
+ * hashName / buildNameIndex
+ * -------------------------
+ * Hashed the first len bytes of an attribute name (FNV-1a), and built the
+ * schema's open-addressing index of names: a power of two of at least
+ * twice as many slots as attributes, probed linearly, each slot holding an
+ * attribute number plus one. A repeated name kept its first attribute. The
+ * index stayed NULL if it could not be allocated; lookups then scanned.
+ */
+static unsigned
+hashName(const char *name, int len)
+{
+    unsigned h = 2166136261u;
+    for (int i = 0; i < len; i++)
+        h = (h ^ (unsigned char) name[i]) * 16777619u;
+    return h;
+}
+static void
+buildNameIndex(Schema *sc)
+{
+    int size = 4;
+    while (size < 2 * sc->numAttr)
+        size *= 2;
+
+    sc->nameMask  = size - 1;
+    sc->nameIndex = (int *) calloc(size, sizeof(int));
+    if (sc->nameIndex == NULL)
+        return;
+    for (int i = 0; i < sc->numAttr; i++)
+    {
+        int len = (int) strlen(sc->attrNames[i]);
+        if (getAttrIndexN(sc, sc->attrNames[i], len) >= 0)
+            continue;
+        unsigned slot = hashName(sc->attrNames[i], len) & sc->nameMask;
+        while (sc->nameIndex[slot] != 0)
+            slot = (slot + 1) & sc->nameMask;
+        sc->nameIndex[slot] = i + 1;
+    }
+}
+
 /*
  * createSchema
  * ------------
@@ -687,6 +2557,8 @@ Schema *createSchema(int numAttr, char **attrNames, DataType *dataTypes,
     sc->typeLength = typeLength;
     sc->keySize    = keySize;
     sc->keyAttrs   = keys;
+    sc->offsets    = NULL;
+    buildNameIndex(sc);
     return sc;
 }
 
@@ -705,10 +2577,99 @@ RC freeSchema(Schema *schema)
     free(schema->dataTypes);
     free(schema->typeLength);
     free(schema->keyAttrs);
+    free(schema->offsets);
+    free(schema->nameIndex);
     free(schema);
     return RC_OK;
 }
 
+/*
+ * setSchemaLayout
+ * ---------------
+ * Chose how records of the schema were laid out. RM_LAYOUT_PACKED stored the
+ * attributes in declaration order without gaps. RM_LAYOUT_ALIGNED stored
+ * them widest alignment first (INT and FLOAT, then BOOL, then strings), each
+ * group in declaration order, so every INT and FLOAT sat at an offset that
+ * allowed a direct typed load. Attribute numbers stayed the declared ones;
+ * only the offsets changed.
+ */
+RC setSchemaLayout(Schema *schema, RM_Layout layout)
+{
+    free(schema->offsets);
+    schema->offsets = NULL;
+    if (layout == RM_LAYOUT_PACKED)
+        return RC_OK;
+    if (layout != RM_LAYOUT_ALIGNED)
+        THROW(RC_ERROR, "unknown record layout");
+
+    schema->offsets = (int *) malloc(sizeof(int) * (schema->numAttr > 0 ? schema->numAttr : 1));
+    if (schema->offsets == NULL)
+        THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate attribute offsets");
+
+    int offset = 0;
+    for (int align = _Alignof(double); align >= 1; align /= 2)
+        for (int i = 0; i < schema->numAttr; i++)
+            if (schema->dataTypes[i] != DT_STRING && attrAlign(schema, i) == align)
+            {
+                offset = ALIGN_UP(offset, align);
+                schema->offsets[i] = offset;
+                offset += attrSize(schema, i);
+            }
+    for (int i = 0; i < schema->numAttr; i++)
+        if (schema->dataTypes[i] == DT_STRING)
+        {
+            schema->offsets[i] = offset;
+            offset += attrSize(schema, i);
+        }
+    return RC_OK;
+}
+
+/*
+ * getAttrOffset
+ * -------------
+ * Returned the byte offset of an attribute inside a record of the schema.
+ */
+int getAttrOffset(Schema *schema, int attrNum)
+{
+    if (schema->offsets != NULL)
+        return schema->offsets[attrNum];
+
+    int offset = 0;
+    for (int i = 0; i < attrNum; i++)
+        offset += attrSize(schema, i);
+    return offset;
+}
+
+/*
+ * getAttrIndex / getAttrIndexN
+ * ----------------------------
+ * Resolved an attribute name (or its first len bytes, for names inside a
+ * longer string) to its attribute number with one probe sequence of the
+ * schema's name index. Returned -1 for an unknown name.
+ */
+int getAttrIndex(Schema *schema, char *name)
+{
+    return getAttrIndexN(schema, name, (int) strlen(name));
+}
+int getAttrIndexN(Schema *schema, const char *name, int len)
+{
+    if (schema->nameIndex == NULL)
+    {
+        for (int i = 0; i < schema->numAttr; i++)
+            if ((int) strlen(schema->attrNames[i]) == len && strncmp(schema->attrNames[i], name, len) == 0)
+                return i;
+        return -1;
+    }
+    for (unsigned slot = hashName(name, len) & schema->nameMask; schema->nameIndex[slot] != 0;
+         slot = (slot + 1) & schema->nameMask)
+    {
+        char *attr = schema->attrNames[schema->nameIndex[slot] - 1];
+        if (strncmp(attr, name, len) == 0 && attr[len] == '\0')
+            return schema->nameIndex[slot] - 1;
+    }
+    return -1;
+}
+
 /*
  * createRecord
  * ------------
@@ -746,38 +2707,34 @@ RC freeRecord(Record *record)
 RC getAttr(Record *record, Schema *schema, int attrNum, Value **value)
 {
     char *base = record->data;
-    int offset = 0;
-
-    // Calculated offset by skipping the sizes of earlier attributes
-    for (int i = 0; i < attrNum; i++)
-    {
-        switch (schema->dataTypes[i])
-        {
-            case DT_INT:    offset += sizeof(int);    break;
-            case DT_FLOAT:  offset += sizeof(float);  break;
-            case DT_BOOL:   offset += sizeof(bool);   break;
-            case DT_STRING: offset += schema->typeLength[i]; break;
-        }
-    }
+    bool aligned = (schema->offsets != NULL);
+    int offset = getAttrOffset(schema, attrNum);
 
-    // Allocated the Value object
-    *value = (Value*) malloc(sizeof(Value));
+    // Allocated the Value object (from the evaluation arena inside a scan)
+    *value = (Value*) evalAlloc(sizeof(Value));
     (*value)->dt = schema->dataTypes[attrNum];
 
     // Copied from record->data + offset
     switch ((*value)->dt)
     {
+        // An aligned layout allowed direct typed loads
         case DT_INT:
         {
             int val;
-            memcpy(&val, base + offset, sizeof(int));
+            if (aligned)
+                val = *(int *) (base + offset);
+            else
+                memcpy(&val, base + offset, sizeof(int));
             (*value)->v.intV = val;
         }
         break;
         case DT_FLOAT:
         {
             float f;
-            memcpy(&f, base + offset, sizeof(float));
+            if (aligned)
+                f = *(float *) (base + offset);
+            else
+                memcpy(&f, base + offset, sizeof(float));
             (*value)->v.floatV = f;
         }
         break;
@@ -791,7 +2748,7 @@ RC getAttr(Record *record, Schema *schema, int attrNum, Value **value)
         case DT_STRING:
         {
             int len = schema->typeLength[attrNum];
-            (*value)->v.stringV = (char*) malloc(len + 1);
+            (*value)->v.stringV = (char*) evalAlloc(len + 1);
             memcpy((*value)->v.stringV, base + offset, len);
             // Null terminator
             (*value)->v.stringV[len] = '\0';
@@ -811,28 +2768,23 @@ RC getAttr(Record *record, Schema *schema, int attrNum, Value **value)
 RC setAttr(Record *record, Schema *schema, int attrNum, Value *value)
 {
     char *base = record->data;
-    int offset = 0;
-
-    // Found how many bytes to skip for earlier attributes
-    for (int i = 0; i < attrNum; i++)
-    {
-        switch (schema->dataTypes[i])
-        {
-            case DT_INT:    offset += sizeof(int);    break;
-            case DT_FLOAT:  offset += sizeof(float);  break;
-            case DT_BOOL:   offset += sizeof(bool);   break;
-            case DT_STRING: offset += schema->typeLength[i]; break;
-        }
-    }
+    bool aligned = (schema->offsets != NULL);
+    int offset = getAttrOffset(schema, attrNum);
 
-    // Wrote the attribute
+    // Wrote the attribute (a direct typed store in an aligned layout)
     switch (value->dt)
     {
         case DT_INT:
-            memcpy(base + offset, &value->v.intV, sizeof(int));
+            if (aligned)
+                *(int *) (base + offset) = value->v.intV;
+            else
+                memcpy(base + offset, &value->v.intV, sizeof(int));
             break;
         case DT_FLOAT:
-            memcpy(base + offset, &value->v.floatV, sizeof(float));
+            if (aligned)
+                *(float *) (base + offset) = value->v.floatV;
+            else
+                memcpy(base + offset, &value->v.floatV, sizeof(float));
             break;
         case DT_BOOL:
             memcpy(base + offset, &value->v.boolV, sizeof(bool));
@@ -1,10 +1,65 @@
 #ifndef RECORD_MGR_H
 #define RECORD_MGR_H
 
+#include "buffer_mgr.h"
 #include "dberror.h"
 #include "expr.h"
+#include "expr_parser.h"
+#include "lock_mgr.h"
+#include "record_pool.h"
 #include "tables.h"
 
+// length of a computed STRING column (e.g. a cast) in a projected scan
+#define PROJECTION_STRING_LENGTH 32
+
+// where the records of an aligned table started on a data page
+#define RECORD_AREA_ALIGN 16
+
+// how attributes were placed inside a record
+typedef enum RM_Layout {
+	RM_LAYOUT_PACKED = 0,   // declaration order, no padding
+	RM_LAYOUT_ALIGNED = 1   // widest alignment first, padded for direct typed loads
+} RM_Layout;
+
+// a group of record operations that committed or aborted together
+typedef struct RM_Transaction RM_Transaction;
+
+// how a scan chose the data pages it read
+typedef enum RM_SampleMethod {
+	RM_SAMPLE_NONE = 0,        // every page
+	RM_SAMPLE_BERNOULLI = 1,   // each page with probability rate
+	RM_SAMPLE_RESERVOIR = 2    // exactly ceil(rate * pages) pages, uniformly
+} RM_SampleMethod;
+
+// options of startScanWithOptions
+typedef struct RM_ScanOptions {
+	RM_SampleMethod sample;
+	double rate;       // share of the data pages to sample, in (0, 1]
+	unsigned seed;     // same seed, same sample (0: a different one every scan)
+} RM_ScanOptions;
+
+// what collectTableStats found; min, max and mean are per attribute and
+// only filled in for INT and FLOAT attributes
+typedef struct RM_TableStats {
+	double fraction;     // share of the data pages read
+	int pagesRead;
+	int sampledTuples;   // records in the pages read
+	double estTuples;    // sampledTuples scaled to the whole table
+	int numAttr;
+	double *min;
+	double *max;
+	double *mean;
+} RM_TableStats;
+
+// what aggregateWhere computed; min, max and avg are 0 when nothing matched
+typedef struct RM_Aggregate {
+	int count;
+	double sum;
+	double min;
+	double max;
+	double avg;
+} RM_Aggregate;
+
 // Bookkeeping for scans
 typedef struct RM_ScanHandle
 {
@@ -12,14 +67,25 @@ typedef struct RM_ScanHandle
 	void *mgmtData;
 } RM_ScanHandle;
 
+// buffer pool of every table opened afterwards
+#define RM_DEFAULT_POOL_PAGES 3
+#define RM_DEFAULT_POOL_STRATEGY RS_FIFO
+
 // table and manager
 extern RC initRecordManager (void *mgmtData);
 extern RC shutdownRecordManager ();
 extern RC createTable (char *name, Schema *schema);
+extern RC createTableWithLayout (char *name, Schema *schema, RM_Layout layout);
 extern RC openTable (RM_TableData *rel, char *name);
 extern RC closeTable (RM_TableData *rel);
 extern RC deleteTable (char *name);
 extern int getNumTuples (RM_TableData *rel);
+extern RC setTablePoolOptions (int numPages, ReplacementStrategy strategy);
+
+// change capture: every insert, update and delete is appended to a change
+// stream (cdc_log.h; NULL path: the table name with CDC_SUFFIX)
+extern RC enableChangeCapture (RM_TableData *rel, char *path);
+extern RC disableChangeCapture (RM_TableData *rel);
 
 // handling records in a table
 extern RC insertRecord (RM_TableData *rel, Record *record);
@@ -27,15 +93,46 @@ extern RC deleteRecord (RM_TableData *rel, RID id);
 extern RC updateRecord (RM_TableData *rel, Record *record);
 extern RC getRecord (RM_TableData *rel, RID id, Record *record);
 
+// transactions: the record operations of the calling thread between begin
+// and commit/abort lock for the transaction and are undone by abort; a commit
+// is durable after one log sync
+extern RC beginTransaction (RM_Transaction **txn);
+extern RC commitTransaction (RM_Transaction *txn);
+extern RC abortTransaction (RM_Transaction *txn);
+
 // scans
 extern RC startScan (RM_TableData *rel, RM_ScanHandle *scan, Expr *cond);
+extern RC startScanPrepared (RM_TableData *rel, RM_ScanHandle *scan, PreparedCond *cond);
+extern RC startScanWithOptions (RM_TableData *rel, RM_ScanHandle *scan, Expr *cond, RM_ScanOptions *options);
+extern double getScanSampleFraction (RM_ScanHandle *scan);
 extern RC next (RM_ScanHandle *scan, Record *record);
+extern RC nextBatch (RM_ScanHandle *scan, Record **records, int maxRecords, int *numRecords);
+extern RC restartScan (RM_ScanHandle *scan, Expr *cond);
 extern RC closeScan (RM_ScanHandle *scan);
+extern RC setScanProjection (RM_ScanHandle *scan, int numExprs, Expr **exprs, char **names, Schema **result);
+
+// matching records counted in place, without copying them out; a NULL
+// condition counts every record
+extern RC countWhere (RM_TableData *rel, Expr *cond, int *count);
+extern RC existsWhere (RM_TableData *rel, Expr *cond, bool *exists);
+
+// SUM/MIN/MAX/AVG of an INT or FLOAT attribute over the matching records,
+// computed on the page bytes by numWorkers threads
+extern RC aggregateWhere (RM_TableData *rel, Expr *cond, int attrNum, int numWorkers, RM_Aggregate *agg);
+
+// statistics of a table, from a full or sampled scan
+extern RC collectTableStats (RM_TableData *rel, RM_ScanOptions *options, RM_TableStats *stats);
+extern RC freeTableStats (RM_TableStats *stats);
 
 // dealing with schemas
 extern int getRecordSize (Schema *schema);
 extern Schema *createSchema (int numAttr, char **attrNames, DataType *dataTypes, int *typeLength, int keySize, int *keys);
 extern RC freeSchema (Schema *schema);
+extern RC setSchemaLayout (Schema *schema, RM_Layout layout);
+extern int getAttrOffset (Schema *schema, int attrNum);
+// attribute number of a name (its first len bytes for getAttrIndexN), or -1
+extern int getAttrIndex (Schema *schema, char *name);
+extern int getAttrIndexN (Schema *schema, const char *name, int len);
 
 // dealing with records and attribute values
 extern RC createRecord (Record **record, Schema *schema);
@@ -0,0 +1,380 @@
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dberror.h"
+#include "record_mgr.h"
+#include "record_pool.h"
+
+/*
+ * Record pools
+ * ---------------------------------------------------------------
+ * createRecord made two allocations per record and freeRecord two frees. A
+ * pool instead carved records from slabs: each chunk held a small header,
+ * the Record struct and the record's data, so one chunk was one record and
+ * record->data pointed just past the struct. Released chunks went on a free
+ * list and were handed out again; slabs were only returned to malloc by
+ * freeRecordPool.
+ *
+ * Every thread kept a cache of up to POOL_CACHE_SIZE free chunks for the
+ * last pool it used, so the common create/release cycle took no lock. The
+ * cache was refilled from (and spilled half of itself to) the pool's free
+ * list under the pool's mutex. When a thread moved to another pool its cache
+ * went back to the old one, provided that pool was still alive: live pools
+ * were kept in a registry and identified by a never-reused id, so a cache
+ * that outlived its pool was simply dropped.
+ */
+
+typedef struct PoolChunk {
+    RecordPool *pool;
+    struct PoolChunk *next;   // free list link
+    Record record;
+} PoolChunk;
+
+typedef struct PoolSlab {
+    struct PoolSlab *next;
+} PoolSlab;
+
+struct RecordPool {
+    unsigned long id;
+    int recordSize;
+    size_t chunkSize;         // header, Record and data, rounded to 16 bytes
+    pthread_mutex_t lock;     // guarded freeList, slabs and the counters
+    PoolChunk *freeList;
+    PoolSlab *slabs;
+    int numSlabs;
+    int numRecords;           // chunks carved from all slabs
+    RecordPool *nextLive;
+};
+
+typedef struct ThreadCache {
+    RecordPool *pool;
+    unsigned long poolId;
+    int count;
+    PoolChunk *items[POOL_CACHE_SIZE];
+} ThreadCache;
+
+#define ROUND16(_n) (((_n) + 15) & ~(size_t) 15)
+#define CHUNK_HEADER ROUND16(sizeof(PoolChunk))
+#define SLAB_HEADER ROUND16(sizeof(PoolSlab))
+#define CHUNK_OF(_record) ((PoolChunk *) ((char *) (_record) - offsetof(PoolChunk, record)))
+
+static pthread_mutex_t registryLock = PTHREAD_MUTEX_INITIALIZER;
+static RecordPool *livePools = NULL;
+static unsigned long nextPoolId = 1;
+
+static __thread ThreadCache cache;
+
+/* --------------------------------------------------------------------------
+   Slabs and the thread cache
+   -------------------------------------------------------------------------- */
+
+/*
+ * newSlab
+ * -------
+ * Allocated a slab of numChunks chunks, linked into the pool's slab list,
+ * and returned its chunks as a list in address order. Called with the pool
+ * locked.
+ */
+static PoolChunk *
+newSlab(RecordPool *pool, int numChunks)
+{
+    char *slab = (char *) malloc(SLAB_HEADER + (size_t) numChunks * pool->chunkSize);
+    PoolChunk *first = NULL, **tail = &first;
+
+    if (slab == NULL)
+        return NULL;
+    ((PoolSlab *) slab)->next = pool->slabs;
+    pool->slabs = (PoolSlab *) slab;
+    pool->numSlabs++;
+    pool->numRecords += numChunks;
+
+    for (int i = 0; i < numChunks; i++)
+    {
+        PoolChunk *chunk = (PoolChunk *) (slab + SLAB_HEADER + (size_t) i * pool->chunkSize);
+        chunk->pool = pool;
+        chunk->record.data = (char *) chunk + CHUNK_HEADER;
+        *tail = chunk;
+        tail = &chunk->next;
+    }
+    *tail = NULL;
+    return first;
+}
+
+/*
+ * flushCache
+ * ----------
+ * Handed the thread's cached chunks back to their pool if it was still
+ * registered under the cached id, and unbound the cache.
+ */
+static void
+flushCache(void)
+{
+    if (cache.count > 0)
+    {
+        pthread_mutex_lock(&registryLock);
+        for (RecordPool *p = livePools; p != NULL; p = p->nextLive)
+        {
+            if (p != cache.pool || p->id != cache.poolId)
+                continue;
+            pthread_mutex_lock(&p->lock);
+            for (int i = 0; i < cache.count; i++)
+            {
+                cache.items[i]->next = p->freeList;
+                p->freeList = cache.items[i];
+            }
+            pthread_mutex_unlock(&p->lock);
+            break;
+        }
+        pthread_mutex_unlock(&registryLock);
+    }
+    cache.pool = NULL;
+    cache.poolId = 0;
+    cache.count = 0;
+}
+
+/*
+ * bindCache
+ * ---------
+ * Made the thread's cache hold chunks of pool, returning the chunks of any
+ * other pool first.
+ */
+static void
+bindCache(RecordPool *pool)
+{
+    if (cache.pool == pool && cache.poolId == pool->id)
+        return;
+    flushCache();
+    cache.pool = pool;
+    cache.poolId = pool->id;
+}
+
+/*
+ * refillCache / spillCache
+ * ------------------------
+ * Moved half a cache worth of chunks from the pool's free list (or a new
+ * slab) into the empty cache, or from the full cache to the free list.
+ */
+static void
+refillCache(RecordPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    if (pool->freeList == NULL)
+        pool->freeList = newSlab(pool, POOL_SLAB_RECORDS);
+    while (cache.count < POOL_CACHE_SIZE / 2 && pool->freeList != NULL)
+    {
+        cache.items[cache.count++] = pool->freeList;
+        pool->freeList = pool->freeList->next;
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+static void
+spillCache(RecordPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (cache.count > POOL_CACHE_SIZE / 2)
+    {
+        PoolChunk *chunk = cache.items[--cache.count];
+        chunk->next = pool->freeList;
+        pool->freeList = chunk;
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+// what createRecord returned: zeroed data and no RID yet
+static Record *
+initRecord(PoolChunk *chunk)
+{
+    memset(chunk->record.data, 0, chunk->pool->recordSize);
+    chunk->record.id.page = -1;
+    chunk->record.id.slot = -1;
+    return &chunk->record;
+}
+
+/* --------------------------------------------------------------------------
+   Pools
+   -------------------------------------------------------------------------- */
+
+/*
+ * createRecordPool
+ * ----------------
+ * Created an empty pool for records of the schema and registered it. The
+ * first slab was allocated by the first request.
+ */
+RC
+createRecordPool(RecordPool **pool, Schema *schema)
+{
+    RecordPool *p = (RecordPool *) malloc(sizeof(RecordPool));
+    if (p == NULL)
+        THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate a record pool");
+
+    p->recordSize = getRecordSize(schema);
+    p->chunkSize  = CHUNK_HEADER + ROUND16(p->recordSize > 0 ? p->recordSize : 1);
+    p->freeList   = NULL;
+    p->slabs      = NULL;
+    p->numSlabs   = 0;
+    p->numRecords = 0;
+    pthread_mutex_init(&p->lock, NULL);
+
+    pthread_mutex_lock(&registryLock);
+    p->id = nextPoolId++;
+    p->nextLive = livePools;
+    livePools = p;
+    pthread_mutex_unlock(&registryLock);
+
+    *pool = p;
+    return RC_OK;
+}
+
+/*
+ * freeRecordPool
+ * --------------
+ * Unregistered the pool, so no thread cache could hand chunks back to it,
+ * and freed its slabs. Records that were still out became invalid.
+ */
+RC
+freeRecordPool(RecordPool *pool)
+{
+    if (pool == NULL)
+        return RC_OK;
+
+    pthread_mutex_lock(&registryLock);
+    for (RecordPool **p = &livePools; *p != NULL; p = &(*p)->nextLive)
+    {
+        if (*p == pool)
+        {
+            *p = pool->nextLive;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&registryLock);
+
+    if (cache.pool == pool)
+        flushCache();
+    for (PoolSlab *s = pool->slabs, *next; s != NULL; s = next)
+    {
+        next = s->next;
+        free(s);
+    }
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+    return RC_OK;
+}
+
+/*
+ * createRecordFromPool / releaseRecord
+ * ------------------------------------
+ * Took a record from the thread's cache, refilling it when empty, and put
+ * one back, spilling half the cache when full. A released record went to
+ * the pool it came from, whichever thread released it.
+ */
+RC
+createRecordFromPool(RecordPool *pool, Record **record)
+{
+    bindCache(pool);
+    if (cache.count == 0)
+        refillCache(pool);
+    if (cache.count == 0)
+        THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate a record slab");
+    *record = initRecord(cache.items[--cache.count]);
+    return RC_OK;
+}
+
+RC
+releaseRecord(Record *record)
+{
+    PoolChunk *chunk;
+
+    if (record == NULL)
+        return RC_OK;
+    chunk = CHUNK_OF(record);
+    bindCache(chunk->pool);
+    if (cache.count == POOL_CACHE_SIZE)
+        spillCache(chunk->pool);
+    cache.items[cache.count++] = chunk;
+    return RC_OK;
+}
+
+/*
+ * createRecordBatch / releaseRecordBatch
+ * --------------------------------------
+ * Filled records[0..numRecords) from the thread's cache, then the free
+ * list, then one new slab sized for the rest (at least POOL_SLAB_RECORDS
+ * chunks, the surplus going to the free list), taking the pool's lock at
+ * most once. Records from the new slab were adjacent in memory.
+ */
+RC
+createRecordBatch(RecordPool *pool, int numRecords, Record **records)
+{
+    int i = 0;
+
+    bindCache(pool);
+    while (i < numRecords && cache.count > 0)
+        records[i++] = initRecord(cache.items[--cache.count]);
+
+    if (i < numRecords)
+    {
+        pthread_mutex_lock(&pool->lock);
+        while (i < numRecords && pool->freeList != NULL)
+        {
+            records[i++] = initRecord(pool->freeList);
+            pool->freeList = pool->freeList->next;
+        }
+        if (i < numRecords)
+        {
+            int rest = numRecords - i;
+            PoolChunk *chunk = newSlab(pool, rest > POOL_SLAB_RECORDS ? rest : POOL_SLAB_RECORDS);
+            if (chunk == NULL)
+            {
+                pthread_mutex_unlock(&pool->lock);
+                releaseRecordBatch(records, i);
+                THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate a record slab");
+            }
+            for (; i < numRecords; chunk = chunk->next)
+                records[i++] = initRecord(chunk);
+            // the surplus of the slab (already in address order)
+            if (chunk != NULL)
+            {
+                PoolChunk *last = chunk;
+                while (last->next != NULL)
+                    last = last->next;
+                last->next = pool->freeList;
+                pool->freeList = chunk;
+            }
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+    return RC_OK;
+}
+
+RC
+releaseRecordBatch(Record **records, int numRecords)
+{
+    for (int i = 0; i < numRecords; i++)
+        releaseRecord(records[i]);
+    return RC_OK;
+}
+
+RC
+flushRecordCache(void)
+{
+    flushCache();
+    return RC_OK;
+}
+
+/*
+ * getRecordPoolStats
+ * ------------------
+ * Reported how many slabs the pool had allocated and how many records they
+ * held in total.
+ */
+void
+getRecordPoolStats(RecordPool *pool, int *numSlabs, int *numRecords)
+{
+    pthread_mutex_lock(&pool->lock);
+    *numSlabs = pool->numSlabs;
+    *numRecords = pool->numRecords;
+    pthread_mutex_unlock(&pool->lock);
+}
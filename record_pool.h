@@ -0,0 +1,34 @@
+#ifndef RECORD_POOL_H
+#define RECORD_POOL_H
+
+#include "dberror.h"
+#include "tables.h"
+
+// records carved from one slab; a batch larger than this gets a slab of its own
+#define POOL_SLAB_RECORDS 256
+// free records a thread keeps for its most recently used pool
+#define POOL_CACHE_SIZE 32
+
+// fixed-size Record plus data blocks for one schema, handed out from slabs
+// and recycled without returning to malloc
+typedef struct RecordPool RecordPool;
+
+extern RC createRecordPool (RecordPool **pool, Schema *schema);
+// frees every slab; records still out become invalid
+extern RC freeRecordPool (RecordPool *pool);
+
+// like createRecord/freeRecord (zeroed data, id -1/-1), for pool records only
+extern RC createRecordFromPool (RecordPool *pool, Record **record);
+extern RC releaseRecord (Record *record);
+
+// numRecords records at once, adjacent in memory when they come from a new slab
+extern RC createRecordBatch (RecordPool *pool, int numRecords, Record **records);
+extern RC releaseRecordBatch (Record **records, int numRecords);
+
+// hands the calling thread's cached records back to their pool (before the
+// thread exits, for example)
+extern RC flushRecordCache (void);
+
+extern void getRecordPoolStats (RecordPool *pool, int *numSlabs, int *numRecords);
+
+#endif // RECORD_POOL_H
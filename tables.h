@@ -41,6 +41,9 @@ typedef struct Schema
 	int *typeLength;
 	int *keyAttrs;
 	int keySize;
+	int *offsets;	// byte offset of each attribute, NULL when packed in declaration order
+	int *nameIndex;	// open-addressing table of attribute number + 1 by name (0 = empty)
+	int nameMask;	// number of nameIndex slots - 1
 } Schema;
 
 // TableData: Management Structure for a Record Manager to handle one relation
@@ -1,9 +1,15 @@
+#include <pthread.h>
 #include <stdlib.h>
+#include <unistd.h>
+#include "cdc_log.h"
+#include "distinct.h"
 #include "dberror.h"
 #include "expr.h"
+#include "partition.h"
 #include "record_mgr.h"
 #include "tables.h"
 #include "test_helper.h"
+#include "txn_log.h"
 
 
 #define ASSERT_EQUALS_RECORDS(_l,_r, schema, message)			\
@@ -55,6 +61,22 @@ static void testScans (void);
 static void testScansTwo (void);
 static void testInsertManyRecords(void);
 static void testMultipleScans(void);
+static void testRestartScanWithParams(void);
+static void testConstantConditions(void);
+static void testScanCopiesOnlyMatches(void);
+static void testPreparedScan(void);
+static void testComputedProjection(void);
+static void testRecordPool(void);
+static void testAlignedLayout(void);
+static void testAttrIndex(void);
+static void testRecordLocks(void);
+static void testTransactions(void);
+static void testPartitionedTable(void);
+static void testSampledScan(void);
+static void testChangeCapture(void);
+static void testCountWhere(void);
+static void testAggregates(void);
+static void testDistinct(void);
 
 // struct for test records
 typedef struct TestRecord {
@@ -84,6 +106,22 @@ main (void)
 	testScans();
 	testScansTwo();
 	testMultipleScans();
+	testRestartScanWithParams();
+	testConstantConditions();
+	testScanCopiesOnlyMatches();
+	testPreparedScan();
+	testComputedProjection();
+	testRecordPool();
+	testAlignedLayout();
+	testAttrIndex();
+	testRecordLocks();
+	testTransactions();
+	testPartitionedTable();
+	testSampledScan();
+	testChangeCapture();
+	testCountWhere();
+	testAggregates();
+	testDistinct();
 
 	return 0;
 }
@@ -259,6 +297,1716 @@ testMultipleScans(void)
 	TEST_DONE();
 }
 
+void
+testRestartScanWithParams(void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	TestRecord inserts[] = {
+			{1, "aaaa", 3},
+			{2, "bbbb", 2},
+			{3, "cccc", 1},
+			{4, "dddd", 3},
+			{5, "eeee", 5},
+			{6, "ffff", 1},
+			{7, "gggg", 3},
+			{8, "hhhh", 3},
+			{9, "iiii", 2},
+			{10, "jjjj", 5},
+	};
+	int expected[] = { 0, 2, 2, 4, 0, 2 };
+	int numInserts = 10, i, c, count;
+	Record *r;
+	Schema *schema;
+	RM_ScanHandle *sc = (RM_ScanHandle *) malloc(sizeof(RM_ScanHandle));
+	Expr *sel, *param, *attr;
+	Value slot;
+	int rc;
+
+	testName = "test restarting one scan with a rebound parameter";
+	schema = testSchema();
+
+	TEST_CHECK(initRecordManager(NULL));
+	TEST_CHECK(createTable("test_table_r",schema));
+	TEST_CHECK(openTable(table, "test_table_r"));
+
+	for(i = 0; i < numInserts; i++)
+	{
+		r = fromTestRecord(schema, inserts[i]);
+		TEST_CHECK(insertRecord(table,r));
+		freeRecord(r);
+	}
+
+	// c = ? with the parameter rebound for every restart
+	slot.dt = DT_INT;
+	slot.v.intV = 0;
+	MAKE_PARAM(param, &slot);
+	MAKE_ATTRREF(attr, 2);
+	MAKE_BINOP_EXPR(sel, attr, param, OP_COMP_EQUAL);
+
+	createRecord(&r, schema);
+	TEST_CHECK(startScan(table, sc, sel));
+	for(c = 0; c <= 5; c++)
+	{
+		slot.v.intV = c;
+		TEST_CHECK(restartScan(sc, sel));
+		count = 0;
+		while((rc = next(sc, r)) == RC_OK)
+			count++;
+		if (rc != RC_RM_NO_MORE_TUPLES)
+			TEST_CHECK(rc);
+		ASSERT_EQUALS_INT(expected[c], count, "rows with c = parameter");
+	}
+
+	// a NULL condition on restart turned the scan into a full scan
+	TEST_CHECK(restartScan(sc, NULL));
+	count = 0;
+	while(next(sc, r) == RC_OK)
+		count++;
+	ASSERT_EQUALS_INT(numInserts, count, "restart without condition returned all rows");
+	TEST_CHECK(closeScan(sc));
+	ASSERT_ERROR(restartScan(sc, sel), "restart after close failed");
+
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_r"));
+	TEST_CHECK(shutdownRecordManager());
+
+	freeRecord(r);
+	freeExpr(sel);
+	free(sc);
+	free(table);
+	TEST_DONE();
+}
+
+void
+testConstantConditions(void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	TestRecord inserts[] = {
+			{1, "aaaa", 3},
+			{2, "bbbb", 2},
+			{3, "cccc", 1},
+			{4, "dddd", 3},
+			{5, "eeee", 5},
+			{6, "ffff", 1},
+			{7, "gggg", 3},
+			{8, "hhhh", 3},
+	};
+	int expected[] = { 4, 0, 4, 0, 8 };
+	int numInserts = 8, i, count;
+	Record *r;
+	Schema *schema;
+	RM_ScanHandle *sc = (RM_ScanHandle *) malloc(sizeof(RM_ScanHandle));
+	Expr *conds[5], *l, *rr, *cmp, *attr, *cons;
+	int rc;
+
+	testName = "test scans with constant subconditions";
+	schema = testSchema();
+
+	TEST_CHECK(initRecordManager(NULL));
+	TEST_CHECK(createTable("test_table_k",schema));
+	TEST_CHECK(openTable(table, "test_table_k"));
+
+	for(i = 0; i < numInserts; i++)
+	{
+		r = fromTestRecord(schema, inserts[i]);
+		TEST_CHECK(insertRecord(table,r));
+		freeRecord(r);
+	}
+
+	// (1 < 2) AND c = 3
+	MAKE_CONS(l, stringToValue("i1"));
+	MAKE_CONS(rr, stringToValue("i2"));
+	MAKE_BINOP_EXPR(cmp, l, rr, OP_COMP_SMALLER);
+	MAKE_ATTRREF(attr, 2);
+	MAKE_CONS(cons, stringToValue("i3"));
+	MAKE_BINOP_EXPR(l, attr, cons, OP_COMP_EQUAL);
+	MAKE_BINOP_EXPR(conds[0], cmp, l, OP_BOOL_AND);
+
+	// c = 3 AND (2 < 1)
+	MAKE_ATTRREF(attr, 2);
+	MAKE_CONS(cons, stringToValue("i3"));
+	MAKE_BINOP_EXPR(l, attr, cons, OP_COMP_EQUAL);
+	MAKE_CONS(cons, stringToValue("i2"));
+	MAKE_CONS(rr, stringToValue("i1"));
+	MAKE_BINOP_EXPR(cmp, cons, rr, OP_COMP_SMALLER);
+	MAKE_BINOP_EXPR(conds[1], l, cmp, OP_BOOL_AND);
+
+	// NOT NOT (3 = c)
+	MAKE_CONS(cons, stringToValue("i3"));
+	MAKE_ATTRREF(attr, 2);
+	MAKE_BINOP_EXPR(l, cons, attr, OP_COMP_EQUAL);
+	MAKE_UNOP_EXPR(cmp, l, OP_BOOL_NOT);
+	MAKE_UNOP_EXPR(conds[2], cmp, OP_BOOL_NOT);
+
+	// NOT (a > 0 OR true)
+	MAKE_ATTRREF(attr, 0);
+	MAKE_CONS(cons, stringToValue("i0"));
+	MAKE_BINOP_EXPR(l, attr, cons, OP_COMP_GREATER);
+	MAKE_CONS(rr, stringToValue("bt"));
+	MAKE_BINOP_EXPR(cmp, l, rr, OP_BOOL_OR);
+	MAKE_UNOP_EXPR(conds[3], cmp, OP_BOOL_NOT);
+
+	// a > 0 OR c = 99 OR true
+	MAKE_ATTRREF(attr, 0);
+	MAKE_CONS(cons, stringToValue("i0"));
+	MAKE_BINOP_EXPR(l, attr, cons, OP_COMP_GREATER);
+	MAKE_ATTRREF(attr, 2);
+	MAKE_CONS(cons, stringToValue("i99"));
+	MAKE_BINOP_EXPR(rr, attr, cons, OP_COMP_EQUAL);
+	MAKE_BINOP_EXPR(cmp, l, rr, OP_BOOL_OR);
+	MAKE_CONS(cons, stringToValue("bt"));
+	MAKE_BINOP_EXPR(conds[4], cmp, cons, OP_BOOL_OR);
+
+	createRecord(&r, schema);
+	for(i = 0; i < 5; i++)
+	{
+		TEST_CHECK(startScan(table, sc, conds[i]));
+		count = 0;
+		while((rc = next(sc, r)) == RC_OK)
+			count++;
+		if (rc != RC_RM_NO_MORE_TUPLES)
+			TEST_CHECK(rc);
+		ASSERT_EQUALS_INT(expected[i], count, "rows matching the simplified condition");
+		TEST_CHECK(closeScan(sc));
+
+		// the caller's tree was left as built
+		ASSERT_TRUE(conds[i]->type == EXPR_OP, "condition not rewritten in place");
+		freeExpr(conds[i]);
+	}
+
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_k"));
+	TEST_CHECK(shutdownRecordManager());
+
+	freeRecord(r);
+	free(sc);
+	free(table);
+	TEST_DONE();
+}
+
+void
+testScanCopiesOnlyMatches(void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	TestRecord inserts[] = {
+			{1, "aaaa", 3},
+			{2, "bbbb", 2},
+			{3, "cccc", 1},
+			{4, "dddd", 3},
+	};
+	int numInserts = 4, i, rc;
+	Record *r, *sentinel;
+	Schema *schema;
+	RM_ScanHandle *sc = (RM_ScanHandle *) malloc(sizeof(RM_ScanHandle));
+	Expr *sel, *attr, *cons;
+
+	testName = "test scan filters in the page and copies only matches";
+	schema = testSchema();
+
+	TEST_CHECK(initRecordManager(NULL));
+	TEST_CHECK(createTable("test_table_c",schema));
+	TEST_CHECK(openTable(table, "test_table_c"));
+	for(i = 0; i < numInserts; i++)
+	{
+		r = fromTestRecord(schema, inserts[i]);
+		TEST_CHECK(insertRecord(table,r));
+		freeRecord(r);
+	}
+
+	// c = 4 matched nothing, so the output record kept its contents
+	sentinel = testRecord(schema, 42, "zzzz", 42);
+	r = testRecord(schema, 42, "zzzz", 42);
+	MAKE_ATTRREF(attr, 2);
+	MAKE_CONS(cons, stringToValue("i4"));
+	MAKE_BINOP_EXPR(sel, attr, cons, OP_COMP_EQUAL);
+	TEST_CHECK(startScan(table, sc, sel));
+	rc = next(sc, r);
+	ASSERT_EQUALS_INT(RC_RM_NO_MORE_TUPLES, rc, "no row with c = 4");
+	ASSERT_EQUALS_RECORDS(sentinel, r, schema, "rejected rows were not copied");
+
+	// c = 2 copied exactly the matching row
+	cons->expr.cons->v.intV = 2;
+	TEST_CHECK(closeScan(sc));
+	TEST_CHECK(startScan(table, sc, sel));
+	TEST_CHECK(next(sc, r));
+	freeRecord(sentinel);
+	sentinel = fromTestRecord(schema, inserts[1]);
+	ASSERT_EQUALS_RECORDS(sentinel, r, schema, "matching row copied");
+	ASSERT_EQUALS_INT(RC_RM_NO_MORE_TUPLES, next(sc, r), "only one row with c = 2");
+	TEST_CHECK(closeScan(sc));
+
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_c"));
+	TEST_CHECK(shutdownRecordManager());
+
+	freeRecord(r);
+	freeRecord(sentinel);
+	freeExpr(sel);
+	free(sc);
+	free(table);
+	TEST_DONE();
+}
+
+void
+testPreparedScan(void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	TestRecord inserts[] = {
+			{1, "aaaa", 3},
+			{2, "bbbb", 2},
+			{3, "cccc", 1},
+			{4, "dddd", 3},
+			{5, "eeee", 5},
+			{6, "ffff", 1},
+			{7, "gggg", 3},
+			{8, "hhhh", 3},
+	};
+	int numInserts = 8, i, count, rc, hits, misses;
+	Record *r;
+	Schema *schema;
+	RM_ScanHandle *sc = (RM_ScanHandle *) malloc(sizeof(RM_ScanHandle));
+	PreparedCond *cond, *again;
+	Value c, a;
+
+	testName = "test scans with a prepared text condition";
+	schema = testSchema();
+
+	TEST_CHECK(initRecordManager(NULL));
+	TEST_CHECK(createTable("test_table_p",schema));
+	TEST_CHECK(openTable(table, "test_table_p"));
+	for(i = 0; i < numInserts; i++)
+	{
+		r = fromTestRecord(schema, inserts[i]);
+		TEST_CHECK(insertRecord(table,r));
+		freeRecord(r);
+	}
+
+	TEST_CHECK(clearConditionCache());
+	TEST_CHECK(prepareCondition("c = ? AND a > ?", schema, &cond));
+	ASSERT_EQUALS_INT(2, getNumParams(cond), "two placeholders");
+	c.dt = DT_INT;
+	c.v.intV = 3;
+	a.dt = DT_INT;
+	a.v.intV = 2;
+	TEST_CHECK(bindParam(cond, 0, &c));
+	TEST_CHECK(bindParam(cond, 1, &a));
+
+	createRecord(&r, schema);
+	TEST_CHECK(startScanPrepared(table, sc, cond));
+	count = 0;
+	while((rc = next(sc, r)) == RC_OK)
+		count++;
+	ASSERT_EQUALS_INT(RC_RM_NO_MORE_TUPLES, rc, "scan ended normally");
+	ASSERT_EQUALS_INT(3, count, "rows with c = 3 and a > 2");
+
+	// the scan held its own reference, so the caller could release early
+	TEST_CHECK(releaseCondition(cond));
+	a.v.intV = 0;
+	TEST_CHECK(bindParam(cond, 1, &a));
+	TEST_CHECK(restartScan(sc, getPreparedExpr(cond)));
+	count = 0;
+	while(next(sc, r) == RC_OK)
+		count++;
+	ASSERT_EQUALS_INT(4, count, "rows with c = 3 and a > 0 after rebinding");
+
+	// the same text against the same schema came from the cache, with
+	// placeholders of its own: binding them left the open scan alone
+	TEST_CHECK(prepareCondition("c = ? AND a > ?", schema, &again));
+	ASSERT_TRUE(again != cond, "repeated condition got its own handle");
+	getConditionCacheStats(&hits, &misses);
+	ASSERT_EQUALS_INT(1, hits, "one cache hit");
+	ASSERT_EQUALS_INT(1, misses, "one cache miss");
+	c.v.intV = 1;
+	TEST_CHECK(bindParam(again, 0, &c));
+	TEST_CHECK(bindParam(again, 1, &a));
+	TEST_CHECK(restartScan(sc, getPreparedExpr(cond)));
+	count = 0;
+	while(next(sc, r) == RC_OK)
+		count++;
+	ASSERT_EQUALS_INT(4, count, "other handle's bindings did not reach the scan");
+	TEST_CHECK(releaseCondition(again));
+	TEST_CHECK(closeScan(sc));
+
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_p"));
+	TEST_CHECK(shutdownRecordManager());
+	TEST_CHECK(clearConditionCache());
+
+	freeRecord(r);
+	freeSchema(schema);
+	free(sc);
+	free(table);
+	TEST_DONE();
+}
+
+void
+testComputedProjection(void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	TestRecord inserts[] = {
+			{1, "aaaa", 3},
+			{2, "bbbb", 2},
+			{3, "cccc", 1},
+			{4, "dddd", 3},
+	};
+	int numInserts = 4, i, count, rc;
+	Record *r;
+	Schema *schema, *out;
+	RM_ScanHandle *sc = (RM_ScanHandle *) malloc(sizeof(RM_ScanHandle));
+	Expr *sel, *cols[3], *a, *c, *sum;
+	Value *v;
+	char *names[] = { "product", "b", "text" };
+
+	testName = "test scans returning computed columns";
+	schema = testSchema();
+
+	TEST_CHECK(initRecordManager(NULL));
+	TEST_CHECK(createTable("test_table_x",schema));
+	TEST_CHECK(openTable(table, "test_table_x"));
+	for(i = 0; i < numInserts; i++)
+	{
+		r = fromTestRecord(schema, inserts[i]);
+		TEST_CHECK(insertRecord(table,r));
+		freeRecord(r);
+	}
+
+	// a * c, b and CAST(a * 10 AS STRING) for the rows with c = 3
+	TEST_CHECK(parseCondition("c = 3", schema, &sel));
+	MAKE_ATTRREF(a, 0);
+	MAKE_ATTRREF(c, 2);
+	MAKE_BINOP_EXPR(cols[0], a, c, OP_ARITH_MUL);
+	MAKE_ATTRREF(cols[1], 1);
+	MAKE_ATTRREF(a, 0);
+	MAKE_VALUE(v, DT_INT, 10);
+	MAKE_CONS(c, v);
+	MAKE_BINOP_EXPR(sum, a, c, OP_ARITH_MUL);
+	MAKE_UNOP_EXPR(cols[2], sum, OP_CAST_STRING);
+
+	TEST_CHECK(startScan(table, sc, sel));
+	TEST_CHECK(setScanProjection(sc, 3, cols, names, &out));
+	ASSERT_EQUALS_INT(3, out->numAttr, "three output columns");
+	ASSERT_TRUE(out->dataTypes[0] == DT_INT && out->dataTypes[1] == DT_STRING && out->typeLength[1] == 4 &&
+		out->dataTypes[2] == DT_STRING && out->typeLength[2] == PROJECTION_STRING_LENGTH, "output schema");
+	ASSERT_EQUALS_STRING("product", out->attrNames[0], "named column");
+
+	createRecord(&r, out);
+	count = 0;
+	while((rc = next(sc, r)) == RC_OK)
+	{
+		TestRecord t = inserts[count == 0 ? 0 : 3];
+		TEST_CHECK(getAttr(r, out, 0, &v));
+		ASSERT_EQUALS_INT(t.a * t.c, v->v.intV, "a * c");
+		freeVal(v);
+		TEST_CHECK(getAttr(r, out, 1, &v));
+		ASSERT_EQUALS_STRING(t.b, v->v.stringV, "b");
+		freeVal(v);
+		TEST_CHECK(getAttr(r, out, 2, &v));
+		ASSERT_EQUALS_INT(t.a * 10, atoi(v->v.stringV), "CAST(a * 10 AS STRING)");
+		freeVal(v);
+		count++;
+	}
+	ASSERT_EQUALS_INT(RC_RM_NO_MORE_TUPLES, rc, "scan ended normally");
+	ASSERT_EQUALS_INT(2, count, "two rows with c = 3");
+	freeRecord(r);
+	freeSchema(out);
+
+	// no projection returned whole records again
+	TEST_CHECK(setScanProjection(sc, 0, NULL, NULL, NULL));
+	TEST_CHECK(restartScan(sc, NULL));
+	createRecord(&r, schema);
+	count = 0;
+	while(next(sc, r) == RC_OK)
+		count++;
+	ASSERT_EQUALS_INT(numInserts, count, "whole records after clearing the projection");
+	TEST_CHECK(closeScan(sc));
+
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_x"));
+	TEST_CHECK(shutdownRecordManager());
+
+	for(i = 0; i < 3; i++)
+		freeExpr(cols[i]);
+	freeExpr(sel);
+	freeRecord(r);
+	freeSchema(schema);
+	free(sc);
+	free(table);
+	TEST_DONE();
+}
+
+// each thread created and released records of the shared pool
+static void *
+poolWorker (void *arg)
+{
+	RecordPool *pool = (RecordPool *) arg;
+	Record *rs[8];
+	int i, j;
+
+	for(i = 0; i < 2000; i++)
+	{
+		for(j = 0; j < 8; j++)
+			createRecordFromPool(pool, &rs[j]);
+		for(j = 0; j < 8; j++)
+		{
+			rs[j]->data[0] = (char) j;
+			releaseRecord(rs[j]);
+		}
+	}
+	flushRecordCache();
+	return NULL;
+}
+
+void
+testRecordPool(void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	RM_ScanHandle *sc = (RM_ScanHandle *) malloc(sizeof(RM_ScanHandle));
+	TestRecord inserts[] = {
+			{1, "aaaa", 3},
+			{2, "bbbb", 2},
+			{3, "cccc", 1},
+			{4, "dddd", 3},
+	};
+	int numInserts = 4, i, n, rc, slabs, records;
+	int recSize;
+	Record *r, *batch[3 * POOL_SLAB_RECORDS];
+	RecordPool *pool;
+	Schema *schema;
+	pthread_t threads[4];
+	bool adjacent;
+
+	testName = "test record pools";
+	schema = testSchema();
+	recSize = getRecordSize(schema);
+	TEST_CHECK(createRecordPool(&pool, schema));
+
+	// records were recycled instead of allocated
+	for(i = 0; i < 10000; i++)
+	{
+		TEST_CHECK(createRecordFromPool(pool, &r));
+		ASSERT_TRUE(r->id.page == -1 && r->id.slot == -1, "fresh record had no RID");
+		ASSERT_TRUE(r->data[0] == 0 && r->data[recSize - 1] == 0, "fresh record was zeroed");
+		memset(r->data, 'x', recSize);
+		r->id.page = 5;
+		TEST_CHECK(releaseRecord(r));
+	}
+	getRecordPoolStats(pool, &slabs, &records);
+	ASSERT_EQUALS_INT(1, slabs, "one slab for one record at a time");
+
+	// a batch larger than a slab came from a slab of its own
+	TEST_CHECK(createRecordBatch(pool, 3 * POOL_SLAB_RECORDS, batch));
+	getRecordPoolStats(pool, &slabs, &records);
+	ASSERT_EQUALS_INT(2, slabs, "the batch took one more slab");
+	adjacent = true;
+	for(i = POOL_SLAB_RECORDS + 2; i < 3 * POOL_SLAB_RECORDS; i++)
+		adjacent &= (batch[i]->data - batch[i - 1]->data == batch[i - 1]->data - batch[i - 2]->data);
+	ASSERT_TRUE(adjacent, "records of the new slab were adjacent");
+	for(i = 0; i < 3 * POOL_SLAB_RECORDS; i++)
+		batch[i]->data[recSize - 1] = 1;
+	TEST_CHECK(releaseRecordBatch(batch, 3 * POOL_SLAB_RECORDS));
+
+	// threads shared the pool without new slabs once it had enough
+	for(i = 0; i < 4; i++)
+		pthread_create(&threads[i], NULL, poolWorker, pool);
+	for(i = 0; i < 4; i++)
+		pthread_join(threads[i], NULL);
+	getRecordPoolStats(pool, &slabs, &records);
+	ASSERT_EQUALS_INT(2, slabs, "threads reused the released records");
+
+	// a batch scan filled pool records
+	TEST_CHECK(initRecordManager(NULL));
+	TEST_CHECK(createTable("test_table_y",schema));
+	TEST_CHECK(openTable(table, "test_table_y"));
+	for(i = 0; i < numInserts; i++)
+	{
+		r = fromTestRecord(schema, inserts[i]);
+		TEST_CHECK(insertRecord(table,r));
+		freeRecord(r);
+	}
+	TEST_CHECK(createRecordBatch(pool, 3, batch));
+	TEST_CHECK(startScan(table, sc, NULL));
+	TEST_CHECK(nextBatch(sc, batch, 3, &n));
+	ASSERT_EQUALS_INT(3, n, "first batch was full");
+	r = fromTestRecord(schema, inserts[2]);
+	ASSERT_EQUALS_RECORDS(r, batch[2], schema, "third record");
+	freeRecord(r);
+	TEST_CHECK(nextBatch(sc, batch, 3, &n));
+	ASSERT_EQUALS_INT(1, n, "second batch held the rest");
+	rc = nextBatch(sc, batch, 3, &n);
+	ASSERT_EQUALS_INT(RC_RM_NO_MORE_TUPLES, rc, "no third batch");
+	TEST_CHECK(closeScan(sc));
+	TEST_CHECK(releaseRecordBatch(batch, 3));
+
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_y"));
+	TEST_CHECK(shutdownRecordManager());
+
+	TEST_CHECK(freeRecordPool(pool));
+	freeSchema(schema);
+	free(sc);
+	free(table);
+	TEST_DONE();
+}
+
+// a 3-byte string left c unaligned in the packed layout; the aligned layout
+// moved the INTs and the FLOAT to the front and kept attribute numbers
+void
+testAlignedLayout(void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	RM_ScanHandle *sc = (RM_ScanHandle *) malloc(sizeof(RM_ScanHandle));
+	char *names[] = { "a", "b", "c", "d", "e" };
+	DataType dt[] = { DT_INT, DT_STRING, DT_INT, DT_BOOL, DT_FLOAT };
+	int sizes[] = { 0, 3, 0, 0, 0 };
+	char **cpNames = (char **) malloc(sizeof(char*) * 5);
+	DataType *cpDt = (DataType *) malloc(sizeof(DataType) * 5);
+	int *cpSizes = (int *) malloc(sizeof(int) * 5);
+	int *cpKeys = (int *) malloc(sizeof(int));
+	int i, count, rc;
+	Schema *schema;
+	Record *r;
+	RID rids[100];
+	Expr *sel;
+	Value *v;
+
+	testName = "test aligned record layout";
+	for(i = 0; i < 5; i++)
+		cpNames[i] = strdup(names[i]);
+	memcpy(cpDt, dt, sizeof(dt));
+	memcpy(cpSizes, sizes, sizeof(sizes));
+	cpKeys[0] = 0;
+	schema = createSchema(5, cpNames, cpDt, cpSizes, 1, cpKeys);
+
+	ASSERT_EQUALS_INT(7, getAttrOffset(schema, 2), "packed c followed the string");
+	rc = getRecordSize(schema);
+	ASSERT_EQUALS_INT(4 + 3 + 4 + (int) sizeof(bool) + 4, rc, "packed record size");
+
+	TEST_CHECK(initRecordManager(NULL));
+	TEST_CHECK(createTableWithLayout("test_table_z", schema, RM_LAYOUT_ALIGNED));
+	ASSERT_TRUE(getAttrOffset(schema, 0) == 0 && getAttrOffset(schema, 2) == 4 && getAttrOffset(schema, 4) == 8,
+		"INTs and the FLOAT came first");
+	ASSERT_TRUE(getAttrOffset(schema, 3) == 12 && getAttrOffset(schema, 1) == 12 + (int) sizeof(bool),
+		"BOOL and string followed");
+	rc = getRecordSize(schema);
+	ASSERT_EQUALS_INT(0, rc % 4, "aligned record size was a multiple of 4");
+
+	TEST_CHECK(openTable(table, "test_table_z"));
+	TEST_CHECK(createRecord(&r, schema));
+	for(i = 0; i < 100; i++)
+	{
+		MAKE_VALUE(v, DT_INT, i);
+		TEST_CHECK(setAttr(r, schema, 0, v));
+		freeVal(v);
+		MAKE_STRING_VALUE(v, i % 2 ? "odd" : "ev");
+		TEST_CHECK(setAttr(r, schema, 1, v));
+		freeVal(v);
+		MAKE_VALUE(v, DT_INT, i * 3);
+		TEST_CHECK(setAttr(r, schema, 2, v));
+		freeVal(v);
+		MAKE_VALUE(v, DT_BOOL, i % 2);
+		TEST_CHECK(setAttr(r, schema, 3, v));
+		freeVal(v);
+		MAKE_VALUE(v, DT_FLOAT, i / 2.0);
+		TEST_CHECK(setAttr(r, schema, 4, v));
+		freeVal(v);
+		TEST_CHECK(insertRecord(table, r));
+		rids[i] = r->id;
+	}
+	TEST_CHECK(closeTable(table));
+
+	// the layout came back with the table
+	TEST_CHECK(openTable(table, "test_table_z"));
+	ASSERT_TRUE(table->schema->offsets != NULL && getAttrOffset(table->schema, 4) == 8, "layout was restored");
+	TEST_CHECK(getRecord(table, rids[41], r));
+	TEST_CHECK(getAttr(r, table->schema, 2, &v));
+	ASSERT_EQUALS_INT(123, v->v.intV, "c of row 41");
+	freeVal(v);
+	TEST_CHECK(getAttr(r, table->schema, 1, &v));
+	ASSERT_EQUALS_STRING("odd", v->v.stringV, "b of row 41");
+	freeVal(v);
+
+	// compiled and evaluated conditions read the aligned offsets
+	TEST_CHECK(parseCondition("c >= 150 AND e < 40.0 AND d AND b = 'odd'", table->schema, &sel));
+	TEST_CHECK(startScan(table, sc, sel));
+	count = 0;
+	while((rc = next(sc, r)) == RC_OK)
+	{
+		TEST_CHECK(getAttr(r, table->schema, 0, &v));
+		ASSERT_TRUE(v->v.intV >= 50 && v->v.intV < 80 && v->v.intV % 2 == 1, "matching row");
+		freeVal(v);
+		count++;
+	}
+	ASSERT_EQUALS_INT(RC_RM_NO_MORE_TUPLES, rc, "scan ended normally");
+	ASSERT_EQUALS_INT(15, count, "odd rows 51 to 79");
+	TEST_CHECK(closeScan(sc));
+	freeExpr(sel);
+
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_z"));
+	TEST_CHECK(shutdownRecordManager());
+
+	freeRecord(r);
+	freeSchema(schema);
+	free(sc);
+	free(table);
+	TEST_DONE();
+}
+
+// names resolved through the schema's hash index, including names that
+// were prefixes of each other
+void
+testAttrIndex(void)
+{
+	int n = 40, i, rc;
+	char **names = (char **) malloc(sizeof(char*) * n);
+	DataType *dt = (DataType *) malloc(sizeof(DataType) * n);
+	int *sizes = (int *) malloc(sizeof(int) * n);
+	int *keys = (int *) malloc(sizeof(int));
+	char name[16];
+	Schema *schema;
+	Expr *e;
+
+	testName = "test attribute name index";
+	for(i = 0; i < n; i++)
+	{
+		sprintf(name, "col%d", i);
+		names[i] = strdup(i == n - 1 ? "col1" : name);
+		dt[i] = DT_INT;
+		sizes[i] = 0;
+	}
+	keys[0] = 0;
+	schema = createSchema(n, names, dt, sizes, 1, keys);
+
+	for(i = 0; i < n - 1; i++)
+	{
+		sprintf(name, "col%d", i);
+		rc = getAttrIndex(schema, name);
+		ASSERT_EQUALS_INT(i, rc, "every name was found");
+	}
+	rc = getAttrIndex(schema, "col1");
+	ASSERT_EQUALS_INT(1, rc, "a repeated name kept its first attribute");
+	rc = getAttrIndex(schema, "col");
+	ASSERT_EQUALS_INT(-1, rc, "a prefix was not a name");
+	rc = getAttrIndex(schema, "col100");
+	ASSERT_EQUALS_INT(-1, rc, "unknown name");
+	rc = getAttrIndexN(schema, "col12 > 3", 5);
+	ASSERT_EQUALS_INT(12, rc, "name inside a longer string");
+
+	TEST_CHECK(parseCondition("col12 > col1", schema, &e));
+	ASSERT_TRUE(e->expr.op->args[0]->expr.attrRef == 12 && e->expr.op->args[1]->expr.attrRef == 1,
+		"the parser resolved names through the index");
+	freeExpr(e);
+	rc = parseCondition("col40 > 1", schema, &e);
+	ASSERT_EQUALS_INT(RC_PARSE_ERROR, rc, "unknown attribute in a condition");
+
+	freeSchema(schema);
+	TEST_DONE();
+}
+
+// shared state of the lock test threads
+typedef struct LockTestArg {
+	RM_TableData *table;
+	Schema *schema;
+	RID rid;
+	int value;
+	RC rc;
+} LockTestArg;
+
+// read a record under its own owner, waiting for a conflicting holder
+static void *
+lockedReader (void *arg)
+{
+	LockTestArg *a = (LockTestArg *) arg;
+	RM_LockOwner *owner;
+	Record *r;
+
+	createLockOwner(&owner);
+	setLockOwner(owner);
+	createRecord(&r, a->schema);
+	a->rc = getRecord(a->table, a->rid, r);
+	freeRecord(r);
+	freeLockOwner(owner);
+	return NULL;
+}
+
+// updated its own record many times, releasing its lock after each update
+static void *
+lockedWriter (void *arg)
+{
+	LockTestArg *a = (LockTestArg *) arg;
+	RM_LockOwner *owner;
+	Record *r;
+	Value *v;
+
+	createLockOwner(&owner);
+	setLockOwner(owner);
+	createRecord(&r, a->schema);
+	a->rc = RC_OK;
+	for(int i = 1; i <= 200 && a->rc == RC_OK; i++)
+	{
+		a->rc = getRecord(a->table, a->rid, r);
+		MAKE_VALUE(v, DT_INT, i);
+		setAttr(r, a->schema, 2, v);
+		freeVal(v);
+		if (a->rc == RC_OK)
+			a->rc = updateRecord(a->table, r);
+		releaseAllLocks(owner);
+	}
+	freeRecord(r);
+	freeLockOwner(owner);
+	return NULL;
+}
+
+void
+testRecordLocks(void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	RM_LockOwner *ownerA, *ownerB;
+	LockTestArg args[4];
+	pthread_t threads[4];
+	Schema *schema;
+	Record *r;
+	RID rids[8];
+	Value *v;
+	int i, rc, id;
+
+	testName = "test record locks";
+	schema = testSchema();
+	TEST_CHECK(initRecordManager(NULL));
+	TEST_CHECK(createTable("test_table_l",schema));
+	TEST_CHECK(openTable(table, "test_table_l"));
+	for(i = 0; i < 8; i++)
+	{
+		r = testRecord(schema, i, "aaaa", 0);
+		TEST_CHECK(insertRecord(table, r));
+		rids[i] = r->id;
+		freeRecord(r);
+	}
+
+	TEST_CHECK(createLockOwner(&ownerA));
+	TEST_CHECK(createLockOwner(&ownerB));
+	setLockTimeout(50);
+	createRecord(&r, schema);
+
+	// an exclusive lock kept others out, shared locks did not
+	setLockOwner(ownerA);
+	TEST_CHECK(getRecord(table, rids[0], r));
+	TEST_CHECK(updateRecord(table, r));
+	ASSERT_EQUALS_INT(1, getNumLocksHeld(ownerA), "S upgraded to X in place");
+	setLockOwner(ownerB);
+	rc = getRecord(table, rids[0], r);
+	ASSERT_EQUALS_INT(RC_RM_LOCK_TIMEOUT, rc, "read waited for the writer and timed out");
+	TEST_CHECK(getRecord(table, rids[1], r));
+	setLockOwner(ownerA);
+	TEST_CHECK(getRecord(table, rids[1], r));
+	rc = updateRecord(table, r);
+	ASSERT_EQUALS_INT(RC_RM_LOCK_TIMEOUT, rc, "no upgrade while another reader held the lock");
+	TEST_CHECK(releaseAllLocks(ownerB));
+	TEST_CHECK(updateRecord(table, r));
+
+	// a waiting reader got the lock once the writer released it
+	setLockTimeout(5000);
+	args[0].table = table;
+	args[0].schema = schema;
+	args[0].rid = rids[0];
+	pthread_create(&threads[0], NULL, lockedReader, &args[0]);
+	usleep(50000);
+	TEST_CHECK(releaseAllLocks(ownerA));
+	pthread_join(threads[0], NULL);
+	TEST_CHECK(args[0].rc);
+
+	// two owners waiting for each other: the second request timed out
+	setLockTimeout(50);
+	id = getLockTableId("test_table_l");
+	TEST_CHECK(lockRecord(ownerA, id, rids[2], LOCK_EXCLUSIVE));
+	TEST_CHECK(lockRecord(ownerB, id, rids[3], LOCK_EXCLUSIVE));
+	rc = lockRecord(ownerB, id, rids[2], LOCK_EXCLUSIVE);
+	ASSERT_EQUALS_INT(RC_RM_LOCK_TIMEOUT, rc, "deadlock broken by the timeout");
+	TEST_CHECK(releaseAllLocks(ownerB));
+	TEST_CHECK(lockRecord(ownerA, id, rids[3], LOCK_EXCLUSIVE));
+	TEST_CHECK(unlockRecord(ownerA, id, rids[2]));
+	ASSERT_EQUALS_INT(1, getNumLocksHeld(ownerA), "one lock left after unlockRecord");
+	TEST_CHECK(releaseAllLocks(ownerA));
+	setLockOwner(NULL);
+
+	// writers of different records did not block each other
+	setLockTimeout(LOCK_TIMEOUT_MS);
+	for(i = 0; i < 4; i++)
+	{
+		args[i].table = table;
+		args[i].schema = schema;
+		args[i].rid = rids[4 + i];
+		pthread_create(&threads[i], NULL, lockedWriter, &args[i]);
+	}
+	for(i = 0; i < 4; i++)
+	{
+		pthread_join(threads[i], NULL);
+		TEST_CHECK(args[i].rc);
+		TEST_CHECK(getRecord(table, rids[4 + i], r));
+		TEST_CHECK(getAttr(r, schema, 2, &v));
+		ASSERT_EQUALS_INT(200, v->v.intV, "every update of a writer landed");
+		freeVal(v);
+	}
+
+	freeRecord(r);
+	TEST_CHECK(freeLockOwner(ownerA));
+	TEST_CHECK(freeLockOwner(ownerB));
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_l"));
+	TEST_CHECK(shutdownRecordManager());
+	freeSchema(schema);
+	free(table);
+	TEST_DONE();
+}
+
+// the whole content of a file, to put a table file back as a crash left it
+static char *
+copyFile (char *name, long *size)
+{
+	FILE *f = fopen(name, "rb");
+	char *buf;
+
+	fseek(f, 0, SEEK_END);
+	*size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	buf = (char *) malloc(*size);
+	fread(buf, 1, *size, f);
+	fclose(f);
+	return buf;
+}
+
+void
+testTransactions(void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	RM_Transaction *txn, *inner;
+	LockTestArg arg;
+	pthread_t thread;
+	Schema *schema;
+	Record *r, *in;
+	RID rids[4], added[100];
+	Value *v;
+	char *image;
+	long size;
+	uint64_t lsn;
+	FILE *f;
+	int i, rc;
+
+	testName = "test transactions";
+	schema = testSchema();
+	TEST_CHECK(setTxnLogFile("test_txn.log"));
+	TEST_CHECK(truncateTxnLog());
+	TEST_CHECK(initRecordManager(NULL));
+	TEST_CHECK(createTable("test_table_x",schema));
+	TEST_CHECK(openTable(table, "test_table_x"));
+	for(i = 0; i < 4; i++)
+	{
+		r = testRecord(schema, i, "aaaa", i);
+		TEST_CHECK(insertRecord(table, r));
+		rids[i] = r->id;
+		freeRecord(r);
+	}
+	createRecord(&r, schema);
+
+	// abort undid an update, a delete and an insert
+	TEST_CHECK(beginTransaction(&txn));
+	in = testRecord(schema, 0, "bbbb", 100);
+	in->id = rids[0];
+	TEST_CHECK(updateRecord(table, in));
+	TEST_CHECK(deleteRecord(table, rids[1]));
+	rc = getRecord(table, rids[1], r);
+	ASSERT_EQUALS_INT(RC_RM_NO_MORE_TUPLES, rc, "deleted record gone inside the transaction");
+	TEST_CHECK(insertRecord(table, in));
+	ASSERT_TRUE(in->id.page != rids[1].page || in->id.slot != rids[1].slot, "slot of a pending delete not reused");
+	ASSERT_ERROR(beginTransaction(&inner), "nested transaction rejected");
+	TEST_CHECK(getRecord(table, rids[0], r));
+	TEST_CHECK(abortTransaction(txn));
+	ASSERT_EQUALS_INT(4, getNumTuples(table), "abort restored the tuple count");
+	TEST_CHECK(getRecord(table, rids[0], r));
+	TEST_CHECK(getAttr(r, schema, 2, &v));
+	ASSERT_EQUALS_INT(0, v->v.intV, "abort restored the before image");
+	freeVal(v);
+	TEST_CHECK(getRecord(table, rids[1], r));
+	rc = getRecord(table, in->id, r);
+	ASSERT_EQUALS_INT(RC_RM_NO_MORE_TUPLES, rc, "abort removed the insert");
+	ASSERT_TRUE(getLockOwner() == NULL, "abort released the transaction's owner");
+	freeRecord(in);
+
+	// keep the table file as it was before the committed transaction
+	TEST_CHECK(closeTable(table));
+	image = copyFile("test_table_x", &size);
+	TEST_CHECK(openTable(table, "test_table_x"));
+
+	// a reader waited for the transaction's lock until commit
+	setLockTimeout(5000);
+	TEST_CHECK(beginTransaction(&txn));
+	in = testRecord(schema, 2, "cccc", 200);
+	in->id = rids[2];
+	TEST_CHECK(updateRecord(table, in));
+	TEST_CHECK(deleteRecord(table, rids[3]));
+	for(i = 0; i < 100; i++)
+	{
+		freeRecord(in);
+		in = testRecord(schema, 10 + i, "dddd", i);
+		TEST_CHECK(insertRecord(table, in));
+		added[i] = in->id;
+	}
+	arg.table = table;
+	arg.schema = schema;
+	arg.rid = rids[2];
+	arg.rc = -1;
+	pthread_create(&thread, NULL, lockedReader, &arg);
+	usleep(50000);
+	ASSERT_EQUALS_INT(-1, arg.rc, "reader still waiting before commit");
+	TEST_CHECK(commitTransaction(txn));
+	pthread_join(thread, NULL);
+	TEST_CHECK(arg.rc);
+	setLockTimeout(LOCK_TIMEOUT_MS);
+	ASSERT_EQUALS_INT(103, getNumTuples(table), "commit freed the deleted slot");
+	freeRecord(in);
+
+	// a crash before the pages reached the file: the log brought them back
+	TEST_CHECK(closeTable(table));
+	f = fopen("test_table_x", "wb");
+	fwrite(image, 1, size, f);
+	fclose(f);
+	free(image);
+	TEST_CHECK(openTable(table, "test_table_x"));
+	ASSERT_EQUALS_INT(103, getNumTuples(table), "replayed tuple count");
+	TEST_CHECK(getRecord(table, rids[2], r));
+	TEST_CHECK(getAttr(r, schema, 2, &v));
+	ASSERT_EQUALS_INT(200, v->v.intV, "replayed update");
+	freeVal(v);
+	rc = getRecord(table, rids[3], r);
+	ASSERT_EQUALS_INT(RC_RM_NO_MORE_TUPLES, rc, "replayed delete");
+	for(i = 0; i < 100; i++)
+	{
+		TEST_CHECK(getRecord(table, added[i], r));
+		TEST_CHECK(getAttr(r, schema, 0, &v));
+		ASSERT_TRUE(v->v.intV == 10 + i, "replayed insert");
+		freeVal(v);
+	}
+
+	// replaying again after a clean close changed nothing
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(openTable(table, "test_table_x"));
+	ASSERT_EQUALS_INT(103, getNumTuples(table), "nothing replayed twice");
+
+	// deleting a record that was not there was not logged
+	TEST_CHECK(beginTransaction(&txn));
+	TEST_CHECK(deleteRecord(table, rids[3]));
+	lsn = getLastLsn();
+	TEST_CHECK(commitTransaction(txn));
+	ASSERT_TRUE(getLastLsn() == lsn, "no log entry for a delete that changed nothing");
+
+	// an open transaction's page was neither evicted nor flushed to the file
+	for(i = 0; i < 1000; i++)
+	{
+		in = testRecord(schema, 1000 + i, "ffff", i);
+		TEST_CHECK(insertRecord(table, in));
+		freeRecord(in);
+	}
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(setTablePoolOptions(2, RS_LRU));
+	TEST_CHECK(openTable(table, "test_table_x"));
+	TEST_CHECK(beginTransaction(&txn));
+	in = testRecord(schema, 2, "eeee", 300);
+	in->id = rids[2];
+	TEST_CHECK(updateRecord(table, in));
+	freeRecord(in);
+
+	// a transaction held more pages than the pool had frames (1000 records
+	// filled several), and a scan still found frames to pin
+	for(i = 0; i < 1000; i++)
+	{
+		in = testRecord(schema, 3000 + i, "gggg", i);
+		TEST_CHECK(insertRecord(table, in));
+		freeRecord(in);
+	}
+	TEST_CHECK(countWhere(table, NULL, &i));
+	ASSERT_EQUALS_INT(2103, i, "scan while the transaction held its pages");
+	rc = closeTable(table);
+	ASSERT_EQUALS_INT(RC_PINNED_PAGES_IN_BUFFER, rc, "no close under an open transaction");
+	image = copyFile("test_table_x", &size);
+	for(i = 0, rc = 0; i + 4 <= size; i++)
+		rc = rc || memcmp(image + i, "eeee", 4) == 0;
+	ASSERT_TRUE(!rc, "uncommitted update not in the table file");
+	free(image);
+	TEST_CHECK(abortTransaction(txn));
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(setTablePoolOptions(RM_DEFAULT_POOL_PAGES, RM_DEFAULT_POOL_STRATEGY));
+	TEST_CHECK(openTable(table, "test_table_x"));
+	TEST_CHECK(getRecord(table, rids[2], r));
+	TEST_CHECK(getAttr(r, schema, 2, &v));
+	ASSERT_EQUALS_INT(200, v->v.intV, "aborted update undone");
+	freeVal(v);
+	ASSERT_EQUALS_INT(1103, getNumTuples(table), "aborted inserts undone");
+
+	// a crash before page 0 was written again: replaying the commit kept a
+	// newer change made outside a transaction that had reached the file
+	TEST_CHECK(closeTable(table));
+	image = copyFile("test_table_x", &size);
+	TEST_CHECK(openTable(table, "test_table_x"));
+	TEST_CHECK(beginTransaction(&txn));
+	in = testRecord(schema, 2, "hhhh", 400);
+	in->id = rids[2];
+	TEST_CHECK(updateRecord(table, in));
+	TEST_CHECK(commitTransaction(txn));
+	freeRecord(in);
+	in = testRecord(schema, 2, "iiii", 500);
+	in->id = rids[2];
+	TEST_CHECK(updateRecord(table, in));
+	freeRecord(in);
+	TEST_CHECK(closeTable(table));
+	f = fopen("test_table_x", "r+b");
+	fwrite(image, 1, PAGE_SIZE, f);
+	fclose(f);
+	free(image);
+	TEST_CHECK(openTable(table, "test_table_x"));
+	TEST_CHECK(getRecord(table, rids[2], r));
+	TEST_CHECK(getAttr(r, schema, 2, &v));
+	ASSERT_EQUALS_INT(500, v->v.intV, "replay kept the newer change");
+	freeVal(v);
+
+	freeRecord(r);
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_x"));
+	TEST_CHECK(shutdownRecordManager());
+	TEST_CHECK(truncateTxnLog());
+	TEST_CHECK(setTxnLogFile(NULL));
+	unlink("test_txn.log");
+	freeSchema(schema);
+	free(table);
+	TEST_DONE();
+}
+
+// number of records a partitioned scan returned and how many partitions it read
+static int
+countPartitioned (RM_PartitionedTable *pt, char *cond, int *scanned)
+{
+	RM_PartitionScan scan;
+	Record *r;
+	Expr *e;
+	int n = 0, p;
+
+	TEST_CHECK(parseCondition(cond, pt->schema, &e));
+	createRecord(&r, pt->schema);
+	TEST_CHECK(startPartitionedScan(pt, &scan, e));
+	*scanned = getNumScannedPartitions(&scan);
+	while (nextPartitioned(&scan, r, &p) == RC_OK)
+		n++;
+	TEST_CHECK(closePartitionedScan(&scan));
+	freeRecord(r);
+	freeExpr(e);
+	return n;
+}
+
+void
+testPartitionedTable(void)
+{
+	RM_PartitionedTable pt;
+	RM_PartitionSpec spec;
+	int bounds[] = { 100, 200, 300 };
+	Schema *schema;
+	Record *r;
+	char key[8];
+	int i, n, p, scanned, rc;
+
+	testName = "test partitioned tables";
+	schema = testSchema();
+	TEST_CHECK(initRecordManager(NULL));
+
+	// range partitions on a: [..100) [100..200) [200..300) [300..)
+	spec.kind = RM_PARTITION_RANGE;
+	spec.keyAttr = 0;
+	spec.numPartitions = 4;
+	spec.bounds = bounds;
+	TEST_CHECK(createPartitionedTable("test_table_p", schema, &spec));
+	TEST_CHECK(openPartitionedTable(&pt, "test_table_p"));
+	for(i = 0; i < 400; i++)
+	{
+		r = testRecord(schema, i, "aaaa", i % 7);
+		TEST_CHECK(insertPartitioned(&pt, r, &p));
+		ASSERT_TRUE(p == i / 100, "routed by key range");
+		freeRecord(r);
+	}
+	ASSERT_EQUALS_INT(100, getNumTuples(getPartitionTable(&pt, 2)), "a quarter in each partition");
+
+	n = countPartitioned(&pt, "a >= 150 AND a < 250", &scanned);
+	ASSERT_EQUALS_INT(100, n, "range scan result");
+	ASSERT_EQUALS_INT(2, scanned, "range scan pruned to two partitions");
+	n = countPartitioned(&pt, "a BETWEEN 310 AND 320 AND c = 1", &scanned);
+	ASSERT_EQUALS_INT(1, n, "between scan result");
+	ASSERT_EQUALS_INT(1, scanned, "between scan pruned to one partition");
+	n = countPartitioned(&pt, "c = 1 OR a = 5", &scanned);
+	ASSERT_EQUALS_INT(4, scanned, "OR pruned nothing");
+
+	// dropping a partition emptied it but kept its range
+	TEST_CHECK(dropPartition(&pt, 0));
+	ASSERT_EQUALS_INT(300, getNumTuplesPartitioned(&pt), "partition dropped");
+	n = countPartitioned(&pt, "a < 100", &scanned);
+	ASSERT_EQUALS_INT(0, n, "nothing left below 100");
+	r = testRecord(schema, 5, "bbbb", 0);
+	TEST_CHECK(insertPartitioned(&pt, r, &p));
+	ASSERT_EQUALS_INT(0, p, "dropped range still accepted inserts");
+	freeRecord(r);
+	rc = dropPartition(&pt, 4);
+	ASSERT_EQUALS_INT(RC_RM_BAD_PARTITION, rc, "no fifth partition");
+
+	TEST_CHECK(closePartitionedTable(&pt));
+	TEST_CHECK(openPartitionedTable(&pt, "test_table_p"));
+	ASSERT_EQUALS_INT(301, getNumTuplesPartitioned(&pt), "partitions persisted");
+	n = countPartitioned(&pt, "a = 5", &scanned);
+	ASSERT_EQUALS_INT(1, n, "reopened range scan");
+	TEST_CHECK(closePartitionedTable(&pt));
+	TEST_CHECK(deletePartitionedTable("test_table_p"));
+
+	// hash partitions on b: an equality read one partition
+	spec.kind = RM_PARTITION_HASH;
+	spec.keyAttr = 1;
+	spec.numPartitions = 3;
+	spec.bounds = NULL;
+	TEST_CHECK(createPartitionedTable("test_table_p", schema, &spec));
+	TEST_CHECK(openPartitionedTable(&pt, "test_table_p"));
+	for(i = 0; i < 60; i++)
+	{
+		sprintf(key, "k%d", i);
+		r = testRecord(schema, i, key, 0);
+		TEST_CHECK(insertPartitioned(&pt, r, NULL));
+		freeRecord(r);
+	}
+	n = countPartitioned(&pt, "b = 'k17'", &scanned);
+	ASSERT_EQUALS_INT(1, n, "hash scan found the key");
+	ASSERT_EQUALS_INT(1, scanned, "hash scan pruned to one partition");
+	n = countPartitioned(&pt, "a < 30", &scanned);
+	ASSERT_EQUALS_INT(30, n, "scan over every hash partition");
+	ASSERT_EQUALS_INT(3, scanned, "non-key condition pruned nothing");
+	for(i = 0, n = 0; i < 3; i++)
+		n += (getNumTuples(getPartitionTable(&pt, i)) > 0);
+	ASSERT_EQUALS_INT(3, n, "keys spread over all partitions");
+	TEST_CHECK(closePartitionedTable(&pt));
+	TEST_CHECK(deletePartitionedTable("test_table_p"));
+
+	// a range key had to be an INT
+	spec.kind = RM_PARTITION_RANGE;
+	spec.bounds = bounds;
+	rc = createPartitionedTable("test_table_p", schema, &spec);
+	ASSERT_EQUALS_INT(RC_RM_BAD_PARTITION, rc, "string range key rejected");
+
+	TEST_CHECK(shutdownRecordManager());
+	freeSchema(schema);
+	TEST_DONE();
+}
+
+// records a scan with the given options returned, and its sampled fraction
+static int
+countSampled (RM_TableData *table, Expr *cond, RM_ScanOptions *options, double *fraction)
+{
+	RM_ScanHandle scan;
+	Record *r;
+	int n = 0;
+
+	createRecord(&r, table->schema);
+	TEST_CHECK(startScanWithOptions(table, &scan, cond, options));
+	while (next(&scan, r) == RC_OK)
+		n++;
+	*fraction = getScanSampleFraction(&scan);
+	TEST_CHECK(closeScan(&scan));
+	freeRecord(r);
+	return n;
+}
+
+void
+testSampledScan(void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	RM_ScanOptions options;
+	RM_TableStats stats;
+	RM_ScanHandle scan;
+	Schema *schema;
+	Record *r;
+	Expr *cond;
+	double fraction, est;
+	int i, n, m, rc;
+
+	testName = "test sampling scans";
+	schema = testSchema();
+	TEST_CHECK(initRecordManager(NULL));
+	TEST_CHECK(createTable("test_table_s",schema));
+	TEST_CHECK(openTable(table, "test_table_s"));
+	for(i = 0; i < 20000; i++)
+	{
+		r = testRecord(schema, i, "aaaa", i % 10);
+		TEST_CHECK(insertRecord(table, r));
+		freeRecord(r);
+	}
+
+	// a full scan read everything
+	options.sample = RM_SAMPLE_NONE;
+	n = countSampled(table, NULL, &options, &fraction);
+	ASSERT_EQUALS_INT(20000, n, "unsampled scan");
+	ASSERT_TRUE(fraction == 1.0, "unsampled fraction");
+
+	// reservoir: exactly a quarter of the pages, the same ones for a seed
+	options.sample = RM_SAMPLE_RESERVOIR;
+	options.rate = 0.25;
+	options.seed = 7;
+	n = countSampled(table, NULL, &options, &fraction);
+	ASSERT_TRUE(fraction >= 0.25 && fraction < 0.35, "reservoir fraction");
+	est = n / fraction;
+	ASSERT_TRUE(est > 16000 && est < 24000, "reservoir estimate near the table size");
+	m = countSampled(table, NULL, &options, &fraction);
+	ASSERT_EQUALS_INT(n, m, "same seed, same sample");
+
+	// Bernoulli with a condition: the estimate scaled the matches
+	options.sample = RM_SAMPLE_BERNOULLI;
+	options.rate = 0.5;
+	options.seed = 11;
+	TEST_CHECK(parseCondition("c = 3", schema, &cond));
+	n = countSampled(table, cond, &options, &fraction);
+	ASSERT_TRUE(fraction > 0.2 && fraction < 0.8, "bernoulli fraction");
+	est = n / fraction;
+	ASSERT_TRUE(est > 1500 && est < 2500, "bernoulli estimate of the matches");
+	freeExpr(cond);
+
+	options.rate = 0;
+	rc = startScanWithOptions(table, &scan, NULL, &options);
+	ASSERT_EQUALS_INT(RC_ERROR, rc, "rate 0 rejected");
+
+	// statistics came from the same sampler
+	options.sample = RM_SAMPLE_RESERVOIR;
+	options.rate = 0.5;
+	options.seed = 3;
+	TEST_CHECK(collectTableStats(table, &options, &stats));
+	ASSERT_TRUE(stats.fraction >= 0.5 && stats.fraction < 0.6, "stats fraction");
+	ASSERT_TRUE(stats.estTuples > 16000 && stats.estTuples < 24000, "estimated tuples");
+	ASSERT_TRUE(stats.min[2] == 0 && stats.max[2] == 9, "min and max of c");
+	ASSERT_TRUE(stats.mean[2] > 4.0 && stats.mean[2] < 5.0, "mean of c");
+	TEST_CHECK(freeTableStats(&stats));
+	TEST_CHECK(collectTableStats(table, NULL, &stats));
+	ASSERT_TRUE(stats.estTuples == 20000 && stats.mean[0] == 9999.5, "exact stats of a full scan");
+	TEST_CHECK(freeTableStats(&stats));
+
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_s"));
+	TEST_CHECK(shutdownRecordManager());
+	freeSchema(schema);
+	free(table);
+	TEST_DONE();
+}
+
+// inserted a record after a pause, while the test tailed the stream
+static void *
+delayedInsert (void *arg)
+{
+	LockTestArg *a = (LockTestArg *) arg;
+	Record *r;
+
+	usleep(50000);
+	r = testRecord(a->schema, a->value, "late", 0);
+	a->rc = insertRecord(a->table, r);
+	freeRecord(r);
+	return NULL;
+}
+
+void
+testChangeCapture(void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	RM_Transaction *txn;
+	CDC_Reader *reader;
+	CDC_Event ev;
+	LockTestArg arg;
+	pthread_t thread;
+	Schema *schema;
+	Record *r, *old;
+	RID rids[3];
+	int i, rc, size;
+
+	testName = "test change data capture";
+	schema = testSchema();
+	size = getRecordSize(schema);
+	unlink("test_table_c.cdc");
+	TEST_CHECK(initRecordManager(NULL));
+	TEST_CHECK(createTable("test_table_c",schema));
+	TEST_CHECK(openTable(table, "test_table_c"));
+	TEST_CHECK(enableChangeCapture(table, NULL));
+
+	for(i = 0; i < 3; i++)
+	{
+		r = testRecord(schema, i, "aaaa", i);
+		TEST_CHECK(insertRecord(table, r));
+		rids[i] = r->id;
+		freeRecord(r);
+	}
+	old = testRecord(schema, 1, "aaaa", 1);
+	r = testRecord(schema, 1, "bbbb", 10);
+	r->id = rids[1];
+	TEST_CHECK(updateRecord(table, r));
+	TEST_CHECK(deleteRecord(table, rids[2]));
+
+	// the stream held the changes in order with their images
+	TEST_CHECK(openChangeStream("test_table_c.cdc", 0, &reader));
+	for(i = 0; i < 3; i++)
+	{
+		TEST_CHECK(readChange(reader, &ev, 0));
+		ASSERT_TRUE(ev.seq == (uint64_t) i + 1 && ev.type == CDC_INSERT, "insert event");
+		ASSERT_TRUE(ev.before == NULL && ev.afterLen == size, "insert has an after image");
+	}
+	TEST_CHECK(readChange(reader, &ev, 0));
+	ASSERT_TRUE(ev.type == CDC_UPDATE && ev.id.page == rids[1].page && ev.id.slot == rids[1].slot, "update event");
+	ASSERT_TRUE(memcmp(ev.before, old->data, size) == 0, "update before image");
+	ASSERT_TRUE(memcmp(ev.after, r->data, size) == 0, "update after image");
+	TEST_CHECK(readChange(reader, &ev, 0));
+	ASSERT_TRUE(ev.seq == 5 && ev.type == CDC_DELETE && ev.after == NULL && ev.beforeLen == size, "delete event");
+	rc = readChange(reader, &ev, 0);
+	ASSERT_EQUALS_INT(RC_RM_NO_MORE_TUPLES, rc, "caught up");
+
+	// a tailing reader woke up for a new change
+	arg.table = table;
+	arg.schema = schema;
+	arg.value = 42;
+	pthread_create(&thread, NULL, delayedInsert, &arg);
+	TEST_CHECK(readChange(reader, &ev, 5000));
+	ASSERT_TRUE(ev.seq == 6 && ev.type == CDC_INSERT, "tailed insert");
+	pthread_join(thread, NULL);
+	TEST_CHECK(arg.rc);
+	TEST_CHECK(closeChangeStream(reader));
+
+	// an aborted transaction was followed by events undoing it
+	TEST_CHECK(beginTransaction(&txn));
+	TEST_CHECK(deleteRecord(table, rids[0]));
+	TEST_CHECK(abortTransaction(txn));
+
+	// sequence numbers went on after a reopen; reading could start anywhere
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(openTable(table, "test_table_c"));
+	TEST_CHECK(enableChangeCapture(table, NULL));
+	TEST_CHECK(deleteRecord(table, rids[0]));
+	TEST_CHECK(openChangeStream("test_table_c.cdc", 7, &reader));
+	TEST_CHECK(readChange(reader, &ev, 0));
+	ASSERT_TRUE(ev.seq == 7 && ev.type == CDC_DELETE, "transaction's delete");
+	TEST_CHECK(readChange(reader, &ev, 0));
+	ASSERT_TRUE(ev.seq == 8 && ev.type == CDC_INSERT && ev.id.slot == rids[0].slot, "abort re-inserted");
+	TEST_CHECK(readChange(reader, &ev, 0));
+	ASSERT_TRUE(ev.seq == 9 && ev.type == CDC_DELETE, "delete after reopen");
+	TEST_CHECK(closeChangeStream(reader));
+
+	freeRecord(r);
+	freeRecord(old);
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_c"));
+	TEST_CHECK(shutdownRecordManager());
+	unlink("test_table_c.cdc");
+	freeSchema(schema);
+	free(table);
+	TEST_DONE();
+}
+
+// counted the matches of cond with a full scan
+static int
+countByScan (RM_TableData *table, Expr *cond)
+{
+	RM_ScanHandle scan;
+	Record *r;
+	int n = 0;
+
+	createRecord(&r, table->schema);
+	startScan(table, &scan, cond);
+	while (next(&scan, r) == RC_OK)
+		n++;
+	closeScan(&scan);
+	freeRecord(r);
+	return n;
+}
+
+void
+testCountWhere(void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	char *conds[] = { "c = 3", "a < 500 AND c > 6", "a + c > 900", "b = 'bbbb' OR a = 7",
+			"c > 100 AND c < 0" };
+	int expected[] = { 100, 150, 103, 1, 0 };
+	RM_ScanHandle scan;
+	Schema *schema;
+	Record *r;
+	Expr *cond;
+	bool exists;
+	int i, n, rc;
+
+	testName = "test countWhere and existsWhere";
+	schema = testSchema();
+	TEST_CHECK(initRecordManager(NULL));
+	TEST_CHECK(createTable("test_table_n",schema));
+	TEST_CHECK(openTable(table, "test_table_n"));
+	for(i = 0; i < 1000; i++)
+	{
+		r = testRecord(schema, i, "aaaa", i % 10);
+		TEST_CHECK(insertRecord(table, r));
+		freeRecord(r);
+	}
+
+	TEST_CHECK(countWhere(table, NULL, &n));
+	ASSERT_EQUALS_INT(1000, n, "popcount of the slot directory");
+
+	// in-place evaluation agreed with a scan, compiled or not
+	for(i = 0; i < 5; i++)
+	{
+		TEST_CHECK(parseCondition(conds[i], schema, &cond));
+		TEST_CHECK(countWhere(table, cond, &n));
+		ASSERT_EQUALS_INT(expected[i], n, conds[i]);
+		rc = countByScan(table, cond);
+		ASSERT_EQUALS_INT(rc, n, "same count as a scan");
+		TEST_CHECK(existsWhere(table, cond, &exists));
+		ASSERT_TRUE(exists == (expected[i] > 0), "existence");
+		freeExpr(cond);
+	}
+
+	// deleted records were not counted
+	for(i = 0; i < 10; i++)
+	{
+		r = testRecord(schema, 0, "aaaa", 0);
+		TEST_CHECK(insertRecord(table, r));
+		TEST_CHECK(deleteRecord(table, r->id));
+		freeRecord(r);
+	}
+	TEST_CHECK(parseCondition("c = 0", schema, &cond));
+	TEST_CHECK(countWhere(table, cond, &n));
+	ASSERT_EQUALS_INT(100, n, "deleted records skipped");
+	freeExpr(cond);
+	TEST_CHECK(parseCondition("a = 999", schema, &cond));
+	TEST_CHECK(existsWhere(table, cond, &exists));
+	ASSERT_TRUE(exists, "last record found");
+	freeExpr(cond);
+	TEST_CHECK(countWhere(table, NULL, &n));
+	ASSERT_EQUALS_INT(getNumTuples(table), n, "popcount matched numTuples");
+
+	// a condition left to evalExpr that failed on a row failed the count and
+	// the scan with its error
+	TEST_CHECK(parseCondition("CAST(a / (c - 3) AS STRING) = '1'", schema, &cond));
+	rc = countWhere(table, cond, &n);
+	ASSERT_EQUALS_INT(RC_RM_DIVISION_BY_ZERO, rc, "count of a failing condition");
+	createRecord(&r, schema);
+	TEST_CHECK(startScan(table, &scan, cond));
+	while ((rc = next(&scan, r)) == RC_OK)
+		;
+	ASSERT_EQUALS_INT(RC_RM_DIVISION_BY_ZERO, rc, "scan of a failing condition");
+	TEST_CHECK(closeScan(&scan));
+	freeRecord(r);
+	freeExpr(cond);
+
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_n"));
+	TEST_CHECK(shutdownRecordManager());
+	freeSchema(schema);
+	free(table);
+	TEST_DONE();
+}
+
+void
+testAggregates(void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	char *names[] = { "a", "b", "e" };
+	DataType dt[] = { DT_INT, DT_STRING, DT_FLOAT };
+	int sizes[] = { 0, 3, 0 };
+	char **cpNames = (char **) malloc(sizeof(char*) * 3);
+	DataType *cpDt = (DataType *) malloc(sizeof(DataType) * 3);
+	int *cpSizes = (int *) malloc(sizeof(int) * 3);
+	int *cpKeys = (int *) malloc(sizeof(int));
+	int workers[] = { 1, 4 };
+	RM_Aggregate agg;
+	Schema *schema;
+	Record *r;
+	Value *v;
+	Expr *cond;
+	int i, rc;
+
+	testName = "test aggregates computed inside the scan";
+	for(i = 0; i < 3; i++)
+		cpNames[i] = strdup(names[i]);
+	memcpy(cpDt, dt, sizeof(dt));
+	memcpy(cpSizes, sizes, sizeof(sizes));
+	cpKeys[0] = 0;
+	schema = createSchema(3, cpNames, cpDt, cpSizes, 1, cpKeys);
+
+	// packed: e started at an unaligned offset
+	TEST_CHECK(initRecordManager(NULL));
+	TEST_CHECK(createTable("test_table_g", schema));
+	TEST_CHECK(openTable(table, "test_table_g"));
+	TEST_CHECK(createRecord(&r, schema));
+	for(i = 0; i < 5000; i++)
+	{
+		MAKE_VALUE(v, DT_INT, i - 1000);
+		TEST_CHECK(setAttr(r, schema, 0, v));
+		freeVal(v);
+		MAKE_STRING_VALUE(v, "xy");
+		TEST_CHECK(setAttr(r, schema, 1, v));
+		freeVal(v);
+		MAKE_VALUE(v, DT_FLOAT, i * 0.5);
+		TEST_CHECK(setAttr(r, schema, 2, v));
+		freeVal(v);
+		TEST_CHECK(insertRecord(table, r));
+	}
+
+	// one thread or several morsel workers, the same results
+	for(i = 0; i < 2; i++)
+	{
+		TEST_CHECK(aggregateWhere(table, NULL, 0, workers[i], &agg));
+		ASSERT_EQUALS_INT(5000, agg.count, "count of a");
+		ASSERT_TRUE(agg.sum == 7497500 && agg.min == -1000 && agg.max == 3999 && agg.avg == 1499.5,
+			"SUM/MIN/MAX/AVG of a");
+
+		TEST_CHECK(aggregateWhere(table, NULL, 2, workers[i], &agg));
+		ASSERT_TRUE(agg.sum == 6248750 && agg.min == 0 && agg.max == 2499.5 && agg.avg == 1249.75,
+			"SUM/MIN/MAX/AVG of the float e");
+
+		// a vectorized condition and one evaluated row by row
+		TEST_CHECK(parseCondition("a < 0", schema, &cond));
+		TEST_CHECK(aggregateWhere(table, cond, 0, workers[i], &agg));
+		ASSERT_TRUE(agg.count == 1000 && agg.sum == -500500 && agg.min == -1000 && agg.max == -1,
+			"aggregates of the negative a");
+		freeExpr(cond);
+		TEST_CHECK(parseCondition("a + 1 > 3000", schema, &cond));
+		TEST_CHECK(aggregateWhere(table, cond, 0, workers[i], &agg));
+		ASSERT_TRUE(agg.count == 1000 && agg.sum == 3499500 && agg.min == 3000 && agg.max == 3999,
+			"aggregates of a over 2999");
+		freeExpr(cond);
+	}
+
+	TEST_CHECK(parseCondition("a > 100000", schema, &cond));
+	TEST_CHECK(aggregateWhere(table, cond, 2, 3, &agg));
+	ASSERT_TRUE(agg.count == 0 && agg.sum == 0 && agg.min == 0 && agg.avg == 0, "nothing matched");
+	freeExpr(cond);
+	rc = aggregateWhere(table, NULL, 1, 1, &agg);
+	ASSERT_EQUALS_INT(RC_RM_ARITH_ARG_IS_NOT_NUMERIC, rc, "string attribute rejected");
+
+	freeRecord(r);
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_g"));
+	TEST_CHECK(shutdownRecordManager());
+	freeSchema(schema);
+	free(table);
+	TEST_DONE();
+}
+
+// counted the records of a distinct scan, failing on a key seen twice;
+// key numbered the key of a record below maxKey
+static int
+countDistinct (RM_TableData *table, Expr *cond, int numAttrs, int *attrs, size_t budget, int maxKey,
+		int (*key) (Record *r), int *spilled)
+{
+	RM_DistinctScan *d;
+	Record *r;
+	char *seen = (char *) calloc(maxKey, 1);
+	bool unique = true;
+	int n = 0, rc;
+
+	createRecord(&r, table->schema);
+	TEST_CHECK(startDistinct(table, cond, numAttrs, attrs, budget, &d));
+	while((rc = nextDistinct(d, r)) == RC_OK)
+	{
+		int k = key(r);
+		if (k < 0 || k >= maxKey || seen[k])
+			unique = false;
+		else
+			seen[k] = 1;
+		n++;
+	}
+	ASSERT_EQUALS_INT(RC_RM_NO_MORE_TUPLES, rc, "distinct scan ended normally");
+	ASSERT_TRUE(unique, "each key returned once");
+	*spilled = getNumSpilledRecords(d);
+	TEST_CHECK(closeDistinct(d));
+	freeRecord(r);
+	free(seen);
+	return n;
+}
+
+static int
+keyOfA (Record *r)
+{
+	int a;
+	memcpy(&a, r->data, sizeof(int));
+	return a;
+}
+
+static int
+keyOfC (Record *r)
+{
+	int c;
+	memcpy(&c, r->data + 8, sizeof(int));
+	return c;
+}
+
+static int
+keyOfBC (Record *r)
+{
+	int c;
+	memcpy(&c, r->data + 8, sizeof(int));
+	return (r->data[4] - 'a') * 50 + c;
+}
+
+void
+testDistinct(void)
+{
+	RM_TableData *table = (RM_TableData *) malloc(sizeof(RM_TableData));
+	char *bs[] = { "aaaa", "bbbb", "cccc" };
+	int attrA[] = { 0 }, attrC[] = { 2 }, attrBC[] = { 1, 2 };
+	Schema *schema;
+	Record *r;
+	Expr *cond;
+	double est;
+	int i, n, spilled;
+
+	testName = "test distinct scans and estimates";
+	schema = testSchema();
+	TEST_CHECK(initRecordManager(NULL));
+	TEST_CHECK(createTable("test_table_d",schema));
+	TEST_CHECK(openTable(table, "test_table_d"));
+	for(i = 0; i < 3100; i++)
+	{
+		// the last 100 records repeated the first 100
+		r = testRecord(schema, i % 3000, bs[i % 3000 % 3], i % 3000 % 50);
+		TEST_CHECK(insertRecord(table, r));
+		freeRecord(r);
+	}
+
+	// fitting in memory
+	n = countDistinct(table, NULL, 1, attrC, 0, 50, keyOfC, &spilled);
+	ASSERT_EQUALS_INT(50, n, "distinct c");
+	ASSERT_EQUALS_INT(0, spilled, "nothing spilled");
+	n = countDistinct(table, NULL, 0, NULL, 0, 3000, keyOfA, &spilled);
+	ASSERT_EQUALS_INT(3000, n, "distinct whole records");
+
+	// the smallest budget spilled, recursively for 3000 keys
+	n = countDistinct(table, NULL, 2, attrBC, 1, 150, keyOfBC, &spilled);
+	ASSERT_EQUALS_INT(150, n, "distinct (b, c) after spilling");
+	ASSERT_TRUE(spilled > 0, "(b, c) spilled");
+	n = countDistinct(table, NULL, 1, attrA, 1, 3000, keyOfA, &spilled);
+	ASSERT_EQUALS_INT(3000, n, "distinct a after spilling");
+	ASSERT_TRUE(spilled > 3000, "a spilled more than once");
+
+	TEST_CHECK(parseCondition("c = 7", schema, &cond));
+	n = countDistinct(table, cond, 1, attrA, 1, 3000, keyOfA, &spilled);
+	ASSERT_EQUALS_INT(60, n, "distinct a of the matching records");
+
+	// HyperLogLog estimates
+	TEST_CHECK(estimateDistinct(table, cond, 1, attrA, &est));
+	ASSERT_TRUE(est > 57 && est < 63, "estimate of a few keys");
+	freeExpr(cond);
+	TEST_CHECK(estimateDistinct(table, NULL, 1, attrA, &est));
+	ASSERT_TRUE(est > 2850 && est < 3150, "estimate within 5%");
+	TEST_CHECK(estimateDistinct(table, NULL, 2, attrBC, &est));
+	ASSERT_TRUE(est > 145 && est < 155, "estimate of (b, c)");
+
+	TEST_CHECK(closeTable(table));
+	TEST_CHECK(deleteTable("test_table_d"));
+	TEST_CHECK(shutdownRecordManager());
+	freeSchema(schema);
+	free(table);
+	TEST_DONE();
+}
+
 void 
 testUpdateTable (void)
 {
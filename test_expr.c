@@ -1,5 +1,13 @@
+#include <limits.h>
+#include <stdint.h>
+#include "arena.h"
 #include "dberror.h"
 #include "expr.h"
+#include "expr_compile.h"
+#include "expr_optimize.h"
+#include "expr_parser.h"
+#include "pred_simd.h"
+#include "value_set.h"
 #include "record_mgr.h"
 #include "tables.h"
 #include "test_helper.h"
@@ -29,6 +37,21 @@
 static void testValueSerialize (void);
 static void testOperators (void);
 static void testExpressions (void);
+static void testCompiledPredicates (void);
+static void testShortCircuit (void);
+static void testAdaptiveTermOrder (void);
+static void testSelectionBitmaps (void);
+static void testRichComparisons (void);
+static void testOptimizer (void);
+static void testFixedLengthStrings (void);
+static void testConditionParser (void);
+static void testArithmetic (void);
+static void testArena (void);
+
+// helpers
+static Schema *exprSchema (void);
+static Schema *intPairSchema (void);
+static void checkCompiled (Expr *expr, Record *record, Schema *schema, char *message);
 
 char *testName;
 
@@ -41,6 +64,16 @@ main (void)
 	testValueSerialize();
 	testOperators();
 	testExpressions();
+	testCompiledPredicates();
+	testShortCircuit();
+	testAdaptiveTermOrder();
+	testSelectionBitmaps();
+	testRichComparisons();
+	testOptimizer();
+	testFixedLengthStrings();
+	testConditionParser();
+	testArithmetic();
+	testArena();
 
 	return 0;
 }
@@ -78,6 +111,8 @@ testOperators (void)
 	// smaller
 	OP_TRUE(stringToValue("i3"),stringToValue("i10"), valueSmaller, "3 < 10");
 	OP_TRUE(stringToValue("f5.0"),stringToValue("f6.5"), valueSmaller, "5.0 < 6.5");
+	OP_TRUE(stringToValue("bf"),stringToValue("bt"), valueSmaller, "f < t");
+	OP_FALSE(stringToValue("bt"),stringToValue("bf"), valueSmaller, "t < f is false");
 
 	// boolean
 	OP_TRUE(stringToValue("bt"),stringToValue("bt"), boolAnd, "t AND t = t");
@@ -123,3 +158,1178 @@ testExpressions (void)
 
 	TEST_DONE();
 }
+
+// ************************************************************
+void
+testCompiledPredicates (void)
+{
+	Schema *schema;
+	Record *r;
+	Expr *a, *b, *c, *d, *op, *l, *rhs;
+	Value slot;
+	PredProgram *prog;
+	bool pass;
+	testName = "test compiled predicates against evalExpr";
+
+	schema = exprSchema();
+	TEST_CHECK(createRecord(&r, schema));
+	TEST_CHECK(setAttr(r, schema, 0, stringToValue("i7")));
+	TEST_CHECK(setAttr(r, schema, 1, stringToValue("sab")));
+	TEST_CHECK(setAttr(r, schema, 2, stringToValue("f2.5")));
+	TEST_CHECK(setAttr(r, schema, 3, stringToValue("bt")));
+
+	// every comparison type, with constants on either side
+	MAKE_ATTRREF(a, 0);
+	MAKE_CONS(l, stringToValue("i7"));
+	MAKE_BINOP_EXPR(op, a, l, OP_COMP_EQUAL);
+	checkCompiled(op, r, schema, "a = 7");
+	freeExpr(op);
+
+	MAKE_ATTRREF(a, 0);
+	MAKE_CONS(l, stringToValue("i9"));
+	MAKE_BINOP_EXPR(op, l, a, OP_COMP_SMALLER);
+	checkCompiled(op, r, schema, "9 < a");
+	freeExpr(op);
+
+	MAKE_ATTRREF(b, 1);
+	MAKE_CONS(l, stringToValue("sab"));
+	MAKE_BINOP_EXPR(op, b, l, OP_COMP_EQUAL);
+	checkCompiled(op, r, schema, "b = 'ab'");
+	freeExpr(op);
+
+	MAKE_ATTRREF(b, 1);
+	MAKE_CONS(l, stringToValue("sabc"));
+	MAKE_BINOP_EXPR(op, b, l, OP_COMP_SMALLER);
+	checkCompiled(op, r, schema, "b < 'abc'");
+	freeExpr(op);
+
+	MAKE_ATTRREF(b, 1);
+	MAKE_CONS(l, stringToValue("sabcdef"));
+	MAKE_BINOP_EXPR(op, l, b, OP_COMP_SMALLER);
+	checkCompiled(op, r, schema, "'abcdef' < b");
+	freeExpr(op);
+
+	MAKE_ATTRREF(c, 2);
+	MAKE_CONS(l, stringToValue("f3.0"));
+	MAKE_BINOP_EXPR(op, c, l, OP_COMP_SMALLER);
+	checkCompiled(op, r, schema, "c < 3.0");
+	freeExpr(op);
+
+	// boolean connectives over several attributes
+	MAKE_ATTRREF(d, 3);
+	MAKE_CONS(l, stringToValue("bt"));
+	MAKE_BINOP_EXPR(rhs, d, l, OP_COMP_EQUAL);
+	MAKE_ATTRREF(a, 0);
+	MAKE_CONS(l, stringToValue("i5"));
+	MAKE_BINOP_EXPR(op, a, l, OP_COMP_SMALLER);
+	MAKE_UNOP_EXPR(l, op, OP_BOOL_NOT);
+	MAKE_BINOP_EXPR(op, l, rhs, OP_BOOL_AND);
+	checkCompiled(op, r, schema, "NOT(a < 5) AND d = true");
+	freeExpr(op);
+
+	// a parameter took the type of the attribute it was compared with
+	slot.dt = DT_INT;
+	slot.v.intV = 7;
+	MAKE_ATTRREF(a, 0);
+	MAKE_PARAM(l, &slot);
+	MAKE_BINOP_EXPR(op, l, a, OP_COMP_EQUAL);
+	TEST_CHECK(compilePredicate(op, schema, &prog));
+	TEST_CHECK(evalPredicate(prog, r->data, &pass));
+	ASSERT_TRUE(pass, "? = a with ? bound to 7");
+	slot.v.intV = 8;
+	TEST_CHECK(evalPredicate(prog, r->data, &pass));
+	ASSERT_TRUE(!pass, "? = a with ? rebound to 8");
+	slot.dt = DT_FLOAT;
+	ASSERT_ERROR(evalPredicate(prog, r->data, &pass), "parameter of the wrong type");
+	freePredicate(prog);
+	freeExpr(op);
+
+	// an INT bound where the program loaded a FLOAT was widened, as evalExpr did
+	slot.dt = DT_FLOAT;
+	slot.v.floatV = 1.0;
+	MAKE_ATTRREF(c, 2);
+	MAKE_PARAM(l, &slot);
+	MAKE_BINOP_EXPR(rhs, c, l, OP_ARITH_MUL);
+	MAKE_CONS(l, stringToValue("f4.0"));
+	MAKE_BINOP_EXPR(op, rhs, l, OP_COMP_GREATER);
+	TEST_CHECK(compilePredicate(op, schema, &prog));
+	slot.dt = DT_INT;
+	slot.v.intV = 2;
+	TEST_CHECK(evalPredicate(prog, r->data, &pass));
+	ASSERT_TRUE(pass, "c * ? > 4.0 with ? rebound to the INT 2");
+	checkCompiled(op, r, schema, "c * ? > 4.0 compiled with an INT bound");
+	freePredicate(prog);
+	freeExpr(op);
+
+	// mixed types were left to evalExpr
+	MAKE_ATTRREF(a, 0);
+	MAKE_CONS(l, stringToValue("f7.0"));
+	MAKE_BINOP_EXPR(op, a, l, OP_COMP_EQUAL);
+	ASSERT_ERROR(compilePredicate(op, schema, &prog), "INT = FLOAT did not compile");
+	ASSERT_TRUE(prog == NULL, "no program for a rejected condition");
+	freeExpr(op);
+
+	freeRecord(r);
+	freeSchema(schema);
+	TEST_DONE();
+}
+
+// ************************************************************
+void
+testShortCircuit (void)
+{
+	Schema *schema;
+	Record *r;
+	Expr *terms[4], *op, *inner, *a, *l;
+	Value *res;
+	Value slot;
+	PredProgram *prog;
+	bool pass;
+	int i;
+	testName = "test short-circuit and n-ary AND/OR";
+
+	schema = exprSchema();
+	TEST_CHECK(createRecord(&r, schema));
+	TEST_CHECK(setAttr(r, schema, 0, stringToValue("i7")));
+
+	// the right side compared INT with FLOAT and would fail if evaluated
+	MAKE_CONS(terms[0], stringToValue("bf"));
+	MAKE_ATTRREF(a, 0);
+	MAKE_CONS(l, stringToValue("f1.0"));
+	MAKE_BINOP_EXPR(terms[1], a, l, OP_COMP_EQUAL);
+	MAKE_BINOP_EXPR(op, terms[0], terms[1], OP_BOOL_AND);
+	TEST_CHECK(evalExpr(r, schema, op, &res));
+	ASSERT_TRUE(!res->v.boolV, "false AND <error> = false");
+	freeVal(res);
+	op->expr.op->type = OP_BOOL_OR;
+	op->expr.op->args[0]->expr.cons->v.boolV = TRUE;
+	TEST_CHECK(evalExpr(r, schema, op, &res));
+	ASSERT_TRUE(res->v.boolV, "true OR <error> = true");
+	freeVal(res);
+	freeExpr(op);
+
+	// the compiled program never loaded the mistyped parameter
+	slot.dt = DT_FLOAT;
+	slot.v.floatV = 1.0;
+	MAKE_CONS(terms[0], stringToValue("bf"));
+	MAKE_ATTRREF(a, 0);
+	MAKE_PARAM(l, &slot);
+	MAKE_BINOP_EXPR(terms[1], a, l, OP_COMP_EQUAL);
+	MAKE_BINOP_EXPR(op, terms[0], terms[1], OP_BOOL_AND);
+	TEST_CHECK(compilePredicate(op, schema, &prog));
+	TEST_CHECK(evalPredicate(prog, r->data, &pass));
+	ASSERT_TRUE(!pass, "compiled false AND <error> = false");
+	freePredicate(prog);
+	freeExpr(op);
+
+	// ((t1 AND t2) AND t3) AND t4 flattened into one four-way AND
+	for (i = 0; i < 4; i++)
+	{
+		MAKE_ATTRREF(a, 0);
+		MAKE_VALUE(res, DT_INT, 4 + i * 2);
+		MAKE_CONS(l, res);
+		MAKE_BINOP_EXPR(terms[i], l, a, OP_COMP_SMALLER);
+	}
+	MAKE_BINOP_EXPR(inner, terms[0], terms[1], OP_BOOL_AND);
+	MAKE_BINOP_EXPR(op, inner, terms[2], OP_BOOL_AND);
+	MAKE_BINOP_EXPR(inner, op, terms[3], OP_BOOL_AND);
+	op = inner;
+	checkCompiled(op, r, schema, "4 < a AND 6 < a AND 8 < a AND 10 < a");
+	TEST_CHECK(flattenExpr(op));
+	ASSERT_EQUALS_INT(4, op->expr.op->numArgs, "flattened AND has four arguments");
+	checkCompiled(op, r, schema, "flattened chain evaluated the same");
+	freeExpr(op);
+
+	for (i = 0; i < 4; i++)
+	{
+		MAKE_ATTRREF(a, 0);
+		MAKE_VALUE(res, DT_INT, 5 + i);
+		MAKE_CONS(l, res);
+		MAKE_BINOP_EXPR(terms[i], a, l, OP_COMP_EQUAL);
+	}
+	MAKE_NARY_EXPR(op, terms, 4, OP_BOOL_OR);
+	checkCompiled(op, r, schema, "a = 5 OR a = 6 OR a = 7 OR a = 8");
+	freeExpr(op);
+
+	freeRecord(r);
+	freeSchema(schema);
+	TEST_DONE();
+}
+
+// ************************************************************
+void
+testAdaptiveTermOrder (void)
+{
+	Schema *schema;
+	Record *r;
+	Expr *terms[2], *op, *a, *l;
+	PredProgram *prog;
+	PredRuntime *rt;
+	bool pass, expected;
+	int i, order[PRED_MAX_TERMS], mismatches = 0, matches = 0;
+	char name[8];
+	testName = "test selectivity-driven reordering of conjuncts";
+
+	schema = exprSchema();
+	TEST_CHECK(createRecord(&r, schema));
+
+	// b < 'zz' passed almost always and compared strings; a = 17 passed rarely
+	MAKE_ATTRREF(a, 1);
+	MAKE_CONS(l, stringToValue("szz"));
+	MAKE_BINOP_EXPR(terms[0], a, l, OP_COMP_SMALLER);
+	MAKE_ATTRREF(a, 0);
+	MAKE_CONS(l, stringToValue("i17"));
+	MAKE_BINOP_EXPR(terms[1], a, l, OP_COMP_EQUAL);
+	MAKE_NARY_EXPR(op, terms, 2, OP_BOOL_AND);
+
+	TEST_CHECK(compilePredicate(op, schema, &prog));
+	TEST_CHECK(createPredRuntime(prog, &rt));
+	ASSERT_EQUALS_INT(2, getPredTermOrder(rt, order), "two terms");
+	ASSERT_EQUALS_INT(0, order[0], "written order before any rows");
+
+	for (i = 0; i < 3 * PRED_REORDER_INTERVAL; i++)
+	{
+		Value *v;
+		MAKE_VALUE(v, DT_INT, i % 100);
+		TEST_CHECK(setAttr(r, schema, 0, v));
+		freeVal(v);
+		sprintf(name, "s%c%c", 'a' + i % 26, 'a' + i % 7);
+		v = stringToValue(name);
+		TEST_CHECK(setAttr(r, schema, 1, v));
+		freeVal(v);
+
+		TEST_CHECK(evalPredicate(prog, r->data, &expected));
+		TEST_CHECK(evalPredicateAdaptive(prog, rt, r->data, &pass));
+		if (pass != expected)
+			mismatches++;
+		if (pass)
+			matches++;
+	}
+	ASSERT_EQUALS_INT(0, mismatches, "adaptive order returned the same results");
+	ASSERT_TRUE(matches > 0, "some rows matched");
+	getPredTermOrder(rt, order);
+	ASSERT_EQUALS_INT(1, order[0], "selective a = 17 moved to the front");
+
+	freePredRuntime(rt);
+	freePredicate(prog);
+	freeExpr(op);
+	freeRecord(r);
+	freeSchema(schema);
+
+	// b != 0 passed almost always and a / b > 1 rarely, but the division
+	// could fail, so it stayed behind the guard and b = 0 was never divided by
+	schema = intPairSchema();
+	TEST_CHECK(createRecord(&r, schema));
+	TEST_CHECK(parseCondition("b != 0 AND a / b > 1", schema, &op));
+	TEST_CHECK(compilePredicate(op, schema, &prog));
+	TEST_CHECK(createPredRuntime(prog, &rt));
+	mismatches = 0;
+	for (i = 0; i < 3 * PRED_REORDER_INTERVAL; i++)
+	{
+		Value *v;
+		RC rc;
+		MAKE_VALUE(v, DT_INT, i % 10);
+		TEST_CHECK(setAttr(r, schema, 0, v));
+		freeVal(v);
+		MAKE_VALUE(v, DT_INT, (i % 500 == 499) ? 0 : 3 + i % 5);
+		TEST_CHECK(setAttr(r, schema, 1, v));
+		freeVal(v);
+
+		TEST_CHECK(evalPredicate(prog, r->data, &expected));
+		rc = evalPredicateAdaptive(prog, rt, r->data, &pass);
+		if (rc != RC_OK || pass != expected)
+			mismatches++;
+	}
+	ASSERT_EQUALS_INT(0, mismatches, "guarded division never failed and agreed with the written order");
+	getPredTermOrder(rt, order);
+	ASSERT_TRUE(order[0] == 0 && order[1] == 1, "the division was not moved past its guard");
+
+	freePredRuntime(rt);
+	freePredicate(prog);
+	freeExpr(op);
+	freeRecord(r);
+	freeSchema(schema);
+	TEST_DONE();
+}
+
+// ************************************************************
+void
+testSelectionBitmaps (void)
+{
+	Schema *schema;
+	Record rec;
+	Expr *terms[2], *op, *inner, *a, *l;
+	PredProgram *prog;
+	uint64_t sel[SEL_WORDS(300)];
+	Value slot;
+	int ints[100], recSize, i, mismatches = 0;
+	char *rows, name[8];
+	bool pass;
+	testName = "test vectorized selection bitmaps";
+
+	// columnar kernel and bitmap helpers
+	for (i = 0; i < 100; i++)
+		ints[i] = i;
+	selCompareInt((char *) ints, sizeof(int), 100, SEL_LT, 37, sel);
+	ASSERT_EQUALS_INT(37, selCount(sel, 100), "37 values < 37");
+	ASSERT_EQUALS_INT(-1, selNext(sel, 100, 37), "no match at or after 37");
+	selNot(sel, 100);
+	ASSERT_EQUALS_INT(63, selCount(sel, 100), "NOT kept the tail clear");
+	ASSERT_EQUALS_INT(37, selNext(sel, 100, 0), "first value >= 37");
+
+	// (a < 50 AND d = true) OR b = 'ab' over 300 records
+	schema = exprSchema();
+	recSize = getRecordSize(schema);
+	rows = (char *) calloc(300, recSize);
+	for (i = 0; i < 300; i++)
+	{
+		Value *v;
+		rec.data = rows + i * recSize;
+		MAKE_VALUE(v, DT_INT, i % 97);
+		TEST_CHECK(setAttr(&rec, schema, 0, v));
+		freeVal(v);
+		sprintf(name, "s%c%c", 'a' + i % 3, 'a' + i % 5);
+		v = stringToValue(name);
+		TEST_CHECK(setAttr(&rec, schema, 1, v));
+		freeVal(v);
+		MAKE_VALUE(v, DT_FLOAT, i / 10.0);
+		TEST_CHECK(setAttr(&rec, schema, 2, v));
+		freeVal(v);
+		v = stringToValue((i % 4 == 0) ? "bt" : "bf");
+		TEST_CHECK(setAttr(&rec, schema, 3, v));
+		freeVal(v);
+	}
+
+	MAKE_ATTRREF(a, 0);
+	MAKE_CONS(l, stringToValue("i50"));
+	MAKE_BINOP_EXPR(terms[0], a, l, OP_COMP_SMALLER);
+	MAKE_ATTRREF(a, 3);
+	MAKE_CONS(l, stringToValue("bt"));
+	MAKE_BINOP_EXPR(terms[1], a, l, OP_COMP_EQUAL);
+	MAKE_NARY_EXPR(inner, terms, 2, OP_BOOL_AND);
+	MAKE_ATTRREF(a, 1);
+	MAKE_CONS(l, stringToValue("sab"));
+	MAKE_BINOP_EXPR(terms[0], a, l, OP_COMP_EQUAL);
+	MAKE_BINOP_EXPR(op, inner, terms[0], OP_BOOL_OR);
+
+	TEST_CHECK(compilePredicate(op, schema, &prog));
+	ASSERT_TRUE(predicateIsVectorized(prog), "condition had a selection plan");
+	TEST_CHECK(evalPredicateBatch(prog, rows, recSize, 300, sel));
+	for (i = 0; i < 300; i++)
+	{
+		TEST_CHECK(evalPredicate(prog, rows + i * recSize, &pass));
+		if (pass != ((sel[i >> 6] >> (i & 63)) & 1))
+			mismatches++;
+	}
+	ASSERT_EQUALS_INT(0, mismatches, "bitmap matched row-at-a-time evaluation");
+	ASSERT_TRUE(selCount(sel, 300) > 0, "some rows matched");
+	freePredicate(prog);
+	freeExpr(op);
+
+	// NOT (c < 2.5) over the same rows
+	MAKE_ATTRREF(a, 2);
+	MAKE_CONS(l, stringToValue("f2.5"));
+	MAKE_BINOP_EXPR(inner, a, l, OP_COMP_SMALLER);
+	MAKE_UNOP_EXPR(op, inner, OP_BOOL_NOT);
+	TEST_CHECK(compilePredicate(op, schema, &prog));
+	TEST_CHECK(evalPredicateBatch(prog, rows, recSize, 300, sel));
+	ASSERT_EQUALS_INT(275, selCount(sel, 300), "275 rows with c >= 2.5");
+	freePredicate(prog);
+	freeExpr(op);
+
+	// c < ? compiled for a FLOAT and then bound to the INT 3
+	slot.dt = DT_FLOAT;
+	slot.v.floatV = 0.0;
+	MAKE_ATTRREF(a, 2);
+	MAKE_PARAM(l, &slot);
+	MAKE_BINOP_EXPR(op, a, l, OP_COMP_SMALLER);
+	TEST_CHECK(compilePredicate(op, schema, &prog));
+	ASSERT_TRUE(predicateIsVectorized(prog), "parameter leaf had a selection plan");
+	slot.dt = DT_INT;
+	slot.v.intV = 3;
+	TEST_CHECK(evalPredicateBatch(prog, rows, recSize, 300, sel));
+	ASSERT_EQUALS_INT(30, selCount(sel, 300), "30 rows with c < 3");
+	freePredicate(prog);
+	freeExpr(op);
+
+	free(rows);
+	freeSchema(schema);
+	TEST_DONE();
+}
+
+// ************************************************************
+void
+testRichComparisons (void)
+{
+	Schema *schema;
+	Record rec;
+	Expr *op, *a, *l, *h;
+	Value *res, *vals[1000];
+	ValueSet *set;
+	PredProgram *prog;
+	uint64_t sel[SEL_WORDS(200)];
+	OpType ops[] = { OP_COMP_GREATER, OP_COMP_SMALLER_EQUAL, OP_COMP_GREATER_EQUAL, OP_COMP_NOT_EQUAL };
+	char *consts[] = { "i3", "sab", "f2.5", "bt" };
+	int recSize, i, j, k, mismatches = 0;
+	char *rows, name[8];
+	bool pass;
+	testName = "test >, <=, >=, !=, BETWEEN and IN";
+
+	// value-level comparisons
+	MAKE_VALUE(res, DT_INT, 0);
+	TEST_CHECK(valueCompare(OP_COMP_GREATER, stringToValue("i10"), stringToValue("i3"), res));
+	ASSERT_TRUE(res->v.boolV, "10 > 3");
+	TEST_CHECK(valueCompare(OP_COMP_SMALLER_EQUAL, stringToValue("f2.5"), stringToValue("f2.5"), res));
+	ASSERT_TRUE(res->v.boolV, "2.5 <= 2.5");
+	TEST_CHECK(valueCompare(OP_COMP_GREATER_EQUAL, stringToValue("sab"), stringToValue("sac"), res));
+	ASSERT_TRUE(!res->v.boolV, "not ab >= ac");
+	TEST_CHECK(valueCompare(OP_COMP_NOT_EQUAL, stringToValue("bt"), stringToValue("bf"), res));
+	ASSERT_TRUE(res->v.boolV, "t != f");
+	ASSERT_TRUE(valueCompare(OP_COMP_GREATER, stringToValue("i1"), stringToValue("f1.0"), res) != RC_OK,
+		"comparing different datatypes fails");
+	freeVal(res);
+
+	// 200 records; every operator on every attribute compiled, batched and
+	// interpreted with the same results
+	schema = exprSchema();
+	recSize = getRecordSize(schema);
+	rows = (char *) calloc(200, recSize);
+	for (i = 0; i < 200; i++)
+	{
+		Value *v;
+		rec.data = rows + i * recSize;
+		MAKE_VALUE(v, DT_INT, i % 7);
+		TEST_CHECK(setAttr(&rec, schema, 0, v));
+		freeVal(v);
+		sprintf(name, "s%c%c", 'a' + i % 2, 'a' + i % 3);
+		v = stringToValue(name);
+		TEST_CHECK(setAttr(&rec, schema, 1, v));
+		freeVal(v);
+		MAKE_VALUE(v, DT_FLOAT, (i % 11) / 2.0);
+		TEST_CHECK(setAttr(&rec, schema, 2, v));
+		freeVal(v);
+		v = stringToValue((i % 3 == 0) ? "bt" : "bf");
+		TEST_CHECK(setAttr(&rec, schema, 3, v));
+		freeVal(v);
+	}
+
+	for (j = 0; j < 4; j++)
+		for (k = 0; k < 4; k++)
+			for (int right = 0; right < 2; right++)
+			{
+				MAKE_ATTRREF(a, k);
+				MAKE_CONS(l, stringToValue(consts[k]));
+				if (right)
+					MAKE_BINOP_EXPR(op, l, a, ops[j]);
+				else
+					MAKE_BINOP_EXPR(op, a, l, ops[j]);
+				TEST_CHECK(compilePredicate(op, schema, &prog));
+				TEST_CHECK(evalPredicateBatch(prog, rows, recSize, 200, sel));
+				for (i = 0; i < 200; i++)
+				{
+					rec.data = rows + i * recSize;
+					TEST_CHECK(evalPredicate(prog, rec.data, &pass));
+					TEST_CHECK(evalExpr(&rec, schema, op, &res));
+					if (pass != res->v.boolV || pass != ((sel[i >> 6] >> (i & 63)) & 1))
+						mismatches++;
+					freeVal(res);
+				}
+				freePredicate(prog);
+				freeExpr(op);
+			}
+	ASSERT_EQUALS_INT(0, mismatches, "comparisons agreed in all evaluators");
+
+	// a BETWEEN 2 AND 4
+	MAKE_ATTRREF(a, 0);
+	MAKE_CONS(l, stringToValue("i2"));
+	MAKE_CONS(h, stringToValue("i4"));
+	MAKE_BETWEEN_EXPR(op, a, l, h);
+	TEST_CHECK(compilePredicate(op, schema, &prog));
+	ASSERT_TRUE(predicateIsVectorized(prog), "INT BETWEEN had a selection plan");
+	TEST_CHECK(evalPredicateBatch(prog, rows, recSize, 200, sel));
+	for (i = 0, k = 0; i < 200; i++)
+	{
+		rec.data = rows + i * recSize;
+		TEST_CHECK(evalExpr(&rec, schema, op, &res));
+		k += res->v.boolV;
+		freeVal(res);
+	}
+	ASSERT_EQUALS_INT(86, k, "86 rows with a in [2, 4]");
+	ASSERT_EQUALS_INT(86, selCount(sel, 200), "bitmap agreed");
+	freePredicate(prog);
+	freeExpr(op);
+
+	// b IN ('ab', 'ba', 'zz')
+	vals[0] = stringToValue("sab");
+	vals[1] = stringToValue("sba");
+	vals[2] = stringToValue("szz");
+	TEST_CHECK(createValueSet(DT_STRING, vals, 3, &set));
+	for (i = 0; i < 3; i++)
+		freeVal(vals[i]);
+	MAKE_ATTRREF(a, 1);
+	MAKE_VALUESET(l, set);
+	MAKE_BINOP_EXPR(op, a, l, OP_COMP_IN);
+	TEST_CHECK(compilePredicate(op, schema, &prog));
+	TEST_CHECK(evalPredicateBatch(prog, rows, recSize, 200, sel));
+	for (i = 0, k = 0, mismatches = 0; i < 200; i++)
+	{
+		rec.data = rows + i * recSize;
+		TEST_CHECK(evalPredicate(prog, rec.data, &pass));
+		TEST_CHECK(evalExpr(&rec, schema, op, &res));
+		if (pass != res->v.boolV)
+			mismatches++;
+		k += pass;
+		freeVal(res);
+	}
+	ASSERT_EQUALS_INT(0, mismatches, "compiled IN agreed with evalExpr");
+	ASSERT_EQUALS_INT(66, k, "66 rows with b in the set");
+	ASSERT_EQUALS_INT(66, selCount(sel, 200), "bitmap agreed");
+	freePredicate(prog);
+	freeExpr(op);
+
+	// a 1000-value IN list on INT, with duplicates
+	for (i = 0; i < 1000; i++)
+		MAKE_VALUE(vals[i], DT_INT, (i % 500) * 3);
+	TEST_CHECK(createValueSet(DT_INT, vals, 1000, &set));
+	ASSERT_EQUALS_INT(500, valueSetSize(set), "duplicates stored once");
+	for (i = 0, k = 0; i < 1500; i++)
+		k += valueSetContainsInt(set, i);
+	ASSERT_EQUALS_INT(500, k, "every multiple of 3 below 1500 found");
+	ASSERT_TRUE(!valueSetContainsInt(set, -3), "-3 not found");
+	freeValueSet(set);
+	ASSERT_TRUE(createValueSet(DT_FLOAT, vals, 1000, &set) != RC_OK, "set of the wrong datatype fails");
+	for (i = 0; i < 1000; i++)
+		freeVal(vals[i]);
+
+	free(rows);
+	freeSchema(schema);
+	TEST_DONE();
+}
+
+// ************************************************************
+void
+testOptimizer (void)
+{
+	Schema *schema;
+	Record *r;
+	Expr *op, *opt, *a, *l, *rhs, *terms[3];
+	Value *res, *resOpt;
+	int i, mismatches = 0;
+	testName = "test constant folding and normalization";
+
+	schema = exprSchema();
+
+	// (1 < 2) AND a = 5 became a = 5
+	MAKE_CONS(l, stringToValue("i1"));
+	MAKE_CONS(rhs, stringToValue("i2"));
+	MAKE_BINOP_EXPR(terms[0], l, rhs, OP_COMP_SMALLER);
+	MAKE_ATTRREF(a, 0);
+	MAKE_CONS(l, stringToValue("i5"));
+	MAKE_BINOP_EXPR(terms[1], a, l, OP_COMP_EQUAL);
+	MAKE_NARY_EXPR(op, terms, 2, OP_BOOL_AND);
+	TEST_CHECK(optimizeExpr(&op, schema));
+	ASSERT_TRUE(op->type == EXPR_OP && op->expr.op->type == OP_COMP_EQUAL, "true dropped from AND");
+	freeExpr(op);
+
+	// NOT NOT (a = 5) became a = 5
+	MAKE_ATTRREF(a, 0);
+	MAKE_CONS(l, stringToValue("i5"));
+	MAKE_BINOP_EXPR(op, a, l, OP_COMP_EQUAL);
+	MAKE_UNOP_EXPR(opt, op, OP_BOOL_NOT);
+	MAKE_UNOP_EXPR(op, opt, OP_BOOL_NOT);
+	TEST_CHECK(optimizeExpr(&op, schema));
+	ASSERT_TRUE(op->type == EXPR_OP && op->expr.op->type == OP_COMP_EQUAL, "double NOT removed");
+	freeExpr(op);
+
+	// NOT (a < 5 OR 'ab' = b) became a >= 5 AND b != 'ab'
+	MAKE_ATTRREF(a, 0);
+	MAKE_CONS(l, stringToValue("i5"));
+	MAKE_BINOP_EXPR(terms[0], a, l, OP_COMP_SMALLER);
+	MAKE_ATTRREF(a, 1);
+	MAKE_CONS(l, stringToValue("sab"));
+	MAKE_BINOP_EXPR(terms[1], l, a, OP_COMP_EQUAL);
+	MAKE_NARY_EXPR(opt, terms, 2, OP_BOOL_OR);
+	MAKE_UNOP_EXPR(op, opt, OP_BOOL_NOT);
+	TEST_CHECK(optimizeExpr(&op, schema));
+	ASSERT_TRUE(op->type == EXPR_OP && op->expr.op->type == OP_BOOL_AND, "NOT pushed through OR");
+	ASSERT_TRUE(op->expr.op->args[0]->expr.op->type == OP_COMP_GREATER_EQUAL, "NOT (a < 5) became a >= 5");
+	ASSERT_TRUE(op->expr.op->args[1]->expr.op->type == OP_COMP_NOT_EQUAL, "NOT (b = 'ab') became b != 'ab'");
+	ASSERT_TRUE(op->expr.op->args[1]->expr.op->args[0]->type == EXPR_ATTRREF, "attribute moved to the left");
+	freeExpr(op);
+
+	// NOT (c < 2.5) stayed a NOT because of NaN
+	MAKE_ATTRREF(a, 2);
+	MAKE_CONS(l, stringToValue("f2.5"));
+	MAKE_BINOP_EXPR(opt, a, l, OP_COMP_SMALLER);
+	MAKE_UNOP_EXPR(op, opt, OP_BOOL_NOT);
+	TEST_CHECK(optimizeExpr(&op, schema));
+	ASSERT_TRUE(op->expr.op->type == OP_BOOL_NOT, "NOT kept for FLOAT");
+	freeExpr(op);
+
+	// a = 1 AND (a < 3 AND NOT true) and a BETWEEN 5 AND 2 were always false
+	MAKE_ATTRREF(a, 0);
+	MAKE_CONS(l, stringToValue("i1"));
+	MAKE_BINOP_EXPR(terms[0], a, l, OP_COMP_EQUAL);
+	MAKE_ATTRREF(a, 0);
+	MAKE_CONS(l, stringToValue("i3"));
+	MAKE_BINOP_EXPR(terms[1], a, l, OP_COMP_SMALLER);
+	MAKE_CONS(l, stringToValue("bt"));
+	MAKE_UNOP_EXPR(terms[2], l, OP_BOOL_NOT);
+	MAKE_NARY_EXPR(opt, terms + 1, 2, OP_BOOL_AND);
+	MAKE_BINOP_EXPR(op, terms[0], opt, OP_BOOL_AND);
+	TEST_CHECK(optimizeExpr(&op, schema));
+	ASSERT_TRUE(exprIsConstant(op, false), "AND with false folded to false");
+	freeExpr(op);
+
+	MAKE_ATTRREF(a, 0);
+	MAKE_CONS(l, stringToValue("i5"));
+	MAKE_CONS(rhs, stringToValue("i2"));
+	MAKE_BETWEEN_EXPR(op, a, l, rhs);
+	TEST_CHECK(optimizeExpr(&op, schema));
+	ASSERT_TRUE(exprIsConstant(op, false), "empty BETWEEN folded to false");
+	freeExpr(op);
+
+	// a false after a dropped true: only the live arguments were freed
+	TEST_CHECK(parseCondition("a = 1 AND 1 = 1 AND 1 = 2", schema, &op));
+	TEST_CHECK(optimizeExpr(&op, schema));
+	ASSERT_TRUE(exprIsConstant(op, false), "AND with a later false folded to false");
+	freeExpr(op);
+	TEST_CHECK(parseCondition("1 = 2 OR a = 1 OR 1 = 1", schema, &op));
+	TEST_CHECK(optimizeExpr(&op, schema));
+	ASSERT_TRUE(exprIsConstant(op, true), "OR with a later true folded to true");
+	freeExpr(op);
+
+	// NOT (a > 3 AND (d = true OR 2 < a)) gave the same results before and after
+	MAKE_ATTRREF(a, 0);
+	MAKE_CONS(l, stringToValue("i3"));
+	MAKE_BINOP_EXPR(terms[0], a, l, OP_COMP_GREATER);
+	MAKE_ATTRREF(a, 3);
+	MAKE_CONS(l, stringToValue("bt"));
+	MAKE_BINOP_EXPR(terms[1], a, l, OP_COMP_EQUAL);
+	MAKE_CONS(l, stringToValue("i2"));
+	MAKE_ATTRREF(a, 0);
+	MAKE_BINOP_EXPR(terms[2], l, a, OP_COMP_SMALLER);
+	MAKE_NARY_EXPR(opt, terms + 1, 2, OP_BOOL_OR);
+	MAKE_BINOP_EXPR(rhs, terms[0], opt, OP_BOOL_AND);
+	MAKE_UNOP_EXPR(op, rhs, OP_BOOL_NOT);
+	TEST_CHECK(copyExpr(op, &opt));
+	TEST_CHECK(optimizeExpr(&opt, schema));
+	ASSERT_TRUE(opt->expr.op->type == OP_BOOL_OR, "NOT pushed through AND");
+
+	TEST_CHECK(createRecord(&r, schema));
+	for (i = 0; i < 20; i++)
+	{
+		Value *v;
+		MAKE_VALUE(v, DT_INT, i % 7);
+		TEST_CHECK(setAttr(r, schema, 0, v));
+		freeVal(v);
+		v = stringToValue((i % 3) ? "bt" : "bf");
+		TEST_CHECK(setAttr(r, schema, 3, v));
+		freeVal(v);
+		TEST_CHECK(evalExpr(r, schema, op, &res));
+		TEST_CHECK(evalExpr(r, schema, opt, &resOpt));
+		if (res->v.boolV != resOpt->v.boolV)
+			mismatches++;
+		freeVal(res);
+		freeVal(resOpt);
+	}
+	ASSERT_EQUALS_INT(0, mismatches, "optimized condition evaluated the same");
+	freeExpr(op);
+	freeExpr(opt);
+
+	freeRecord(r);
+	freeSchema(schema);
+	TEST_DONE();
+}
+
+// ************************************************************
+void
+testFixedLengthStrings (void)
+{
+	Schema *schema;
+	Record *r;
+	Expr *op, *a, *l;
+	char *names[] = { "x", "y" };
+	DataType dt[] = { DT_STRING, DT_STRING };
+	int sizes[] = { 40, 40 };
+	char **cpNames = (char **) malloc(sizeof(char*) * 2);
+	DataType *cpDt = (DataType *) malloc(sizeof(DataType) * 2);
+	int *cpSizes = (int *) malloc(sizeof(int) * 2);
+	int *cpKeys = (int *) malloc(sizeof(int));
+	char *values[] = { "s", "sabc", "sabd", "sab", "s0123456789012345678901234567890123456789",
+		"s0123456789012345678901234567890123456780", "s01234567890123456789012345678901234567890" };
+	OpType ops[] = { OP_COMP_EQUAL, OP_COMP_SMALLER, OP_COMP_SMALLER_EQUAL, OP_COMP_GREATER,
+		OP_COMP_GREATER_EQUAL, OP_COMP_NOT_EQUAL };
+	int i, j, k;
+	char msg[128];
+	testName = "test comparisons of fixed-length strings in place";
+
+	ASSERT_TRUE(selByteComparator(40)("0123456789012345678901234567890123456789",
+		"0123456789012345678901234567890123456788", 40) > 0, "40-byte comparator ordered bytes");
+	ASSERT_TRUE(selByteComparator(4)("ab\0\0", "abc\0", 4) < 0, "shorter padded string sorted first");
+
+	for (i = 0; i < 2; i++)
+		cpNames[i] = strdup(names[i]);
+	memcpy(cpDt, dt, sizeof(dt));
+	memcpy(cpSizes, sizes, sizeof(sizes));
+	cpKeys[0] = 0;
+	schema = createSchema(2, cpNames, cpDt, cpSizes, 1, cpKeys);
+	TEST_CHECK(createRecord(&r, schema));
+
+	// every pair of values (the last one is longer than the attributes), as
+	// attribute vs constant and attribute vs attribute, under every operator
+	for (i = 0; i < 6; i++)
+		for (j = 0; j < 7; j++)
+		{
+			Value *v = stringToValue(values[i]);
+			TEST_CHECK(setAttr(r, schema, 0, v));
+			freeVal(v);
+			if (j < 6)
+			{
+				v = stringToValue(values[j]);
+				TEST_CHECK(setAttr(r, schema, 1, v));
+				freeVal(v);
+			}
+			for (k = 0; k < 6; k++)
+			{
+				MAKE_ATTRREF(a, 0);
+				MAKE_CONS(l, stringToValue(values[j]));
+				MAKE_BINOP_EXPR(op, a, l, ops[k]);
+				sprintf(msg, "x op %d '%s' with x = '%s'", k, values[j] + 1, values[i] + 1);
+				checkCompiled(op, r, schema, msg);
+				freeExpr(op);
+
+				if (j < 6)
+				{
+					MAKE_ATTRREF(a, 1);
+					MAKE_ATTRREF(l, 0);
+					MAKE_BINOP_EXPR(op, a, l, ops[k]);
+					checkCompiled(op, r, schema, "y op x");
+					freeExpr(op);
+				}
+			}
+		}
+
+	freeRecord(r);
+	freeSchema(schema);
+	TEST_DONE();
+}
+
+// ************************************************************
+void
+testConditionParser (void)
+{
+	Schema *schema, *other;
+	Record *r;
+	Expr *e;
+	Value *v, *res;
+	PreparedCond *cond, *again;
+	PredProgram *prog;
+	bool pass;
+	int i, rc, hits, misses;
+	char text[32];
+	char *conds[] = { "a = 5", "a < 10 AND b = 'ab'", "a >= 6 or not d", "c > 2",
+		"a BETWEEN 1 AND 5", "a NOT IN (1, 2, 3)", "b in ('x', 'ab')", "NOT (a <> 5)",
+		"d", "a > -3 AND c <= 2.5", "b = 'it''s'", "(a = 1 OR a = 5) AND (c != 2.5 OR d = true)",
+		"c IN (2.5, 3)", "FALSE OR a == 5" };
+	bool expected[] = { true, true, false, true, true, true, true, true,
+		true, true, false, true, true, true };
+	char *bad[] = { "a <", "zz = 1", "a = 'x'", "a = ?", "(a = 1", "a = 1 b", "a # 1",
+		"b = 'ab", "a NOT 3", "a IN ()" };
+	testName = "test parsing text conditions";
+
+	schema = exprSchema();
+	TEST_CHECK(createRecord(&r, schema));
+	MAKE_VALUE(v, DT_INT, 5);
+	TEST_CHECK(setAttr(r, schema, 0, v));
+	freeVal(v);
+	v = stringToValue("sab");
+	TEST_CHECK(setAttr(r, schema, 1, v));
+	freeVal(v);
+	MAKE_VALUE(v, DT_FLOAT, 2.5);
+	TEST_CHECK(setAttr(r, schema, 2, v));
+	freeVal(v);
+	MAKE_VALUE(v, DT_BOOL, true);
+	TEST_CHECK(setAttr(r, schema, 3, v));
+	freeVal(v);
+
+	// parsed trees evaluated like hand-built ones, compiled or not
+	for (i = 0; i < 14; i++)
+	{
+		TEST_CHECK(parseCondition(conds[i], schema, &e));
+		TEST_CHECK(evalExpr(r, schema, e, &res));
+		ASSERT_TRUE(res->v.boolV == expected[i], conds[i]);
+		freeVal(res);
+		checkCompiled(e, r, schema, conds[i]);
+		freeExpr(e);
+	}
+	for (i = 0; i < 10; i++)
+	{
+		rc = parseCondition(bad[i], schema, &e);
+		ASSERT_EQUALS_INT(RC_PARSE_ERROR, rc, bad[i]);
+	}
+
+	// placeholders took the type of the other side and were rebindable
+	TEST_CHECK(clearConditionCache());
+	rc = prepareCondition("? = ?", schema, &cond);
+	ASSERT_EQUALS_INT(RC_PARSE_ERROR, rc, "untyped placeholders");
+	TEST_CHECK(prepareCondition("a < ? AND b = ?", schema, &cond));
+	ASSERT_EQUALS_INT(2, getNumParams(cond), "two placeholders");
+	MAKE_VALUE(v, DT_INT, 10);
+	TEST_CHECK(bindParam(cond, 0, v));
+	ASSERT_ERROR(bindParam(cond, 1, v), "INT bound to a STRING placeholder");
+	freeVal(v);
+	v = stringToValue("sab");
+	TEST_CHECK(bindParam(cond, 1, v));
+	freeVal(v);
+	prog = getPreparedProgram(cond);
+	ASSERT_TRUE(prog != NULL, "prepared condition was compiled");
+	TEST_CHECK(evalPredicate(prog, r->data, &pass));
+	ASSERT_TRUE(pass, "a < 10 AND b = 'ab'");
+	MAKE_VALUE(v, DT_INT, 3);
+	TEST_CHECK(bindParam(cond, 0, v));
+	freeVal(v);
+	TEST_CHECK(evalPredicate(prog, r->data, &pass));
+	ASSERT_TRUE(!pass, "a < 3 after rebinding");
+	TEST_CHECK(evalExpr(r, schema, getPreparedExpr(cond), &res));
+	ASSERT_TRUE(!res->v.boolV, "evalExpr read the rebound placeholder");
+	freeVal(res);
+
+	// the same text hit the cache but got placeholders of its own; the same
+	// text on another schema did not hit it
+	TEST_CHECK(prepareCondition("a < ? AND b = ?", schema, &again));
+	ASSERT_TRUE(again != cond, "repeated condition got its own handle");
+	MAKE_VALUE(v, DT_INT, 100);
+	TEST_CHECK(bindParam(again, 0, v));
+	freeVal(v);
+	v = stringToValue("sab");
+	TEST_CHECK(bindParam(again, 1, v));
+	freeVal(v);
+	TEST_CHECK(evalPredicate(getPreparedProgram(again), r->data, &pass));
+	ASSERT_TRUE(pass, "a < 100 on the second handle");
+	TEST_CHECK(evalPredicate(prog, r->data, &pass));
+	ASSERT_TRUE(!pass, "first handle still read a < 3");
+	TEST_CHECK(evalExpr(r, schema, getPreparedExpr(cond), &res));
+	ASSERT_TRUE(!res->v.boolV, "first handle's tree still read a < 3");
+	freeVal(res);
+	TEST_CHECK(releaseCondition(again));
+	other = exprSchema();
+	other->typeLength[1] = 8;
+	TEST_CHECK(prepareCondition("a < ? AND b = ?", other, &again));
+	ASSERT_TRUE(again != cond, "different schema prepared separately");
+	TEST_CHECK(releaseCondition(again));
+	getConditionCacheStats(&hits, &misses);
+	ASSERT_EQUALS_INT(1, hits, "one hit");
+	ASSERT_EQUALS_INT(3, misses, "three misses, one of them the failed prepare");
+
+	// a full cache evicted the least recently used entry nobody held
+	for (i = 0; i < PREPARED_CACHE_SIZE; i++)
+	{
+		sprintf(text, "a = %d", i);
+		TEST_CHECK(prepareCondition(text, schema, &again));
+		TEST_CHECK(releaseCondition(again));
+	}
+	TEST_CHECK(prepareCondition("a < ? AND b = ?", schema, &again));
+	TEST_CHECK(releaseCondition(again));
+	TEST_CHECK(prepareCondition("a = 0", schema, &again));
+	TEST_CHECK(releaseCondition(again));
+	getConditionCacheStats(&hits, &misses);
+	ASSERT_EQUALS_INT(2, hits, "held entry survived eviction and was a hit");
+	ASSERT_EQUALS_INT(3 + PREPARED_CACHE_SIZE + 1, misses, "evicted entry was a miss");
+
+	// clearing the cache left held entries valid until released
+	TEST_CHECK(clearConditionCache());
+	TEST_CHECK(evalPredicate(prog, r->data, &pass));
+	TEST_CHECK(releaseCondition(cond));
+
+	// an INT bound to a FLOAT placeholder was widened
+	TEST_CHECK(prepareCondition("c * ? > 4.0", schema, &again));
+	MAKE_VALUE(v, DT_INT, 2);
+	TEST_CHECK(bindParam(again, 0, v));
+	freeVal(v);
+	TEST_CHECK(evalPredicate(getPreparedProgram(again), r->data, &pass));
+	ASSERT_TRUE(pass, "c * ? > 4.0 with the INT 2 bound");
+	TEST_CHECK(evalExpr(r, schema, getPreparedExpr(again), &res));
+	ASSERT_TRUE(res->v.boolV, "evalExpr read the widened placeholder");
+	freeVal(res);
+	TEST_CHECK(releaseCondition(again));
+
+	freeSchema(other);
+	freeRecord(r);
+	freeSchema(schema);
+	TEST_DONE();
+}
+
+// ************************************************************
+void
+testArithmetic (void)
+{
+	Schema *schema;
+	Record *r;
+	Expr *e, *a, *k;
+	Value *v, *res, left, right, out;
+	PredProgram *prog;
+	DataType dt;
+	bool pass;
+	int i, rc, n;
+	char *conds[] = { "a + 2 * a = 15", "a % 3 = 2", "c * 2 > 4", "a / 2 = 2", "CAST(c AS INT) = 2",
+		"CAST(a AS FLOAT) / 2 = 2.5", "-a < 0", "(a + 1) * 2 = 12", "a - -3 = 8", "a * c = 12.5",
+		"CAST(a AS STRING) = '5'", "CAST(b AS BOOL)", "7 - a * 2 BETWEEN 0 AND 3" };
+	bool expected[] = { true, true, true, true, true, true, true, true, true, true, true, false, false };
+	char *failing[] = { "a / 0 = 1", "a / 0 + 1 < 2", "a = 5 AND a / 0 = 1", "a = 1 OR a % 0 = 1",
+		"NOT (a / 0 = 1)", "NOT (a = 1 OR a / 0 > 2)" };
+	testName = "test arithmetic and casts";
+
+	// INT with INT stayed INT, a FLOAT operand widened the other side
+	left.dt = DT_INT;
+	left.v.intV = 7;
+	right.dt = DT_INT;
+	right.v.intV = 2;
+	TEST_CHECK(valueArith(OP_ARITH_DIV, &left, &right, &out));
+	ASSERT_TRUE(out.dt == DT_INT && out.v.intV == 3, "7 / 2 = 3");
+	TEST_CHECK(valueArith(OP_ARITH_MOD, &left, &right, &out));
+	ASSERT_TRUE(out.dt == DT_INT && out.v.intV == 1, "7 % 2 = 1");
+	right.dt = DT_FLOAT;
+	right.v.floatV = 2;
+	TEST_CHECK(valueArith(OP_ARITH_DIV, &left, &right, &out));
+	ASSERT_TRUE(out.dt == DT_FLOAT && out.v.floatV == 3.5, "7 / 2.0 = 3.5");
+	ASSERT_EQUALS_INT(RC_RM_ARITH_ARG_IS_NOT_NUMERIC, valueArith(OP_ARITH_MOD, &left, &right, &out), "FLOAT modulo");
+	right.dt = DT_INT;
+	right.v.intV = 0;
+	ASSERT_EQUALS_INT(RC_RM_DIVISION_BY_ZERO, valueArith(OP_ARITH_DIV, &left, &right, &out), "division by zero");
+	left.v.intV = INT_MIN;
+	right.v.intV = -1;
+	TEST_CHECK(valueArith(OP_ARITH_DIV, &left, &right, &out));
+	ASSERT_TRUE(out.v.intV == INT_MIN, "INT_MIN / -1 wrapped around");
+
+	// casts
+	left.dt = DT_FLOAT;
+	left.v.floatV = -2.7;
+	TEST_CHECK(valueCast(&left, DT_INT, &out));
+	ASSERT_EQUALS_INT(-2, out.v.intV, "FLOAT to INT truncated");
+	left.v.floatV = 3e9;
+	ASSERT_EQUALS_INT(RC_RM_CAST_FAILED, valueCast(&left, DT_INT, &out), "FLOAT out of the INT range");
+	left.v.floatV = 2.5;
+	TEST_CHECK(valueCast(&left, DT_STRING, &out));
+	ASSERT_EQUALS_STRING("2.5", out.v.stringV, "FLOAT to STRING");
+	free(out.v.stringV);
+	v = stringToValue("s42");
+	TEST_CHECK(valueCast(v, DT_INT, &out));
+	ASSERT_EQUALS_INT(42, out.v.intV, "STRING to INT");
+	freeVal(v);
+	v = stringToValue("s4x");
+	ASSERT_EQUALS_INT(RC_RM_CAST_FAILED, valueCast(v, DT_FLOAT, &out), "STRING that was not a number");
+	freeVal(v);
+
+	schema = exprSchema();
+	TEST_CHECK(createRecord(&r, schema));
+	MAKE_VALUE(v, DT_INT, 5);
+	TEST_CHECK(setAttr(r, schema, 0, v));
+	freeVal(v);
+	v = stringToValue("sab");
+	TEST_CHECK(setAttr(r, schema, 1, v));
+	freeVal(v);
+	MAKE_VALUE(v, DT_FLOAT, 2.5);
+	TEST_CHECK(setAttr(r, schema, 2, v));
+	freeVal(v);
+
+	// evalExpr and compiled programs agreed, before and after optimization
+	for (i = 0; i < 13; i++)
+	{
+		rc = parseCondition(conds[i], schema, &e);
+		if (i == 11)
+		{
+			// 'ab' was not a BOOL, and evalExpr said so
+			TEST_CHECK(rc);
+			rc = evalExpr(r, schema, e, &res);
+			ASSERT_EQUALS_INT(RC_RM_CAST_FAILED, rc, conds[i]);
+			freeExpr(e);
+			continue;
+		}
+		TEST_CHECK(rc);
+		TEST_CHECK(evalExpr(r, schema, e, &res));
+		ASSERT_TRUE(res->v.boolV == expected[i], conds[i]);
+		freeVal(res);
+		if (i == 10)
+		{
+			ASSERT_TRUE(compilePredicate(e, schema, &prog) != RC_OK, "casts to STRING were left to evalExpr");
+			freeExpr(e);
+			continue;
+		}
+		checkCompiled(e, r, schema, conds[i]);
+		TEST_CHECK(optimizeExpr(&e, schema));
+		checkCompiled(e, r, schema, conds[i]);
+		freeExpr(e);
+	}
+
+	// a constant subexpression was folded, a failing one was left alone
+	TEST_CHECK(parseCondition("a < 2 * 3 + 1", schema, &e));
+	TEST_CHECK(optimizeExpr(&e, schema));
+	k = e->expr.op->args[1];
+	ASSERT_TRUE(k->type == EXPR_CONST && k->expr.cons->v.intV == 7, "2 * 3 + 1 folded to 7");
+	freeExpr(e);
+	TEST_CHECK(parseCondition("a < 1 / 0", schema, &e));
+	TEST_CHECK(optimizeExpr(&e, schema));
+	ASSERT_TRUE(e->expr.op->args[1]->type == EXPR_OP, "1 / 0 was not folded");
+	TEST_CHECK(compilePredicate(e, schema, &prog));
+	rc = evalPredicate(prog, r->data, &pass);
+	ASSERT_EQUALS_INT(RC_RM_DIVISION_BY_ZERO, rc, "compiled division by zero");
+	freePredicate(prog);
+	freeExpr(e);
+
+	// a BETWEEN bound that failed was reported, with nothing left allocated
+	TEST_CHECK(parseCondition("a BETWEEN 1 / 0 AND 9", schema, &e));
+	ASSERT_EQUALS_INT(RC_RM_DIVISION_BY_ZERO, evalExpr(r, schema, e, &res), "failing lower bound");
+	ASSERT_TRUE(res == NULL, "no result after a failing lower bound");
+	freeExpr(e);
+	TEST_CHECK(parseCondition("a BETWEEN 1 AND 9 / 0", schema, &e));
+	ASSERT_EQUALS_INT(RC_RM_DIVISION_BY_ZERO, evalExpr(r, schema, e, &res), "failing upper bound");
+	ASSERT_TRUE(res == NULL, "no result after a failing upper bound");
+	freeExpr(e);
+
+	// an operand that failed below a comparison, AND/OR or NOT failed the
+	// whole condition the same way
+	for(i = 0; i < 6; i++)
+	{
+		TEST_CHECK(parseCondition(failing[i], schema, &e));
+		ASSERT_EQUALS_INT(RC_RM_DIVISION_BY_ZERO, evalExpr(r, schema, e, &res), failing[i]);
+		ASSERT_TRUE(res == NULL, "no result after a failing operand");
+		freeExpr(e);
+	}
+
+	// a value program wrote its result in the record layout
+	MAKE_ATTRREF(a, 0);
+	MAKE_VALUE(v, DT_INT, 3);
+	MAKE_CONS(k, v);
+	MAKE_BINOP_EXPR(e, a, k, OP_ARITH_MUL);
+	TEST_CHECK(exprType(e, schema, &dt));
+	ASSERT_TRUE(dt == DT_INT, "a * 3 was an INT");
+	TEST_CHECK(compileValueExpr(e, schema, &prog, &dt));
+	TEST_CHECK(evalValueExpr(prog, r->data, (char *) &n, 0));
+	ASSERT_EQUALS_INT(15, n, "a * 3 = 15");
+	freePredicate(prog);
+	freeExpr(e);
+
+	freeRecord(r);
+	freeSchema(schema);
+	TEST_DONE();
+}
+
+// evalExpr temporaries came from an installed arena and freeVal left them to
+// the next reset; without an arena they were malloc'd as before
+void
+testArena (void)
+{
+	Schema *schema;
+	Record *r;
+	Expr *e;
+	Value *v, *res;
+	Arena *arena, *prev;
+	char *p, *q, *big;
+	int i;
+	testName = "test evaluation arena";
+
+	// aligned bump allocation, oversized requests, O(1) reset with reuse
+	TEST_CHECK(createArena(&arena, 256));
+	p = (char *) arenaAlloc(arena, 3);
+	q = (char *) arenaAlloc(arena, 5);
+	ASSERT_TRUE(((uintptr_t) p % 16) == 0 && ((uintptr_t) q % 16) == 0, "allocations were aligned");
+	ASSERT_TRUE(q == p + 16, "allocations were bumped");
+	big = (char *) arenaAlloc(arena, 1000);
+	memset(big, 'x', 1000);
+	ASSERT_TRUE(arenaOwns(arena, p) && arenaOwns(arena, big + 999), "arena owned its blocks");
+	ASSERT_TRUE(!arenaOwns(arena, &i), "arena did not own other memory");
+	resetArena(arena);
+	ASSERT_TRUE(arenaAlloc(arena, 8) == p, "reset reused the first block");
+	ASSERT_TRUE(arenaAlloc(arena, 1000) == big, "reset kept the oversized block");
+
+	// evaluation under an installed arena
+	schema = exprSchema();
+	TEST_CHECK(createRecord(&r, schema));
+	MAKE_VALUE(v, DT_INT, 5);
+	TEST_CHECK(setAttr(r, schema, 0, v));
+	freeVal(v);
+	v = stringToValue("sab");
+	TEST_CHECK(setAttr(r, schema, 1, v));
+	freeVal(v);
+	TEST_CHECK(parseCondition("CAST(a AS STRING) = '5' AND b = 'ab'", schema, &e));
+
+	prev = setEvalArena(arena);
+	ASSERT_TRUE(prev == NULL, "no arena was installed before");
+	for (i = 0; i < 100; i++)
+	{
+		resetArena(arena);
+		TEST_CHECK(evalExpr(r, schema, e, &res));
+		ASSERT_TRUE(arenaOwns(arena, res), "result came from the arena");
+		ASSERT_TRUE(res->dt == DT_BOOL && res->v.boolV, "condition held under the arena");
+		freeVal(res);
+	}
+	TEST_CHECK(getAttr(r, schema, 1, &v));
+	ASSERT_TRUE(arenaOwns(arena, v) && arenaOwns(arena, v->v.stringV), "getAttr used the arena");
+	ASSERT_EQUALS_STRING("ab", v->v.stringV, "getAttr read the string");
+	freeVal(v);
+	setEvalArena(prev);
+
+	// malloc again once the arena was uninstalled
+	TEST_CHECK(evalExpr(r, schema, e, &res));
+	ASSERT_TRUE(!arenaOwns(arena, res) && res->v.boolV, "result was malloc'd without an arena");
+	freeVal(res);
+
+	TEST_CHECK(freeArena(arena));
+	freeExpr(e);
+	freeRecord(r);
+	freeSchema(schema);
+	TEST_DONE();
+}
+
+static Schema *
+exprSchema (void)
+{
+	char *names[] = { "a", "b", "c", "d" };
+	DataType dt[] = { DT_INT, DT_STRING, DT_FLOAT, DT_BOOL };
+	int sizes[] = { 0, 4, 0, 0 };
+	char **cpNames = (char **) malloc(sizeof(char*) * 4);
+	DataType *cpDt = (DataType *) malloc(sizeof(DataType) * 4);
+	int *cpSizes = (int *) malloc(sizeof(int) * 4);
+	int *cpKeys = (int *) malloc(sizeof(int));
+	int i;
+
+	for(i = 0; i < 4; i++)
+		cpNames[i] = strdup(names[i]);
+	memcpy(cpDt, dt, sizeof(DataType) * 4);
+	memcpy(cpSizes, sizes, sizeof(int) * 4);
+	cpKeys[0] = 0;
+
+	return createSchema(4, cpNames, cpDt, cpSizes, 1, cpKeys);
+}
+
+// two INT attributes, a and b
+static Schema *
+intPairSchema (void)
+{
+	char **names = (char **) malloc(sizeof(char*) * 2);
+	DataType *dt = (DataType *) malloc(sizeof(DataType) * 2);
+	int *sizes = (int *) calloc(2, sizeof(int));
+	int *keys = (int *) malloc(sizeof(int));
+
+	names[0] = strdup("a");
+	names[1] = strdup("b");
+	dt[0] = dt[1] = DT_INT;
+	keys[0] = 0;
+	return createSchema(2, names, dt, sizes, 1, keys);
+}
+
+static void
+checkCompiled (Expr *expr, Record *record, Schema *schema, char *message)
+{
+	PredProgram *prog;
+	Value *res;
+	bool pass;
+
+	TEST_CHECK(compilePredicate(expr, schema, &prog));
+	TEST_CHECK(evalPredicate(prog, record->data, &pass));
+	TEST_CHECK(evalExpr(record, schema, expr, &res));
+	ASSERT_TRUE(pass == res->v.boolV, message);
+	freeVal(res);
+	freePredicate(prog);
+}
@@ -0,0 +1,327 @@
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "dberror.h"
+#include "txn_log.h"
+
+/*
+ * Transaction log
+ * ---------------------------------------------------------------
+ * Committed transactions were made durable by appending redo entries to one
+ * log file shared by all tables, then a commit marker, with a single write
+ * and a single fsync: a commit cost one sequential sync however many records
+ * it changed, and the changed pages could reach the table files whenever the
+ * buffer pool wrote them. Each entry got a log sequence number (LSN) from a
+ * counter that only grew; a table remembered the LSN it was known to contain
+ * and openTable replayed the committed entries after it.
+ *
+ * An entry on disk was
+ *
+ *   u32 length of the rest | u64 lsn | u8 op | u16 name length | name |
+ *   i32 page | i32 slot | u32 data length | data
+ *
+ * A commit marker was an entry with op TXN_LOG_COMMIT and no table. Entries
+ * that were not followed by a marker (a commit torn by a crash) were ignored.
+ */
+
+#define ENTRY_FIXED (4 + 8 + 1 + 2 + 4 + 4 + 4)
+
+static pthread_mutex_t logLock = PTHREAD_MUTEX_INITIALIZER;
+static char *logPath = NULL;
+static int logFd = -1;
+static uint64_t lastLsn = 0;
+static bool lsnKnown = false;
+
+/* --------------------------------------------------------------------------
+   Encoding
+   -------------------------------------------------------------------------- */
+
+static char *
+putBytes(char *p, const void *src, size_t len)
+{
+    memcpy(p, src, len);
+    return p + len;
+}
+
+/*
+ * encodeEntry
+ * -----------
+ * Wrote one entry at p and returned the end of it.
+ */
+static char *
+encodeEntry(char *p, uint64_t lsn, TxnLogOp op, char *table, RID id, int dataLen, char *data)
+{
+    uint16_t nameLen = (uint16_t) (table ? strlen(table) : 0);
+    uint32_t length  = ENTRY_FIXED - 4 + nameLen + (uint32_t) dataLen;
+    uint8_t code     = (uint8_t) op;
+    int32_t page     = id.page, slot = id.slot;
+    uint32_t len     = (uint32_t) dataLen;
+
+    p = putBytes(p, &length, 4);
+    p = putBytes(p, &lsn, 8);
+    p = putBytes(p, &code, 1);
+    p = putBytes(p, &nameLen, 2);
+    p = putBytes(p, table, nameLen);
+    p = putBytes(p, &page, 4);
+    p = putBytes(p, &slot, 4);
+    p = putBytes(p, &len, 4);
+    return putBytes(p, data, dataLen);
+}
+
+/*
+ * decodeEntry
+ * -----------
+ * Read the entry at p (end bounded the buffer) into entry, pointing its name
+ * and data into the buffer; the name was copied to nameBuf so it could be
+ * terminated. Returned the next entry, or NULL for a torn one.
+ */
+static char *
+decodeEntry(char *p, char *end, TxnLogEntry *entry, char *nameBuf, int nameCap)
+{
+    uint32_t length, len;
+    uint16_t nameLen;
+    uint8_t code;
+    int32_t page, slot;
+
+    if (end - p < ENTRY_FIXED)
+        return NULL;
+    memcpy(&length, p, 4);
+    if ((size_t) (end - p) - 4 < length || length < ENTRY_FIXED - 4)
+        return NULL;
+    char *next = p + 4 + length;
+
+    memcpy(&entry->lsn, p + 4, 8);
+    memcpy(&code, p + 12, 1);
+    memcpy(&nameLen, p + 13, 2);
+    if (ENTRY_FIXED - 4 + (uint32_t) nameLen > length || nameLen >= nameCap)
+        return NULL;
+    memcpy(nameBuf, p + 15, nameLen);
+    nameBuf[nameLen] = '\0';
+    p += 15 + nameLen;
+    memcpy(&page, p, 4);
+    memcpy(&slot, p + 4, 4);
+    memcpy(&len, p + 8, 4);
+    if (ENTRY_FIXED - 4 + (uint32_t) nameLen + len != length)
+        return NULL;
+
+    entry->op      = (TxnLogOp) code;
+    entry->table   = nameBuf;
+    entry->id.page = page;
+    entry->id.slot = slot;
+    entry->dataLen = (int) len;
+    entry->data    = p + 12;
+    return next;
+}
+
+/*
+ * readLog
+ * -------
+ * Read the whole log into a new buffer (NULL and 0 when there was none).
+ */
+static char *
+readLog(size_t *size)
+{
+    FILE *f = fopen(getTxnLogFile(), "rb");
+    char *buf;
+
+    *size = 0;
+    if (f == NULL)
+        return NULL;
+    fseek(f, 0, SEEK_END);
+    long n = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    buf = (char *) malloc(n > 0 ? n : 1);
+    if (buf != NULL)
+        *size = fread(buf, 1, n, f);
+    fclose(f);
+    return buf;
+}
+
+// found the highest LSN of the log once per log file; called with logLock held
+static void
+ensureLsn(void)
+{
+    char name[1024];
+    TxnLogEntry e;
+    size_t size;
+
+    if (lsnKnown)
+        return;
+    char *buf = readLog(&size);
+    for (char *p = buf; p != NULL && (p = decodeEntry(p, buf + size, &e, name, sizeof(name))) != NULL; )
+        if (e.lsn > lastLsn)
+            lastLsn = e.lsn;
+    free(buf);
+    lsnKnown = true;
+}
+
+/* --------------------------------------------------------------------------
+   Interface
+   -------------------------------------------------------------------------- */
+
+RC
+setTxnLogFile(char *path)
+{
+    pthread_mutex_lock(&logLock);
+    if (logFd >= 0)
+        close(logFd);
+    logFd = -1;
+    free(logPath);
+    logPath = path ? strdup(path) : NULL;
+    lsnKnown = false;
+    pthread_mutex_unlock(&logLock);
+    return RC_OK;
+}
+
+char *
+getTxnLogFile(void)
+{
+    return logPath ? logPath : TXN_LOG_FILE;
+}
+
+/*
+ * appendTxnLog
+ * ------------
+ * Numbered the entries, encoded them and a commit marker into one buffer
+ * and wrote it with one write and one fsync. The log lock kept concurrent
+ * commits from interleaving, so a transaction's entries were contiguous.
+ */
+RC
+appendTxnLog(TxnLogEntry *entries, int numEntries, uint64_t *commitLsn)
+{
+    size_t size = ENTRY_FIXED;
+    RID none = { 0, 0 };
+    RC rc = RC_OK;
+
+    for (int i = 0; i < numEntries; i++)
+        size += ENTRY_FIXED + strlen(entries[i].table) + entries[i].dataLen;
+    char *buf = (char *) malloc(size);
+    if (buf == NULL)
+        THROW(RC_MEMORY_ALLOCATION_ERROR, "cannot allocate a log buffer");
+
+    pthread_mutex_lock(&logLock);
+    ensureLsn();
+    if (logFd < 0)
+        logFd = open(getTxnLogFile(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+    if (logFd < 0)
+    {
+        pthread_mutex_unlock(&logLock);
+        free(buf);
+        THROW(RC_WRITE_FAILED, "cannot open the transaction log");
+    }
+
+    char *p = buf;
+    for (int i = 0; i < numEntries; i++)
+    {
+        entries[i].lsn = ++lastLsn;
+        p = encodeEntry(p, entries[i].lsn, entries[i].op, entries[i].table, entries[i].id,
+                        entries[i].dataLen, entries[i].data);
+    }
+    *commitLsn = ++lastLsn;
+    p = encodeEntry(p, *commitLsn, TXN_LOG_COMMIT, NULL, none, 0, NULL);
+
+    for (char *w = buf; w < p && rc == RC_OK; )
+    {
+        ssize_t n = write(logFd, w, p - w);
+        if (n <= 0)
+            rc = RC_WRITE_FAILED;
+        else
+            w += n;
+    }
+    if (rc == RC_OK && fsync(logFd) != 0)
+        rc = RC_WRITE_FAILED;
+    pthread_mutex_unlock(&logLock);
+
+    free(buf);
+    if (rc != RC_OK)
+        THROW(rc, "cannot write the transaction log");
+    return RC_OK;
+}
+
+/*
+ * replayTxnLog
+ * ------------
+ * Walked the log, holding back each transaction's entries until its commit
+ * marker, and applied the committed ones of the table past afterLsn.
+ */
+RC
+replayTxnLog(char *table, uint64_t afterLsn, RC (*apply) (TxnLogEntry *entry, void *ctx), void *ctx)
+{
+    char name[1024];
+    TxnLogEntry e;
+    size_t size;
+    RC rc = RC_OK;
+
+    pthread_mutex_lock(&logLock);
+    char *buf = readLog(&size);
+    pthread_mutex_unlock(&logLock);
+    if (buf == NULL)
+        return RC_OK;
+
+    char *p = buf, *txnStart = buf, *next;
+    while (rc == RC_OK && (next = decodeEntry(p, buf + size, &e, name, sizeof(name))) != NULL)
+    {
+        if (e.op == TXN_LOG_COMMIT)
+        {
+            for (char *q = txnStart; rc == RC_OK && q < p; )
+            {
+                q = decodeEntry(q, buf + size, &e, name, sizeof(name));
+                if (e.lsn > afterLsn && strcmp(e.table, table) == 0)
+                    rc = apply(&e, ctx);
+            }
+            txnStart = next;
+        }
+        p = next;
+    }
+    free(buf);
+    return rc;
+}
+
+uint64_t
+getLastLsn(void)
+{
+    uint64_t lsn;
+    pthread_mutex_lock(&logLock);
+    ensureLsn();
+    lsn = lastLsn;
+    pthread_mutex_unlock(&logLock);
+    return lsn;
+}
+
+/*
+ * truncateTxnLog
+ * --------------
+ * Emptied the log except for a commit marker carrying the last LSN, so LSNs
+ * kept growing after a restart and tables were not handed entries again.
+ */
+RC
+truncateTxnLog(void)
+{
+    RID none = { 0, 0 };
+    char marker[ENTRY_FIXED];
+    RC rc = RC_OK;
+
+    pthread_mutex_lock(&logLock);
+    ensureLsn();
+    if (logFd >= 0)
+        close(logFd);
+    logFd = -1;
+    FILE *f = fopen(getTxnLogFile(), "wb");
+    if (f == NULL)
+        rc = RC_WRITE_FAILED;
+    else
+    {
+        encodeEntry(marker, lastLsn, TXN_LOG_COMMIT, NULL, none, 0, NULL);
+        if (fwrite(marker, 1, sizeof(marker), f) != sizeof(marker))
+            rc = RC_WRITE_FAILED;
+        fclose(f);
+    }
+    pthread_mutex_unlock(&logLock);
+    if (rc != RC_OK)
+        THROW(rc, "cannot truncate the transaction log");
+    return RC_OK;
+}
@@ -0,0 +1,47 @@
+#ifndef TXN_LOG_H
+#define TXN_LOG_H
+
+#include <stdint.h>
+
+#include "dberror.h"
+#include "tables.h"
+
+// where committed transactions are logged unless setTxnLogFile chose another file
+#define TXN_LOG_FILE "rm_txn.log"
+
+typedef enum TxnLogOp {
+	TXN_LOG_INSERT = 1,
+	TXN_LOG_UPDATE = 2,
+	TXN_LOG_DELETE = 3,
+	TXN_LOG_COMMIT = 4
+} TxnLogOp;
+
+// one redo entry: the record image after an insert or update, none for a delete
+typedef struct TxnLogEntry {
+	uint64_t lsn;
+	TxnLogOp op;
+	char *table;
+	RID id;
+	int dataLen;
+	char *data;
+} TxnLogEntry;
+
+extern RC setTxnLogFile (char *path);
+extern char *getTxnLogFile (void);
+
+// appends the entries and a commit marker with one write and one fsync;
+// each entry's lsn is assigned, the commit's is returned
+extern RC appendTxnLog (TxnLogEntry *entries, int numEntries, uint64_t *commitLsn);
+
+// hands every committed entry of the table with an lsn above afterLsn, in
+// log order, to apply; a torn or uncommitted tail is ignored
+extern RC replayTxnLog (char *table, uint64_t afterLsn,
+		RC (*apply) (TxnLogEntry *entry, void *ctx), void *ctx);
+
+// highest lsn in the log (0 for an empty log)
+extern uint64_t getLastLsn (void);
+
+// empties the log; only safe once every table that used it was closed
+extern RC truncateTxnLog (void);
+
+#endif // TXN_LOG_H
@@ -0,0 +1,327 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "dberror.h"
+#include "value_set.h"
+
+/*
+ * Value sets
+ * ---------------------------------------------------------------
+ * An open-addressing hash table with linear probing, sized to a power of two
+ * at least twice the number of distinct values. INT, FLOAT and BOOL values
+ * were stored as 64-bit keys; strings were copied and stored with their hash.
+ * Slots held the index of an entry plus one, so 0 meant empty.
+ *
+ * The set compared values the way valueEquals did: -0.0 matched 0.0, NaN
+ * matched nothing, and strings compared equal when strcmp did.
+ */
+
+struct ValueSet {
+    DataType dt;
+    int numEntries;
+    uint64_t *keys;       // INT / FLOAT / BOOL entries
+    char **strings;       // DT_STRING entries
+    uint32_t *hashes;     // DT_STRING entries
+    int *slots;
+    uint32_t mask;        // number of slots - 1
+};
+
+/* --------------------------------------------------------------------------
+   Helpers
+   -------------------------------------------------------------------------- */
+
+/*
+ * mixKey / hashString
+ * -------------------
+ * Hashed a 64-bit key (splitmix64 finalizer) or the bytes of a string up to
+ * its first NUL or maxLen (FNV-1a).
+ */
+static uint32_t
+mixKey(uint64_t x)
+{
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return (uint32_t) x;
+}
+
+static uint32_t
+hashString(const char *s, int maxLen, int *len)
+{
+    uint32_t h = 2166136261u;
+    int i = 0;
+    for (; i < maxLen && s[i] != '\0'; i++)
+    {
+        h ^= (unsigned char) s[i];
+        h *= 16777619u;
+    }
+    *len = i;
+    return h;
+}
+
+/*
+ * floatKey
+ * --------
+ * Turned a float into a key; returned false for NaN, which matched nothing.
+ */
+static bool
+floatKey(float f, uint64_t *key)
+{
+    if (f != f)
+        return false;
+    if (f == 0.0f)
+        f = 0.0f;   // -0.0 == 0.0
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(float));
+    *key = bits;
+    return true;
+}
+
+/*
+ * findKey / findString
+ * --------------------
+ * Probed for a key and returned its slot, which was empty if the key was
+ * not in the set.
+ */
+static uint32_t
+findKey(ValueSet *set, uint64_t key)
+{
+    uint32_t i = mixKey(key) & set->mask;
+    while (set->slots[i] != 0 && set->keys[set->slots[i] - 1] != key)
+        i = (i + 1) & set->mask;
+    return i;
+}
+
+static uint32_t
+findString(ValueSet *set, const char *s, int len, uint32_t h)
+{
+    uint32_t i = h & set->mask;
+    while (set->slots[i] != 0)
+    {
+        int e = set->slots[i] - 1;
+        if (set->hashes[e] == h && strncmp(set->strings[e], s, len) == 0 && set->strings[e][len] == '\0')
+            break;
+        i = (i + 1) & set->mask;
+    }
+    return i;
+}
+
+/* --------------------------------------------------------------------------
+   Interface
+   -------------------------------------------------------------------------- */
+
+/*
+ * createValueSet
+ * --------------
+ * Built a set of type dt from numValues values, which stayed owned by the
+ * caller. Duplicates were stored once. Failed if a value had another type.
+ */
+RC
+createValueSet(DataType dt, Value **values, int numValues, ValueSet **set)
+{
+    *set = NULL;
+    for (int i = 0; i < numValues; i++)
+        if (values[i]->dt != dt)
+            THROW(RC_RM_COMPARE_VALUE_OF_DIFFERENT_DATATYPE, "all values of a set must have the set's datatype");
+
+    uint32_t numSlots = 8;
+    while (numSlots < 2 * (uint32_t) numValues)
+        numSlots *= 2;
+
+    ValueSet *s = (ValueSet *) calloc(1, sizeof(ValueSet));
+    if (s == NULL)
+        return RC_MEMORY_ALLOCATION_ERROR;
+    s->dt    = dt;
+    s->mask  = numSlots - 1;
+    s->slots = (int *) calloc(numSlots, sizeof(int));
+    if (dt == DT_STRING)
+    {
+        s->strings = (char **) calloc(numValues + 1, sizeof(char *));
+        s->hashes  = (uint32_t *) calloc(numValues + 1, sizeof(uint32_t));
+    }
+    else
+        s->keys = (uint64_t *) calloc(numValues + 1, sizeof(uint64_t));
+    if (s->slots == NULL || (dt == DT_STRING ? (s->strings == NULL || s->hashes == NULL) : s->keys == NULL))
+    {
+        freeValueSet(s);
+        return RC_MEMORY_ALLOCATION_ERROR;
+    }
+
+    for (int i = 0; i < numValues; i++)
+    {
+        Value *v = values[i];
+        uint32_t slot;
+
+        if (dt == DT_STRING)
+        {
+            int len;
+            uint32_t h = hashString(v->v.stringV, (int) strlen(v->v.stringV), &len);
+            slot = findString(s, v->v.stringV, len, h);
+            if (s->slots[slot] != 0)
+                continue;
+            s->strings[s->numEntries] = strdup(v->v.stringV);
+            if (s->strings[s->numEntries] == NULL)
+            {
+                freeValueSet(s);
+                return RC_MEMORY_ALLOCATION_ERROR;
+            }
+            s->hashes[s->numEntries] = h;
+        }
+        else
+        {
+            uint64_t key;
+            if (dt == DT_INT)
+                key = (uint32_t) v->v.intV;
+            else if (dt == DT_BOOL)
+                key = v->v.boolV ? 1 : 0;
+            else if (!floatKey(v->v.floatV, &key))
+                continue;
+            slot = findKey(s, key);
+            if (s->slots[slot] != 0)
+                continue;
+            s->keys[s->numEntries] = key;
+        }
+        s->slots[slot] = ++s->numEntries;
+    }
+
+    *set = s;
+    return RC_OK;
+}
+
+/*
+ * copyValueSet
+ * ------------
+ * Made an independent copy of a set, e.g. for a copied Expr tree.
+ */
+RC
+copyValueSet(ValueSet *set, ValueSet **copy)
+{
+    uint32_t numSlots = set->mask + 1;
+    int n = set->numEntries;
+
+    *copy = NULL;
+    ValueSet *s = (ValueSet *) calloc(1, sizeof(ValueSet));
+    if (s == NULL)
+        return RC_MEMORY_ALLOCATION_ERROR;
+    s->dt    = set->dt;
+    s->mask  = set->mask;
+    s->slots = (int *) malloc(numSlots * sizeof(int));
+    if (set->dt == DT_STRING)
+    {
+        s->strings = (char **) calloc(n + 1, sizeof(char *));
+        s->hashes  = (uint32_t *) malloc((n + 1) * sizeof(uint32_t));
+    }
+    else
+        s->keys = (uint64_t *) malloc((n + 1) * sizeof(uint64_t));
+    if (s->slots == NULL || (set->dt == DT_STRING ? (s->strings == NULL || s->hashes == NULL) : s->keys == NULL))
+    {
+        freeValueSet(s);
+        return RC_MEMORY_ALLOCATION_ERROR;
+    }
+
+    memcpy(s->slots, set->slots, numSlots * sizeof(int));
+    if (set->dt == DT_STRING)
+    {
+        memcpy(s->hashes, set->hashes, n * sizeof(uint32_t));
+        for (; s->numEntries < n; s->numEntries++)
+        {
+            s->strings[s->numEntries] = strdup(set->strings[s->numEntries]);
+            if (s->strings[s->numEntries] == NULL)
+            {
+                freeValueSet(s);
+                return RC_MEMORY_ALLOCATION_ERROR;
+            }
+        }
+    }
+    else
+    {
+        memcpy(s->keys, set->keys, n * sizeof(uint64_t));
+        s->numEntries = n;
+    }
+
+    *copy = s;
+    return RC_OK;
+}
+
+RC
+freeValueSet(ValueSet *set)
+{
+    if (set == NULL)
+        return RC_OK;
+    if (set->strings != NULL)
+        for (int i = 0; i < set->numEntries; i++)
+            free(set->strings[i]);
+    free(set->strings);
+    free(set->hashes);
+    free(set->keys);
+    free(set->slots);
+    free(set);
+    return RC_OK;
+}
+
+DataType
+valueSetType(ValueSet *set)
+{
+    return set->dt;
+}
+
+int
+valueSetSize(ValueSet *set)
+{
+    return set->numEntries;
+}
+
+bool
+valueSetContainsInt(ValueSet *set, int v)
+{
+    return set->slots[findKey(set, (uint32_t) v)] != 0;
+}
+
+bool
+valueSetContainsFloat(ValueSet *set, float v)
+{
+    uint64_t key;
+    return floatKey(v, &key) && set->slots[findKey(set, key)] != 0;
+}
+
+bool
+valueSetContainsBool(ValueSet *set, bool v)
+{
+    return set->slots[findKey(set, v ? 1 : 0)] != 0;
+}
+
+bool
+valueSetContainsString(ValueSet *set, const char *s, int maxLen)
+{
+    int len;
+    uint32_t h = hashString(s, maxLen, &len);
+    return set->slots[findString(set, s, len, h)] != 0;
+}
+
+/*
+ * valueSetContains
+ * ----------------
+ * Told whether a value was in the set; failed like valueEquals when the
+ * value had another type.
+ */
+RC
+valueSetContains(ValueSet *set, Value *val, bool *result)
+{
+    if (val->dt != set->dt)
+        THROW(RC_RM_COMPARE_VALUE_OF_DIFFERENT_DATATYPE, "IN only supported for values of the set's datatype");
+
+    switch (val->dt)
+    {
+        case DT_INT:    *result = valueSetContainsInt(set, val->v.intV);     break;
+        case DT_FLOAT:  *result = valueSetContainsFloat(set, val->v.floatV); break;
+        case DT_BOOL:   *result = valueSetContainsBool(set, val->v.boolV);   break;
+        case DT_STRING:
+            *result = valueSetContainsString(set, val->v.stringV, (int) strlen(val->v.stringV));
+            break;
+    }
+    return RC_OK;
+}
@@ -0,0 +1,27 @@
+#ifndef VALUE_SET_H
+#define VALUE_SET_H
+
+#include "dberror.h"
+#include "tables.h"
+
+// an immutable set of values of one data type, built once for an IN list
+// and probed with one hash lookup per value
+typedef struct ValueSet ValueSet;
+
+extern RC createValueSet (DataType dt, Value **values, int numValues, ValueSet **set);
+extern RC copyValueSet (ValueSet *set, ValueSet **copy);
+extern RC freeValueSet (ValueSet *set);
+extern DataType valueSetType (ValueSet *set);
+extern int valueSetSize (ValueSet *set);
+
+// membership test with the same equality as valueEquals
+extern RC valueSetContains (ValueSet *set, Value *val, bool *result);
+
+// membership tests on raw attribute bytes, used by compiled predicates;
+// a string ends at its first NUL or after maxLen bytes
+extern bool valueSetContainsInt (ValueSet *set, int v);
+extern bool valueSetContainsFloat (ValueSet *set, float v);
+extern bool valueSetContainsBool (ValueSet *set, bool v);
+extern bool valueSetContainsString (ValueSet *set, const char *s, int maxLen);
+
+#endif // VALUE_SET_H
@@ -0,0 +1,621 @@
+#include <math.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "buffer_mgr.h"
+#include "dberror.h"
+#include "record_mgr.h"
+#include "tables.h"
+
+/*
+ * ycsb
+ * ---------------------------------------------------------------
+ * A YCSB-style driver for the record manager. It loaded a table of
+ * numRecords records (an INT key and FIELDS string fields) and ran the core
+ * workloads on it, each for a fixed time with a number of threads:
+ *
+ *   A  50% read, 50% update              zipfian
+ *   B  95% read, 5% update               zipfian
+ *   C  100% read                         zipfian
+ *   D  95% read, 5% insert               latest
+ *   E  95% scan, 5% insert               zipfian, 1 to MAX_SCAN_LENGTH records
+ *   F  50% read, 50% read-modify-write   zipfian
+ *
+ * The record manager had no index, so the driver kept the RID of every key
+ * in memory, as a client of a key-value store would hold its handles; a
+ * read was a getRecord of the key's RID, and a scan read consecutive keys.
+ * Zipfian keys were scrambled by a hash so the popular keys were spread
+ * over the table; "latest" favored the most recently inserted keys.
+ *
+ * Each thread timed every operation into a log-linear histogram (64
+ * buckets per power of two, so percentiles were within about 1.6%), and the
+ * histograms were merged at the end of a workload. The results went to
+ * stdout as one JSON document: ops/sec and p50/p99/p999 latencies in
+ * nanoseconds per workload and per operation. The messages the storage
+ * manager printed were dropped.
+ *
+ *   usage: ycsb [-w workloads] [-n records] [-t threads] [-d seconds]
+ *               [-o maxOpsPerThread] [-r uniform|zipfian|latest]
+ *               [-f fieldLength] [-p poolPages]
+ *
+ * -w took a string of workload letters, run in order on the same table
+ * (default "ABCFDE", the order YCSB recommends since D and E insert);
+ * -r replaced the key distribution of every workload.
+ */
+
+#define FIELDS 10
+#define MAX_SCAN_LENGTH 100
+#define ZIPFIAN_THETA 0.99
+#define TABLE_NAME "ycsb_table"
+
+// RIDs of the keys, in chunks so inserts never moved the ones read
+#define CHUNK_KEYS 65536
+#define MAX_CHUNKS 16384
+
+// latency histogram: values below 64 ns exactly, then 64 buckets per power of two
+#define SUB_BUCKETS 64
+#define NUM_BUCKETS (SUB_BUCKETS + 58 * SUB_BUCKETS)
+
+typedef enum Distribution {
+    DIST_UNIFORM = 0,
+    DIST_ZIPFIAN = 1,
+    DIST_LATEST = 2,
+    DIST_DEFAULT = 3     // the workload's own
+} Distribution;
+
+typedef enum YcsbOp {
+    OP_READ = 0,
+    OP_UPDATE = 1,
+    OP_INSERT = 2,
+    OP_SCAN = 3,
+    OP_RMW = 4,
+    NUM_OPS = 5
+} YcsbOp;
+
+static const char *opNames[] = { "READ", "UPDATE", "INSERT", "SCAN", "READ_MODIFY_WRITE" };
+static const char *distNames[] = { "uniform", "zipfian", "latest" };
+
+typedef struct Workload {
+    char name;
+    double mix[NUM_OPS];   // share of each operation
+    Distribution dist;
+} Workload;
+
+static const Workload workloads[] = {
+    { 'A', { 0.50, 0.50, 0,    0,    0    }, DIST_ZIPFIAN },
+    { 'B', { 0.95, 0.05, 0,    0,    0    }, DIST_ZIPFIAN },
+    { 'C', { 1.00, 0,    0,    0,    0    }, DIST_ZIPFIAN },
+    { 'D', { 0.95, 0,    0.05, 0,    0    }, DIST_LATEST },
+    { 'E', { 0,    0,    0.05, 0.95, 0    }, DIST_ZIPFIAN },
+    { 'F', { 0.50, 0,    0,    0,    0.50 }, DIST_ZIPFIAN },
+};
+
+typedef struct Histogram {
+    uint64_t counts[NUM_BUCKETS];
+    uint64_t total;
+    uint64_t max;
+} Histogram;
+
+// zipfian over [0, items), after Gray et al. as in YCSB's generator
+typedef struct Zipfian {
+    int items;
+    double theta, alpha, zetan, eta, half;
+} Zipfian;
+
+static struct {
+    int records;
+    int threads;
+    int seconds;
+    long maxOps;
+    int fieldLength;
+    int poolPages;
+    Distribution dist;
+} config = { 100000, 4, 10, 0, 100, 256, DIST_DEFAULT };
+
+static RM_TableData table;
+static Schema *schema;
+static int recordSize;
+static Zipfian zipf;
+
+static RID *chunks[MAX_CHUNKS];
+static int numKeys;                 // keys whose RID was published
+static pthread_mutex_t insertLock = PTHREAD_MUTEX_INITIALIZER;
+static FILE *json;                  // stdout as it was at start
+
+/* --------------------------------------------------------------------------
+   Helpers
+   -------------------------------------------------------------------------- */
+
+static uint64_t
+nowNanos(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+static void
+check(RC rc, const char *what)
+{
+    if (rc != RC_OK)
+    {
+        fprintf(stderr, "ycsb: %s failed with RC %d\n", what, rc);
+        exit(1);
+    }
+}
+
+// xorshift64* step of a thread's generator, whose state was never 0
+static uint64_t
+nextRandom(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 0x2545f4914f6cdd1dULL;
+}
+
+static double
+nextUniform(uint64_t *state)
+{
+    return (nextRandom(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// FNV-1a of a key's bytes, used to scramble zipfian keys
+static uint64_t
+fnvHash(uint64_t v)
+{
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (int i = 0; i < 8; i++)
+    {
+        h ^= v & 0xff;
+        h *= 0x100000001b3ULL;
+        v >>= 8;
+    }
+    return h;
+}
+
+/* --------------------------------------------------------------------------
+   Key distributions
+   -------------------------------------------------------------------------- */
+
+static void
+initZipfian(Zipfian *z, int items, double theta)
+{
+    double zeta2 = 1.0 + 1.0 / pow(2.0, theta);
+    z->items = items;
+    z->theta = theta;
+    z->zetan = 0;
+    for (int i = 1; i <= items; i++)
+        z->zetan += 1.0 / pow((double) i, theta);
+    z->alpha = 1.0 / (1.0 - theta);
+    z->eta   = (1.0 - pow(2.0 / items, 1.0 - theta)) / (1.0 - zeta2 / z->zetan);
+    z->half  = 1.0 + pow(0.5, theta);
+}
+
+// rank drawn from the zipfian, 0 the most popular
+static int
+nextZipfian(Zipfian *z, uint64_t *state)
+{
+    double u  = nextUniform(state);
+    double uz = u * z->zetan;
+    if (uz < 1.0)
+        return 0;
+    if (uz < z->half)
+        return 1;
+    int rank = (int) (z->items * pow(z->eta * u - z->eta + 1.0, z->alpha));
+    return rank < z->items ? rank : z->items - 1;
+}
+
+/*
+ * nextKey
+ * -------
+ * Picked an existing key. The zipfian ranks were over the loaded keys and
+ * hashed onto all the keys there were; "latest" counted them back from the
+ * newest key.
+ */
+static int
+nextKey(Distribution dist, uint64_t *state)
+{
+    int n = __atomic_load_n(&numKeys, __ATOMIC_ACQUIRE);
+    switch (dist)
+    {
+        case DIST_ZIPFIAN:
+            return (int) (fnvHash((uint64_t) nextZipfian(&zipf, state)) % (uint64_t) n);
+        case DIST_LATEST:
+        {
+            int key = n - 1 - nextZipfian(&zipf, state);
+            return key < 0 ? 0 : key;
+        }
+        default:
+            return (int) (nextRandom(state) % (uint64_t) n);
+    }
+}
+
+static RID
+ridOf(int key)
+{
+    return chunks[key / CHUNK_KEYS][key % CHUNK_KEYS];
+}
+
+/* --------------------------------------------------------------------------
+   Histograms
+   -------------------------------------------------------------------------- */
+
+static void
+record(Histogram *h, uint64_t ns)
+{
+    int idx;
+    if (ns < SUB_BUCKETS)
+        idx = (int) ns;
+    else
+    {
+        int exp = 63 - __builtin_clzll(ns);          // >= 6
+        int sub = (int) (ns >> (exp - 6)) & (SUB_BUCKETS - 1);
+        idx = SUB_BUCKETS + (exp - 6) * SUB_BUCKETS + sub;
+    }
+    h->counts[idx]++;
+    h->total++;
+    if (ns > h->max)
+        h->max = ns;
+}
+
+// lowest value that fell into bucket idx
+static uint64_t
+bucketValue(int idx)
+{
+    if (idx < SUB_BUCKETS)
+        return (uint64_t) idx;
+    int exp = (idx - SUB_BUCKETS) / SUB_BUCKETS + 6;
+    int sub = (idx - SUB_BUCKETS) % SUB_BUCKETS;
+    return (uint64_t) (SUB_BUCKETS + sub) << (exp - 6);
+}
+
+static uint64_t
+percentile(Histogram *h, double p)
+{
+    uint64_t rank = (uint64_t) ceil(p * h->total), seen = 0;
+    if (h->total == 0)
+        return 0;
+    if (rank == 0)
+        rank = 1;
+    for (int i = 0; i < NUM_BUCKETS; i++)
+        if ((seen += h->counts[i]) >= rank)
+            return bucketValue(i);
+    return h->max;
+}
+
+static void
+mergeHistogram(Histogram *into, Histogram *h)
+{
+    for (int i = 0; i < NUM_BUCKETS; i++)
+        into->counts[i] += h->counts[i];
+    into->total += h->total;
+    if (h->max > into->max)
+        into->max = h->max;
+}
+
+static void
+printLatency(Histogram *h)
+{
+    fprintf(json, "{\"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu}",
+            (unsigned long long) percentile(h, 0.50), (unsigned long long) percentile(h, 0.99),
+            (unsigned long long) percentile(h, 0.999), (unsigned long long) h->max);
+}
+
+/* --------------------------------------------------------------------------
+   Operations
+   -------------------------------------------------------------------------- */
+
+static Schema *
+ycsbSchema(void)
+{
+    char **names = (char **) malloc(sizeof(char*) * (FIELDS + 1));
+    DataType *dt = (DataType *) malloc(sizeof(DataType) * (FIELDS + 1));
+    int *sizes = (int *) malloc(sizeof(int) * (FIELDS + 1));
+    int *keys = (int *) malloc(sizeof(int));
+
+    names[0] = strdup("key");
+    dt[0] = DT_INT;
+    sizes[0] = 0;
+    for (int i = 1; i <= FIELDS; i++)
+    {
+        char name[16];
+        sprintf(name, "field%d", i - 1);
+        names[i] = strdup(name);
+        dt[i] = DT_STRING;
+        sizes[i] = config.fieldLength;
+    }
+    keys[0] = 0;
+    return createSchema(FIELDS + 1, names, dt, sizes, 1, keys);
+}
+
+// filled one field (all of them when field < 0) with random letters
+static void
+fillFields(Record *r, int key, int field, uint64_t *state)
+{
+    memcpy(r->data, &key, sizeof(int));
+    for (int f = 0; f < FIELDS; f++)
+    {
+        if (field >= 0 && f != field)
+            continue;
+        char *p = r->data + sizeof(int) + f * config.fieldLength;
+        for (int i = 0; i < config.fieldLength; i++)
+            p[i] = (char) ('a' + nextRandom(state) % 26);
+    }
+}
+
+/*
+ * insertKey
+ * ---------
+ * Inserted the next key and published its RID once the record was in, so
+ * readers only picked keys that existed.
+ */
+static void
+insertKey(Record *r, uint64_t *state)
+{
+    pthread_mutex_lock(&insertLock);
+    int key = numKeys;
+    if (key >= MAX_CHUNKS * CHUNK_KEYS)
+    {
+        pthread_mutex_unlock(&insertLock);
+        fprintf(stderr, "ycsb: too many keys\n");
+        exit(1);
+    }
+    if (chunks[key / CHUNK_KEYS] == NULL
+        && (chunks[key / CHUNK_KEYS] = (RID *) malloc(sizeof(RID) * CHUNK_KEYS)) == NULL)
+    {
+        pthread_mutex_unlock(&insertLock);
+        fprintf(stderr, "ycsb: out of memory\n");
+        exit(1);
+    }
+    fillFields(r, key, -1, state);
+    check(insertRecord(&table, r), "insertRecord");
+    chunks[key / CHUNK_KEYS][key % CHUNK_KEYS] = r->id;
+    __atomic_store_n(&numKeys, key + 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&insertLock);
+}
+
+static void
+doOperation(YcsbOp op, Distribution dist, Record *r, uint64_t *state)
+{
+    int key;
+    switch (op)
+    {
+        case OP_READ:
+            check(getRecord(&table, ridOf(nextKey(dist, state)), r), "getRecord");
+            break;
+        case OP_UPDATE:
+            key = nextKey(dist, state);
+            fillFields(r, key, -1, state);
+            r->id = ridOf(key);
+            check(updateRecord(&table, r), "updateRecord");
+            break;
+        case OP_INSERT:
+            insertKey(r, state);
+            break;
+        case OP_SCAN:
+        {
+            int n = __atomic_load_n(&numKeys, __ATOMIC_ACQUIRE);
+            int len = 1 + (int) (nextRandom(state) % MAX_SCAN_LENGTH);
+            key = nextKey(dist, state);
+            for (int k = key; k < key + len && k < n; k++)
+                check(getRecord(&table, ridOf(k), r), "getRecord");
+            break;
+        }
+        case OP_RMW:
+            key = nextKey(dist, state);
+            check(getRecord(&table, ridOf(key), r), "getRecord");
+            fillFields(r, key, (int) (nextRandom(state) % FIELDS), state);
+            check(updateRecord(&table, r), "updateRecord");
+            break;
+        default:
+            break;
+    }
+}
+
+/* --------------------------------------------------------------------------
+   Running a workload
+   -------------------------------------------------------------------------- */
+
+typedef struct Worker {
+    const Workload *workload;
+    Distribution dist;
+    uint64_t deadline;
+    uint64_t seed;
+    long ops;
+    Histogram *hist;     // NUM_OPS of them
+} Worker;
+
+static void *
+runWorker(void *arg)
+{
+    Worker *w = (Worker *) arg;
+    uint64_t state = w->seed;
+    Record *r;
+
+    check(createRecord(&r, schema), "createRecord");
+    while (config.maxOps == 0 || w->ops < config.maxOps)
+    {
+        double u = nextUniform(&state), acc = 0;
+        YcsbOp op = OP_READ;
+        for (int i = 0; i < NUM_OPS; i++)
+            if (w->workload->mix[i] > 0 && u < (acc += w->workload->mix[i]))
+            {
+                op = (YcsbOp) i;
+                break;
+            }
+
+        uint64_t t = nowNanos();
+        doOperation(op, w->dist, r, &state);
+        uint64_t done = nowNanos();
+        record(&w->hist[op], done - t);
+        w->ops++;
+        if (done >= w->deadline)
+            break;
+    }
+    freeRecord(r);
+    return NULL;
+}
+
+static void
+runWorkload(const Workload *workload, bool first)
+{
+    Worker *workers = (Worker *) calloc(config.threads, sizeof(Worker));
+    pthread_t *threads = (pthread_t *) malloc(sizeof(pthread_t) * config.threads);
+    Histogram *merged = (Histogram *) calloc(NUM_OPS + 1, sizeof(Histogram));
+    Distribution dist = (config.dist == DIST_DEFAULT) ? workload->dist : config.dist;
+    long ops = 0;
+
+    uint64_t start = nowNanos();
+    for (int i = 0; i < config.threads; i++)
+    {
+        workers[i].workload = workload;
+        workers[i].dist     = dist;
+        workers[i].deadline = start + (uint64_t) config.seconds * 1000000000ULL;
+        workers[i].seed     = 0x9e3779b97f4a7c15ULL * (uint64_t) (i + 1) + (uint64_t) workload->name;
+        workers[i].hist     = (Histogram *) calloc(NUM_OPS, sizeof(Histogram));
+        if (workers[i].hist == NULL || pthread_create(&threads[i], NULL, runWorker, &workers[i]) != 0)
+        {
+            fprintf(stderr, "ycsb: cannot start a worker\n");
+            exit(1);
+        }
+    }
+    for (int i = 0; i < config.threads; i++)
+        pthread_join(threads[i], NULL);
+    double seconds = (nowNanos() - start) / 1e9;
+
+    // merged[NUM_OPS] held every operation
+    for (int i = 0; i < config.threads; i++)
+    {
+        for (int op = 0; op < NUM_OPS; op++)
+        {
+            mergeHistogram(&merged[op], &workers[i].hist[op]);
+            mergeHistogram(&merged[NUM_OPS], &workers[i].hist[op]);
+        }
+        ops += workers[i].ops;
+        free(workers[i].hist);
+    }
+
+    fprintf(json, "%s    {\"workload\": \"%c\", \"distribution\": \"%s\", \"ops\": %ld, "
+            "\"seconds\": %.3f, \"opsPerSec\": %.1f, \"latencyNs\": ",
+            first ? "" : ",\n", workload->name, distNames[dist], ops, seconds, ops / seconds);
+    printLatency(&merged[NUM_OPS]);
+    fprintf(json, ", \"operations\": {");
+    bool firstOp = true;
+    for (int op = 0; op < NUM_OPS; op++)
+    {
+        if (merged[op].total == 0)
+            continue;
+        fprintf(json, "%s\"%s\": {\"ops\": %llu, \"latencyNs\": ", firstOp ? "" : ", ", opNames[op],
+                (unsigned long long) merged[op].total);
+        printLatency(&merged[op]);
+        fprintf(json, "}");
+        firstOp = false;
+    }
+    fprintf(json, "}}");
+
+    free(merged);
+    free(workers);
+    free(threads);
+}
+
+/* --------------------------------------------------------------------------
+   Main
+   -------------------------------------------------------------------------- */
+
+static void
+usage(void)
+{
+    fprintf(stderr, "usage: ycsb [-w workloads] [-n records] [-t threads] [-d seconds]\n"
+                    "            [-o maxOpsPerThread] [-r uniform|zipfian|latest]\n"
+                    "            [-f fieldLength] [-p poolPages]\n");
+    exit(2);
+}
+
+int
+main(int argc, char **argv)
+{
+    char *names = "ABCFDE";
+    uint64_t state = 0x2545f4914f6cdd1dULL;
+    Record *r;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "w:n:t:d:o:r:f:p:")) != -1)
+    {
+        switch (opt)
+        {
+            case 'w': names = optarg; break;
+            case 'n': config.records = atoi(optarg); break;
+            case 't': config.threads = atoi(optarg); break;
+            case 'd': config.seconds = atoi(optarg); break;
+            case 'o': config.maxOps = atol(optarg); break;
+            case 'f': config.fieldLength = atoi(optarg); break;
+            case 'p': config.poolPages = atoi(optarg); break;
+            case 'r':
+                if (strcmp(optarg, "uniform") == 0)
+                    config.dist = DIST_UNIFORM;
+                else if (strcmp(optarg, "zipfian") == 0)
+                    config.dist = DIST_ZIPFIAN;
+                else if (strcmp(optarg, "latest") == 0)
+                    config.dist = DIST_LATEST;
+                else
+                    usage();
+                break;
+            default:
+                usage();
+        }
+    }
+    if (config.records < 2 || config.threads < 1 || config.seconds < 1 || config.fieldLength < 1
+        || config.poolPages < 1 || sizeof(int) + (size_t) FIELDS * config.fieldLength > PAGE_SIZE / 2)
+        usage();
+    for (char *w = names; *w != '\0'; w++)
+        if (*w < 'A' || *w > 'F')
+            usage();
+
+    json = fdopen(dup(STDOUT_FILENO), "w");
+    if (json == NULL || freopen("/dev/null", "w", stdout) == NULL)
+    {
+        fprintf(stderr, "ycsb: cannot redirect stdout\n");
+        return 1;
+    }
+
+    // Loaded the table with one thread
+    check(initRecordManager(NULL), "initRecordManager");
+    check(setTablePoolOptions(config.poolPages, RS_LRU), "setTablePoolOptions");
+    schema = ycsbSchema();
+    recordSize = getRecordSize(schema);
+    check(createTable(TABLE_NAME, schema), "createTable");
+    check(openTable(&table, TABLE_NAME), "openTable");
+    check(createRecord(&r, schema), "createRecord");
+    initZipfian(&zipf, config.records, ZIPFIAN_THETA);
+
+    uint64_t start = nowNanos();
+    for (int i = 0; i < config.records; i++)
+        insertKey(r, &state);
+    double loadSeconds = (nowNanos() - start) / 1e9;
+    freeRecord(r);
+
+    fprintf(json, "{\n  \"benchmark\": \"ycsb\",\n  \"records\": %d,\n  \"recordSize\": %d,\n"
+            "  \"threads\": %d,\n  \"secondsPerWorkload\": %d,\n"
+            "  \"load\": {\"ops\": %d, \"seconds\": %.3f, \"opsPerSec\": %.1f},\n  \"results\": [\n",
+            config.records, recordSize, config.threads, config.seconds,
+            config.records, loadSeconds, config.records / loadSeconds);
+    for (char *w = names; *w != '\0'; w++)
+        runWorkload(&workloads[*w - 'A'], w == names);
+    fprintf(json, "\n  ]\n}\n");
+    fclose(json);
+
+    check(closeTable(&table), "closeTable");
+    check(deleteTable(TABLE_NAME), "deleteTable");
+    freeSchema(schema);
+    setTablePoolOptions(RM_DEFAULT_POOL_PAGES, RM_DEFAULT_POOL_STRATEGY);
+    check(shutdownRecordManager(), "shutdownRecordManager");
+    for (int c = 0; c < MAX_CHUNKS && chunks[c] != NULL; c++)
+        free(chunks[c]);
+    return 0;
+}